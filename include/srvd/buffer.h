@@ -30,4 +30,9 @@
 #define SRVD_BUFFER_ITERATOR_PREV(iterator, length) \
   (iterator) -= (length)
 
+/* The number of bytes to skip to align the iterator to the given alignment,
+ * which must be a power of two. */
+#define SRVD_BUFFER_ALIGNMENT_PADDING(iterator, alignment) \
+  ((size_t)(-(uintptr_t)(iterator) & ((alignment) - 1)))
+
 #endif
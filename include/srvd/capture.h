@@ -0,0 +1,96 @@
+/* capture.h: Request capture logs.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_CAPTURE_H
+#define _SRVD_CAPTURE_H
+
+/* A server can write every request it receives to a capture log (see
+ * srvd_server_capture()) so that the same lookups can be played back later,
+ * with the same timing, against another server (see the srvd-replay command).
+ *
+ * A log starts with a header:
+ *
+ * 0       8       16      24      32
+ * +-------------------------------+
+ * | magic                         |
+ * +-------------------------------+
+ * | version                       |
+ * +-------------------------------+
+ * | started (seconds since the    |
+ * | epoch, in microseconds)       |
+ * +-------------------------------+
+ *
+ * Each request follows as a record: the number of microseconds between when
+ * the log was started and when the request was received, then the length of
+ * the request, then the request itself, serialized exactly as it would be
+ * sent. Everything is in network byte order.
+ *
+ * 0       8       16      24      32
+ * +-------------------------------+
+ * | time                          |
+ * |                               |
+ * +-------------------------------+
+ * | length                        |
+ * +-------------------------------+
+ * | request                       |
+ * |               .               |
+ * |               .               |
+ * +-------------------------------+
+ *
+ * Each record is written with a single write() to a file opened for
+ * appending, so any number of threads can record at once, and a log can be
+ * read while it's being written (though the last record might not be
+ * complete yet). */
+
+#include <srvd/srvd.h>
+#include <srvd/protocol/packet.h>
+
+#define SRVD_CAPTURE_MAGIC ((uint32_t)0x53525643)
+#define SRVD_CAPTURE_VERSION ((uint32_t)1)
+
+#define SRVD_CAPTURE_HEADER_SIZE 16
+#define SRVD_CAPTURE_RECORD_HEADER_SIZE 12
+
+typedef struct srvd_capture srvd_capture_t;
+typedef struct srvd_capture_reader srvd_capture_reader_t;
+
+struct srvd_capture {
+  int descriptor;
+  uint64_t started;
+};
+
+srvd_capture_t *srvd_capture_allocate(void);
+void srvd_capture_free(srvd_capture_t *);
+
+/* Starts a new log at the given path, replacing whatever was there. */
+srvd_boolean_t srvd_capture_initialize(srvd_capture_t *, const char *);
+srvd_boolean_t srvd_capture_finalize(srvd_capture_t *);
+
+srvd_boolean_t srvd_capture_record(srvd_capture_t *, const srvd_protocol_packet_t *);
+
+/* Reading. The whole log is mapped into memory, and records point into it. */
+
+struct srvd_capture_reader {
+  char *data;
+  size_t size, offset;
+  uint64_t started;
+};
+
+srvd_boolean_t srvd_capture_reader_initialize(srvd_capture_reader_t *, const char *);
+srvd_boolean_t srvd_capture_reader_finalize(srvd_capture_reader_t *);
+
+/* Gets the next record's time, request and length. Returns SRVD_FALSE at the
+ * end of the log (including when the last record is incomplete). */
+srvd_boolean_t srvd_capture_reader_next(srvd_capture_reader_t *, uint64_t *, char **,
+                                        uint32_t *);
+
+/* Unserializes a request from a record. */
+srvd_boolean_t srvd_capture_request_unpack(char *, uint32_t, srvd_protocol_packet_t *);
+
+#endif
@@ -13,17 +13,24 @@
 /* Our client communication protocol is very simple. Each send and received
  * packet header has a predefined length (see <srvd/protocol/packet.h>); we use
  * this to determine how much more data we have to read from a socket after the
- * fixed-length header is read for each packet. We technically could keep
- * connections open long after each request is made and use some basic locking
- * to make everything work together nicely, but considering how lightweight
+ * fixed-length header is read for each packet. Considering how lightweight
  * UNIX domain sockets are (which is what almost all users are going to be
- * using), we're not going to worry about this for now.
+ * using), UNIX domain socket clients don't bother keeping connections open
+ * between requests by default. TCP clients do (see the persistent flag below);
+ * srvd_service_request_query() keeps one such connection per thread.
  *
  * To make that a bit clearer, the execution flow for a client is basically:
  *  connect -> send request -> receive response -> disconnect
  *
- * We ship two implementations, one that uses UNIX domain sockets and one that
- * uses TCP. UNIX domain sockets are highly recommended. */
+ * Servers do keep connections open until the client hangs up, though, and
+ * answer the requests on each one in order. Asynchronous clients (see below)
+ * use this to keep many requests outstanding on one connection.
+ *
+ * We ship four implementations: one that uses UNIX domain sockets, one that
+ * uses TCP, one that sets up shared memory over a UNIX domain socket (see
+ * <srvd/client/shm.h>), and one that calls a server in the same process (see
+ * <srvd/client/inproc.h>). UNIX domain sockets are highly recommended; shared
+ * memory is faster still for processes that make lots of queries. */
 
 /* Strictly speaking, this packet format is only enforced by the serialization
  * procedures that are part of <srvd/protocol/serial_packet.h>. A client could
@@ -38,7 +45,13 @@
 
 #include <srvd/srvd.h>
 #include <srvd/conf.h>
+#include <srvd/thread.h>
+#include <srvd/protocol/hello.h>
 #include <srvd/protocol/packet.h>
+#include <srvd/protocol/serial_packet.h>
+
+#include <sys/socket.h>
+#include <time.h>
 
 typedef struct srvd_client srvd_client_t;
 
@@ -48,6 +61,8 @@ typedef srvd_boolean_t (*srvd_client_connect_pt)(srvd_client_t *);
 typedef srvd_boolean_t (*srvd_client_disconnect_pt)(srvd_client_t *);
 typedef srvd_boolean_t (*srvd_client_write_pt)(srvd_client_t *, const srvd_protocol_packet_t *);
 typedef srvd_boolean_t (*srvd_client_read_pt)(srvd_client_t *, srvd_protocol_packet_t *);
+typedef srvd_boolean_t (*srvd_client_read_serial_pt)(srvd_client_t *, srvd_protocol_serial_packet_t *);
+typedef int (*srvd_client_descriptor_pt)(const srvd_client_t *);
 
 #define SRVD_CLIENT_HEADER                 \
   srvd_client_free_pt free;                \
@@ -56,14 +71,112 @@ typedef srvd_boolean_t (*srvd_client_read_pt)(srvd_client_t *, srvd_protocol_pac
   srvd_client_disconnect_pt disconnect;    \
   srvd_client_write_pt write;              \
   srvd_client_read_pt read;                \
-  srvd_boolean_t connected
+  srvd_client_read_serial_pt read_serial;  \
+  srvd_client_descriptor_pt descriptor;    \
+  long timeout;                            \
+  struct timespec deadline;                \
+  srvd_boolean_t persistent;               \
+  srvd_boolean_t connected;                \
+  srvd_boolean_t negotiate;                \
+  srvd_protocol_hello_t hello
 
 struct srvd_client {
   SRVD_CLIENT_HEADER;
 };
 
+/* Creates (but doesn't connect) a client for the adapter named by
+ * client:adapter, configured from the rest of the configuration. */
 srvd_boolean_t srvd_client_get_by_conf(srvd_client_t **, const srvd_conf_t *);
 
+/* Adapters.
+ *
+ * Each adapter is described by a name, a function to allocate a client, a
+ * function to initialize it from the configuration, and a set of capability
+ * flags. The unsock, shm and tcp adapters are built in; others can be
+ * registered by the application, or loaded from a shared object named by
+ * client:module. Such a module must export an srvd_client_adapter_t named
+ * srvd_client_adapter_module, which is registered the first time the module
+ * is needed.
+ *
+ * Looking up the adapter for a configuration is only done once per
+ * configuration generation (see <srvd/conf.h>). */
+
+typedef struct srvd_client_adapter srvd_client_adapter_t;
+
+typedef srvd_client_t *(*srvd_client_adapter_allocate_pt)(void);
+typedef srvd_boolean_t (*srvd_client_adapter_initialize_pt)(srvd_client_t *, const srvd_conf_t *);
+
+/* Clients can keep several requests outstanding on one connection (required
+ * by asynchronous clients). */
+#define SRVD_CLIENT_ADAPTER_PIPELINING ((uint32_t)(1 << 0))
+
+/* Clients are persistent unless told otherwise. */
+#define SRVD_CLIENT_ADAPTER_PERSISTENT ((uint32_t)(1 << 1))
+
+/* Clients move packets through shared memory instead of a socket. */
+#define SRVD_CLIENT_ADAPTER_SHM ((uint32_t)(1 << 2))
+
+/* Clients can talk to servers on other machines. */
+#define SRVD_CLIENT_ADAPTER_REMOTE ((uint32_t)(1 << 3))
+
+/* Clients set read_serial, to hand back responses the way they arrived (see
+ * srvd_client_read_serial()). */
+#define SRVD_CLIENT_ADAPTER_SERIAL ((uint32_t)(1 << 4))
+
+struct srvd_client_adapter {
+  const char *name;
+  srvd_client_adapter_allocate_pt allocate;
+  srvd_client_adapter_initialize_pt initialize;
+  uint32_t capabilities;
+
+  /* Used by the registry. */
+  srvd_client_adapter_t *next;
+};
+
+/* Registered adapters take precedence over built-in ones with the same name.
+ * The adapter must stay around for as long as the process does. */
+srvd_boolean_t srvd_client_adapter_register(srvd_client_adapter_t *);
+srvd_boolean_t srvd_client_adapter_get(const char *, const srvd_client_adapter_t **);
+srvd_boolean_t srvd_client_adapter_get_by_conf(const srvd_conf_t *,
+                                               const srvd_client_adapter_t **);
+
+/* Deadlines.
+ *
+ * A client with a timeout (client:timeout, in milliseconds) gives up on a
+ * query once that much time has passed since srvd_client_deadline_start() was
+ * called; the deadline covers connecting, writing and reading together, not
+ * each of them separately. Clients without a timeout wait forever. */
+void srvd_client_deadline_start(srvd_client_t *);
+
+/* Returns the number of milliseconds left before the deadline, 0 if it has
+ * passed, or -1 if there is no deadline. */
+int srvd_client_deadline_remaining(const srvd_client_t *);
+
+/* Helpers for adapters. These behave like connect(), read() and write() on
+ * blocking sockets, except that they transfer everything they're asked to
+ * (short reads only happen at end-of-file) and fail with errno set to
+ * ETIMEDOUT if the client's deadline passes first. */
+srvd_boolean_t srvd_client_socket_connect(const srvd_client_t *, int, const struct sockaddr *,
+                                          socklen_t);
+ssize_t srvd_client_socket_read(const srvd_client_t *, int, char *, size_t);
+ssize_t srvd_client_socket_write(const srvd_client_t *, int, const char *, size_t);
+
+/* Like srvd_client_socket_read(), but for sockets that preserve message
+ * boundaries: reads exactly one message, failing with EMSGSIZE if it doesn't
+ * fit in the buffer. */
+ssize_t srvd_client_socket_receive(const srvd_client_t *, int, char *, size_t);
+
+/* Serializes a packet onto a socket, or reads one back. */
+srvd_boolean_t srvd_client_socket_write_packet(const srvd_client_t *, int,
+                                               const srvd_protocol_packet_t *);
+srvd_boolean_t srvd_client_socket_read_packet(const srvd_client_t *, int,
+                                              srvd_protocol_packet_t *);
+
+/* Reads one packet off a socket into a serial packet, without unserializing
+ * the body (see srvd_client_read_serial()). */
+srvd_boolean_t srvd_client_socket_read_serial(const srvd_client_t *, int,
+                                              srvd_protocol_serial_packet_t *);
+
 static inline void srvd_client_free(srvd_client_t *client) {
   client->free(client);
 }
@@ -72,8 +185,25 @@ static inline srvd_boolean_t srvd_client_finalize(srvd_client_t *client) {
   return client->finalize(client);
 }
 
+/* Negotiation.
+ *
+ * A client with the negotiate flag set starts every connection with a
+ * handshake (see <srvd/protocol/hello.h>) and keeps what the server said it
+ * supports in hello; otherwise, hello stays at the baseline. The handshake
+ * costs a round trip, so by default (client:negotiate) only persistent clients
+ * make one. Returns SRVD_FALSE, and disconnects, only if the connection
+ * breaks. */
+srvd_boolean_t srvd_client_negotiate(srvd_client_t *);
+
+/* The packet version, with any flags, that adapters should write requests in
+ * given what the handshake said. */
+uint16_t srvd_client_version(const srvd_client_t *);
+
 static inline srvd_boolean_t srvd_client_connect(srvd_client_t *client) {
-  return client->connect(client);
+  if(!client->connect(client))
+    return SRVD_FALSE;
+
+  return client->negotiate ? srvd_client_negotiate(client) : SRVD_TRUE;
 }
 
 static inline srvd_boolean_t srvd_client_disconnect(srvd_client_t *client) {
@@ -90,4 +220,120 @@ static inline srvd_boolean_t srvd_client_read(srvd_client_t *client,
   return client->read(client, packet);
 }
 
+/* Reads a response but leaves it serialized, for callers that walk it once
+ * with a reader (see <srvd/protocol/serial_packet.h>) and have no use for a
+ * packet. The serial packet must be initialized and empty; afterwards, its
+ * data holds the header and body, and it has to be finalized even if this
+ * fails. The body may still be compressed. Adapters without
+ * SRVD_CLIENT_ADAPTER_SERIAL read a packet and serialize it again. */
+srvd_boolean_t srvd_client_read_serial(srvd_client_t *, srvd_protocol_serial_packet_t *);
+
+/* Returns a file descriptor that becomes readable when a response is waiting
+ * to be read, or -1 if the client isn't connected or has no such thing. */
+static inline int srvd_client_descriptor(const srvd_client_t *client) {
+  return client->descriptor(client);
+}
+
+/* Circuit breakers.
+ *
+ * When the server is down or wedged, every query fails, and with a timeout,
+ * every query fails slowly. A breaker counts consecutive failed queries; once
+ * there have been too many (client:breaker:threshold), it opens, and for the
+ * next client:breaker:cooldown milliseconds queries fail immediately with
+ * SRVD_SERVICE_RESPONSE_UNAVAIL instead of contacting the server. After that,
+ * it lets exactly one query through as a probe. If the probe succeeds, the
+ * breaker closes again; if not, it stays open for another cooldown period.
+ *
+ * srvd_service_request_query() uses a single breaker for the whole process,
+ * configured from the default configuration file. A threshold of 0 disables
+ * it. */
+
+typedef struct srvd_client_breaker srvd_client_breaker_t;
+
+struct srvd_client_breaker {
+  uint32_t threshold, failures;
+  long cooldown;
+  struct timespec reopen;
+  srvd_boolean_t open, probing;
+  SRVD_THREAD_MUTEX_DECLARE_UNINITIALIZED(lock);
+};
+
+#define SRVD_CLIENT_BREAKER_THRESHOLD_DEFAULT 5
+#define SRVD_CLIENT_BREAKER_COOLDOWN_DEFAULT 1000
+
+srvd_client_breaker_t *srvd_client_breaker_allocate(void);
+void srvd_client_breaker_free(srvd_client_breaker_t *);
+srvd_boolean_t srvd_client_breaker_initialize(srvd_client_breaker_t *, uint32_t, long);
+srvd_boolean_t srvd_client_breaker_finalize(srvd_client_breaker_t *);
+srvd_boolean_t srvd_client_breaker_configure(srvd_client_breaker_t *, const srvd_conf_t *);
+
+/* Returns SRVD_FALSE if a query shouldn't be attempted right now. Every query
+ * that is allowed must be followed by a call to srvd_client_breaker_report()
+ * with its outcome. */
+srvd_boolean_t srvd_client_breaker_allow(srvd_client_breaker_t *);
+void srvd_client_breaker_report(srvd_client_breaker_t *, srvd_boolean_t);
+
+srvd_boolean_t srvd_client_breaker_default_get(srvd_client_breaker_t **, const srvd_conf_t *);
+
+/* Asynchronous requests.
+ *
+ * An asynchronous client keeps a single connection open and lets any number of
+ * requests be outstanding on it at once. Servers answer the requests on a
+ * connection in the order they were sent, so responses are matched to
+ * requests by keeping the requests in a queue; the protocol itself doesn't
+ * change.
+ *
+ * Nothing happens in the background. When the descriptor returned by
+ * srvd_client_async_descriptor() becomes readable (in poll(), or whatever
+ * event loop the application uses), call srvd_client_async_process() to read
+ * the next response and complete the oldest request, which runs its callback.
+ * srvd_client_async_wait() processes responses until a particular request is
+ * complete, for callers that want to block after all.
+ *
+ * Requests belong to the caller and must be freed with
+ * srvd_client_async_request_free() once they're complete. A callback may free
+ * its own request, unless another thread is waiting on it; a request being
+ * waited on in the same thread can be freed, since srvd_client_async_wait()
+ * doesn't look at it again once it has completed. Callbacks must not call
+ * srvd_client_async_process() or srvd_client_async_wait().
+ *
+ * Submitting blocks while the request is written, so an application that
+ * keeps thousands of requests outstanding without processing any responses
+ * will eventually stall; keep reading. */
+
+typedef struct srvd_client_async srvd_client_async_t;
+typedef struct srvd_client_async_request srvd_client_async_request_t;
+
+typedef void (*srvd_client_async_callback_pt)(srvd_client_async_request_t *, void *);
+
+struct srvd_client_async_request {
+  srvd_protocol_packet_t response;
+  srvd_boolean_t complete, succeeded;
+  srvd_client_async_callback_pt callback;
+  void *argument;
+  srvd_client_async_request_t *next;
+};
+
+struct srvd_client_async {
+  srvd_client_t *client;
+  srvd_boolean_t broken;
+  size_t pending_count;
+  srvd_client_async_request_t *pending_head, *pending_tail;
+  SRVD_THREAD_MUTEX_DECLARE_UNINITIALIZED(write_lock);
+  SRVD_THREAD_MUTEX_DECLARE_UNINITIALIZED(read_lock);
+};
+
+srvd_client_async_t *srvd_client_async_allocate(void);
+void srvd_client_async_free(srvd_client_async_t *);
+srvd_boolean_t srvd_client_async_initialize(srvd_client_async_t *, const srvd_conf_t *);
+srvd_boolean_t srvd_client_async_finalize(srvd_client_async_t *);
+int srvd_client_async_descriptor(const srvd_client_async_t *);
+srvd_boolean_t srvd_client_async_submit(srvd_client_async_t *, const srvd_protocol_packet_t *,
+                                        srvd_client_async_callback_pt, void *,
+                                        srvd_client_async_request_t **);
+srvd_boolean_t srvd_client_async_process(srvd_client_async_t *);
+srvd_boolean_t srvd_client_async_wait(srvd_client_async_t *, srvd_client_async_request_t *);
+
+void srvd_client_async_request_free(srvd_client_async_request_t *);
+
 #endif
@@ -0,0 +1,62 @@
+/* inproc.h: In-process client.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_CLIENT_INPROC_H
+#define _SRVD_CLIENT_INPROC_H
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+#include <srvd/server.h>
+
+typedef struct srvd_client_inproc srvd_client_inproc_t;
+
+/* In-process clients hand requests straight to a server in the same process
+ * (see srvd_server_dispatch()): nothing is serialized (unless the response is
+ * read with srvd_client_read_serial()), and no system calls are made. Writing a request runs its handler right away, in the calling thread,
+ * and reading takes the response; only one request can be outstanding at a
+ * time. The server doesn't need to be executing, but it has to outlive its
+ * clients, and its handlers have to be safe to call from any thread.
+ *
+ * Clients configured with client:adapter = inproc find their server by the
+ * name in client:server, which the application gives it with
+ * srvd_client_inproc_server_register(). The name is looked up when the client
+ * connects. */
+struct srvd_client_inproc {
+  SRVD_CLIENT_HEADER;
+  char *name;
+  srvd_server_t *server;
+  srvd_service_request_t request;
+  srvd_service_response_t response;
+  srvd_boolean_t pending;
+};
+
+/* Makes a server available to clients under the given name (replacing any
+ * server already registered with it), or withdraws it if the server is
+ * NULL. */
+srvd_boolean_t srvd_client_inproc_server_register(const char *, srvd_server_t *);
+
+srvd_client_t *srvd_client_inproc_allocate(void);
+void srvd_client_inproc_free(srvd_client_t *);
+
+/* Takes the server to use directly. */
+srvd_boolean_t srvd_client_inproc_initialize(srvd_client_t *, srvd_server_t *);
+
+/* Reads client:server. */
+srvd_boolean_t srvd_client_inproc_initialize_by_conf(srvd_client_t *, const srvd_conf_t *);
+srvd_boolean_t srvd_client_inproc_finalize(srvd_client_t *);
+srvd_boolean_t srvd_client_inproc_connect(srvd_client_t *);
+srvd_boolean_t srvd_client_inproc_disconnect(srvd_client_t *);
+srvd_boolean_t srvd_client_inproc_write(srvd_client_t *, const srvd_protocol_packet_t *);
+srvd_boolean_t srvd_client_inproc_read(srvd_client_t *, srvd_protocol_packet_t *);
+
+/* Serializes the response once, straight from the handler's packet. */
+srvd_boolean_t srvd_client_inproc_read_serial(srvd_client_t *, srvd_protocol_serial_packet_t *);
+int srvd_client_inproc_descriptor(const srvd_client_t *);
+
+#endif
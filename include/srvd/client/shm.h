@@ -0,0 +1,66 @@
+/* shm.h: Shared memory client.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_CLIENT_SHM_H
+#define _SRVD_CLIENT_SHM_H
+
+/* The shared memory client connects to the same UNIX domain socket as the
+ * unsock client, but then creates a region of memory (see <srvd/shm.h>) and
+ * passes it to the server. After that, requests and responses are serialized
+ * straight into the region's rings, and the socket is only used for packets
+ * too big to fit and to notice when one side goes away.
+ *
+ * Setting up the region is relatively expensive, so shared memory clients are
+ * persistent by default. If the server (or the platform) doesn't support
+ * shared memory, the client quietly behaves like an unsock client instead. */
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+#include <srvd/shm.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+typedef struct srvd_client_shm srvd_client_shm_t;
+
+/* A forked child inherits the region along with the rest of the client, but
+ * it's still the parent's session; only the process that set it up (pid)
+ * closes it when disconnecting. Others just let go of their copy. */
+struct srvd_client_shm {
+  SRVD_CLIENT_HEADER;
+  struct sockaddr_un endpoint;
+  int socket;
+  uint32_t ring_size;
+  srvd_shm_t shm;
+  pid_t pid;
+};
+
+srvd_client_t *srvd_client_shm_allocate(void);
+void srvd_client_shm_free(srvd_client_t *);
+
+/* Takes the socket path and the size of each ring in bytes (a power of two
+ * between SRVD_SHM_RING_SIZE_MINIMUM and SRVD_SHM_RING_SIZE_MAXIMUM). */
+srvd_boolean_t srvd_client_shm_initialize(srvd_client_t *, const char *, uint32_t);
+
+/* Reads client:path and client:shm:size. */
+srvd_boolean_t srvd_client_shm_initialize_by_conf(srvd_client_t *, const srvd_conf_t *);
+srvd_boolean_t srvd_client_shm_finalize(srvd_client_t *);
+srvd_boolean_t srvd_client_shm_connect(srvd_client_t *);
+srvd_boolean_t srvd_client_shm_disconnect(srvd_client_t *);
+srvd_boolean_t srvd_client_shm_write(srvd_client_t *, const srvd_protocol_packet_t *);
+srvd_boolean_t srvd_client_shm_read(srvd_client_t *, srvd_protocol_packet_t *);
+
+/* Copies the response record straight out of the ring. */
+srvd_boolean_t srvd_client_shm_read_serial(srvd_client_t *, srvd_protocol_serial_packet_t *);
+
+/* Responses that arrive through the region don't make the socket readable, so
+ * this is -1 unless the client fell back to using the socket. */
+int srvd_client_shm_descriptor(const srvd_client_t *);
+
+#endif
@@ -0,0 +1,48 @@
+/* tcp.h: TCP client.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_CLIENT_TCP_H
+#define _SRVD_CLIENT_TCP_H
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+
+#include <sys/socket.h>
+
+typedef struct srvd_client_tcp srvd_client_tcp_t;
+
+/* The endpoint is resolved once, when the client is initialized. Unlike UNIX
+ * domain socket clients, TCP clients are persistent by default, since setting
+ * up a TCP connection costs a round trip of its own. */
+struct srvd_client_tcp {
+  SRVD_CLIENT_HEADER;
+  struct sockaddr_storage endpoint;
+  socklen_t endpoint_length;
+  int socket;
+};
+
+srvd_client_t *srvd_client_tcp_allocate(void);
+void srvd_client_tcp_free(srvd_client_t *);
+
+/* Takes the address family (AF_INET, AF_INET6 or AF_UNSPEC for either), host
+ * name and port (or service name). */
+srvd_boolean_t srvd_client_tcp_initialize(srvd_client_t *, int, const char *, const char *);
+
+/* Reads client:family (`inet' or `inet6'; optional), client:host and
+ * client:port. */
+srvd_boolean_t srvd_client_tcp_initialize_by_conf(srvd_client_t *, const srvd_conf_t *);
+srvd_boolean_t srvd_client_tcp_finalize(srvd_client_t *);
+srvd_boolean_t srvd_client_tcp_connect(srvd_client_t *);
+srvd_boolean_t srvd_client_tcp_disconnect(srvd_client_t *);
+srvd_boolean_t srvd_client_tcp_write(srvd_client_t *, const srvd_protocol_packet_t *);
+srvd_boolean_t srvd_client_tcp_read(srvd_client_t *, srvd_protocol_packet_t *);
+srvd_boolean_t srvd_client_tcp_read_serial(srvd_client_t *, srvd_protocol_serial_packet_t *);
+int srvd_client_tcp_descriptor(const srvd_client_t *);
+
+#endif
@@ -18,19 +18,34 @@
 
 typedef struct srvd_client_unsock srvd_client_unsock_t;
 
+/* UNIX domain socket clients normally use SOCK_STREAM sockets. They can use
+ * SOCK_SEQPACKET sockets instead (client:socket = seqpacket), which keep each
+ * packet in a message of its own, so sending or receiving one takes exactly
+ * one system call. If the system doesn't have them, or the server isn't
+ * listening on one, the client falls back to SOCK_STREAM. */
 struct srvd_client_unsock {
   SRVD_CLIENT_HEADER;
   struct sockaddr_un endpoint;
-  int socket;
+  int socket, type;
+
+  /* Only used with SOCK_SEQPACKET sockets, and allocated the first time it's
+   * needed. */
+  char *buffer;
 };
 
 srvd_client_t *srvd_client_unsock_allocate(void);
 void srvd_client_unsock_free(srvd_client_t *);
-srvd_boolean_t srvd_client_unsock_initialize(srvd_client_t *, const char *);
+/* Takes the socket path and type (SOCK_STREAM or SOCK_SEQPACKET). */
+srvd_boolean_t srvd_client_unsock_initialize(srvd_client_t *, const char *, int);
+
+/* Reads client:path and client:socket (`stream' or `seqpacket'). */
+srvd_boolean_t srvd_client_unsock_initialize_by_conf(srvd_client_t *, const srvd_conf_t *);
 srvd_boolean_t srvd_client_unsock_finalize(srvd_client_t *);
 srvd_boolean_t srvd_client_unsock_connect(srvd_client_t *);
 srvd_boolean_t srvd_client_unsock_disconnect(srvd_client_t *);
 srvd_boolean_t srvd_client_unsock_write(srvd_client_t *, const srvd_protocol_packet_t *);
 srvd_boolean_t srvd_client_unsock_read(srvd_client_t *, srvd_protocol_packet_t *);
+srvd_boolean_t srvd_client_unsock_read_serial(srvd_client_t *, srvd_protocol_serial_packet_t *);
+int srvd_client_unsock_descriptor(const srvd_client_t *);
 
 #endif
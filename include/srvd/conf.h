@@ -29,8 +29,12 @@ struct srvd_conf_node {
   srvd_conf_node_t *next;
 };
 
+/* The generation changes whenever the configuration does, and no two
+ * configurations ever share one, so anything derived from a configuration can
+ * be cached until its generation changes. */
 struct srvd_conf {
   srvd_conf_node_t *nodes;
+  unsigned long generation;
 };
 
 srvd_conf_t *srvd_conf_allocate(void);
@@ -42,6 +46,10 @@ srvd_boolean_t srvd_conf_item_add(srvd_conf_t *, const char *, size_t, const cha
 srvd_boolean_t srvd_conf_item_has(const srvd_conf_t *, const char *);
 srvd_boolean_t srvd_conf_item_get(const srvd_conf_t *, const char *, char **, size_t *);
 
+/* Gets an item as a base-10 integer. Fails if the item doesn't exist or isn't
+ * entirely a number. */
+srvd_boolean_t srvd_conf_item_get_integer(const srvd_conf_t *, const char *, long *);
+
 /* File-based configuration. */
 
 struct srvd_conf_file {
@@ -65,4 +73,9 @@ srvd_boolean_t srvd_conf_file_parse(srvd_conf_file_t *);
 
 srvd_boolean_t srvd_conf_file_default_get(srvd_conf_file_t **);
 
+/* Reads the default configuration from somewhere else from now on (for
+ * programs like srvd-bench that run their own server). This must be done
+ * before anything asks for the default file. */
+srvd_boolean_t srvd_conf_file_default_set(const char *);
+
 #endif
@@ -0,0 +1,119 @@
+/* filter.h: Negative lookup filter.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_FILTER_H
+#define _SRVD_FILTER_H
+
+/* A lot of lookups are for keys that don't exist anywhere (typos, scanners,
+ * programs probing for users), and with a line like `passwd: files srvd' in
+ * nsswitch.conf, every one of those ends up at the daemon. To avoid that, the
+ * daemon can publish a Bloom filter of every key it knows about to a file,
+ * which clients map into memory and consult before making a request. If the
+ * filter says a key is definitely absent, the client returns "not found"
+ * without any communication with the server.
+ *
+ * Keys are namespaced by the protocol type of the request they correspond to
+ * (e.g., SRVD_SERVICE_NSS_PASSWD_REQUEST_UID), so the same bytes can be used
+ * as keys for different databases without interfering with each other.
+ *
+ * Because a filter only ever gives false positives (never false negatives)
+ * when it's up to date, the daemon must publish a new filter whenever keys are
+ * added to its backend. Publishing replaces the file atomically, and clients
+ * pick up the new version the next time they look something up. */
+
+/* Filter file format (all values in network byte order):
+ *
+ * 0       8       16      24      32
+ * +-------------------------------+
+ * | magic ("SRVF")                | <-- Header
+ * +---------------+---------------+
+ * | version       | hash count    |
+ * +---------------+---------------+
+ * | bit count                     |
+ * +-------------------------------+
+ * | key count                     |
+ * +-------------------------------+
+ * | bits                          | <-- Data
+ * |               .               |
+ * |               .               |
+ * +-------------------------------+
+ */
+
+#include <srvd/srvd.h>
+#include <srvd/protocol.h>
+
+#include <arpa/inet.h>
+
+#define SRVD_FILTER_MAGIC "SRVF"
+#define SRVD_FILTER_VERSION 1
+
+#define SRVD_FILTER_HEADER_SIZE 16
+
+#define SRVD_FILTER_HEADER_OFFSET_MAGIC 0
+#define SRVD_FILTER_HEADER_OFFSET_VERSION 4
+#define SRVD_FILTER_HEADER_OFFSET_HASHES 6
+#define SRVD_FILTER_HEADER_OFFSET_BITS 8
+#define SRVD_FILTER_HEADER_OFFSET_KEYS 12
+
+/* About 1% false positives at the configured key count. */
+#define SRVD_FILTER_BITS_PER_KEY 10
+#define SRVD_FILTER_HASH_COUNT 7
+
+/* The smallest filter we'll create, in bits. */
+#define SRVD_FILTER_BITS_MINIMUM 1024
+
+typedef struct srvd_filter srvd_filter_t;
+
+struct srvd_filter {
+  uint32_t bit_count, hash_count, key_count;
+  unsigned char *bits;
+
+  /* Either the memory mapping of a published filter or the allocated buffer
+   * (including space for the header) of a filter being built. */
+  char *data;
+  size_t size;
+  srvd_boolean_t mapped;
+};
+
+srvd_filter_t *srvd_filter_allocate(void);
+void srvd_filter_free(srvd_filter_t *);
+srvd_boolean_t srvd_filter_initialize(srvd_filter_t *, uint32_t);
+srvd_boolean_t srvd_filter_map(srvd_filter_t *, const char *);
+srvd_boolean_t srvd_filter_finalize(srvd_filter_t *);
+srvd_boolean_t srvd_filter_add(srvd_filter_t *, srvd_protocol_type_t, const void *, size_t);
+srvd_boolean_t srvd_filter_has(const srvd_filter_t *, srvd_protocol_type_t, const void *, size_t);
+srvd_boolean_t srvd_filter_publish(const srvd_filter_t *, const char *);
+
+static inline
+srvd_boolean_t srvd_filter_add_uint32(srvd_filter_t *filter, srvd_protocol_type_t type,
+                                      uint32_t key) {
+  uint32_t v = htonl(key);
+  return srvd_filter_add(filter, type, &v, sizeof(uint32_t));
+}
+
+static inline
+srvd_boolean_t srvd_filter_has_uint32(const srvd_filter_t *filter, srvd_protocol_type_t type,
+                                      uint32_t key) {
+  uint32_t v = htonl(key);
+  return srvd_filter_has(filter, type, &v, sizeof(uint32_t));
+}
+
+/* Default filter, as specified by `client:filter' in the default configuration
+ * file. These return SRVD_TRUE if the key might exist, which includes the case
+ * where no filter is configured or the filter can't be read. */
+
+srvd_boolean_t srvd_filter_default_has(srvd_protocol_type_t, const void *, size_t);
+
+static inline
+srvd_boolean_t srvd_filter_default_has_uint32(srvd_protocol_type_t type, uint32_t key) {
+  uint32_t v = htonl(key);
+  return srvd_filter_default_has(type, &v, sizeof(uint32_t));
+}
+
+#endif
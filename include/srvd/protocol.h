@@ -21,6 +21,21 @@ typedef uint16_t srvd_protocol_type_t;
  * communication. */
 #define SRVD_PROTOCOL_STATUS ((srvd_protocol_type_t)65535)
 
+/* Batch requests and responses; see <srvd/service.h>. */
+#define SRVD_PROTOCOL_BATCH ((srvd_protocol_type_t)65534)
+
+/* Shared memory handshakes; see <srvd/client/shm.h>. */
+#define SRVD_PROTOCOL_SHM ((srvd_protocol_type_t)65533)
+
+/* Server statistics; see <srvd/stats.h>. */
+#define SRVD_PROTOCOL_STATS ((srvd_protocol_type_t)65532)
+
+/* Feature negotiation; see <srvd/protocol/hello.h>. */
+#define SRVD_PROTOCOL_HELLO ((srvd_protocol_type_t)65531)
+
+/* Deadlines, priorities and cache hints; see <srvd/protocol/extension.h>. */
+#define SRVD_PROTOCOL_EXTENSION ((srvd_protocol_type_t)65530)
+
 /* Additional protocol types are defined in the files in the `service'
  * directory and begin with `SRVD_SERVICE_'. */
 
@@ -0,0 +1,39 @@
+/* compress.h: Block compression for packet bodies.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_PROTOCOL_COMPRESS_H
+#define _SRVD_PROTOCOL_COMPRESS_H
+
+/* Blocks use the LZ4 block format: a sequence of literal runs, each followed
+ * by a back-reference of at least 4 bytes into the last 64 KiB of output, with
+ * the block ending in literals. It's not the tightest format around, but it
+ * costs little more than a copy to decode, which is what matters for the big
+ * responses we use it on (enumeration pages and long member lists): they're
+ * mostly names that repeat a lot of their text. */
+
+#include <srvd/srvd.h>
+
+/* No block decompresses to more than this many times its size. */
+#define SRVD_PROTOCOL_COMPRESS_RATIO_MAXIMUM 255
+
+/* The largest a block can get, for input that doesn't compress at all. */
+static inline size_t srvd_protocol_compress_bound(size_t size) {
+  return size + size / 255 + 16;
+}
+
+/* Returns the size of the block, or 0 if it didn't fit in the output. */
+size_t srvd_protocol_compress(const char *input, size_t input_size, char *output,
+                              size_t output_size);
+
+/* Returns SRVD_FALSE unless the block is well-formed and decompresses to
+ * exactly the size of the output. */
+srvd_boolean_t srvd_protocol_decompress(const char *input, size_t input_size, char *output,
+                                        size_t output_size);
+
+#endif
@@ -0,0 +1,82 @@
+/* extension.h: Request extensions.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_PROTOCOL_EXTENSION_H
+#define _SRVD_PROTOCOL_EXTENSION_H
+
+/* A request can tell the server how long its client is willing to wait and how
+ * much the answer matters by carrying a SRVD_PROTOCOL_EXTENSION field after its
+ * service fields (never first, since the first field says what the request
+ * is). The field has three entries:
+ *
+ *  - the deadline, in milliseconds since the Epoch, or 0 for none (64 bits,
+ *    most significant half first),
+ *  - the priority class (8 bits; see below), and
+ *  - flags (32 bits; see below).
+ *
+ * Servers that predate extensions ignore the field like any other they don't
+ * ask for, so no handshake is needed. Servers that know about it don't run the
+ * handler for a request whose deadline has already passed (its client has
+ * given up on it), and answer it with SRVD_SERVICE_RESPONSE_UNAVAIL instead.
+ * Deadlines are in wall-clock time, so they only mean anything when the
+ * clocks on both ends agree. */
+
+#include <srvd/srvd.h>
+#include <srvd/protocol/packet.h>
+
+/* Someone is waiting on the answer (e.g., a single lookup by name). */
+#define SRVD_PROTOCOL_EXTENSION_PRIORITY_INTERACTIVE ((uint8_t)0)
+
+/* Requests without an extension, or with a class we don't know. */
+#define SRVD_PROTOCOL_EXTENSION_PRIORITY_NORMAL ((uint8_t)1)
+
+/* Walking a whole database, where throughput matters more than latency. */
+#define SRVD_PROTOCOL_EXTENSION_PRIORITY_BULK ((uint8_t)2)
+
+#define SRVD_PROTOCOL_EXTENSION_PRIORITY_COUNT 3
+
+/* Flags are hints for handlers that keep caches of their own; the server
+ * itself doesn't look at them. */
+
+/* Don't answer from a cache; go to the backend. */
+#define SRVD_PROTOCOL_EXTENSION_FLAG_BYPASS_CACHE ((uint32_t)(1 << 0))
+
+/* An expired cache entry is better than waiting on a slow backend. */
+#define SRVD_PROTOCOL_EXTENSION_FLAG_STALE_OK ((uint32_t)(1 << 1))
+
+typedef struct srvd_protocol_extension srvd_protocol_extension_t;
+
+struct srvd_protocol_extension {
+  uint64_t deadline;
+  uint8_t priority;
+  uint32_t flags;
+};
+
+/* Sets up what a request without an extension gets: no deadline, normal
+ * priority and no flags. */
+void srvd_protocol_extension_initialize(srvd_protocol_extension_t *);
+
+/* Sets the deadline to the given number of milliseconds from now. */
+void srvd_protocol_extension_deadline_set(srvd_protocol_extension_t *, uint32_t);
+
+/* Returns SRVD_TRUE if there's a deadline and it has passed. */
+srvd_boolean_t srvd_protocol_extension_expired(const srvd_protocol_extension_t *);
+
+/* The current time, in milliseconds since the Epoch. */
+uint64_t srvd_protocol_extension_now(void);
+
+srvd_boolean_t srvd_protocol_extension_pack(const srvd_protocol_extension_t *,
+                                            srvd_protocol_packet_t *);
+
+/* Leaves the extension initialized if the packet doesn't have one. Returns
+ * SRVD_FALSE if it has one that's malformed. */
+srvd_boolean_t srvd_protocol_extension_unpack(const srvd_protocol_packet_t *,
+                                              srvd_protocol_extension_t *);
+
+#endif
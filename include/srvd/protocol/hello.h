@@ -0,0 +1,76 @@
+/* hello.h: Protocol feature negotiation.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_PROTOCOL_HELLO_H
+#define _SRVD_PROTOCOL_HELLO_H
+
+/* Clients and servers are upgraded at different times, so neither side can
+ * assume the other understands anything newer than the baseline: packet
+ * version 110 with none of the optional features. A client that wants more
+ * starts its connection with a handshake: a packet whose only field is
+ * SRVD_PROTOCOL_HELLO, with four entries:
+ *
+ *  - the oldest packet version it can read (16 bits),
+ *  - the newest packet version it can read (16 bits),
+ *  - the features it supports (32 bits; see below), and
+ *  - the largest packet it's willing to receive, or 0 for no limit (32 bits).
+ *
+ * The server answers with a status and a SRVD_PROTOCOL_HELLO field in the same
+ * format, where both versions are the newest one they have in common and the
+ * features are the ones they both support. Servers that predate the handshake
+ * answer with SRVD_SERVICE_RESPONSE_UNAVAIL, like for any request they don't
+ * know, and the client sticks to the baseline.
+ *
+ * Servers don't remember anything about a connection: they read whatever
+ * version a request was written in and answer in the same one, so it's up to
+ * the client to only use what the handshake said the server supports. */
+
+#include <srvd/srvd.h>
+#include <srvd/protocol/packet.h>
+
+/* The server answers requests on a connection in order, so more than one can
+ * be outstanding (see srvd_client_async_t). */
+#define SRVD_PROTOCOL_HELLO_PIPELINING ((uint32_t)(1 << 0))
+
+/* The server understands SRVD_PROTOCOL_BATCH requests (see
+ * srvd_service_batch_t). */
+#define SRVD_PROTOCOL_HELLO_BATCH ((uint32_t)(1 << 1))
+
+/* Large packets can be compressed (see
+ * SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE). */
+#define SRVD_PROTOCOL_HELLO_COMPRESSION ((uint32_t)(1 << 2))
+
+/* Everything this library supports. */
+#define SRVD_PROTOCOL_HELLO_FEATURES \
+  (SRVD_PROTOCOL_HELLO_PIPELINING | SRVD_PROTOCOL_HELLO_BATCH | SRVD_PROTOCOL_HELLO_COMPRESSION)
+
+typedef struct srvd_protocol_hello srvd_protocol_hello_t;
+
+struct srvd_protocol_hello {
+  uint16_t version_minimum, version_maximum;
+  uint32_t features;
+  uint32_t size_maximum;
+};
+
+/* Sets up what every peer can be assumed to support. */
+void srvd_protocol_hello_initialize(srvd_protocol_hello_t *);
+
+/* Sets up everything this library supports. */
+void srvd_protocol_hello_initialize_local(srvd_protocol_hello_t *);
+
+srvd_boolean_t srvd_protocol_hello_pack(const srvd_protocol_hello_t *, srvd_protocol_packet_t *);
+srvd_boolean_t srvd_protocol_hello_unpack(const srvd_protocol_packet_t *, srvd_protocol_hello_t *);
+
+/* Works out what two peers have in common. Returns SRVD_FALSE if they have no
+ * packet version in common. */
+srvd_boolean_t srvd_protocol_hello_negotiate(const srvd_protocol_hello_t *,
+                                             const srvd_protocol_hello_t *,
+                                             srvd_protocol_hello_t *);
+
+#endif
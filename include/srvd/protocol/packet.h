@@ -27,7 +27,7 @@ struct srvd_protocol_packet {
 };
 
 struct srvd_protocol_packet_field {
-  uint16_t entry_count;
+  uint32_t entry_count;
   SRVD_THREAD_MUTEX_DECLARE_UNINITIALIZED(entry_lock);
   srvd_protocol_packet_field_entry_t *entry_head, *entry_tail;
   srvd_protocol_type_t type;
@@ -35,7 +35,7 @@ struct srvd_protocol_packet_field {
 };
 
 struct srvd_protocol_packet_field_entry {
-  uint16_t size;
+  uint32_t size;
   void *data;
   srvd_protocol_packet_field_entry_t *next, *previous;
 };
@@ -83,9 +83,9 @@ srvd_boolean_t srvd_protocol_packet_field_get_or_inject(srvd_protocol_packet_t *
                                                         srvd_protocol_packet_field_t **);
 
 srvd_boolean_t srvd_protocol_packet_field_append(srvd_protocol_packet_t *,
-                                                 srvd_protocol_type_t, uint16_t, const void *);
+                                                 srvd_protocol_type_t, uint32_t, const void *);
 srvd_boolean_t srvd_protocol_packet_field_insert(srvd_protocol_packet_t *,
-                                                 srvd_protocol_type_t, uint16_t, const void *);
+                                                 srvd_protocol_type_t, uint32_t, const void *);
 
 srvd_protocol_packet_field_t *srvd_protocol_packet_field_allocate(void);
 void srvd_protocol_packet_field_free(srvd_protocol_packet_field_t *);
@@ -93,12 +93,12 @@ srvd_boolean_t srvd_protocol_packet_field_initialize(srvd_protocol_packet_field_
                                                      srvd_protocol_type_t);
 srvd_boolean_t srvd_protocol_packet_field_finalize(srvd_protocol_packet_field_t *);
 
-srvd_boolean_t srvd_protocol_packet_field_entry_add(srvd_protocol_packet_field_t *, uint16_t,
+srvd_boolean_t srvd_protocol_packet_field_entry_add(srvd_protocol_packet_field_t *, uint32_t,
                                                     const void *);
-srvd_boolean_t srvd_protocol_packet_field_entry_inject(srvd_protocol_packet_field_t *, uint16_t,
+srvd_boolean_t srvd_protocol_packet_field_entry_inject(srvd_protocol_packet_field_t *, uint32_t,
                                                        const void *);
 srvd_boolean_t srvd_protocol_packet_field_entry_get(const srvd_protocol_packet_field_t *,
-                                                    uint16_t, srvd_protocol_packet_field_entry_t **);
+                                                    uint32_t, srvd_protocol_packet_field_entry_t **);
 
 static inline
 srvd_boolean_t srvd_protocol_packet_field_get_first(const srvd_protocol_packet_t *packet,
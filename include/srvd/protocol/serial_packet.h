@@ -41,12 +41,77 @@
  *                 .
  */
 
+/* Version 120 packets have the same header, but everything in the body is
+ * variable-length:
+ *
+ * +-----------+-------------+
+ * | type      | entry count | <-- Fields
+ * +-----------+-------------+
+ * +-----------+-------------------+
+ * | header    | data              | <-- Entry
+ * +-----------+-------------------+
+ *
+ * The type, entry count and entry header are unsigned LEB128 integers: seven
+ * bits at a time, least significant first, with the high bit set on every byte
+ * but the last. The entry header is the size of the entry shifted left by one.
+ * If its low bit is set, the entry is a 2- or 4-byte integer in network byte
+ * order (like a UID), and the data is its value as another LEB128 integer
+ * instead; we do that whenever it's shorter.
+ *
+ * Peers that don't know each other only use version 110 (see
+ * <srvd/protocol/hello.h>). */
+
+/* The top four bits of the version are flags, which any version can have:
+ *
+ *  - SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE: The peer that wrote the
+ *    packet can read compressed packets. Clients only set it once the
+ *    handshake says the server can too, and servers only compress responses to
+ *    requests that have it.
+ *  - SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED: The body is compressed
+ *    (see <srvd/protocol/compress.h>):
+ *
+ *    +-------------------------------+
+ *    | uncompressed body size        |
+ *    +-------------------------------+
+ *    | compressed body               |
+ *    |               .               |
+ *    |               .               |
+ *    +-------------------------------+
+ *
+ *    The size in the header is the size of all of that, and the field count is
+ *    unchanged.
+ *
+ * Only packets of at least SRVD_PROTOCOL_SERIAL_PACKET_COMPRESS_THRESHOLD bytes
+ * are worth compressing, and only then if it makes them smaller; point lookups
+ * never are. */
+#define SRVD_PROTOCOL_SERIAL_PACKET_FLAGS ((uint16_t)0xf000)
+#define SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED ((uint16_t)0x8000)
+#define SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE ((uint16_t)0x4000)
+
+/* The flags that say what the writer of a packet can read. Servers keep them
+ * from the request to decide how to write the response. */
+#define SRVD_PROTOCOL_SERIAL_PACKET_FLAGS_CAPABILITIES SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE
+
+#define SRVD_PROTOCOL_SERIAL_PACKET_COMPRESS_THRESHOLD 4096
+
+/* The uncompressed body size. */
+#define SRVD_PROTOCOL_SERIAL_PACKET_COMPRESSED_HEADER_SIZE 4
+
 /* Protocol changes:
+ * - 120: Variable-length integers throughout the body.
  * - 110: Support multiple entries per field.
  * - 100: Initial version.
  */
 #define SRVD_PROTOCOL_SERIAL_PACKET_VERSION 110
 
+/* The versions we can read. Packets are written in SRVD_PROTOCOL_SERIAL_PACKET_VERSION
+ * unless the peer has said it can read something newer (see
+ * <srvd/protocol/hello.h>). */
+#define SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MINIMUM 110
+#define SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MAXIMUM 120
+
+#define SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT 120
+
 /* All packets are at least the size of the header, which is 8 bytes. */
 #define SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE 8
 
@@ -56,6 +121,19 @@
 /* And each field entry has an overhead of 2 bytes. */
 #define SRVD_PROTOCOL_SERIAL_PACKET_FIELD_ENTRY_HEADER_SIZE 2
 
+/* Transports that send each packet as a single message (SOCK_SEQPACKET
+ * sockets) can't send anything bigger than this. It stays under the default
+ * socket buffer size on Linux. */
+#define SRVD_PROTOCOL_SERIAL_PACKET_MESSAGE_SIZE_MAXIMUM 131072
+
+/* Version 110 entries can't be bigger than UINT16_MAX bytes, and fields can't
+ * have more than UINT16_MAX entries. Version 120 has no limit on the number of
+ * entries, and entries can be up to this big. */
+#define SRVD_PROTOCOL_SERIAL_PACKET_ENTRY_SIZE_MAXIMUM ((uint32_t)0x7fffffff)
+
+/* The longest a LEB128-encoded 32-bit integer can be. */
+#define SRVD_PROTOCOL_SERIAL_PACKET_VARINT_SIZE_MAXIMUM 5
+
 /* Offsets for reading the structures. */
 #define SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_VERSION 0
 #define SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_COUNT 2
@@ -78,16 +156,122 @@ typedef struct srvd_protocol_serial_packet srvd_protocol_serial_packet_t;
 
 struct srvd_protocol_serial_packet {
   size_t size, body_size;
+  uint16_t version, flags;
   uint16_t field_count;
   char *data;
 };
 
 srvd_protocol_serial_packet_t *srvd_protocol_serial_packet_allocate(void);
 void srvd_protocol_serial_packet_free(srvd_protocol_serial_packet_t *);
+
+/* Serial packets are written in SRVD_PROTOCOL_SERIAL_PACKET_VERSION without any
+ * flags unless the version or flags are changed after initializing them. If
+ * SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE is set, serializing compresses
+ * the packet if it's worth it, and sets SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED
+ * if it did. Unserializing a header sets the version and flags to the ones it
+ * was written with, and the body is decompressed as needed. */
 srvd_boolean_t srvd_protocol_serial_packet_initialize(srvd_protocol_serial_packet_t *);
 srvd_boolean_t srvd_protocol_serial_packet_finalize(srvd_protocol_serial_packet_t *);
 srvd_boolean_t srvd_protocol_serial_packet_serialize(srvd_protocol_serial_packet_t *, const srvd_protocol_packet_t *);
+
+/* For serializing into memory that's already been set aside (e.g., shared
+ * memory). The size is the total, header included. The version can include
+ * SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE, but packets serialized this way
+ * are never compressed. */
+size_t srvd_protocol_serial_packet_size(const srvd_protocol_packet_t *);
+size_t srvd_protocol_serial_packet_size_version(const srvd_protocol_packet_t *, uint16_t);
+srvd_boolean_t srvd_protocol_serial_packet_serialize_into(const srvd_protocol_packet_t *, char *, size_t);
+srvd_boolean_t srvd_protocol_serial_packet_serialize_into_version(const srvd_protocol_packet_t *,
+                                                                  char *, size_t, uint16_t);
+/* Replaces the data of a compressed serial packet, header and all, with the
+ * uncompressed form; does nothing if it isn't compressed. */
+srvd_boolean_t srvd_protocol_serial_packet_decompress(srvd_protocol_serial_packet_t *);
+
+/* Unserializing the header doesn't touch the packet, which can be NULL if the
+ * body is going to be read with a reader (see below) instead. */
 srvd_boolean_t srvd_protocol_serial_packet_unserialize_header(srvd_protocol_serial_packet_t *, srvd_protocol_packet_t *, char *header);
 srvd_boolean_t srvd_protocol_serial_packet_unserialize_body(srvd_protocol_serial_packet_t *, srvd_protocol_packet_t *, char *body);
 
+/* Readers.
+ *
+ * Walks the fields and entries of a serialized body in place, for callers that
+ * only look at each of them once and would rather not build a packet to do
+ * it. The serial packet needs its header unserialized; the body is
+ * decompressed first if it has to be. Entries point into the body (or the
+ * reader), so they're only good until the reader is finalized or the next
+ * entry is read.
+ *
+ * Moving to the next field skips whatever's left of the current one. Both
+ * return SRVD_FALSE once there's nothing more to read, or if the body turns out
+ * to be malformed, in which case error is set. */
+typedef struct srvd_protocol_serial_packet_reader srvd_protocol_serial_packet_reader_t;
+
+struct srvd_protocol_serial_packet_reader {
+  uint16_t version;
+  uint16_t field_count;
+  uint32_t entry_count;
+  const char *p, *end;
+  srvd_boolean_t error;
+
+  /* The uncompressed body, if it was compressed. */
+  char *buffer;
+
+  /* Integers packed by version 120, put back the way they were. */
+  char packed[sizeof(uint32_t)];
+};
+
+srvd_boolean_t srvd_protocol_serial_packet_reader_initialize(srvd_protocol_serial_packet_reader_t *,
+                                                             const srvd_protocol_serial_packet_t *,
+                                                             const char *body);
+srvd_boolean_t srvd_protocol_serial_packet_reader_finalize(srvd_protocol_serial_packet_reader_t *);
+srvd_boolean_t srvd_protocol_serial_packet_reader_field_next(srvd_protocol_serial_packet_reader_t *,
+                                                             srvd_protocol_type_t *, uint32_t *);
+srvd_boolean_t srvd_protocol_serial_packet_reader_entry_next(srvd_protocol_serial_packet_reader_t *,
+                                                             const char **, uint32_t *);
+
+/* LEB128 integers. */
+
+static inline size_t srvd_protocol_serial_packet_varint_size(uint32_t value) {
+  size_t size = 1;
+
+  for(; value >= 0x80; value >>= 7)
+    size++;
+
+  return size;
+}
+
+static inline size_t srvd_protocol_serial_packet_varint_put(char *buffer, uint32_t value) {
+  unsigned char *p = (unsigned char *)buffer;
+  size_t size = 0;
+
+  for(; value >= 0x80; value >>= 7)
+    p[size++] = (unsigned char)(value | 0x80);
+  p[size++] = (unsigned char)value;
+
+  return size;
+}
+
+/* Returns the number of bytes read, or 0 if the integer runs past the end of
+ * the buffer or doesn't fit in 32 bits. */
+static inline size_t srvd_protocol_serial_packet_varint_get(const char *buffer, size_t available,
+                                                            uint32_t *value) {
+  const unsigned char *p = (const unsigned char *)buffer;
+  uint32_t result = 0;
+  size_t i;
+
+  for(i = 0; i < available && i < SRVD_PROTOCOL_SERIAL_PACKET_VARINT_SIZE_MAXIMUM; i++) {
+    result |= (uint32_t)(p[i] & 0x7f) << (7 * i);
+
+    if((p[i] & 0x80) == 0) {
+      if(i == SRVD_PROTOCOL_SERIAL_PACKET_VARINT_SIZE_MAXIMUM - 1 && p[i] > 0x0f)
+        return 0;
+
+      *value = result;
+      return i + 1;
+    }
+  }
+
+  return 0;
+}
+
 #endif
@@ -0,0 +1,108 @@
+/* scheduler.h: Request scheduling.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_SCHEDULER_H
+#define _SRVD_SCHEDULER_H
+
+/* A server has one thread answering every connection on a socket, so a client
+ * walking a whole database (or just sending a lot) can keep everyone else
+ * waiting. Requests that have been read but not yet answered wait in a
+ * scheduler, which decides what goes next.
+ *
+ * Each request belongs to a class with a queue of its own, and classes take
+ * turns in proportion to their weights (smooth weighted round robin: with the
+ * default weights, eight lookups are answered for every request that's part
+ * of an enumeration, but never eight in a row if both are waiting). A class
+ * with nothing waiting doesn't save up its turns for later.
+ *
+ * Within a class, requests are kept per peer, and peers take turns one
+ * request at a time, so a peer with a lot of connections gets no more than a
+ * peer with one. On local sockets, peers are processes (from SO_PEERCRED,
+ * where it's available), so a busy process can't hold up another one running
+ * as the same user, like a login waiting behind a long enumeration. Elsewhere,
+ * each connection is a peer of its own. */
+
+#include <srvd/srvd.h>
+
+/* Lookups by key. */
+#define SRVD_SCHEDULER_CLASS_POINT ((uint8_t)0)
+
+/* Batches (see srvd_service_batch_t). */
+#define SRVD_SCHEDULER_CLASS_BATCH ((uint8_t)1)
+
+/* Walking a whole database, or anything else marked as bulk (see
+ * <srvd/protocol/extension.h>). */
+#define SRVD_SCHEDULER_CLASS_ENUMERATION ((uint8_t)2)
+
+/* Handshakes and statistics. */
+#define SRVD_SCHEDULER_CLASS_ADMIN ((uint8_t)3)
+
+#define SRVD_SCHEDULER_CLASS_COUNT 4
+
+#define SRVD_SCHEDULER_WEIGHT_POINT_DEFAULT 8
+#define SRVD_SCHEDULER_WEIGHT_BATCH_DEFAULT 2
+#define SRVD_SCHEDULER_WEIGHT_ENUMERATION_DEFAULT 1
+#define SRVD_SCHEDULER_WEIGHT_ADMIN_DEFAULT 4
+
+typedef uint64_t srvd_scheduler_peer_t;
+
+typedef struct srvd_scheduler srvd_scheduler_t;
+typedef struct srvd_scheduler_class srvd_scheduler_class_t;
+typedef struct srvd_scheduler_queue srvd_scheduler_queue_t;
+typedef struct srvd_scheduler_item srvd_scheduler_item_t;
+
+/* Callers embed an item in whatever they're scheduling, and get it back from
+ * srvd_scheduler_pop(). */
+struct srvd_scheduler_item {
+  srvd_scheduler_item_t *next;
+};
+
+/* A peer's requests in one class. The queues of a class with anything in them
+ * form a ring, and the class's cursor is the one that went last. */
+struct srvd_scheduler_queue {
+  srvd_scheduler_peer_t peer;
+  srvd_scheduler_item_t *head, *tail;
+  srvd_scheduler_queue_t *next;
+};
+
+struct srvd_scheduler_class {
+  uint32_t weight;
+  int64_t credit;
+  uint32_t item_count;
+  srvd_scheduler_queue_t *cursor;
+};
+
+/* Queues that have emptied out are kept for reuse. */
+struct srvd_scheduler {
+  srvd_scheduler_class_t classes[SRVD_SCHEDULER_CLASS_COUNT];
+  uint32_t item_count;
+  srvd_scheduler_queue_t *spare;
+};
+
+/* Fills in the default weight of each class. */
+void srvd_scheduler_weights_default(uint32_t *);
+
+/* Takes a weight for each class, or NULL for the defaults. Weights must be at
+ * least 1. */
+srvd_boolean_t srvd_scheduler_initialize(srvd_scheduler_t *, const uint32_t *);
+
+/* Anything still waiting is forgotten; it's up to the caller to clean it up
+ * first. */
+srvd_boolean_t srvd_scheduler_finalize(srvd_scheduler_t *);
+
+srvd_boolean_t srvd_scheduler_push(srvd_scheduler_t *, srvd_scheduler_item_t *, uint8_t,
+                                   srvd_scheduler_peer_t);
+
+/* Returns SRVD_FALSE if nothing is waiting. */
+srvd_boolean_t srvd_scheduler_pop(srvd_scheduler_t *, srvd_scheduler_item_t **);
+
+/* Works out who's on the other end of a connected socket. */
+srvd_scheduler_peer_t srvd_scheduler_peer_get(int);
+
+#endif
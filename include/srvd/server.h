@@ -11,31 +11,156 @@
 #define _SRVD_SERVER_H
 
 #include <srvd/srvd.h>
+#include <srvd/capture.h>
 #include <srvd/protocol.h>
+#include <srvd/protocol/hello.h>
+#include <srvd/scheduler.h>
 #include <srvd/service.h>
+#include <srvd/stats.h>
+#include <srvd/thread.h>
 
 typedef struct srvd_server srvd_server_t;
 typedef struct srvd_server_service srvd_server_service_t;
+typedef struct srvd_server_submission srvd_server_submission_t;
 
+/* Every server keeps statistics on the requests it answers (see
+ * <srvd/stats.h>), and answers SRVD_PROTOCOL_STATS requests itself. To let
+ * monitoring tools read them straight from memory instead, call
+ * srvd_stats_publish() on them before executing the server.
+ *
+ * Servers also answer handshakes (SRVD_PROTOCOL_HELLO; see
+ * <srvd/protocol/hello.h>) themselves, offering what's in hello. It starts out
+ * as everything the library supports; transports lower it to suit
+ * themselves.
+ *
+ * Socket servers keep requests in a scheduler (see <srvd/scheduler.h>) until
+ * it's their turn, with a weight for each class that starts out as the
+ * default and can be changed before executing the server. Requests that other
+ * threads read (see srvd_server_socket_submit()) wait in the submissions until
+ * the server picks them up; the wake descriptor is how it finds out, and is -1
+ * whenever it isn't executing. */
 struct srvd_server {
   srvd_server_service_t *services;
   srvd_boolean_t executing;
+  srvd_stats_t stats;
+  srvd_capture_t *capture;
+  srvd_protocol_hello_t hello;
+  uint32_t scheduling_weights[SRVD_SCHEDULER_CLASS_COUNT];
+  srvd_server_submission_t *submissions;
+  int submissions_wake;
+  SRVD_THREAD_MUTEX_DECLARE_UNINITIALIZED(submissions_lock);
+  SRVD_THREAD_CONDITION_DECLARE_UNINITIALIZED(submissions_done);
 };
 
 typedef void (*srvd_server_service_handler_pt)(const srvd_service_request_t *, srvd_service_response_t *);
+typedef srvd_boolean_t (*srvd_server_service_validator_pt)(const srvd_service_request_t *);
 
 struct srvd_server_service {
   srvd_protocol_type_t type;
   srvd_server_service_handler_pt handler;
+  srvd_server_service_validator_pt validator;
+  uint8_t scheduling_class;
   srvd_server_service_t *next;
 };
 
 srvd_boolean_t srvd_server_initialize(srvd_server_t *);
+
+/* Also ends any shared memory sessions the server still has (see
+ * <srvd/server/shm.h>), and waits for them to finish. */
 srvd_boolean_t srvd_server_finalize(srvd_server_t *);
 
+/* Starts writing every request the server receives to a capture log at the
+ * given path (see <srvd/capture.h>), or stops if the path is NULL. This must
+ * be done before executing the server. */
+srvd_boolean_t srvd_server_capture(srvd_server_t *, const char *);
+
 srvd_boolean_t srvd_server_service_add(srvd_server_t *, srvd_protocol_type_t, srvd_server_service_handler_pt);
 srvd_boolean_t srvd_server_service_get(srvd_server_t *, srvd_protocol_type_t, srvd_server_service_handler_pt *);
 srvd_boolean_t srvd_server_service_has(srvd_server_t *, srvd_protocol_type_t);
 srvd_boolean_t srvd_server_service_remove(srvd_server_t *, srvd_protocol_type_t);
 
+/* Services are scheduled as lookups (SRVD_SCHEDULER_CLASS_POINT) unless told
+ * otherwise, e.g., for the types that walk a whole database. Requests that say
+ * they're interactive or bulk (see <srvd/protocol/extension.h>) are scheduled
+ * as lookups or enumerations either way. */
+srvd_boolean_t srvd_server_service_class_set(srvd_server_t *, srvd_protocol_type_t, uint8_t);
+
+/* Requests are checked before they're handed to the handler, and answered
+ * with SRVD_SERVICE_RESPONSE_FAIL if they don't pass. Services for the types
+ * in <srvd/service/nss/> get the database's request validator (e.g.,
+ * srvd_service_nss_passwd_request_validate()) when they're added; others
+ * aren't checked unless given a validator here. NULL turns checking off. */
+srvd_boolean_t srvd_server_service_validator_set(srvd_server_t *, srvd_protocol_type_t,
+                                                 srvd_server_service_validator_pt);
+
+/* Runs the handler for a request (or each request in a batch) and fills in the
+ * response, including its status field. Transports call this for every packet
+ * they receive. Requests whose deadline has passed (see
+ * <srvd/protocol/extension.h>) are answered with SRVD_SERVICE_RESPONSE_UNAVAIL
+ * without running the handler. Returns SRVD_FALSE if the request is malformed,
+ * in which case nothing should be sent back.
+ *
+ * Transports that serialize the response pass the version it'll be written in
+ * to srvd_server_dispatch_version(), so that each response in a batch is one
+ * that version can carry; srvd_server_dispatch() is for responses that are
+ * never serialized.
+ *
+ * Handlers aren't expected to be thread-safe, so a server must only dispatch
+ * from one thread at a time. Transports with threads of their own hand their
+ * requests to srvd_server_socket_submit() instead. */
+srvd_boolean_t srvd_server_dispatch(srvd_server_t *, const srvd_service_request_t *,
+                                    srvd_service_response_t *);
+srvd_boolean_t srvd_server_dispatch_version(srvd_server_t *, const srvd_service_request_t *,
+                                            srvd_service_response_t *, uint16_t);
+
+/* Transports fill in a sample as they go (see <srvd/stats.h>) and record it
+ * once the response has been sent, or once they've given up on it. */
+void srvd_server_stats_record(srvd_server_t *, srvd_stats_sample_t *,
+                              const srvd_service_request_t *, const srvd_service_response_t *);
+
+/* Serves requests from clients connecting to a listening socket until an
+ * error occurs. Clients may keep their connections open and send any number of
+ * requests; each connection's requests are answered in order, but requests
+ * from different connections are answered in whatever order the scheduler
+ * picks. If given, the
+ * prepare function is called on each new connection (e.g., to set socket
+ * options) and may refuse it by returning SRVD_FALSE.
+ *
+ * The listening socket may be a SOCK_STREAM or a SOCK_SEQPACKET socket. On a
+ * SOCK_SEQPACKET socket, each packet must be a single message of no more than
+ * SRVD_PROTOCOL_SERIAL_PACKET_MESSAGE_SIZE_MAXIMUM bytes, and shared memory
+ * handshakes aren't accepted. On either, requests bigger than
+ * SRVD_SERVER_SOCKET_REQUEST_SIZE_MAXIMUM are refused, and the connection
+ * closed, before anything more than the header has been read. */
+#define SRVD_SERVER_SOCKET_REQUEST_SIZE_MAXIMUM SRVD_PROTOCOL_SERIAL_PACKET_MESSAGE_SIZE_MAXIMUM
+
+typedef srvd_boolean_t (*srvd_server_socket_prepare_pt)(int);
+
+srvd_boolean_t srvd_server_socket_execute(srvd_server_t *, int, srvd_server_socket_prepare_pt);
+
+/* Hands a request that another thread has read to the executing socket server,
+ * which schedules it along with its own, as coming from the given peer (see
+ * srvd_scheduler_peer_get()), dispatches it on its own thread, and fills in
+ * the response and the sample's dispatched and handled times. This waits until
+ * that's done. Returns SRVD_FALSE if the request is malformed (as
+ * srvd_server_dispatch_version() does), or if the server isn't executing or
+ * stops before it gets to the request. */
+srvd_boolean_t srvd_server_socket_submit(srvd_server_t *, srvd_scheduler_peer_t,
+                                         const srvd_service_request_t *,
+                                         srvd_service_response_t *, uint16_t,
+                                         srvd_stats_sample_t *);
+
+/* Helpers for transports. These read a packet from a connected socket (setting
+ * the version it was written in, and the flag if the client hung up before
+ * sending one) or write one to it in the given version, retrying until the
+ * whole thing is transferred. Responses should be written in the same version
+ * as their requests. The version read includes
+ * SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE if the client can read
+ * compressed packets, in which case large ones are written compressed. Like
+ * srvd_server_socket_execute(), they don't read requests bigger than
+ * SRVD_SERVER_SOCKET_REQUEST_SIZE_MAXIMUM. */
+srvd_boolean_t srvd_server_socket_read_packet(int, srvd_protocol_packet_t *, uint16_t *,
+                                              srvd_boolean_t *);
+srvd_boolean_t srvd_server_socket_write_packet(int, const srvd_protocol_packet_t *, uint16_t);
+
 #endif
@@ -0,0 +1,42 @@
+/* shm.h: Shared memory server sessions.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_SERVER_SHM_H
+#define _SRVD_SERVER_SHM_H
+
+/* There's no separate shared memory server; socket servers (see
+ * srvd_server_socket_execute()) accept shared memory handshakes from
+ * <srvd/client/shm.h> clients on their ordinary connections. Each connection
+ * that switches to shared memory gets a thread of its own, which answers
+ * requests from the region until the client closes it or hangs up.
+ *
+ * The client can write to the region whenever it likes, so requests are copied
+ * out of it before they're looked at. Sessions don't dispatch requests
+ * themselves: they submit them to srvd_server_socket_execute() (see
+ * srvd_server_socket_submit()), so handlers only ever run on its thread, and
+ * shared memory clients take their turns in the scheduler like everyone else.
+ * Once it returns, sessions end as soon as they get another request, and
+ * srvd_server_finalize() ends the rest. */
+
+#include <srvd/srvd.h>
+#include <srvd/server.h>
+
+/* Takes over a connection whose client sent a shared memory handshake along
+ * with the given file descriptor, which is always closed. On success, the
+ * connection belongs to the new session, and the caller must forget about it.
+ * Returns SRVD_FALSE if the region isn't usable or there are already too
+ * many sessions, in which case the caller should answer the handshake
+ * itself. */
+srvd_boolean_t srvd_server_shm_attach(srvd_server_t *, int, int);
+
+/* Ends every session attached to the server, and waits until they've all
+ * finished. */
+void srvd_server_shm_detach(srvd_server_t *);
+
+#endif
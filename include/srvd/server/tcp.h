@@ -0,0 +1,44 @@
+/* tcp.h: TCP server.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_SERVER_TCP_H
+#define _SRVD_SERVER_TCP_H
+
+#include <srvd/srvd.h>
+#include <srvd/server.h>
+
+#include <sys/socket.h>
+
+typedef struct srvd_server_tcp srvd_server_tcp_t;
+typedef struct srvd_server_tcp_conf srvd_server_tcp_conf_t;
+
+/* The host may be NULL to listen on every address. The family is AF_INET,
+ * AF_INET6 or AF_UNSPEC; an AF_INET6 server only accepts IPv6 connections. */
+struct srvd_server_tcp_conf {
+  int family;
+  char *host;
+  char *port;
+  size_t queue_size;
+};
+
+struct srvd_server_tcp {
+  srvd_server_t monitor;
+  srvd_server_tcp_conf_t conf;
+  struct sockaddr_storage endpoint;
+  socklen_t endpoint_length;
+  int socket;
+};
+
+srvd_server_tcp_t *srvd_server_tcp_allocate(void);
+void srvd_server_tcp_free(srvd_server_tcp_t *);
+srvd_boolean_t srvd_server_tcp_initialize(srvd_server_tcp_t *, const srvd_server_tcp_conf_t *);
+srvd_boolean_t srvd_server_tcp_finalize(srvd_server_tcp_t *);
+srvd_boolean_t srvd_server_tcp_execute(srvd_server_tcp_t *);
+
+#endif
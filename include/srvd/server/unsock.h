@@ -19,9 +19,13 @@
 typedef struct srvd_server_unsock srvd_server_unsock_t;
 typedef struct srvd_server_unsock_conf srvd_server_unsock_conf_t;
 
+/* If seqpacket is set, the server listens on a SOCK_SEQPACKET socket (see
+ * <srvd/client/unsock.h>) if the system supports them, and a SOCK_STREAM
+ * socket otherwise. */
 struct srvd_server_unsock_conf {
   char *path;
   size_t queue_size;
+  srvd_boolean_t seqpacket;
 };
 
 struct srvd_server_unsock {
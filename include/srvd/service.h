@@ -13,6 +13,7 @@
 #include <srvd/srvd.h>
 #include <srvd/protocol.h>
 #include <srvd/protocol/packet.h>
+#include <srvd/protocol/serial_packet.h>
 
 typedef struct srvd_service_request srvd_service_request_t;
 
@@ -58,4 +59,72 @@ void srvd_service_response_free(srvd_service_response_t *);
 srvd_boolean_t srvd_service_response_initialize(srvd_service_response_t *);
 srvd_boolean_t srvd_service_response_finalize(srvd_service_response_t *);
 
+/* Serialized responses.
+ *
+ * Callers that copy a response straight into something else (like the
+ * buffers the C library hands NSS modules) can have it left the way it came
+ * off the wire and walk it with a reader (see <srvd/protocol/serial_packet.h>),
+ * skipping the packet altogether. The status field is still first. */
+typedef struct srvd_service_serial_response srvd_service_serial_response_t;
+
+struct srvd_service_serial_response {
+  srvd_protocol_serial_packet_t serial;
+  srvd_service_response_code_t status;
+};
+
+srvd_boolean_t srvd_service_serial_response_initialize(srvd_service_serial_response_t *);
+srvd_boolean_t srvd_service_serial_response_finalize(srvd_service_serial_response_t *);
+
+/* Starts a reader at the beginning of the response body. */
+srvd_boolean_t srvd_service_serial_response_reader_initialize(const srvd_service_serial_response_t *,
+                                                              srvd_protocol_serial_packet_reader_t *);
+
+srvd_boolean_t srvd_service_request_query_serial(const srvd_service_request_t *,
+                                                 srvd_service_serial_response_t *);
+
+/* Batches.
+ *
+ * A batch carries any number of keys for the same request type (e.g., a list
+ * of UIDs for SRVD_SERVICE_NSS_PASSWD_REQUEST_UID) to the server in a single
+ * packet, and gets back one response per key, in the order the keys were
+ * added. Each response has its own status, so some keys can be found while
+ * others aren't.
+ *
+ * A response too big to fit in the batch is sent back empty, and
+ * srvd_service_batch_query() asks for that key again on its own.
+ *
+ * Servers that don't know about batches answer with a status of
+ * SRVD_SERVICE_RESPONSE_UNAVAIL for the whole batch; in that case, the keys
+ * have to be requested one at a time. */
+
+typedef struct srvd_service_batch srvd_service_batch_t;
+
+struct srvd_service_batch {
+  srvd_service_request_t request;
+  srvd_protocol_packet_field_t *keys;
+  srvd_service_response_code_t status;
+  uint16_t response_count;
+  srvd_service_response_t *responses;
+};
+
+srvd_service_batch_t *srvd_service_batch_allocate(void);
+void srvd_service_batch_free(srvd_service_batch_t *);
+srvd_boolean_t srvd_service_batch_initialize(srvd_service_batch_t *, srvd_protocol_type_t);
+srvd_boolean_t srvd_service_batch_finalize(srvd_service_batch_t *);
+srvd_boolean_t srvd_service_batch_key_add(srvd_service_batch_t *, uint16_t, const void *);
+srvd_boolean_t srvd_service_batch_query(srvd_service_batch_t *);
+srvd_boolean_t srvd_service_batch_response_get(const srvd_service_batch_t *, uint16_t,
+                                               const srvd_service_response_t **);
+
+static inline
+srvd_boolean_t srvd_service_batch_key_add_uint32(srvd_service_batch_t *batch, uint32_t key) {
+  uint32_t v = htonl(key);
+  return srvd_service_batch_key_add(batch, sizeof(uint32_t), &v);
+}
+
+static inline
+srvd_boolean_t srvd_service_batch_key_add_string(srvd_service_batch_t *batch, const char *key) {
+  return srvd_service_batch_key_add(batch, (uint16_t)(strlen(key) + 1), key);
+}
+
 #endif
@@ -13,26 +13,28 @@
 #include <srvd/srvd.h>
 #include <srvd/protocol.h>
 #include <srvd/service.h>
+#include <srvd/service/schema.h>
 
 #define SRVD_SERVICE_NSS_ALIASES_REQUEST_NAME ((srvd_protocol_type_t)101)
 #define SRVD_SERVICE_NSS_ALIASES_REQUEST_ENTITIES ((srvd_protocol_type_t)102)
 
-srvd_boolean_t srvd_service_nss_aliases_request_name_get(const srvd_service_request_t *,
-                                                         char **);
-srvd_boolean_t srvd_service_nss_aliases_request_name_free(const srvd_service_request_t *,
-                                                          char **);
-srvd_boolean_t srvd_service_nss_aliases_request_entities_get(const srvd_service_request_t *,
-                                                             int32_t *);
+#define SRVD_SERVICE_NSS_ALIASES_REQUEST_SCHEMA(F)                      \
+  F(nss_aliases, name, SRVD_SERVICE_NSS_ALIASES_REQUEST_NAME, string, char *) \
+  F(nss_aliases, entities, SRVD_SERVICE_NSS_ALIASES_REQUEST_ENTITIES, uint32, int32_t)
+
+SRVD_SERVICE_NSS_ALIASES_REQUEST_SCHEMA(SRVD_SERVICE_SCHEMA_REQUEST_DECLARE)
 
 #define SRVD_SERVICE_NSS_ALIASES_RESPONSE_NAME ((srvd_protocol_type_t)151)
 #define SRVD_SERVICE_NSS_ALIASES_RESPONSE_MEMBERS ((srvd_protocol_type_t)152)
 #define SRVD_SERVICE_NSS_ALIASES_RESPONSE_LOCAL ((srvd_protocol_type_t)153)
 
-srvd_boolean_t srvd_service_nss_aliases_response_name_set(srvd_service_response_t *,
-                                                          const char *, size_t);
-srvd_boolean_t srvd_service_nss_aliases_response_member_add(srvd_service_response_t *,
-                                                            const char *, size_t);
-srvd_boolean_t srvd_service_nss_aliases_response_local_set(srvd_service_response_t *,
-                                                           srvd_boolean_t);
+#define SRVD_SERVICE_NSS_ALIASES_RESPONSE_SCHEMA(F)                     \
+  F(nss_aliases, name, SRVD_SERVICE_NSS_ALIASES_RESPONSE_NAME, string, char *) \
+  F(nss_aliases, member, SRVD_SERVICE_NSS_ALIASES_RESPONSE_MEMBERS, string_list, char *) \
+  F(nss_aliases, local, SRVD_SERVICE_NSS_ALIASES_RESPONSE_LOCAL, boolean, srvd_boolean_t)
+
+SRVD_SERVICE_NSS_ALIASES_RESPONSE_SCHEMA(SRVD_SERVICE_SCHEMA_RESPONSE_DECLARE)
+
+SRVD_SERVICE_SCHEMA_VALIDATE_DECLARE(nss_aliases)
 
 #endif
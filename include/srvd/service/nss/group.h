@@ -0,0 +1,89 @@
+/* group.h: Support for the group database.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_SERVICE_NSS_GROUP_H
+#define _SRVD_SERVICE_NSS_GROUP_H
+
+#include <srvd/srvd.h>
+#include <srvd/protocol.h>
+#include <srvd/service.h>
+#include <srvd/service/schema.h>
+
+#define SRVD_SERVICE_NSS_GROUP_REQUEST_NAME ((srvd_protocol_type_t)301)
+#define SRVD_SERVICE_NSS_GROUP_REQUEST_GID ((srvd_protocol_type_t)302)
+#define SRVD_SERVICE_NSS_GROUP_REQUEST_ENTITIES ((srvd_protocol_type_t)303)
+#define SRVD_SERVICE_NSS_GROUP_REQUEST_INITGROUPS ((srvd_protocol_type_t)304)
+
+#define SRVD_SERVICE_NSS_GROUP_REQUEST_SCHEMA(F)                        \
+  F(nss_group, name, SRVD_SERVICE_NSS_GROUP_REQUEST_NAME, string, char *) \
+  F(nss_group, gid, SRVD_SERVICE_NSS_GROUP_REQUEST_GID, uint32, gid_t)  \
+  F(nss_group, entities, SRVD_SERVICE_NSS_GROUP_REQUEST_ENTITIES, uint32, int32_t) \
+  F(nss_group, initgroups, SRVD_SERVICE_NSS_GROUP_REQUEST_INITGROUPS, string, char *)
+
+SRVD_SERVICE_NSS_GROUP_REQUEST_SCHEMA(SRVD_SERVICE_SCHEMA_REQUEST_DECLARE)
+
+#define SRVD_SERVICE_NSS_GROUP_RESPONSE_NAME ((srvd_protocol_type_t)351)
+#define SRVD_SERVICE_NSS_GROUP_RESPONSE_PASSWD ((srvd_protocol_type_t)352)
+#define SRVD_SERVICE_NSS_GROUP_RESPONSE_GID ((srvd_protocol_type_t)353)
+#define SRVD_SERVICE_NSS_GROUP_RESPONSE_MEMBERS ((srvd_protocol_type_t)354)
+
+/* The response to an INITGROUPS request is a single field containing every
+ * group ID the user is a member of. */
+#define SRVD_SERVICE_NSS_GROUP_RESPONSE_GIDS ((srvd_protocol_type_t)355)
+
+#define SRVD_SERVICE_NSS_GROUP_RESPONSE_SCHEMA(F)                       \
+  F(nss_group, name, SRVD_SERVICE_NSS_GROUP_RESPONSE_NAME, string, char *) \
+  F(nss_group, passwd, SRVD_SERVICE_NSS_GROUP_RESPONSE_PASSWD, string, char *) \
+  F(nss_group, gid, SRVD_SERVICE_NSS_GROUP_RESPONSE_GID, uint32, gid_t) \
+  F(nss_group, member, SRVD_SERVICE_NSS_GROUP_RESPONSE_MEMBERS, string_list, char *) \
+  F(nss_group, gids, SRVD_SERVICE_NSS_GROUP_RESPONSE_GIDS, uint32_list, gid_t)
+
+SRVD_SERVICE_NSS_GROUP_RESPONSE_SCHEMA(SRVD_SERVICE_SCHEMA_RESPONSE_DECLARE)
+
+SRVD_SERVICE_SCHEMA_VALIDATE_DECLARE(nss_group)
+
+/* Membership index.
+ *
+ * Answering an INITGROUPS request by scanning every group is exactly the
+ * problem we're trying to get rid of on the client side, so servers can build
+ * an index of the groups each user belongs to when they load their data. The
+ * index isn't synchronized; build it before serving requests (or swap between
+ * two of them) and only read from it afterward. */
+
+typedef struct srvd_service_nss_group_index srvd_service_nss_group_index_t;
+typedef struct srvd_service_nss_group_index_node srvd_service_nss_group_index_node_t;
+
+struct srvd_service_nss_group_index_node {
+  char *user;
+  size_t gid_count, gid_capacity;
+  gid_t *gids;
+  srvd_service_nss_group_index_node_t *next;
+};
+
+struct srvd_service_nss_group_index {
+  size_t bucket_count;
+  srvd_service_nss_group_index_node_t **buckets;
+};
+
+srvd_service_nss_group_index_t *srvd_service_nss_group_index_allocate(void);
+void srvd_service_nss_group_index_free(srvd_service_nss_group_index_t *);
+srvd_boolean_t srvd_service_nss_group_index_initialize(srvd_service_nss_group_index_t *, size_t);
+srvd_boolean_t srvd_service_nss_group_index_finalize(srvd_service_nss_group_index_t *);
+srvd_boolean_t srvd_service_nss_group_index_add(srvd_service_nss_group_index_t *,
+                                                const char *, gid_t);
+srvd_boolean_t srvd_service_nss_group_index_get(const srvd_service_nss_group_index_t *,
+                                                const char *, const gid_t **, size_t *);
+
+/* Fills in a response to an INITGROUPS request from the index, setting the
+ * response status appropriately. */
+srvd_boolean_t srvd_service_nss_group_index_respond(const srvd_service_nss_group_index_t *,
+                                                    const srvd_service_request_t *,
+                                                    srvd_service_response_t *);
+
+#endif
@@ -13,19 +13,18 @@
 #include <srvd/srvd.h>
 #include <srvd/protocol.h>
 #include <srvd/service.h>
+#include <srvd/service/schema.h>
 
 #define SRVD_SERVICE_NSS_PASSWD_REQUEST_NAME ((srvd_protocol_type_t)701)
 #define SRVD_SERVICE_NSS_PASSWD_REQUEST_UID ((srvd_protocol_type_t)702)
 #define SRVD_SERVICE_NSS_PASSWD_REQUEST_ENTITIES ((srvd_protocol_type_t)703)
 
-srvd_boolean_t srvd_service_nss_passwd_request_name_get(const srvd_service_request_t *,
-                                                        char **);
-srvd_boolean_t srvd_service_nss_passwd_request_name_free(const srvd_service_request_t *,
-                                                         char **);
-srvd_boolean_t srvd_service_nss_passwd_request_uid_get(const srvd_service_request_t *,
-                                                       uid_t *);
-srvd_boolean_t srvd_service_nss_passwd_request_entities_get(const srvd_service_request_t *,
-                                                            int32_t *);
+#define SRVD_SERVICE_NSS_PASSWD_REQUEST_SCHEMA(F)                       \
+  F(nss_passwd, name, SRVD_SERVICE_NSS_PASSWD_REQUEST_NAME, string, char *) \
+  F(nss_passwd, uid, SRVD_SERVICE_NSS_PASSWD_REQUEST_UID, uint32, uid_t) \
+  F(nss_passwd, entities, SRVD_SERVICE_NSS_PASSWD_REQUEST_ENTITIES, uint32, int32_t)
+
+SRVD_SERVICE_NSS_PASSWD_REQUEST_SCHEMA(SRVD_SERVICE_SCHEMA_REQUEST_DECLARE)
 
 #define SRVD_SERVICE_NSS_PASSWD_RESPONSE_NAME ((srvd_protocol_type_t)751)
 #define SRVD_SERVICE_NSS_PASSWD_RESPONSE_UID ((srvd_protocol_type_t)752)
@@ -34,15 +33,16 @@ srvd_boolean_t srvd_service_nss_passwd_request_entities_get(const srvd_service_r
 #define SRVD_SERVICE_NSS_PASSWD_RESPONSE_SHELL ((srvd_protocol_type_t)755)
 #define SRVD_SERVICE_NSS_PASSWD_RESPONSE_GECOS ((srvd_protocol_type_t)756)
 
-srvd_boolean_t srvd_service_nss_passwd_response_name_set(srvd_service_response_t *,
-                                                         const char *, size_t);
-srvd_boolean_t srvd_service_nss_passwd_response_uid_set(srvd_service_response_t *, uid_t);
-srvd_boolean_t srvd_service_nss_passwd_response_gid_set(srvd_service_response_t *, gid_t);
-srvd_boolean_t srvd_service_nss_passwd_response_dir_set(srvd_service_response_t *,
-                                                        const char *, size_t);
-srvd_boolean_t srvd_service_nss_passwd_response_shell_set(srvd_service_response_t *,
-                                                          const char *, size_t);
-srvd_boolean_t srvd_service_nss_passwd_response_gecos_set(srvd_service_response_t *,
-                                                          const char *, size_t);
+#define SRVD_SERVICE_NSS_PASSWD_RESPONSE_SCHEMA(F)                      \
+  F(nss_passwd, name, SRVD_SERVICE_NSS_PASSWD_RESPONSE_NAME, string, char *) \
+  F(nss_passwd, uid, SRVD_SERVICE_NSS_PASSWD_RESPONSE_UID, uint32, uid_t) \
+  F(nss_passwd, gid, SRVD_SERVICE_NSS_PASSWD_RESPONSE_GID, uint32, gid_t) \
+  F(nss_passwd, dir, SRVD_SERVICE_NSS_PASSWD_RESPONSE_DIR, string, char *) \
+  F(nss_passwd, shell, SRVD_SERVICE_NSS_PASSWD_RESPONSE_SHELL, string, char *) \
+  F(nss_passwd, gecos, SRVD_SERVICE_NSS_PASSWD_RESPONSE_GECOS, string, char *)
+
+SRVD_SERVICE_NSS_PASSWD_RESPONSE_SCHEMA(SRVD_SERVICE_SCHEMA_RESPONSE_DECLARE)
+
+SRVD_SERVICE_SCHEMA_VALIDATE_DECLARE(nss_passwd)
 
 #endif
@@ -0,0 +1,250 @@
+/* schema.h: Declarative descriptions of service databases.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_SERVICE_SCHEMA_H
+#define _SRVD_SERVICE_SCHEMA_H
+
+/* A database describes its requests and its responses as lists of fields,
+ * written as X-macros that apply F to each of them:
+ *
+ *   F(database, name, type, kind, value_type)
+ *
+ * and the macros below turn those lists into the accessors for each field and
+ * a validator for each direction. The kind of a field decides what it holds
+ * and what accessors it gets:
+ *
+ *   string       a single NUL-terminated string: _get()/_free() on requests,
+ *                _set() on responses
+ *   uint32       a single integer, handed around as value_type: _get() on
+ *                requests, _set() on responses
+ *   boolean      a single byte: _set() on responses
+ *   string_list  any number of strings: _add() on responses
+ *   uint32_list  any number of integers, as value_type: _add() on responses
+ *
+ * Request accessors only look at the first field, since that's the only one
+ * servers dispatch on. Validators check that every field of a type they know
+ * about is well-formed for its kind and ignore the rest. */
+
+#include <srvd/srvd.h>
+#include <srvd/protocol.h>
+#include <srvd/protocol/packet.h>
+#include <srvd/service.h>
+
+/* What the generated accessors are made of. */
+srvd_boolean_t srvd_service_schema_request_string_get(const srvd_service_request_t *,
+                                                      srvd_protocol_type_t, const char *caller,
+                                                      char **);
+srvd_boolean_t srvd_service_schema_request_string_free(const srvd_service_request_t *, char **);
+srvd_boolean_t srvd_service_schema_request_uint32_get(const srvd_service_request_t *,
+                                                      srvd_protocol_type_t, const char *caller,
+                                                      uint32_t *);
+srvd_boolean_t srvd_service_schema_response_entry_add(srvd_service_response_t *,
+                                                      srvd_protocol_type_t, const char *caller,
+                                                      uint32_t, const void *);
+
+static inline srvd_boolean_t
+srvd_service_schema_entry_valid_string(const srvd_protocol_packet_field_entry_t *entry) {
+  return entry->size > 0 && memchr(entry->data, '\0', entry->size) != NULL;
+}
+
+static inline srvd_boolean_t
+srvd_service_schema_entry_valid_uint32(const srvd_protocol_packet_field_entry_t *entry) {
+  return entry->size == sizeof(uint32_t);
+}
+
+static inline srvd_boolean_t
+srvd_service_schema_entry_valid_boolean(const srvd_protocol_packet_field_entry_t *entry) {
+  return entry->size == sizeof(uint8_t);
+}
+
+#define SRVD_SERVICE_SCHEMA_FIELD_VALID_SINGLE(field, kind)             \
+  ((field)->entry_count == 1 &&                                         \
+   srvd_service_schema_entry_valid_##kind((field)->entry_head))
+
+static inline srvd_boolean_t srvd_service_schema_field_valid_list(const srvd_protocol_packet_field_t *field,
+                                                                  srvd_boolean_t (*valid)(const srvd_protocol_packet_field_entry_t *)) {
+  const srvd_protocol_packet_field_entry_t *entry;
+
+  SRVD_PROTOCOL_PACKET_FIELD_ENTRY_ITERATE(field, entry) {
+    if(!valid(entry))
+      return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+#define SRVD_SERVICE_SCHEMA_FIELD_VALID_string(field)   \
+  SRVD_SERVICE_SCHEMA_FIELD_VALID_SINGLE(field, string)
+#define SRVD_SERVICE_SCHEMA_FIELD_VALID_uint32(field)   \
+  SRVD_SERVICE_SCHEMA_FIELD_VALID_SINGLE(field, uint32)
+#define SRVD_SERVICE_SCHEMA_FIELD_VALID_boolean(field)  \
+  SRVD_SERVICE_SCHEMA_FIELD_VALID_SINGLE(field, boolean)
+#define SRVD_SERVICE_SCHEMA_FIELD_VALID_string_list(field)              \
+  srvd_service_schema_field_valid_list(field, srvd_service_schema_entry_valid_string)
+#define SRVD_SERVICE_SCHEMA_FIELD_VALID_uint32_list(field)              \
+  srvd_service_schema_field_valid_list(field, srvd_service_schema_entry_valid_uint32)
+
+/* Declarations, for the database's header. */
+
+#define SRVD_SERVICE_SCHEMA_REQUEST_DECLARE(database, name, type, kind, value_type) \
+  SRVD_SERVICE_SCHEMA_REQUEST_DECLARE_##kind(database, name, value_type)
+
+#define SRVD_SERVICE_SCHEMA_REQUEST_DECLARE_string(database, name, value_type) \
+  srvd_boolean_t srvd_service_##database##_request_##name##_get(const srvd_service_request_t *, \
+                                                                char **); \
+  srvd_boolean_t srvd_service_##database##_request_##name##_free(const srvd_service_request_t *, \
+                                                                 char **);
+
+#define SRVD_SERVICE_SCHEMA_REQUEST_DECLARE_uint32(database, name, value_type) \
+  srvd_boolean_t srvd_service_##database##_request_##name##_get(const srvd_service_request_t *, \
+                                                                value_type *);
+
+#define SRVD_SERVICE_SCHEMA_RESPONSE_DECLARE(database, name, type, kind, value_type) \
+  SRVD_SERVICE_SCHEMA_RESPONSE_DECLARE_##kind(database, name, value_type)
+
+#define SRVD_SERVICE_SCHEMA_RESPONSE_DECLARE_string(database, name, value_type) \
+  srvd_boolean_t srvd_service_##database##_response_##name##_set(srvd_service_response_t *, \
+                                                                 const char *, size_t);
+
+#define SRVD_SERVICE_SCHEMA_RESPONSE_DECLARE_uint32(database, name, value_type) \
+  srvd_boolean_t srvd_service_##database##_response_##name##_set(srvd_service_response_t *, \
+                                                                 value_type);
+
+#define SRVD_SERVICE_SCHEMA_RESPONSE_DECLARE_boolean(database, name, value_type) \
+  srvd_boolean_t srvd_service_##database##_response_##name##_set(srvd_service_response_t *, \
+                                                                 srvd_boolean_t);
+
+#define SRVD_SERVICE_SCHEMA_RESPONSE_DECLARE_string_list(database, name, value_type) \
+  srvd_boolean_t srvd_service_##database##_response_##name##_add(srvd_service_response_t *, \
+                                                                 const char *, size_t);
+
+#define SRVD_SERVICE_SCHEMA_RESPONSE_DECLARE_uint32_list(database, name, value_type) \
+  srvd_boolean_t srvd_service_##database##_response_##name##_add(srvd_service_response_t *, \
+                                                                 value_type);
+
+#define SRVD_SERVICE_SCHEMA_VALIDATE_DECLARE(database)                  \
+  srvd_boolean_t srvd_service_##database##_request_validate(const srvd_service_request_t *); \
+  srvd_boolean_t srvd_service_##database##_response_validate(const srvd_service_response_t *);
+
+/* Definitions, for the database's source file. */
+
+#define SRVD_SERVICE_SCHEMA_REQUEST_DEFINE(database, name, type, kind, value_type) \
+  SRVD_SERVICE_SCHEMA_REQUEST_DEFINE_##kind(database, name, type, value_type)
+
+#define SRVD_SERVICE_SCHEMA_REQUEST_DEFINE_string(database, name, type, value_type) \
+  srvd_boolean_t srvd_service_##database##_request_##name##_get(const srvd_service_request_t *request, \
+                                                                char **value) { \
+    return srvd_service_schema_request_string_get(request, (type), __func__, value); \
+  }                                                                     \
+                                                                        \
+  srvd_boolean_t srvd_service_##database##_request_##name##_free(const srvd_service_request_t *request, \
+                                                                 char **value) { \
+    return srvd_service_schema_request_string_free(request, value);     \
+  }
+
+#define SRVD_SERVICE_SCHEMA_REQUEST_DEFINE_uint32(database, name, type, value_type) \
+  srvd_boolean_t srvd_service_##database##_request_##name##_get(const srvd_service_request_t *request, \
+                                                                value_type *value) { \
+    uint32_t v;                                                         \
+                                                                        \
+    SRVD_RETURN_FALSE_UNLESS(value);                                    \
+                                                                        \
+    if(!srvd_service_schema_request_uint32_get(request, (type), __func__, &v)) \
+      return SRVD_FALSE;                                                \
+                                                                        \
+    *value = (value_type)v;                                             \
+    return SRVD_TRUE;                                                   \
+  }
+
+#define SRVD_SERVICE_SCHEMA_RESPONSE_DEFINE(database, name, type, kind, value_type) \
+  SRVD_SERVICE_SCHEMA_RESPONSE_DEFINE_##kind(database, name, type, value_type)
+
+#define SRVD_SERVICE_SCHEMA_RESPONSE_DEFINE_string(database, name, type, value_type) \
+  srvd_boolean_t srvd_service_##database##_response_##name##_set(srvd_service_response_t *response, \
+                                                                 const char *value, size_t length) { \
+    SRVD_RETURN_FALSE_UNLESS(response);                                 \
+    SRVD_RETURN_FALSE_UNLESS(value);                                    \
+                                                                        \
+    return srvd_protocol_packet_field_append(&response->packet, (type), (uint32_t)length, value); \
+  }
+
+#define SRVD_SERVICE_SCHEMA_RESPONSE_DEFINE_uint32(database, name, type, value_type) \
+  srvd_boolean_t srvd_service_##database##_response_##name##_set(srvd_service_response_t *response, \
+                                                                 value_type value) { \
+    SRVD_RETURN_FALSE_UNLESS(response);                                 \
+                                                                        \
+    return srvd_protocol_packet_field_append_uint32(&response->packet, (type), (uint32_t)value); \
+  }
+
+#define SRVD_SERVICE_SCHEMA_RESPONSE_DEFINE_boolean(database, name, type, value_type) \
+  srvd_boolean_t srvd_service_##database##_response_##name##_set(srvd_service_response_t *response, \
+                                                                 srvd_boolean_t value) { \
+    SRVD_RETURN_FALSE_UNLESS(response);                                 \
+                                                                        \
+    return srvd_protocol_packet_field_append_uint8(&response->packet, (type), (uint8_t)value); \
+  }
+
+#define SRVD_SERVICE_SCHEMA_RESPONSE_DEFINE_string_list(database, name, type, value_type) \
+  srvd_boolean_t srvd_service_##database##_response_##name##_add(srvd_service_response_t *response, \
+                                                                 const char *value, size_t length) { \
+    SRVD_RETURN_FALSE_UNLESS(value);                                    \
+                                                                        \
+    return srvd_service_schema_response_entry_add(response, (type), __func__, (uint32_t)length, \
+                                                  value);               \
+  }
+
+#define SRVD_SERVICE_SCHEMA_RESPONSE_DEFINE_uint32_list(database, name, type, value_type) \
+  srvd_boolean_t srvd_service_##database##_response_##name##_add(srvd_service_response_t *response, \
+                                                                 value_type value) { \
+    uint32_t v = htonl((uint32_t)value);                                \
+                                                                        \
+    return srvd_service_schema_response_entry_add(response, (type), __func__, sizeof(uint32_t), \
+                                                  &v);                  \
+  }
+
+#define SRVD_SERVICE_SCHEMA_VALIDATE_CASE(database, name, type, kind, value_type) \
+  case (type):                                                          \
+    if(!SRVD_SERVICE_SCHEMA_FIELD_VALID_##kind(field))                  \
+      return SRVD_FALSE;                                                \
+    break;
+
+#define SRVD_SERVICE_SCHEMA_VALIDATE_DEFINE(database, request_schema, response_schema) \
+  srvd_boolean_t srvd_service_##database##_request_validate(const srvd_service_request_t *request) { \
+    const srvd_protocol_packet_field_t *field;                          \
+                                                                        \
+    SRVD_RETURN_FALSE_UNLESS(request);                                  \
+    SRVD_RETURN_FALSE_UNLESS(request->packet.field_head);               \
+                                                                        \
+    field = request->packet.field_head;                                 \
+    switch(field->type) {                                               \
+      request_schema(SRVD_SERVICE_SCHEMA_VALIDATE_CASE)                 \
+    default:                                                            \
+      return SRVD_FALSE;                                                \
+    }                                                                   \
+                                                                        \
+    return SRVD_TRUE;                                                   \
+  }                                                                     \
+                                                                        \
+  srvd_boolean_t srvd_service_##database##_response_validate(const srvd_service_response_t *response) { \
+    const srvd_protocol_packet_field_t *field;                          \
+                                                                        \
+    SRVD_RETURN_FALSE_UNLESS(response);                                 \
+                                                                        \
+    SRVD_PROTOCOL_PACKET_FIELD_ITERATE(&response->packet, field) {      \
+      switch(field->type) {                                             \
+        response_schema(SRVD_SERVICE_SCHEMA_VALIDATE_CASE)              \
+      default:                                                          \
+        break;                                                          \
+      }                                                                 \
+    }                                                                   \
+                                                                        \
+    return SRVD_TRUE;                                                   \
+  }
+
+#endif
@@ -0,0 +1,129 @@
+/* shm.h: Shared memory rings.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_SHM_H
+#define _SRVD_SHM_H
+
+/* The shared memory transport (see <srvd/client/shm.h>) moves packets between
+ * a client and the server through a region of memory they both map. The region
+ * holds two rings, one for requests and one for responses, each with exactly
+ * one producer and one consumer.
+ *
+ * Records in a ring are a length followed by a serialized packet, padded so
+ * each record starts on an 8-byte boundary. A record never wraps around the
+ * end of the ring; if there isn't enough room left before the end, the
+ * producer writes a wrap marker and starts over at the beginning. A packet
+ * too big for the ring is sent over the socket instead, with a socket marker
+ * in the ring to keep everything in order.
+ *
+ * Neither side makes a system call unless it has to wait: a consumer that
+ * finds the ring empty says so in the ring and sleeps on a futex, and a
+ * producer only wakes it up if it said it was sleeping (and similarly for a
+ * producer waiting for space).
+ *
+ * This is only available on Linux; elsewhere, every operation fails with
+ * ENOSYS. */
+
+#include <srvd/srvd.h>
+
+#define SRVD_SHM_MAGIC ((uint32_t)0x5352564d)
+#define SRVD_SHM_VERSION ((uint32_t)1)
+
+#define SRVD_SHM_RING_SIZE_DEFAULT ((uint32_t)65536)
+#define SRVD_SHM_RING_SIZE_MINIMUM ((uint32_t)4096)
+#define SRVD_SHM_RING_SIZE_MAXIMUM ((uint32_t)(1 << 30))
+
+#define SRVD_SHM_RECORD_HEADER_SIZE 8
+#define SRVD_SHM_RECORD_ALIGNMENT 8
+
+/* Special record lengths. */
+#define SRVD_SHM_RECORD_WRAP ((uint32_t)0xffffffff)
+#define SRVD_SHM_RECORD_SOCKET ((uint32_t)0xfffffffe)
+
+typedef struct srvd_shm srvd_shm_t;
+typedef struct srvd_shm_ring srvd_shm_ring_t;
+typedef struct srvd_shm_region srvd_shm_region_t;
+
+/* The producer and consumer halves are kept on separate cache lines so the two
+ * sides don't fight over them. Head and tail are byte counts that are allowed
+ * to overflow; the ring size is a power of two, so they stay consistent. */
+struct srvd_shm_ring {
+  volatile uint32_t head;
+  volatile uint32_t head_sequence;
+  volatile uint32_t consumer_waiting;
+  uint32_t producer_padding[13];
+
+  volatile uint32_t tail;
+  volatile uint32_t tail_sequence;
+  volatile uint32_t producer_waiting;
+  uint32_t consumer_padding[13];
+};
+
+/* The region is followed immediately by the request ring's data and then the
+ * response ring's data. */
+struct srvd_shm_region {
+  uint32_t magic, version, ring_size;
+  volatile uint32_t closed;
+  uint32_t padding[12];
+
+  srvd_shm_ring_t requests, responses;
+};
+
+/* Each side's own view of a mapped region. Everything in here is checked once,
+ * when the region is mapped, and never read back from shared memory, so the
+ * other side can't change it out from under us. */
+struct srvd_shm {
+  srvd_shm_region_t *region;
+  size_t size;
+  uint32_t ring_size;
+  char *requests_data, *responses_data;
+};
+
+size_t srvd_shm_region_size(uint32_t);
+
+/* Creates a new region with rings of the given size (a power of two between
+ * SRVD_SHM_RING_SIZE_MINIMUM and SRVD_SHM_RING_SIZE_MAXIMUM) and maps it,
+ * returning a file descriptor for it that can be passed to another process.
+ * The region's size is sealed, so it can't be changed afterward. */
+srvd_boolean_t srvd_shm_create(srvd_shm_t *, uint32_t, int *);
+
+/* Maps a region created by someone else, checking that it's sane first
+ * (including that its size is sealed). The descriptor can be closed
+ * afterward. */
+srvd_boolean_t srvd_shm_map(srvd_shm_t *, int);
+srvd_boolean_t srvd_shm_unmap(srvd_shm_t *);
+
+/* The longest record a ring will take. Limiting records to half the ring
+ * means one always fits once the ring is empty, even if it has to wrap. */
+static inline uint32_t srvd_shm_record_maximum(const srvd_shm_t *shm) {
+  return shm->ring_size / 2 - SRVD_SHM_RECORD_HEADER_SIZE;
+}
+
+/* Marks the region closed and wakes up anyone waiting on it. */
+void srvd_shm_close(srvd_shm_t *);
+
+/* Producer side. Reserving waits (for up to the given number of milliseconds,
+ * or forever if -1) until there's room for a record of the given length and
+ * returns a pointer to where its data should go; publishing makes it visible
+ * to the consumer. Reserving fails with EMSGSIZE if the record could never
+ * fit, with ETIMEDOUT if time runs out, and with EPIPE if the region has been
+ * closed. */
+srvd_boolean_t srvd_shm_ring_reserve(const srvd_shm_t *, srvd_shm_ring_t *, char *, uint32_t,
+                                     int, char **);
+void srvd_shm_ring_publish(const srvd_shm_t *, srvd_shm_ring_t *, char *, uint32_t);
+
+/* Consumer side. Peeking waits for the next record and returns its data and
+ * length (which may be SRVD_SHM_RECORD_SOCKET); releasing frees it up for the
+ * producer. Peeking fails like reserving does, and with EPROTO if the ring
+ * doesn't make sense. */
+srvd_boolean_t srvd_shm_ring_peek(const srvd_shm_t *, srvd_shm_ring_t *, char *, int, char **,
+                                  uint32_t *);
+void srvd_shm_ring_release(const srvd_shm_t *, srvd_shm_ring_t *, uint32_t);
+
+#endif
@@ -0,0 +1,186 @@
+/* stats.h: Server statistics.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_STATS_H
+#define _SRVD_STATS_H
+
+/* Every server keeps counters and latency histograms for each protocol type it
+ * answers. Clients can ask for them by sending a request whose first field is
+ * an empty SRVD_PROTOCOL_STATS field (see the srvd-stat command).
+ *
+ * Recording a request mustn't slow it down, so each thread that serves
+ * requests claims a slot of its own and is the only one that ever writes to
+ * it; nothing is locked or shared on the way through. Reading sums all the
+ * slots. Threads that can't get a slot of their own (because there are more of
+ * them than slots) share the first slot, with a lock.
+ *
+ * All of the slots live in a single block of memory with no pointers in it,
+ * which a server can publish as a file (see srvd_stats_publish()) so that
+ * monitoring tools can map it and read it as often as they like without
+ * sending the server anything. Each set of counters in a slot has a sequence
+ * number that its writer makes odd while it's updating them and even again
+ * once it's done, so readers can tell when they've caught it halfway and try
+ * again.
+ *
+ * Histograms have four buckets for each power of two, so any value they
+ * report is within 25% of the real one. Times are in microseconds. */
+
+#include <srvd/srvd.h>
+#include <srvd/protocol.h>
+#include <srvd/service.h>
+#include <srvd/thread.h>
+
+/* How many distinct protocol types we keep track of. Requests of any other
+ * type are counted together, and reported as SRVD_PROTOCOL_NONE. */
+#define SRVD_STATS_TYPE_MAXIMUM 16
+
+#define SRVD_STATS_SLOT_COUNT_DEFAULT 16
+
+#define SRVD_STATS_MAGIC ((uint32_t)0x53525653)
+#define SRVD_STATS_VERSION ((uint32_t)1)
+
+/* Responses are counted by status: one for each of the known response codes,
+ * and one for everything else. */
+#define SRVD_STATS_STATUS_COUNT 5
+
+#define SRVD_STATS_HISTOGRAM_SUB_BUCKET_BITS 2
+#define SRVD_STATS_HISTOGRAM_BUCKET_COUNT 112
+
+typedef struct srvd_stats srvd_stats_t;
+typedef struct srvd_stats_block srvd_stats_block_t;
+typedef struct srvd_stats_slot srvd_stats_slot_t;
+typedef struct srvd_stats_claim srvd_stats_claim_t;
+typedef struct srvd_stats_counters srvd_stats_counters_t;
+typedef struct srvd_stats_histogram srvd_stats_histogram_t;
+typedef struct srvd_stats_sample srvd_stats_sample_t;
+typedef struct srvd_stats_snapshot srvd_stats_snapshot_t;
+
+struct srvd_stats_histogram {
+  uint64_t buckets[SRVD_STATS_HISTOGRAM_BUCKET_COUNT];
+};
+
+/* Errors are requests we couldn't answer at all (because they were malformed,
+ * or the response couldn't be sent). Queue wait is the time from when we
+ * noticed a request until it was dispatched, and serialization time includes
+ * sending the response. */
+struct srvd_stats_counters {
+  uint64_t requests, errors;
+  uint64_t statuses[SRVD_STATS_STATUS_COUNT];
+  uint64_t bytes_in, bytes_out;
+  srvd_stats_histogram_t queue_wait, handler, serialization;
+};
+
+/* The last entry is for types that didn't fit in the type table. */
+struct srvd_stats_slot {
+  volatile uint32_t sequences[SRVD_STATS_TYPE_MAXIMUM + 1];
+  srvd_stats_counters_t types[SRVD_STATS_TYPE_MAXIMUM + 1];
+};
+
+/* Types are added to the table in the order they're first seen and never
+ * removed; the count is only updated once the type is in place. The block is
+ * only ever read by programs built against the same version of this file, so
+ * everything is in host byte order. */
+struct srvd_stats_block {
+  uint32_t magic, version;
+  uint64_t size;
+  uint32_t slot_count;
+  volatile uint32_t type_count;
+  srvd_protocol_type_t types[SRVD_STATS_TYPE_MAXIMUM];
+  uint64_t started;
+  srvd_stats_slot_t slots[];
+};
+
+struct srvd_stats_claim {
+  srvd_stats_t *stats;
+  srvd_stats_slot_t *slot;
+  srvd_boolean_t claimed;
+};
+
+/* A statistics object either owns its block (which may be published) or has
+ * mapped someone else's, in which case it has no claims and can only be
+ * read. */
+struct srvd_stats {
+  srvd_stats_block_t *block;
+  size_t size;
+  srvd_boolean_t mapped;
+  srvd_stats_claim_t *claims;
+  SRVD_THREAD_KEY_DECLARE(key);
+  SRVD_THREAD_MUTEX_DECLARE_UNINITIALIZED(lock);
+};
+
+srvd_stats_t *srvd_stats_allocate(void);
+void srvd_stats_free(srvd_stats_t *);
+srvd_boolean_t srvd_stats_initialize(srvd_stats_t *, uint32_t);
+srvd_boolean_t srvd_stats_finalize(srvd_stats_t *);
+
+/* Moves the block into a file at the given path (replacing whatever was
+ * there) that stays up to date for as long as the statistics are around. This
+ * must be done before anything is recorded. */
+srvd_boolean_t srvd_stats_publish(srvd_stats_t *, const char *);
+
+/* Maps a published block for reading. Finalize it to unmap it. */
+srvd_boolean_t srvd_stats_map(srvd_stats_t *, const char *);
+
+/* The current time, in microseconds, for filling in samples. */
+uint64_t srvd_stats_now(void);
+
+/* Everything we learn about a single request. The times are from
+ * srvd_stats_now(): when the request was noticed, when it was dispatched,
+ * when the handler finished, and when the response was sent. */
+struct srvd_stats_sample {
+  srvd_protocol_type_t type;
+  srvd_service_response_code_t status;
+  srvd_boolean_t error;
+  uint64_t bytes_in, bytes_out;
+  uint64_t received, dispatched, handled, sent;
+};
+
+void srvd_stats_sample_initialize(srvd_stats_sample_t *);
+
+/* Fills in the type, status and sizes from a request and its response. */
+void srvd_stats_sample_set_packets(srvd_stats_sample_t *, const srvd_protocol_packet_t *,
+                                   const srvd_protocol_packet_t *);
+
+void srvd_stats_record(srvd_stats_t *, const srvd_stats_sample_t *);
+
+void srvd_stats_histogram_record(srvd_stats_histogram_t *, uint64_t);
+uint64_t srvd_stats_histogram_count(const srvd_stats_histogram_t *);
+
+/* Returns the smallest value that at least the given fraction (between 0 and
+ * 1) of the recorded values are no greater than, or 0 if nothing has been
+ * recorded. */
+uint64_t srvd_stats_histogram_percentile(const srvd_stats_histogram_t *, double);
+
+/* Snapshots.
+ *
+ * A snapshot is the sum of every slot at some point in time, with one set of
+ * counters for each type that has been seen. Snapshots can be sent to clients
+ * in a SRVD_PROTOCOL_STATS field: the first entry is the uptime (as a 64-bit
+ * integer in network byte order), and each entry after that is a type
+ * followed by its counters, in the order they're declared, in the same
+ * format. */
+
+struct srvd_stats_snapshot {
+  uint64_t uptime;
+  uint32_t type_count;
+  srvd_protocol_type_t types[SRVD_STATS_TYPE_MAXIMUM + 1];
+  srvd_stats_counters_t counters[SRVD_STATS_TYPE_MAXIMUM + 1];
+};
+
+srvd_boolean_t srvd_stats_snapshot(srvd_stats_t *, srvd_stats_snapshot_t *);
+
+/* Subtracts an earlier snapshot from a later one, leaving what happened in
+ * between. */
+void srvd_stats_snapshot_subtract(srvd_stats_snapshot_t *, const srvd_stats_snapshot_t *);
+
+srvd_boolean_t srvd_stats_snapshot_pack(const srvd_stats_snapshot_t *, srvd_protocol_packet_t *);
+srvd_boolean_t srvd_stats_snapshot_unpack(const srvd_protocol_packet_t *,
+                                          srvd_stats_snapshot_t *);
+
+#endif
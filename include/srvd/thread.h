@@ -21,6 +21,9 @@
 #define SRVD_THREAD_KEY_INITIALIZE(name)                                \
   (void)pthread_key_create(SRVD_THREAD_KEY_REFERENCE(name), NULL)
 
+#define SRVD_THREAD_KEY_INITIALIZE_DESTRUCTOR(name, destructor)         \
+  (void)pthread_key_create(SRVD_THREAD_KEY_REFERENCE(name), destructor)
+
 #define SRVD_THREAD_KEY_DATA_GET(name)                  \
   pthread_getspecific(name)
 
@@ -54,4 +57,22 @@
 #define SRVD_THREAD_MUTEX_UNLOCK(name)          \
   (void)pthread_mutex_unlock(&(name))
 
+#define SRVD_THREAD_CONDITION_DECLARE(name)                     \
+  pthread_cond_t (name) = PTHREAD_COND_INITIALIZER
+
+#define SRVD_THREAD_CONDITION_DECLARE_UNINITIALIZED(name)       \
+  pthread_cond_t (name)
+
+#define SRVD_THREAD_CONDITION_INITIALIZE(name)  \
+  (void)pthread_cond_init(&(name), NULL)
+
+#define SRVD_THREAD_CONDITION_FINALIZE(name)    \
+  (void)pthread_cond_destroy(&(name))
+
+#define SRVD_THREAD_CONDITION_WAIT(name, mutex)         \
+  (void)pthread_cond_wait(&(name), &(mutex))
+
+#define SRVD_THREAD_CONDITION_BROADCAST(name)   \
+  (void)pthread_cond_broadcast(&(name))
+
 #endif
@@ -0,0 +1,282 @@
+/* capture.c: Request capture logs.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+/* For clock_gettime(). */
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/capture.h>
+#include <srvd/protocol/serial_packet.h>
+#include <srvd/stats.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/* Most requests are much smaller than this, so they don't need to allocate
+ * anything to be recorded. */
+#define _SRVD_CAPTURE_RECORD_BUFFER_SIZE 1024
+
+static char *_srvd_capture_pack_uint32(char *to, uint32_t value) {
+  to[0] = (char)(value >> 24);
+  to[1] = (char)(value >> 16);
+  to[2] = (char)(value >> 8);
+  to[3] = (char)value;
+
+  return to + 4;
+}
+
+static char *_srvd_capture_pack_uint64(char *to, uint64_t value) {
+  to = _srvd_capture_pack_uint32(to, (uint32_t)(value >> 32));
+  return _srvd_capture_pack_uint32(to, (uint32_t)value);
+}
+
+static const char *_srvd_capture_unpack_uint32(const char *from, uint32_t *value) {
+  *value = ((uint32_t)(uint8_t)from[0] << 24) | ((uint32_t)(uint8_t)from[1] << 16) |
+    ((uint32_t)(uint8_t)from[2] << 8) | (uint32_t)(uint8_t)from[3];
+
+  return from + 4;
+}
+
+static const char *_srvd_capture_unpack_uint64(const char *from, uint64_t *value) {
+  uint32_t high, low;
+
+  from = _srvd_capture_unpack_uint32(from, &high);
+  from = _srvd_capture_unpack_uint32(from, &low);
+  *value = ((uint64_t)high << 32) | low;
+
+  return from;
+}
+
+static ssize_t _srvd_capture_write_full(int to, const char *buffer, size_t size) {
+  size_t written = 0;
+
+  while(written < size) {
+    ssize_t result = write(to, buffer + written, size - written);
+    if(result == -1 && errno == EINTR)
+      continue;
+    else if(result <= 0)
+      return -1;
+    written += (size_t)result;
+  }
+
+  return (ssize_t)written;
+}
+
+srvd_capture_t *srvd_capture_allocate(void) {
+  srvd_capture_t *capture = malloc(sizeof(srvd_capture_t));
+  if(capture == NULL)
+    SRVD_LOG_ERROR("srvd_capture_allocate: Unable to allocate memory");
+
+  return capture;
+}
+
+void srvd_capture_free(srvd_capture_t *capture) {
+  SRVD_RETURN_UNLESS(capture);
+
+  free(capture);
+}
+
+srvd_boolean_t srvd_capture_initialize(srvd_capture_t *capture, const char *path) {
+  char header[SRVD_CAPTURE_HEADER_SIZE], *p;
+  struct timespec now;
+
+  SRVD_RETURN_FALSE_UNLESS(capture);
+  SRVD_RETURN_FALSE_UNLESS(path);
+
+  capture->descriptor = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+  if(capture->descriptor == -1) {
+    SRVD_LOG_ERROR("srvd_capture_initialize: Unable to open \"%s\"", path);
+    return SRVD_FALSE;
+  }
+
+  capture->started = srvd_stats_now();
+  if(clock_gettime(CLOCK_REALTIME, &now) == -1)
+    memset(&now, 0, sizeof(now));
+
+  p = _srvd_capture_pack_uint32(header, SRVD_CAPTURE_MAGIC);
+  p = _srvd_capture_pack_uint32(p, SRVD_CAPTURE_VERSION);
+  _srvd_capture_pack_uint64(p, (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000);
+
+  if(_srvd_capture_write_full(capture->descriptor, header, sizeof(header)) == -1) {
+    SRVD_LOG_ERROR("srvd_capture_initialize: Unable to write to \"%s\"", path);
+    close(capture->descriptor);
+    return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_capture_finalize(srvd_capture_t *capture) {
+  SRVD_RETURN_FALSE_UNLESS(capture);
+
+  if(capture->descriptor != -1)
+    close(capture->descriptor);
+  capture->descriptor = -1;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_capture_record(srvd_capture_t *capture, const srvd_protocol_packet_t *packet) {
+  srvd_boolean_t status = SRVD_FALSE;
+  char local[_SRVD_CAPTURE_RECORD_BUFFER_SIZE], *buffer = local, *p;
+  size_t size;
+
+  SRVD_RETURN_FALSE_UNLESS(capture);
+  SRVD_RETURN_FALSE_UNLESS(packet);
+
+  size = srvd_protocol_serial_packet_size(packet);
+  if(size > UINT32_MAX - SRVD_CAPTURE_RECORD_HEADER_SIZE) {
+    SRVD_LOG_ERROR("srvd_capture_record: Request is too large to record");
+    return SRVD_FALSE;
+  }
+
+  if(SRVD_CAPTURE_RECORD_HEADER_SIZE + size > sizeof(local)) {
+    buffer = malloc(SRVD_CAPTURE_RECORD_HEADER_SIZE + size);
+    if(buffer == NULL) {
+      SRVD_LOG_ERROR("srvd_capture_record: Unable to allocate memory for record");
+      return SRVD_FALSE;
+    }
+  }
+
+  p = _srvd_capture_pack_uint64(buffer, srvd_stats_now() - capture->started);
+  p = _srvd_capture_pack_uint32(p, (uint32_t)size);
+
+  if(!srvd_protocol_serial_packet_serialize_into(packet, p, size)) {
+    SRVD_LOG_ERROR("srvd_capture_record: Unable to serialize request");
+    goto _srvd_capture_record_error;
+  }
+
+  if(_srvd_capture_write_full(capture->descriptor, buffer,
+                              SRVD_CAPTURE_RECORD_HEADER_SIZE + size) == -1) {
+    SRVD_LOG_ERROR("srvd_capture_record: Unable to write record");
+    goto _srvd_capture_record_error;
+  }
+
+  status = SRVD_TRUE;
+
+ _srvd_capture_record_error:
+
+  if(buffer != local)
+    free(buffer);
+
+  return status;
+}
+
+srvd_boolean_t srvd_capture_reader_initialize(srvd_capture_reader_t *reader, const char *path) {
+  srvd_boolean_t status = SRVD_FALSE;
+  struct stat info;
+  uint32_t magic, version;
+  const char *p;
+  int descriptor;
+  void *data;
+
+  SRVD_RETURN_FALSE_UNLESS(reader);
+  SRVD_RETURN_FALSE_UNLESS(path);
+
+  reader->data = NULL;
+  reader->size = 0;
+  reader->offset = SRVD_CAPTURE_HEADER_SIZE;
+
+  descriptor = open(path, O_RDONLY);
+  if(descriptor == -1) {
+    SRVD_LOG_ERROR("srvd_capture_reader_initialize: Unable to open \"%s\"", path);
+    return SRVD_FALSE;
+  }
+
+  if(fstat(descriptor, &info) == -1 || (size_t)info.st_size < SRVD_CAPTURE_HEADER_SIZE) {
+    SRVD_LOG_ERROR("srvd_capture_reader_initialize: Capture \"%s\" is too short", path);
+    goto _srvd_capture_reader_initialize_error;
+  }
+
+  data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+  if(data == MAP_FAILED) {
+    SRVD_LOG_ERROR("srvd_capture_reader_initialize: Unable to map capture \"%s\"", path);
+    goto _srvd_capture_reader_initialize_error;
+  }
+
+  p = _srvd_capture_unpack_uint32((const char *)data, &magic);
+  p = _srvd_capture_unpack_uint32(p, &version);
+  _srvd_capture_unpack_uint64(p, &reader->started);
+
+  if(magic != SRVD_CAPTURE_MAGIC || version != SRVD_CAPTURE_VERSION) {
+    SRVD_LOG_ERROR("srvd_capture_reader_initialize: Capture \"%s\" has an invalid header", path);
+    munmap(data, (size_t)info.st_size);
+    goto _srvd_capture_reader_initialize_error;
+  }
+
+  reader->data = (char *)data;
+  reader->size = (size_t)info.st_size;
+
+  status = SRVD_TRUE;
+
+ _srvd_capture_reader_initialize_error:
+
+  close(descriptor);
+
+  return status;
+}
+
+srvd_boolean_t srvd_capture_reader_finalize(srvd_capture_reader_t *reader) {
+  SRVD_RETURN_FALSE_UNLESS(reader);
+
+  if(reader->data)
+    munmap(reader->data, reader->size);
+  reader->data = NULL;
+  reader->size = 0;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_capture_reader_next(srvd_capture_reader_t *reader, uint64_t *received,
+                                        char **request, uint32_t *length) {
+  const char *p;
+
+  SRVD_RETURN_FALSE_UNLESS(reader);
+  SRVD_RETURN_FALSE_UNLESS(reader->data);
+
+  if(reader->size - reader->offset < SRVD_CAPTURE_RECORD_HEADER_SIZE)
+    return SRVD_FALSE;
+
+  p = _srvd_capture_unpack_uint64(reader->data + reader->offset, received);
+  p = _srvd_capture_unpack_uint32(p, length);
+
+  if(reader->size - reader->offset - SRVD_CAPTURE_RECORD_HEADER_SIZE < *length)
+    return SRVD_FALSE;
+
+  *request = reader->data + reader->offset + SRVD_CAPTURE_RECORD_HEADER_SIZE;
+  reader->offset += SRVD_CAPTURE_RECORD_HEADER_SIZE + *length;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_capture_request_unpack(char *request, uint32_t length,
+                                           srvd_protocol_packet_t *packet) {
+  srvd_protocol_serial_packet_t serial;
+
+  SRVD_RETURN_FALSE_UNLESS(request);
+  SRVD_RETURN_FALSE_UNLESS(packet);
+
+  if(length < SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE) {
+    SRVD_LOG_ERROR("srvd_capture_request_unpack: Request is too short");
+    return SRVD_FALSE;
+  }
+
+  srvd_protocol_serial_packet_initialize(&serial);
+  if(!srvd_protocol_serial_packet_unserialize_header(&serial, packet, request))
+    return SRVD_FALSE;
+
+  if(serial.body_size != length - SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE) {
+    SRVD_LOG_ERROR("srvd_capture_request_unpack: Request has the wrong length");
+    return SRVD_FALSE;
+  }
+
+  return srvd_protocol_serial_packet_unserialize_body(&serial, packet,
+                                                     request + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
+}
@@ -7,58 +7,1054 @@
  * this distribution.
  */
 
+/* For clock_gettime(). */
+#define _POSIX_C_SOURCE 200112L
+
+#include "config.h"
+
 #include <srvd/client.h>
+#include <srvd/client/inproc.h>
+#include <srvd/client/shm.h>
+#include <srvd/client/tcp.h>
 #include <srvd/client/unsock.h>
+#include <srvd/protocol/serial_packet.h>
+#include <srvd/service.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#if defined(HAVE_DLFCN_H) && defined(HAVE_DLOPEN)
+# include <dlfcn.h>
+#endif
+
+static void _srvd_client_time_get(struct timespec *now) {
+  if(clock_gettime(CLOCK_MONOTONIC, now) == -1) {
+    now->tv_sec = time(NULL);
+    now->tv_nsec = 0;
+  }
+}
+
+static void _srvd_client_time_add(struct timespec *t, long milliseconds) {
+  t->tv_sec += milliseconds / 1000;
+  t->tv_nsec += (milliseconds % 1000) * 1000000;
+  if(t->tv_nsec >= 1000000000) {
+    t->tv_sec++;
+    t->tv_nsec -= 1000000000;
+  }
+}
+
+static long _srvd_client_time_until(const struct timespec *t) {
+  struct timespec now;
+
+  _srvd_client_time_get(&now);
+
+  return (long)(t->tv_sec - now.tv_sec) * 1000 + (t->tv_nsec - now.tv_nsec) / 1000000;
+}
+
+/* Adapters that come with libsrvd. */
+static const srvd_client_adapter_t _srvd_client_adapters[] = {
+  { "unsock", srvd_client_unsock_allocate, srvd_client_unsock_initialize_by_conf,
+    SRVD_CLIENT_ADAPTER_PIPELINING | SRVD_CLIENT_ADAPTER_SERIAL, NULL },
+  { "shm", srvd_client_shm_allocate, srvd_client_shm_initialize_by_conf,
+    SRVD_CLIENT_ADAPTER_PIPELINING | SRVD_CLIENT_ADAPTER_PERSISTENT | SRVD_CLIENT_ADAPTER_SHM |
+    SRVD_CLIENT_ADAPTER_SERIAL, NULL },
+  { "tcp", srvd_client_tcp_allocate, srvd_client_tcp_initialize_by_conf,
+    SRVD_CLIENT_ADAPTER_PIPELINING | SRVD_CLIENT_ADAPTER_PERSISTENT | SRVD_CLIENT_ADAPTER_REMOTE |
+    SRVD_CLIENT_ADAPTER_SERIAL, NULL },
+  { "inproc", srvd_client_inproc_allocate, srvd_client_inproc_initialize_by_conf,
+    SRVD_CLIENT_ADAPTER_PERSISTENT | SRVD_CLIENT_ADAPTER_SERIAL, NULL },
+  { NULL, NULL, NULL, 0, NULL }
+};
+
+/* Everything here is protected by the registry lock. */
+static SRVD_THREAD_MUTEX_DECLARE(_srvd_client_adapter_lock);
+static srvd_client_adapter_t *_srvd_client_adapter_registered = NULL;
+static unsigned long _srvd_client_adapter_cached_generation = 0;
+static const srvd_client_adapter_t *_srvd_client_adapter_cached = NULL;
+
+static const srvd_client_adapter_t *_srvd_client_adapter_find(const char *name) {
+  const srvd_client_adapter_t *i;
+
+  for(i = _srvd_client_adapter_registered; i != NULL; i = i->next) {
+    if(strcmp(i->name, name) == 0)
+      return i;
+  }
+
+  for(i = _srvd_client_adapters; i->name != NULL; i++) {
+    if(strcmp(i->name, name) == 0)
+      return i;
+  }
+
+  return NULL;
+}
+
+srvd_boolean_t srvd_client_adapter_register(srvd_client_adapter_t *adapter) {
+  SRVD_RETURN_FALSE_UNLESS(adapter);
+  SRVD_RETURN_FALSE_UNLESS(adapter->name);
+  SRVD_RETURN_FALSE_UNLESS(adapter->allocate);
+  SRVD_RETURN_FALSE_UNLESS(adapter->initialize);
+
+  SRVD_THREAD_MUTEX_LOCK(_srvd_client_adapter_lock);
+  adapter->next = _srvd_client_adapter_registered;
+  _srvd_client_adapter_registered = adapter;
+
+  /* Whatever we looked up before might not be right anymore. */
+  _srvd_client_adapter_cached = NULL;
+  SRVD_THREAD_MUTEX_UNLOCK(_srvd_client_adapter_lock);
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_adapter_get(const char *name, const srvd_client_adapter_t **adapter) {
+  SRVD_RETURN_FALSE_UNLESS(name);
+  SRVD_RETURN_FALSE_UNLESS(adapter);
+
+  SRVD_THREAD_MUTEX_LOCK(_srvd_client_adapter_lock);
+  *adapter = _srvd_client_adapter_find(name);
+  SRVD_THREAD_MUTEX_UNLOCK(_srvd_client_adapter_lock);
+
+  return *adapter ? SRVD_TRUE : SRVD_FALSE;
+}
+
+/* Loads an adapter from a shared object and registers it. Modules are never
+ * unloaded, since clients created from them may still be around. Called with
+ * the registry lock held. */
+static srvd_boolean_t _srvd_client_adapter_module_load(const char *path) {
+#if defined(HAVE_DLFCN_H) && defined(HAVE_DLOPEN)
+  void *module;
+  srvd_client_adapter_t *adapter;
+
+  module = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if(module == NULL) {
+    SRVD_LOG_ERROR("srvd_client_adapter_get_by_conf: Unable to load module \"%s\": %s", path,
+                   dlerror());
+    return SRVD_FALSE;
+  }
+
+  adapter = (srvd_client_adapter_t *)dlsym(module, "srvd_client_adapter_module");
+  if(adapter == NULL || adapter->name == NULL || adapter->allocate == NULL ||
+     adapter->initialize == NULL) {
+    SRVD_LOG_ERROR("srvd_client_adapter_get_by_conf: Module \"%s\" does not provide an "
+                   "adapter", path);
+    dlclose(module);
+    return SRVD_FALSE;
+  }
+
+  adapter->next = _srvd_client_adapter_registered;
+  _srvd_client_adapter_registered = adapter;
+
+  return SRVD_TRUE;
+#else
+  SRVD_LOG_ERROR("srvd_client_adapter_get_by_conf: Unable to load module \"%s\": Modules are "
+                 "not supported on this system", path);
+  return SRVD_FALSE;
+#endif
+}
+
+srvd_boolean_t srvd_client_adapter_get_by_conf(const srvd_conf_t *conf,
+                                               const srvd_client_adapter_t **adapter) {
+  char *name = NULL, *module = NULL;
+  const srvd_client_adapter_t *r;
+
+  SRVD_RETURN_FALSE_UNLESS(conf);
+  SRVD_RETURN_FALSE_UNLESS(adapter);
+
+  SRVD_THREAD_MUTEX_LOCK(_srvd_client_adapter_lock);
+
+  if(_srvd_client_adapter_cached && _srvd_client_adapter_cached_generation == conf->generation) {
+    *adapter = _srvd_client_adapter_cached;
+    SRVD_THREAD_MUTEX_UNLOCK(_srvd_client_adapter_lock);
+    return SRVD_TRUE;
+  }
+
+  if(!srvd_conf_item_get(conf, "client:adapter", &name, NULL)) {
+    SRVD_LOG_ERROR("srvd_client_adapter_get_by_conf: No adapter specified in configuration");
+    goto _srvd_client_adapter_get_by_conf_error;
+  }
+
+  r = _srvd_client_adapter_find(name);
+  if(r == NULL && srvd_conf_item_get(conf, "client:module", &module, NULL)) {
+    if(!_srvd_client_adapter_module_load(module))
+      goto _srvd_client_adapter_get_by_conf_error;
+
+    r = _srvd_client_adapter_find(name);
+  }
+
+  if(r == NULL) {
+    SRVD_LOG_ERROR("srvd_client_adapter_get_by_conf: Invalid adapter \"%s\" specified", name);
+    goto _srvd_client_adapter_get_by_conf_error;
+  }
+
+  _srvd_client_adapter_cached = r;
+  _srvd_client_adapter_cached_generation = conf->generation;
+  SRVD_THREAD_MUTEX_UNLOCK(_srvd_client_adapter_lock);
+
+  *adapter = r;
+
+  return SRVD_TRUE;
+
+ _srvd_client_adapter_get_by_conf_error:
+
+  SRVD_THREAD_MUTEX_UNLOCK(_srvd_client_adapter_lock);
+
+  return SRVD_FALSE;
+}
 
 srvd_boolean_t srvd_client_get_by_conf(srvd_client_t **client, const srvd_conf_t *conf) {
+  const srvd_client_adapter_t *adapter = NULL;
   srvd_client_t *r = NULL;
+  char *persistent = NULL, *negotiate = NULL;
+  size_t persistent_length, negotiate_length;
 
   SRVD_RETURN_FALSE_UNLESS(client);
   SRVD_RETURN_FALSE_UNLESS(*client == NULL);
   SRVD_RETURN_FALSE_UNLESS(conf);
 
-  /* Get the adapter. */
-  char *adapter = NULL;
-  size_t adapter_length;
-  if(!srvd_conf_item_get(conf, "client:adapter", &adapter, &adapter_length)) {
-    SRVD_LOG_ERROR("srvd_client_get_by_conf: No adapter specified in configuration");
+  if(!srvd_client_adapter_get_by_conf(conf, &adapter))
+    return SRVD_FALSE;
+
+  r = adapter->allocate();
+  if(r == NULL) {
+    SRVD_LOG_ERROR("srvd_client_get_by_conf: Unable to allocate memory for client");
     return SRVD_FALSE;
   }
 
-  /* See which one we should start up.
-   *
-   * XXX: Move this to a lookup table. */
-  if(strncmp(adapter, "unsock", adapter_length) == 0) {
-    char *path = NULL;
-    size_t path_length;
-    if(!srvd_conf_item_get(conf, "client:path", &path, &path_length)) {
-      SRVD_LOG_ERROR("srvd_client_get_by_conf: No socket path specified for UNIX domain socket "
-                     "adapter");
-      return SRVD_FALSE;
-    }
+  /* Adapters from before read_serial existed don't know to set it. */
+  if(!(adapter->capabilities & SRVD_CLIENT_ADAPTER_SERIAL))
+    r->read_serial = NULL;
+
+  if(!adapter->initialize(r, conf)) {
+    SRVD_LOG_ERROR("srvd_client_get_by_conf: Unable to initialize client");
+    srvd_client_free(r);
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_conf_item_get_integer(conf, "client:timeout", &r->timeout) || r->timeout < 0)
+    r->timeout = 0;
+
+  /* Whether to keep the connection open between requests. Each adapter picks
+   * its own default. */
+  if(srvd_conf_item_get(conf, "client:persistent", &persistent, &persistent_length))
+    r->persistent = strncmp(persistent, "yes", persistent_length) == 0 ? SRVD_TRUE : SRVD_FALSE;
+
+  /* Handshakes only pay off over connections that are kept open. */
+  if(srvd_conf_item_get(conf, "client:negotiate", &negotiate, &negotiate_length))
+    r->negotiate = strncmp(negotiate, "yes", negotiate_length) == 0 ? SRVD_TRUE : SRVD_FALSE;
+  else
+    r->negotiate = r->persistent;
+  srvd_protocol_hello_initialize(&r->hello);
+
+  *client = r;
+
+  return SRVD_TRUE;
+}
+
+void srvd_client_deadline_start(srvd_client_t *client) {
+  SRVD_RETURN_UNLESS(client);
+
+  if(client->timeout > 0) {
+    _srvd_client_time_get(&client->deadline);
+    _srvd_client_time_add(&client->deadline, client->timeout);
+  }
+  else {
+    client->deadline.tv_sec = 0;
+    client->deadline.tv_nsec = 0;
+  }
+}
+
+int srvd_client_deadline_remaining(const srvd_client_t *client) {
+  long remaining;
+
+  SRVD_RETURN_VALUE_UNLESS(client, -1);
+  SRVD_RETURN_VALUE_IF(client->deadline.tv_sec == 0 && client->deadline.tv_nsec == 0, -1);
+
+  remaining = _srvd_client_time_until(&client->deadline);
+
+  return remaining > 0 ? (int)remaining : 0;
+}
 
-    r = srvd_client_unsock_allocate();
-    if(r == NULL) {
-      SRVD_LOG_ERROR("srvd_client_get_by_conf: Unable to allocate memory for client");
+srvd_boolean_t srvd_client_negotiate(srvd_client_t *client) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_protocol_packet_t request, response;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  srvd_protocol_hello_t local, peer;
+  uint16_t code = SRVD_SERVICE_RESPONSE_UNAVAIL;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(client->connected);
+
+  srvd_protocol_hello_initialize(&client->hello);
+  srvd_protocol_hello_initialize_local(&local);
+
+  srvd_protocol_packet_initialize(&request);
+  srvd_protocol_packet_initialize(&response);
+
+  if(!srvd_protocol_hello_pack(&local, &request))
+    goto _srvd_client_negotiate_error;
+
+  if(!srvd_client_write(client, &request) || !srvd_client_read(client, &response)) {
+    SRVD_LOG_ERROR("srvd_client_negotiate: Error exchanging handshake with server");
+    srvd_client_disconnect(client);
+    goto _srvd_client_negotiate_error;
+  }
+
+  if(srvd_protocol_packet_field_get_by_type(&response, SRVD_PROTOCOL_STATUS, &field) &&
+     srvd_protocol_packet_field_entry_get_first(field, &entry))
+    srvd_protocol_packet_field_entry_get_uint16(entry, &code);
+
+  /* Anything we don't understand leaves us at the baseline, which every
+   * server supports. */
+  if(code == SRVD_SERVICE_RESPONSE_SUCCESS && srvd_protocol_hello_unpack(&response, &peer) &&
+     !srvd_protocol_hello_negotiate(&local, &peer, &client->hello))
+    srvd_protocol_hello_initialize(&client->hello);
+
+  status = SRVD_TRUE;
+
+ _srvd_client_negotiate_error:
+
+  srvd_protocol_packet_finalize(&request);
+  srvd_protocol_packet_finalize(&response);
+
+  return status;
+}
+
+uint16_t srvd_client_version(const srvd_client_t *client) {
+  uint16_t version;
+
+  SRVD_RETURN_VALUE_UNLESS(client, SRVD_PROTOCOL_SERIAL_PACKET_VERSION);
+
+  version = client->hello.version_maximum;
+  if(client->hello.features & SRVD_PROTOCOL_HELLO_COMPRESSION)
+    version |= SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE;
+
+  return version;
+}
+
+/* Waits until the socket is ready for the given events or the deadline
+ * passes. */
+static srvd_boolean_t _srvd_client_socket_wait(const srvd_client_t *client, int socket,
+                                               short events) {
+  struct pollfd descriptor;
+  int remaining, result;
+
+  remaining = srvd_client_deadline_remaining(client);
+  SRVD_RETURN_TRUE_IF(remaining == -1);
+
+  descriptor.fd = socket;
+  descriptor.events = events;
+
+  for(;;) {
+    result = poll(&descriptor, 1, remaining);
+    if(result > 0)
+      return SRVD_TRUE;
+    else if(result == -1 && errno != EINTR)
+      return SRVD_FALSE;
+    else if(result == 0 || (remaining = srvd_client_deadline_remaining(client)) == 0) {
+      errno = ETIMEDOUT;
       return SRVD_FALSE;
     }
+  }
+}
 
-    if(!srvd_client_unsock_initialize(r, path)) {
-      SRVD_LOG_ERROR("srvd_client_get_by_conf: Unable to initialize client");
-      free(r);
-      return SRVD_FALSE;
+srvd_boolean_t srvd_client_socket_connect(const srvd_client_t *client, int socket,
+                                          const struct sockaddr *address, socklen_t length) {
+  int flags, error = 0;
+  socklen_t error_length = sizeof(error);
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(address);
+
+  if(srvd_client_deadline_remaining(client) == -1)
+    return connect(socket, address, length) == 0 ? SRVD_TRUE : SRVD_FALSE;
+
+  /* Connect without blocking so we can give up when the deadline passes. */
+  flags = fcntl(socket, F_GETFL);
+  if(flags == -1 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) == -1)
+    return SRVD_FALSE;
+
+  if(connect(socket, address, length) == -1) {
+    if(errno != EINPROGRESS && errno != EAGAIN && errno != EINTR)
+      goto _srvd_client_socket_connect_error;
+
+    if(!_srvd_client_socket_wait(client, socket, POLLOUT))
+      goto _srvd_client_socket_connect_error;
+
+    if(getsockopt(socket, SOL_SOCKET, SO_ERROR, &error, &error_length) == -1)
+      goto _srvd_client_socket_connect_error;
+    else if(error != 0) {
+      errno = error;
+      goto _srvd_client_socket_connect_error;
     }
   }
-  else if(strncmp(adapter, "tcp", adapter_length) == 0) {
-    SRVD_LOG_ERROR("srvd_client_get_by_conf: The TCP adapter is not implemented");
+
+  return fcntl(socket, F_SETFL, flags) == -1 ? SRVD_FALSE : SRVD_TRUE;
+
+ _srvd_client_socket_connect_error:
+
+  error = errno;
+  fcntl(socket, F_SETFL, flags);
+  errno = error;
+
+  return SRVD_FALSE;
+}
+
+ssize_t srvd_client_socket_read(const srvd_client_t *client, int from, char *buffer,
+                                size_t size) {
+  size_t offset = 0;
+
+  while(offset < size) {
+    ssize_t result;
+
+    if(!_srvd_client_socket_wait(client, from, POLLIN))
+      return -1;
+
+    result = read(from, buffer + offset, size - offset);
+    if(result == -1 && errno == EINTR)
+      continue;
+    else if(result <= 0)
+      return result == 0 ? (ssize_t)offset : -1;
+
+    offset += (size_t)result;
+  }
+
+  return (ssize_t)offset;
+}
+
+ssize_t srvd_client_socket_write(const srvd_client_t *client, int to, const char *buffer,
+                                 size_t size) {
+  size_t offset = 0;
+
+  while(offset < size) {
+    ssize_t result;
+
+    if(!_srvd_client_socket_wait(client, to, POLLOUT))
+      return -1;
+
+    result = write(to, buffer + offset, size - offset);
+    if(result == -1 && errno == EINTR)
+      continue;
+    else if(result == -1)
+      return -1;
+
+    offset += (size_t)result;
+  }
+
+  return (ssize_t)offset;
+}
+
+ssize_t srvd_client_socket_receive(const srvd_client_t *client, int from, char *buffer,
+                                   size_t size) {
+  struct msghdr message;
+  struct iovec vector;
+  ssize_t result;
+
+  memset(&message, 0, sizeof(struct msghdr));
+  vector.iov_base = buffer;
+  vector.iov_len = size;
+  message.msg_iov = &vector;
+  message.msg_iovlen = 1;
+
+  do {
+    if(!_srvd_client_socket_wait(client, from, POLLIN))
+      return -1;
+
+    result = recvmsg(from, &message, 0);
+  } while(result == -1 && errno == EINTR);
+
+  if(result > 0 && (message.msg_flags & MSG_TRUNC)) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  return result;
+}
+
+srvd_boolean_t srvd_client_socket_write_packet(const srvd_client_t *client, int to,
+                                               const srvd_protocol_packet_t *packet) {
+  srvd_boolean_t status = SRVD_FALSE;
+  ssize_t result;
+
+  srvd_protocol_serial_packet_t serial;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(packet);
+
+  srvd_protocol_serial_packet_initialize(&serial);
+  serial.version = client->hello.version_maximum;
+  serial.flags = srvd_client_version(client) & SRVD_PROTOCOL_SERIAL_PACKET_FLAGS;
+  if(!srvd_protocol_serial_packet_serialize(&serial, packet)) {
+    SRVD_LOG_ERROR("srvd_client_socket_write_packet: Unable to serialize packet");
+    goto _srvd_client_socket_write_packet_error;
+  }
+
+  result = srvd_client_socket_write(client, to, serial.data, serial.size);
+  if(result == -1) {
+    SRVD_LOG_ERROR("srvd_client_socket_write_packet: Error writing data%s",
+                   errno == ETIMEDOUT ? " (timed out)" : "");
+    goto _srvd_client_socket_write_packet_error;
+  }
+  else if((size_t)result != serial.size) {
+    SRVD_LOG_ERROR("srvd_client_socket_write_packet: Interrupted: Wrote %d of %u bytes",
+                   result, serial.size);
+    goto _srvd_client_socket_write_packet_error;
+  }
+
+  status = SRVD_TRUE;
+
+ _srvd_client_socket_write_packet_error:
+
+  srvd_protocol_serial_packet_finalize(&serial);
+
+  return status;
+}
+
+srvd_boolean_t srvd_client_socket_read_packet(const srvd_client_t *client, int from,
+                                              srvd_protocol_packet_t *packet) {
+  srvd_boolean_t status = SRVD_FALSE;
+  ssize_t result;
+
+  srvd_protocol_serial_packet_t serial;
+
+  char header[SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE];
+  char *body = NULL;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(packet);
+
+  srvd_protocol_serial_packet_initialize(&serial);
+
+  result = srvd_client_socket_read(client, from, header,
+                                   SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
+  if(result == -1) {
+    SRVD_LOG_ERROR("srvd_client_socket_read_packet: Error reading packet header%s",
+                   errno == ETIMEDOUT ? " (timed out)" : "");
+    goto _srvd_client_socket_read_packet_error;
+  }
+  else if((size_t)result != SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE) {
+    SRVD_LOG_ERROR("srvd_client_socket_read_packet: Interrupted: Read %d of %u bytes",
+                   result, SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
+    goto _srvd_client_socket_read_packet_error;
+  }
+
+  if(!srvd_protocol_serial_packet_unserialize_header(&serial, packet, header)) {
+    SRVD_LOG_ERROR("srvd_client_socket_read_packet: Error unserializing packet header");
+    goto _srvd_client_socket_read_packet_error;
+  }
+
+  body = malloc(serial.body_size);
+  if(body == NULL) {
+    SRVD_LOG_ERROR("srvd_client_socket_read_packet: Could not allocate packet body buffer "
+                   "(out of memory?)");
+    goto _srvd_client_socket_read_packet_error;
+  }
+
+  result = srvd_client_socket_read(client, from, body, serial.body_size);
+  if(result == -1) {
+    SRVD_LOG_ERROR("srvd_client_socket_read_packet: Error reading packet body%s",
+                   errno == ETIMEDOUT ? " (timed out)" : "");
+    goto _srvd_client_socket_read_packet_error;
+  }
+  else if((size_t)result != serial.body_size) {
+    SRVD_LOG_ERROR("srvd_client_socket_read_packet: Interrupted: Read %d of %u bytes",
+                   result, serial.body_size);
+    goto _srvd_client_socket_read_packet_error;
+  }
+
+  if(!srvd_protocol_serial_packet_unserialize_body(&serial, packet, body)) {
+    SRVD_LOG_ERROR("srvd_client_socket_read_packet: Error unserializing packet body");
+    goto _srvd_client_socket_read_packet_error;
+  }
+
+  status = SRVD_TRUE;
+
+ _srvd_client_socket_read_packet_error:
+
+  srvd_protocol_serial_packet_finalize(&serial);
+  if(body)
+    free(body);
+
+  return status;
+}
+
+srvd_boolean_t srvd_client_socket_read_serial(const srvd_client_t *client, int from,
+                                              srvd_protocol_serial_packet_t *serial) {
+  char header[SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE];
+  ssize_t result;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(serial);
+
+  result = srvd_client_socket_read(client, from, header, SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
+  if(result == -1) {
+    SRVD_LOG_ERROR("srvd_client_socket_read_serial: Error reading packet header%s",
+                   errno == ETIMEDOUT ? " (timed out)" : "");
     return SRVD_FALSE;
   }
-  else {
-    SRVD_LOG_ERROR("srvd_client_get_by_conf: Invalid adapter \"%s\" specified", adapter);
+  else if((size_t)result != SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE) {
+    SRVD_LOG_ERROR("srvd_client_socket_read_serial: Interrupted: Read %d of %u bytes",
+                   result, SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
     return SRVD_FALSE;
   }
 
-  *client = r;
+  if(!srvd_protocol_serial_packet_unserialize_header(serial, NULL, header)) {
+    SRVD_LOG_ERROR("srvd_client_socket_read_serial: Error unserializing packet header");
+    return SRVD_FALSE;
+  }
+
+  serial->data = malloc(serial->size);
+  if(serial->data == NULL) {
+    SRVD_LOG_ERROR("srvd_client_socket_read_serial: Could not allocate packet buffer "
+                   "(out of memory?)");
+    return SRVD_FALSE;
+  }
+  memcpy(serial->data, header, SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
+
+  result = srvd_client_socket_read(client, from,
+                                   serial->data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE,
+                                   serial->body_size);
+  if(result == -1) {
+    SRVD_LOG_ERROR("srvd_client_socket_read_serial: Error reading packet body%s",
+                   errno == ETIMEDOUT ? " (timed out)" : "");
+    return SRVD_FALSE;
+  }
+  else if((size_t)result != serial->body_size) {
+    SRVD_LOG_ERROR("srvd_client_socket_read_serial: Interrupted: Read %d of %u bytes",
+                   result, serial->body_size);
+    return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_read_serial(srvd_client_t *client, srvd_protocol_serial_packet_t *serial) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_protocol_packet_t packet;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(serial);
+
+  if(client->read_serial)
+    return client->read_serial(client, serial);
+
+  srvd_protocol_packet_initialize(&packet);
+
+  if(!srvd_client_read(client, &packet))
+    goto _srvd_client_read_serial_error;
+
+  serial->version = SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MAXIMUM;
+  if(!srvd_protocol_serial_packet_serialize(serial, &packet)) {
+    SRVD_LOG_ERROR("srvd_client_read_serial: Unable to serialize packet");
+    goto _srvd_client_read_serial_error;
+  }
+
+  status = SRVD_TRUE;
+
+ _srvd_client_read_serial_error:
+
+  srvd_protocol_packet_finalize(&packet);
+
+  return status;
+}
+
+srvd_client_breaker_t *srvd_client_breaker_allocate(void) {
+  srvd_client_breaker_t *breaker = malloc(sizeof(srvd_client_breaker_t));
+  SRVD_RETURN_NULL_UNLESS(breaker);
+
+  return breaker;
+}
+
+void srvd_client_breaker_free(srvd_client_breaker_t *breaker) {
+  SRVD_RETURN_UNLESS(breaker);
+
+  free(breaker);
+}
+
+srvd_boolean_t srvd_client_breaker_initialize(srvd_client_breaker_t *breaker, uint32_t threshold,
+                                              long cooldown) {
+  SRVD_RETURN_FALSE_UNLESS(breaker);
+  SRVD_RETURN_FALSE_IF(cooldown < 0);
+
+  breaker->threshold = threshold;
+  breaker->cooldown = cooldown;
+  breaker->failures = 0;
+  breaker->reopen.tv_sec = 0;
+  breaker->reopen.tv_nsec = 0;
+  breaker->open = SRVD_FALSE;
+  breaker->probing = SRVD_FALSE;
+
+  SRVD_THREAD_MUTEX_INITIALIZE(breaker->lock);
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_breaker_finalize(srvd_client_breaker_t *breaker) {
+  SRVD_RETURN_FALSE_UNLESS(breaker);
+
+  SRVD_THREAD_MUTEX_FINALIZE(breaker->lock);
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_breaker_configure(srvd_client_breaker_t *breaker,
+                                             const srvd_conf_t *conf) {
+  long threshold, cooldown;
+
+  SRVD_RETURN_FALSE_UNLESS(breaker);
+  SRVD_RETURN_FALSE_UNLESS(conf);
+
+  if(!srvd_conf_item_get_integer(conf, "client:breaker:threshold", &threshold) ||
+     threshold < 0 || threshold > (long)UINT32_MAX)
+    threshold = SRVD_CLIENT_BREAKER_THRESHOLD_DEFAULT;
+  if(!srvd_conf_item_get_integer(conf, "client:breaker:cooldown", &cooldown) || cooldown < 0)
+    cooldown = SRVD_CLIENT_BREAKER_COOLDOWN_DEFAULT;
+
+  SRVD_THREAD_MUTEX_LOCK(breaker->lock);
+  breaker->threshold = (uint32_t)threshold;
+  breaker->cooldown = cooldown;
+  if(breaker->threshold == 0)
+    breaker->open = SRVD_FALSE;
+  SRVD_THREAD_MUTEX_UNLOCK(breaker->lock);
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_breaker_allow(srvd_client_breaker_t *breaker) {
+  srvd_boolean_t allow = SRVD_TRUE;
+
+  SRVD_RETURN_TRUE_UNLESS(breaker);
+
+  SRVD_THREAD_MUTEX_LOCK(breaker->lock);
+  if(breaker->open) {
+    /* Once the cooldown is over, let one query through to see whether the
+     * server has come back. */
+    if(breaker->probing || _srvd_client_time_until(&breaker->reopen) > 0)
+      allow = SRVD_FALSE;
+    else
+      breaker->probing = SRVD_TRUE;
+  }
+  SRVD_THREAD_MUTEX_UNLOCK(breaker->lock);
+
+  return allow;
+}
+
+void srvd_client_breaker_report(srvd_client_breaker_t *breaker, srvd_boolean_t succeeded) {
+  SRVD_RETURN_UNLESS(breaker);
+
+  SRVD_THREAD_MUTEX_LOCK(breaker->lock);
+  if(succeeded) {
+    if(breaker->open)
+      SRVD_LOG_NOTICE("srvd_client_breaker_report: Server is back; closing circuit breaker");
+
+    breaker->failures = 0;
+    breaker->open = SRVD_FALSE;
+  }
+  else if(breaker->threshold > 0 &&
+          (breaker->open || ++breaker->failures >= breaker->threshold)) {
+    if(!breaker->open)
+      SRVD_LOG_WARNING("srvd_client_breaker_report: %u consecutive failures; opening circuit "
+                       "breaker for %ld ms", (unsigned)breaker->failures, breaker->cooldown);
+
+    breaker->open = SRVD_TRUE;
+    _srvd_client_time_get(&breaker->reopen);
+    _srvd_client_time_add(&breaker->reopen, breaker->cooldown);
+  }
+  breaker->probing = SRVD_FALSE;
+  SRVD_THREAD_MUTEX_UNLOCK(breaker->lock);
+}
+
+static srvd_client_breaker_t _srvd_client_breaker_default;
+static SRVD_THREAD_ONCE_DECLARE(_srvd_client_breaker_default_once);
+
+static void _srvd_client_breaker_default_initialize(void) {
+  srvd_client_breaker_initialize(&_srvd_client_breaker_default,
+                                 SRVD_CLIENT_BREAKER_THRESHOLD_DEFAULT,
+                                 SRVD_CLIENT_BREAKER_COOLDOWN_DEFAULT);
+}
+
+srvd_boolean_t srvd_client_breaker_default_get(srvd_client_breaker_t **breaker,
+                                               const srvd_conf_t *conf) {
+  SRVD_RETURN_FALSE_UNLESS(breaker);
+
+  SRVD_THREAD_ONCE_CALL(_srvd_client_breaker_default_once, _srvd_client_breaker_default_initialize);
+
+  if(conf)
+    srvd_client_breaker_configure(&_srvd_client_breaker_default, conf);
+
+  *breaker = &_srvd_client_breaker_default;
+
+  return SRVD_TRUE;
+}
+
+srvd_client_async_t *srvd_client_async_allocate(void) {
+  srvd_client_async_t *async = malloc(sizeof(srvd_client_async_t));
+  SRVD_RETURN_NULL_UNLESS(async);
+
+  return async;
+}
+
+void srvd_client_async_free(srvd_client_async_t *async) {
+  SRVD_RETURN_UNLESS(async);
+
+  free(async);
+}
+
+srvd_boolean_t srvd_client_async_initialize(srvd_client_async_t *async, const srvd_conf_t *conf) {
+  const srvd_client_adapter_t *adapter = NULL;
+
+  SRVD_RETURN_FALSE_UNLESS(async);
+  SRVD_RETURN_FALSE_UNLESS(conf);
+
+  async->client = NULL;
+  async->broken = SRVD_FALSE;
+  async->pending_count = 0;
+  async->pending_head = async->pending_tail = NULL;
+
+  if(!srvd_client_adapter_get_by_conf(conf, &adapter)) {
+    SRVD_LOG_ERROR("srvd_client_async_initialize: Unable to get adapter");
+    return SRVD_FALSE;
+  }
+  else if(!(adapter->capabilities & SRVD_CLIENT_ADAPTER_PIPELINING)) {
+    SRVD_LOG_ERROR("srvd_client_async_initialize: Adapter \"%s\" does not support "
+                   "asynchronous requests", adapter->name);
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_client_get_by_conf(&async->client, conf)) {
+    SRVD_LOG_ERROR("srvd_client_async_initialize: Unable to get client");
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_client_connect(async->client)) {
+    SRVD_LOG_ERROR("srvd_client_async_initialize: Unable to connect to server");
+    srvd_client_finalize(async->client);
+    srvd_client_free(async->client);
+    return SRVD_FALSE;
+  }
+
+  SRVD_THREAD_MUTEX_INITIALIZE(async->write_lock);
+  SRVD_THREAD_MUTEX_INITIALIZE(async->read_lock);
 
   return SRVD_TRUE;
 }
+
+/* Takes every pending request off the queue and fails it. Once a read or write
+ * goes wrong, we can't tell which response belongs to which request anymore,
+ * so the connection is no good for anything else. */
+static void _srvd_client_async_break(srvd_client_async_t *async) {
+  srvd_client_async_request_t *i, *ni;
+
+  SRVD_THREAD_MUTEX_LOCK(async->write_lock);
+  async->broken = SRVD_TRUE;
+  i = async->pending_head;
+  async->pending_head = async->pending_tail = NULL;
+  async->pending_count = 0;
+  SRVD_THREAD_MUTEX_UNLOCK(async->write_lock);
+
+  for(; i != NULL; i = ni) {
+    ni = i->next;
+
+    i->complete = SRVD_TRUE;
+    i->succeeded = SRVD_FALSE;
+    if(i->callback)
+      i->callback(i, i->argument);
+  }
+}
+
+srvd_boolean_t srvd_client_async_finalize(srvd_client_async_t *async) {
+  srvd_boolean_t status = SRVD_TRUE;
+
+  SRVD_RETURN_FALSE_UNLESS(async);
+  SRVD_RETURN_FALSE_UNLESS(async->client);
+
+  SRVD_THREAD_MUTEX_LOCK(async->read_lock);
+  _srvd_client_async_break(async);
+  SRVD_THREAD_MUTEX_UNLOCK(async->read_lock);
+
+  if(!srvd_client_finalize(async->client)) {
+    SRVD_LOG_ERROR("srvd_client_async_finalize: Unable to finalize client");
+    status = SRVD_FALSE;
+  }
+  srvd_client_free(async->client);
+  async->client = NULL;
+
+  SRVD_THREAD_MUTEX_FINALIZE(async->write_lock);
+  SRVD_THREAD_MUTEX_FINALIZE(async->read_lock);
+
+  return status;
+}
+
+int srvd_client_async_descriptor(const srvd_client_async_t *async) {
+  SRVD_RETURN_VALUE_UNLESS(async, -1);
+  SRVD_RETURN_VALUE_UNLESS(async->client, -1);
+
+  return srvd_client_descriptor(async->client);
+}
+
+srvd_boolean_t srvd_client_async_submit(srvd_client_async_t *async,
+                                        const srvd_protocol_packet_t *packet,
+                                        srvd_client_async_callback_pt callback, void *argument,
+                                        srvd_client_async_request_t **request) {
+  srvd_client_async_request_t *r;
+
+  SRVD_RETURN_FALSE_UNLESS(async);
+  SRVD_RETURN_FALSE_UNLESS(packet);
+  SRVD_RETURN_FALSE_UNLESS(request);
+  SRVD_RETURN_FALSE_UNLESS(*request == NULL);
+
+  r = malloc(sizeof(srvd_client_async_request_t));
+  if(r == NULL) {
+    SRVD_LOG_ERROR("srvd_client_async_submit: Unable to allocate memory for request");
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_protocol_packet_initialize(&r->response)) {
+    SRVD_LOG_ERROR("srvd_client_async_submit: Unable to initialize response packet");
+    free(r);
+    return SRVD_FALSE;
+  }
+
+  r->complete = SRVD_FALSE;
+  r->succeeded = SRVD_FALSE;
+  r->callback = callback;
+  r->argument = argument;
+  r->next = NULL;
+
+  /* The write and the enqueue have to happen together, or two threads
+   * submitting at once could get their responses crossed. */
+  SRVD_THREAD_MUTEX_LOCK(async->write_lock);
+  if(async->broken) {
+    SRVD_LOG_ERROR("srvd_client_async_submit: Connection is no longer usable");
+    goto _srvd_client_async_submit_error;
+  }
+
+  if(!srvd_client_write(async->client, packet)) {
+    int descriptor;
+
+    /* Someone may be reading into the pending requests right now, so they
+     * can't be failed here. Instead, make sure the next read fails, and let
+     * whoever does it clean up. */
+    SRVD_LOG_ERROR("srvd_client_async_submit: Unable to write request");
+    async->broken = SRVD_TRUE;
+    descriptor = srvd_client_descriptor(async->client);
+    if(descriptor != -1)
+      shutdown(descriptor, SHUT_RDWR);
+    goto _srvd_client_async_submit_error;
+  }
+
+  if(async->pending_tail)
+    async->pending_tail->next = r;
+  else
+    async->pending_head = r;
+  async->pending_tail = r;
+  async->pending_count++;
+  SRVD_THREAD_MUTEX_UNLOCK(async->write_lock);
+
+  *request = r;
+
+  return SRVD_TRUE;
+
+ _srvd_client_async_submit_error:
+
+  SRVD_THREAD_MUTEX_UNLOCK(async->write_lock);
+
+  srvd_client_async_request_free(r);
+
+  return SRVD_FALSE;
+}
+
+/* Sets *watched if the request completed is the one given, before its
+ * callback has a chance to free it. */
+static srvd_boolean_t _srvd_client_async_process_locked(srvd_client_async_t *async,
+                                                        const srvd_client_async_request_t *watch,
+                                                        srvd_boolean_t *watched) {
+  srvd_client_async_request_t *r;
+  srvd_boolean_t result, broken;
+
+  SRVD_THREAD_MUTEX_LOCK(async->write_lock);
+  r = async->pending_head;
+  broken = async->broken;
+  SRVD_THREAD_MUTEX_UNLOCK(async->write_lock);
+
+  /* A submit failed, and left the pending requests for us. */
+  if(broken) {
+    _srvd_client_async_break(async);
+    return SRVD_FALSE;
+  }
+
+  /* Nothing to wait for. */
+  SRVD_RETURN_FALSE_UNLESS(r);
+
+  /* Only the reader ever removes requests from the head of the queue, so this
+   * one can't go anywhere while we read. */
+  result = srvd_client_read(async->client, &r->response);
+  if(!result) {
+    SRVD_LOG_ERROR("srvd_client_async_process: Unable to read response");
+    _srvd_client_async_break(async);
+    return SRVD_FALSE;
+  }
+
+  SRVD_THREAD_MUTEX_LOCK(async->write_lock);
+  async->pending_head = r->next;
+  if(async->pending_head == NULL)
+    async->pending_tail = NULL;
+  async->pending_count--;
+  SRVD_THREAD_MUTEX_UNLOCK(async->write_lock);
+
+  r->next = NULL;
+  r->complete = SRVD_TRUE;
+  r->succeeded = SRVD_TRUE;
+  if(watched && r == watch)
+    *watched = SRVD_TRUE;
+  if(r->callback)
+    r->callback(r, r->argument);
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_async_process(srvd_client_async_t *async) {
+  srvd_boolean_t status;
+
+  SRVD_RETURN_FALSE_UNLESS(async);
+
+  SRVD_THREAD_MUTEX_LOCK(async->read_lock);
+  status = _srvd_client_async_process_locked(async, NULL, NULL);
+  SRVD_THREAD_MUTEX_UNLOCK(async->read_lock);
+
+  return status;
+}
+
+srvd_boolean_t srvd_client_async_wait(srvd_client_async_t *async,
+                                      srvd_client_async_request_t *request) {
+  srvd_boolean_t status, watched = SRVD_FALSE;
+
+  SRVD_RETURN_FALSE_UNLESS(async);
+  SRVD_RETURN_FALSE_UNLESS(request);
+
+  /* Once we start processing, the request's callback may free it, so after
+   * this we only find out how it went from _srvd_client_async_process_locked().
+   * If processing fails, the request has been failed along with the rest. */
+  SRVD_THREAD_MUTEX_LOCK(async->read_lock);
+  if(request->complete)
+    status = request->succeeded;
+  else {
+    status = SRVD_FALSE;
+    while(_srvd_client_async_process_locked(async, request, &watched)) {
+      if(watched) {
+        status = SRVD_TRUE;
+        break;
+      }
+    }
+  }
+  SRVD_THREAD_MUTEX_UNLOCK(async->read_lock);
+
+  return status;
+}
+
+void srvd_client_async_request_free(srvd_client_async_request_t *request) {
+  SRVD_RETURN_UNLESS(request);
+
+  srvd_protocol_packet_finalize(&request->response);
+  free(request);
+}
@@ -0,0 +1,330 @@
+/* inproc.c: In-process client.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include <srvd/client.h>
+#include <srvd/client/inproc.h>
+#include <srvd/stats.h>
+#include <srvd/thread.h>
+
+typedef struct _srvd_client_inproc_server _srvd_client_inproc_server_t;
+
+struct _srvd_client_inproc_server {
+  char *name;
+  srvd_server_t *server;
+  _srvd_client_inproc_server_t *next;
+};
+
+static SRVD_THREAD_MUTEX_DECLARE(_srvd_client_inproc_server_lock);
+static _srvd_client_inproc_server_t *_srvd_client_inproc_servers = NULL;
+
+srvd_boolean_t srvd_client_inproc_server_register(const char *name, srvd_server_t *server) {
+  _srvd_client_inproc_server_t *i, *pi;
+  srvd_boolean_t status = SRVD_TRUE;
+
+  SRVD_RETURN_FALSE_UNLESS(name);
+
+  SRVD_THREAD_MUTEX_LOCK(_srvd_client_inproc_server_lock);
+
+  for(pi = NULL, i = _srvd_client_inproc_servers; i != NULL; pi = i, i = i->next) {
+    if(strcmp(i->name, name) == 0)
+      break;
+  }
+
+  if(i && server)
+    i->server = server;
+  else if(i) {
+    if(pi == NULL)
+      _srvd_client_inproc_servers = i->next;
+    else
+      pi->next = i->next;
+
+    free(i->name);
+    free(i);
+  }
+  else if(server) {
+    i = malloc(sizeof(_srvd_client_inproc_server_t));
+    if(i == NULL || (i->name = malloc(strlen(name) + 1)) == NULL) {
+      SRVD_LOG_ERROR("srvd_client_inproc_server_register: Unable to allocate memory");
+      free(i);
+      status = SRVD_FALSE;
+    }
+    else {
+      strcpy(i->name, name);
+      i->server = server;
+      i->next = _srvd_client_inproc_servers;
+      _srvd_client_inproc_servers = i;
+    }
+  }
+
+  SRVD_THREAD_MUTEX_UNLOCK(_srvd_client_inproc_server_lock);
+
+  return status;
+}
+
+static srvd_server_t *_srvd_client_inproc_server_find(const char *name) {
+  _srvd_client_inproc_server_t *i;
+  srvd_server_t *server = NULL;
+
+  SRVD_THREAD_MUTEX_LOCK(_srvd_client_inproc_server_lock);
+
+  for(i = _srvd_client_inproc_servers; i != NULL; i = i->next) {
+    if(strcmp(i->name, name) == 0) {
+      server = i->server;
+      break;
+    }
+  }
+
+  SRVD_THREAD_MUTEX_UNLOCK(_srvd_client_inproc_server_lock);
+
+  return server;
+}
+
+/* Packets own their fields through a list, so a whole packet can be handed
+ * over by moving the list, without copying anything. */
+static void _srvd_client_inproc_packet_move(srvd_protocol_packet_t *to,
+                                            srvd_protocol_packet_t *from) {
+  if(from->field_head == NULL)
+    return;
+
+  if(to->field_tail)
+    to->field_tail->next = from->field_head;
+  else
+    to->field_head = from->field_head;
+  to->field_tail = from->field_tail;
+  to->field_count = (uint16_t)(to->field_count + from->field_count);
+
+  from->field_head = from->field_tail = NULL;
+  from->field_count = 0;
+}
+
+srvd_client_t *srvd_client_inproc_allocate(void) {
+  srvd_client_t *client = (srvd_client_t *)malloc(sizeof(srvd_client_inproc_t));
+  SRVD_RETURN_NULL_UNLESS(client);
+
+  client->free = srvd_client_inproc_free;
+  client->finalize = srvd_client_inproc_finalize;
+  client->connect = srvd_client_inproc_connect;
+  client->disconnect = srvd_client_inproc_disconnect;
+  client->write = srvd_client_inproc_write;
+  client->read = srvd_client_inproc_read;
+  client->read_serial = srvd_client_inproc_read_serial;
+  client->descriptor = srvd_client_inproc_descriptor;
+
+  return client;
+}
+
+void srvd_client_inproc_free(srvd_client_t *cl) {
+  srvd_client_inproc_t *client = (srvd_client_inproc_t *)cl;
+
+  SRVD_RETURN_UNLESS(client);
+
+  free(client);
+}
+
+srvd_boolean_t srvd_client_inproc_initialize(srvd_client_t *cl, srvd_server_t *server) {
+  srvd_client_inproc_t *client = (srvd_client_inproc_t *)cl;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+
+  client->connected = SRVD_FALSE;
+  client->persistent = SRVD_TRUE;
+  client->timeout = 0;
+  client->deadline.tv_sec = 0;
+  client->deadline.tv_nsec = 0;
+  client->negotiate = SRVD_FALSE;
+  srvd_protocol_hello_initialize(&client->hello);
+
+  client->name = NULL;
+  client->server = server;
+  client->pending = SRVD_FALSE;
+
+  srvd_service_request_initialize(&client->request);
+  srvd_service_response_initialize(&client->response);
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_inproc_initialize_by_conf(srvd_client_t *cl, const srvd_conf_t *conf) {
+  srvd_client_inproc_t *client = (srvd_client_inproc_t *)cl;
+  char *name = NULL;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(conf);
+
+  if(!srvd_conf_item_get(conf, "client:server", &name, NULL)) {
+    SRVD_LOG_ERROR("srvd_client_inproc_initialize_by_conf: No server specified for in-process "
+                   "adapter");
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_client_inproc_initialize(cl, NULL))
+    return SRVD_FALSE;
+
+  client->name = malloc(strlen(name) + 1);
+  if(client->name == NULL) {
+    SRVD_LOG_ERROR("srvd_client_inproc_initialize_by_conf: Unable to allocate memory for name");
+    srvd_client_inproc_finalize(cl);
+    return SRVD_FALSE;
+  }
+  strcpy(client->name, name);
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_inproc_finalize(srvd_client_t *cl) {
+  srvd_client_inproc_t *client = (srvd_client_inproc_t *)cl;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+
+  if(client->connected)
+    srvd_client_inproc_disconnect(cl);
+
+  if(client->name)
+    free(client->name);
+  client->name = NULL;
+
+  srvd_service_request_finalize(&client->request);
+  srvd_service_response_finalize(&client->response);
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_inproc_connect(srvd_client_t *cl) {
+  srvd_client_inproc_t *client = (srvd_client_inproc_t *)cl;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_IF(client->connected);
+
+  if(client->name)
+    client->server = _srvd_client_inproc_server_find(client->name);
+
+  if(client->server == NULL) {
+    SRVD_LOG_ERROR("srvd_client_inproc_connect: No server named \"%s\"",
+                   client->name ? client->name : "");
+    return SRVD_FALSE;
+  }
+
+  client->connected = SRVD_TRUE;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_inproc_disconnect(srvd_client_t *cl) {
+  srvd_client_inproc_t *client = (srvd_client_inproc_t *)cl;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(client->connected);
+
+  /* Throw away a response nobody read. */
+  if(client->pending) {
+    srvd_service_response_finalize(&client->response);
+    srvd_service_response_initialize(&client->response);
+    client->pending = SRVD_FALSE;
+  }
+
+  client->connected = SRVD_FALSE;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_inproc_write(srvd_client_t *cl, const srvd_protocol_packet_t *packet) {
+  srvd_client_inproc_t *client = (srvd_client_inproc_t *)cl;
+  srvd_stats_sample_t sample;
+  srvd_boolean_t status;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(client->connected);
+  SRVD_RETURN_FALSE_UNLESS(packet);
+
+  if(client->pending) {
+    SRVD_LOG_ERROR("srvd_client_inproc_write: The last response hasn't been read yet");
+    return SRVD_FALSE;
+  }
+
+  /* Handlers can't change the request, so it can borrow the caller's
+   * fields. */
+  client->request.packet.field_count = packet->field_count;
+  client->request.packet.field_head = packet->field_head;
+  client->request.packet.field_tail = packet->field_tail;
+  client->response.status = SRVD_SERVICE_RESPONSE_UNKNOWN;
+
+  srvd_stats_sample_initialize(&sample);
+  sample.received = sample.dispatched = srvd_stats_now();
+
+  status = srvd_server_dispatch(client->server, &client->request, &client->response);
+
+  sample.handled = sample.sent = srvd_stats_now();
+  sample.error = !status;
+  srvd_server_stats_record(client->server, &sample, &client->request,
+                           status ? &client->response : NULL);
+
+  client->request.packet.field_count = 0;
+  client->request.packet.field_head = client->request.packet.field_tail = NULL;
+
+  if(!status) {
+    SRVD_LOG_ERROR("srvd_client_inproc_write: Server rejected the request");
+    srvd_service_response_finalize(&client->response);
+    srvd_service_response_initialize(&client->response);
+    return SRVD_FALSE;
+  }
+
+  client->pending = SRVD_TRUE;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_inproc_read(srvd_client_t *cl, srvd_protocol_packet_t *packet) {
+  srvd_client_inproc_t *client = (srvd_client_inproc_t *)cl;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(client->connected);
+  SRVD_RETURN_FALSE_UNLESS(packet);
+
+  if(!client->pending) {
+    SRVD_LOG_ERROR("srvd_client_inproc_read: No request has been written");
+    return SRVD_FALSE;
+  }
+
+  _srvd_client_inproc_packet_move(packet, &client->response.packet);
+  client->pending = SRVD_FALSE;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_inproc_read_serial(srvd_client_t *cl,
+                                              srvd_protocol_serial_packet_t *serial) {
+  srvd_client_inproc_t *client = (srvd_client_inproc_t *)cl;
+  srvd_boolean_t status;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(client->connected);
+  SRVD_RETURN_FALSE_UNLESS(serial);
+
+  if(!client->pending) {
+    SRVD_LOG_ERROR("srvd_client_inproc_read_serial: No request has been written");
+    return SRVD_FALSE;
+  }
+
+  serial->version = SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MAXIMUM;
+  status = srvd_protocol_serial_packet_serialize(serial, &client->response.packet);
+  if(!status)
+    SRVD_LOG_ERROR("srvd_client_inproc_read_serial: Unable to serialize packet");
+
+  srvd_service_response_finalize(&client->response);
+  srvd_service_response_initialize(&client->response);
+  client->pending = SRVD_FALSE;
+
+  return status;
+}
+
+int srvd_client_inproc_descriptor(const srvd_client_t *cl) {
+  SRVD_UNUSED(cl);
+
+  return -1;
+}
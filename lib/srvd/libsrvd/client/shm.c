@@ -0,0 +1,455 @@
+/* shm.c: Shared memory client.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include <srvd/client.h>
+#include <srvd/client/shm.h>
+#include <srvd/protocol/serial_packet.h>
+#include <srvd/service.h>
+
+#define _SUN_PATH_LENGTH \
+  ((size_t)(sizeof(((struct sockaddr_un *)NULL)->sun_path) / sizeof(char)))
+
+srvd_client_t *srvd_client_shm_allocate(void) {
+  srvd_client_t *client = (srvd_client_t *)malloc(sizeof(srvd_client_shm_t));
+  SRVD_RETURN_NULL_UNLESS(client);
+
+  client->free = srvd_client_shm_free;
+  client->finalize = srvd_client_shm_finalize;
+  client->connect = srvd_client_shm_connect;
+  client->disconnect = srvd_client_shm_disconnect;
+  client->write = srvd_client_shm_write;
+  client->read = srvd_client_shm_read;
+  client->read_serial = srvd_client_shm_read_serial;
+  client->descriptor = srvd_client_shm_descriptor;
+
+  return client;
+}
+
+void srvd_client_shm_free(srvd_client_t *cl) {
+  srvd_client_shm_t *client = (srvd_client_shm_t *)cl;
+
+  SRVD_RETURN_UNLESS(client);
+
+  free(client);
+}
+
+srvd_boolean_t srvd_client_shm_initialize(srvd_client_t *cl, const char *path,
+                                          uint32_t ring_size) {
+  srvd_client_shm_t *client = (srvd_client_shm_t *)cl;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(path);
+
+  if(strlen(path) >= _SUN_PATH_LENGTH) {
+    SRVD_LOG_ERROR("srvd_client_shm_initialize: Path too long: %s", path);
+    return SRVD_FALSE;
+  }
+
+  if(ring_size < SRVD_SHM_RING_SIZE_MINIMUM || ring_size > SRVD_SHM_RING_SIZE_MAXIMUM ||
+     (ring_size & (ring_size - 1)) != 0) {
+    SRVD_LOG_ERROR("srvd_client_shm_initialize: Invalid ring size %u", ring_size);
+    return SRVD_FALSE;
+  }
+
+  client->connected = SRVD_FALSE;
+  client->persistent = SRVD_TRUE;
+  client->timeout = 0;
+  client->deadline.tv_sec = 0;
+  client->deadline.tv_nsec = 0;
+  client->negotiate = SRVD_FALSE;
+  srvd_protocol_hello_initialize(&client->hello);
+
+  client->endpoint.sun_family = AF_UNIX;
+  memcpy(client->endpoint.sun_path, path, strlen(path) + 1);
+
+  client->socket = -1;
+  client->ring_size = ring_size;
+  client->shm.region = NULL;
+  client->pid = 0;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_shm_initialize_by_conf(srvd_client_t *cl, const srvd_conf_t *conf) {
+  char *path = NULL;
+  long ring_size;
+
+  SRVD_RETURN_FALSE_UNLESS(cl);
+  SRVD_RETURN_FALSE_UNLESS(conf);
+
+  if(!srvd_conf_item_get(conf, "client:path", &path, NULL)) {
+    SRVD_LOG_ERROR("srvd_client_shm_initialize_by_conf: No socket path specified for shared "
+                   "memory adapter");
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_conf_item_get_integer(conf, "client:shm:size", &ring_size))
+    ring_size = SRVD_SHM_RING_SIZE_DEFAULT;
+  else if(ring_size < 0 || ring_size > (long)SRVD_SHM_RING_SIZE_MAXIMUM) {
+    SRVD_LOG_ERROR("srvd_client_shm_initialize_by_conf: Invalid ring size %ld", ring_size);
+    return SRVD_FALSE;
+  }
+
+  return srvd_client_shm_initialize(cl, path, (uint32_t)ring_size);
+}
+
+srvd_boolean_t srvd_client_shm_finalize(srvd_client_t *cl) {
+  srvd_client_shm_t *client = (srvd_client_shm_t *)cl;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+
+  if(client->connected) {
+    if(!srvd_client_shm_disconnect(cl)) {
+      SRVD_LOG_ERROR("srvd_client_shm_finalize: Could not disconnect "
+                     "(connection terminated unexpectedly?)");
+      return SRVD_FALSE;
+    }
+  }
+
+  return SRVD_TRUE;
+}
+
+/* Sends the handshake, with the region's file descriptor attached to the
+ * first byte of it. */
+static srvd_boolean_t _srvd_client_shm_handshake_write(srvd_client_shm_t *client, int descriptor) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_protocol_packet_t packet;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_serial_packet_t serial;
+
+  struct msghdr message;
+  struct iovec vector;
+  struct cmsghdr *control;
+  union {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(int))];
+  } control_buffer;
+  ssize_t result;
+
+  srvd_protocol_packet_initialize(&packet);
+  srvd_protocol_serial_packet_initialize(&serial);
+
+  if(!srvd_protocol_packet_field_get_or_add(&packet, SRVD_PROTOCOL_SHM, &field) ||
+     !srvd_protocol_serial_packet_serialize(&serial, &packet))
+    goto _srvd_client_shm_handshake_write_error;
+
+  memset(&message, 0, sizeof(struct msghdr));
+  memset(&control_buffer, 0, sizeof(control_buffer));
+
+  vector.iov_base = serial.data;
+  vector.iov_len = 1;
+  message.msg_iov = &vector;
+  message.msg_iovlen = 1;
+  message.msg_control = control_buffer.buffer;
+  message.msg_controllen = sizeof(control_buffer.buffer);
+
+  control = CMSG_FIRSTHDR(&message);
+  control->cmsg_level = SOL_SOCKET;
+  control->cmsg_type = SCM_RIGHTS;
+  control->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(control), &descriptor, sizeof(int));
+
+  do {
+    result = sendmsg(client->socket, &message, 0);
+  } while(result == -1 && errno == EINTR);
+  if(result != 1)
+    goto _srvd_client_shm_handshake_write_error;
+
+  result = srvd_client_socket_write((srvd_client_t *)client, client->socket, serial.data + 1,
+                                    serial.size - 1);
+  if(result == -1 || (size_t)result != serial.size - 1)
+    goto _srvd_client_shm_handshake_write_error;
+
+  status = SRVD_TRUE;
+
+ _srvd_client_shm_handshake_write_error:
+
+  srvd_protocol_serial_packet_finalize(&serial);
+  srvd_protocol_packet_finalize(&packet);
+
+  return status;
+}
+
+/* Sets up a region and offers it to the server. Returns SRVD_FALSE only if the
+ * connection itself is broken; if we can't create the region or the server
+ * doesn't want it, the client carries on without it. */
+static srvd_boolean_t _srvd_client_shm_attach(srvd_client_shm_t *client) {
+  srvd_boolean_t status = SRVD_FALSE;
+  int descriptor;
+  srvd_shm_t shm;
+
+  srvd_protocol_packet_t response;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  uint16_t code = SRVD_SERVICE_RESPONSE_UNAVAIL;
+
+  if(!srvd_shm_create(&shm, client->ring_size, &descriptor)) {
+    if(errno != ENOSYS)
+      SRVD_LOG_WARNING("srvd_client_shm_connect: Unable to create shared memory; using socket");
+    return SRVD_TRUE;
+  }
+
+  srvd_protocol_packet_initialize(&response);
+
+  if(!_srvd_client_shm_handshake_write(client, descriptor)) {
+    SRVD_LOG_ERROR("srvd_client_shm_connect: Error sending shared memory handshake%s",
+                   errno == ETIMEDOUT ? " (timed out)" : "");
+    goto _srvd_client_shm_attach_error;
+  }
+
+  if(!srvd_client_socket_read_packet((srvd_client_t *)client, client->socket, &response)) {
+    SRVD_LOG_ERROR("srvd_client_shm_connect: Error reading shared memory handshake response");
+    goto _srvd_client_shm_attach_error;
+  }
+
+  if(srvd_protocol_packet_field_get_by_type(&response, SRVD_PROTOCOL_STATUS, &field) &&
+     srvd_protocol_packet_field_entry_get_first(field, &entry))
+    srvd_protocol_packet_field_entry_get_uint16(entry, &code);
+
+  /* If the server can't use the region (or doesn't know what it is), we just
+   * keep talking over the socket. */
+  status = SRVD_TRUE;
+  if(code == SRVD_SERVICE_RESPONSE_SUCCESS) {
+    client->shm = shm;
+    client->pid = getpid();
+    shm.region = NULL;
+  }
+
+ _srvd_client_shm_attach_error:
+
+  if(shm.region)
+    srvd_shm_unmap(&shm);
+  close(descriptor);
+  srvd_protocol_packet_finalize(&response);
+
+  return status;
+}
+
+srvd_boolean_t srvd_client_shm_connect(srvd_client_t *cl) {
+  srvd_client_shm_t *client = (srvd_client_shm_t *)cl;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_IF(client->connected);
+
+  client->socket = socket(PF_UNIX, SOCK_STREAM, 0);
+  if(client->socket == -1) {
+    SRVD_LOG_ERROR("srvd_client_shm_connect: Error creating socket");
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_client_socket_connect(cl, client->socket, (struct sockaddr *)&client->endpoint,
+                                 sizeof(struct sockaddr_un))) {
+    SRVD_LOG_ERROR("srvd_client_shm_connect: Error opening socket%s",
+                   errno == ETIMEDOUT ? " (timed out)" : "");
+    goto _srvd_client_shm_connect_error;
+  }
+
+  if(!_srvd_client_shm_attach(client))
+    goto _srvd_client_shm_connect_error;
+
+  client->connected = SRVD_TRUE;
+
+  return SRVD_TRUE;
+
+ _srvd_client_shm_connect_error:
+
+  close(client->socket);
+  client->socket = -1;
+
+  return SRVD_FALSE;
+}
+
+srvd_boolean_t srvd_client_shm_disconnect(srvd_client_t *cl) {
+  srvd_client_shm_t *client = (srvd_client_shm_t *)cl;
+  srvd_boolean_t status = SRVD_TRUE;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(client->connected);
+
+  client->connected = SRVD_FALSE;
+
+  if(client->shm.region) {
+    /* Let the server know right away instead of whenever it next checks the
+     * socket, unless it's our parent's session. */
+    if(client->pid == getpid())
+      srvd_shm_close(&client->shm);
+    srvd_shm_unmap(&client->shm);
+  }
+
+  if(close(client->socket) == -1) {
+    SRVD_LOG_ERROR("srvd_client_shm_disconnect: Error closing socket");
+    status = SRVD_FALSE;
+  }
+
+  client->socket = -1;
+
+  return status;
+}
+
+srvd_boolean_t srvd_client_shm_write(srvd_client_t *cl, const srvd_protocol_packet_t *packet) {
+  srvd_client_shm_t *client = (srvd_client_shm_t *)cl;
+  srvd_shm_t *shm;
+  char *record = NULL;
+  size_t size;
+  uint32_t length;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(client->connected);
+  SRVD_RETURN_FALSE_UNLESS(packet);
+
+  shm = &client->shm;
+  if(shm->region == NULL)
+    return srvd_client_socket_write_packet(cl, client->socket, packet);
+
+  /* The rings only have room for one writer, and that's our parent. */
+  if(client->pid != getpid()) {
+    SRVD_LOG_ERROR("srvd_client_shm_write: Shared memory belongs to another process");
+    return SRVD_FALSE;
+  }
+
+  /* Packets too big for the ring go over the socket, with a marker in the ring
+   * so the server knows to look for them there. */
+  size = srvd_protocol_serial_packet_size_version(packet, srvd_client_version(cl));
+  length = size > srvd_shm_record_maximum(shm) ? SRVD_SHM_RECORD_SOCKET : (uint32_t)size;
+
+  if(!srvd_shm_ring_reserve(shm, &shm->region->requests, shm->requests_data, length,
+                            srvd_client_deadline_remaining(cl), &record)) {
+    SRVD_LOG_ERROR("srvd_client_shm_write: Error reserving space in ring%s",
+                   errno == ETIMEDOUT ? " (timed out)" : "");
+    return SRVD_FALSE;
+  }
+
+  if(length == SRVD_SHM_RECORD_SOCKET) {
+    srvd_shm_ring_publish(shm, &shm->region->requests, shm->requests_data, length);
+    return srvd_client_socket_write_packet(cl, client->socket, packet);
+  }
+
+  if(!srvd_protocol_serial_packet_serialize_into_version(packet, record, size,
+                                                         srvd_client_version(cl))) {
+    SRVD_LOG_ERROR("srvd_client_shm_write: Unable to serialize packet");
+    return SRVD_FALSE;
+  }
+
+  srvd_shm_ring_publish(shm, &shm->region->requests, shm->requests_data, length);
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_shm_read(srvd_client_t *cl, srvd_protocol_packet_t *packet) {
+  srvd_client_shm_t *client = (srvd_client_shm_t *)cl;
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_shm_t *shm;
+  srvd_protocol_serial_packet_t serial;
+  char *record = NULL;
+  uint32_t length;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(client->connected);
+  SRVD_RETURN_FALSE_UNLESS(packet);
+
+  shm = &client->shm;
+  if(shm->region == NULL)
+    return srvd_client_socket_read_packet(cl, client->socket, packet);
+
+  if(!srvd_shm_ring_peek(shm, &shm->region->responses, shm->responses_data,
+                         srvd_client_deadline_remaining(cl), &record, &length)) {
+    SRVD_LOG_ERROR("srvd_client_shm_read: Error waiting for response%s",
+                   errno == ETIMEDOUT ? " (timed out)" : "");
+    return SRVD_FALSE;
+  }
+
+  if(length == SRVD_SHM_RECORD_SOCKET) {
+    srvd_shm_ring_release(shm, &shm->region->responses, length);
+    return srvd_client_socket_read_packet(cl, client->socket, packet);
+  }
+
+  /* Unserializing copies everything out of the ring, so we can parse the
+   * record where it is. */
+  srvd_protocol_serial_packet_initialize(&serial);
+  if(length < SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE ||
+     !srvd_protocol_serial_packet_unserialize_header(&serial, packet, record) ||
+     serial.size != length ||
+     !srvd_protocol_serial_packet_unserialize_body(&serial, packet,
+                                                   record + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE)) {
+    SRVD_LOG_ERROR("srvd_client_shm_read: Error unserializing packet");
+    goto _srvd_client_shm_read_error;
+  }
+
+  status = SRVD_TRUE;
+
+ _srvd_client_shm_read_error:
+
+  srvd_protocol_serial_packet_finalize(&serial);
+  srvd_shm_ring_release(shm, &shm->region->responses, length);
+
+  return status;
+}
+
+srvd_boolean_t srvd_client_shm_read_serial(srvd_client_t *cl, srvd_protocol_serial_packet_t *serial) {
+  srvd_client_shm_t *client = (srvd_client_shm_t *)cl;
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_shm_t *shm;
+  char *record = NULL;
+  uint32_t length;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(client->connected);
+  SRVD_RETURN_FALSE_UNLESS(serial);
+
+  shm = &client->shm;
+  if(shm->region == NULL)
+    return srvd_client_socket_read_serial(cl, client->socket, serial);
+
+  if(!srvd_shm_ring_peek(shm, &shm->region->responses, shm->responses_data,
+                         srvd_client_deadline_remaining(cl), &record, &length)) {
+    SRVD_LOG_ERROR("srvd_client_shm_read_serial: Error waiting for response%s",
+                   errno == ETIMEDOUT ? " (timed out)" : "");
+    return SRVD_FALSE;
+  }
+
+  if(length == SRVD_SHM_RECORD_SOCKET) {
+    srvd_shm_ring_release(shm, &shm->region->responses, length);
+    return srvd_client_socket_read_serial(cl, client->socket, serial);
+  }
+
+  if(length < SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE ||
+     !srvd_protocol_serial_packet_unserialize_header(serial, NULL, record) ||
+     serial->size != length) {
+    SRVD_LOG_ERROR("srvd_client_shm_read_serial: Error unserializing packet header");
+    goto _srvd_client_shm_read_serial_error;
+  }
+
+  /* The ring space goes back to the server, so the packet needs its own copy
+   * of the record. */
+  serial->data = malloc(length);
+  if(serial->data == NULL) {
+    SRVD_LOG_ERROR("srvd_client_shm_read_serial: Could not allocate packet buffer "
+                   "(out of memory?)");
+    goto _srvd_client_shm_read_serial_error;
+  }
+  memcpy(serial->data, record, length);
+
+  status = SRVD_TRUE;
+
+ _srvd_client_shm_read_serial_error:
+
+  srvd_shm_ring_release(shm, &shm->region->responses, length);
+
+  return status;
+}
+
+int srvd_client_shm_descriptor(const srvd_client_t *cl) {
+  const srvd_client_shm_t *client = (const srvd_client_shm_t *)cl;
+
+  SRVD_RETURN_VALUE_UNLESS(client, -1);
+  SRVD_RETURN_VALUE_UNLESS(client->connected, -1);
+  SRVD_RETURN_VALUE_IF(client->shm.region, -1);
+
+  return client->socket;
+}
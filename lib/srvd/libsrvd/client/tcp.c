@@ -0,0 +1,219 @@
+/* tcp.c: TCP client.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+/* For getaddrinfo(). */
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/client.h>
+#include <srvd/client/tcp.h>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+srvd_client_t *srvd_client_tcp_allocate(void) {
+  srvd_client_t *client = (srvd_client_t *)malloc(sizeof(srvd_client_tcp_t));
+  SRVD_RETURN_NULL_UNLESS(client);
+
+  client->free = srvd_client_tcp_free;
+  client->finalize = srvd_client_tcp_finalize;
+  client->connect = srvd_client_tcp_connect;
+  client->disconnect = srvd_client_tcp_disconnect;
+  client->write = srvd_client_tcp_write;
+  client->read = srvd_client_tcp_read;
+  client->read_serial = srvd_client_tcp_read_serial;
+  client->descriptor = srvd_client_tcp_descriptor;
+
+  return client;
+}
+
+void srvd_client_tcp_free(srvd_client_t *cl) {
+  srvd_client_tcp_t *client = (srvd_client_tcp_t *)cl;
+
+  SRVD_RETURN_UNLESS(client);
+
+  free(client);
+}
+
+srvd_boolean_t srvd_client_tcp_initialize(srvd_client_t *cl, int family, const char *host,
+                                          const char *port) {
+  srvd_client_tcp_t *client = (srvd_client_tcp_t *)cl;
+  struct addrinfo hints, *addresses = NULL;
+  int result;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(host);
+  SRVD_RETURN_FALSE_UNLESS(port);
+
+  client->connected = SRVD_FALSE;
+  client->persistent = SRVD_TRUE;
+  client->timeout = 0;
+  client->deadline.tv_sec = 0;
+  client->deadline.tv_nsec = 0;
+  client->negotiate = SRVD_FALSE;
+  srvd_protocol_hello_initialize(&client->hello);
+  client->socket = -1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = family;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+
+  result = getaddrinfo(host, port, &hints, &addresses);
+  if(result != 0) {
+    SRVD_LOG_ERROR("srvd_client_tcp_initialize: Unable to resolve \"%s\" port \"%s\": %s",
+                   host, port, gai_strerror(result));
+    return SRVD_FALSE;
+  }
+
+  /* Just use the first address; the resolver already put them in order of
+   * preference. */
+  memcpy(&client->endpoint, addresses->ai_addr, addresses->ai_addrlen);
+  client->endpoint_length = addresses->ai_addrlen;
+
+  freeaddrinfo(addresses);
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_tcp_initialize_by_conf(srvd_client_t *cl, const srvd_conf_t *conf) {
+  char *family = NULL, *host = NULL, *port = NULL;
+  size_t family_length;
+  int family_value = AF_UNSPEC;
+
+  SRVD_RETURN_FALSE_UNLESS(cl);
+  SRVD_RETURN_FALSE_UNLESS(conf);
+
+  if(!srvd_conf_item_get(conf, "client:host", &host, NULL) ||
+     !srvd_conf_item_get(conf, "client:port", &port, NULL)) {
+    SRVD_LOG_ERROR("srvd_client_tcp_initialize_by_conf: No host or port specified for TCP "
+                   "adapter");
+    return SRVD_FALSE;
+  }
+
+  if(srvd_conf_item_get(conf, "client:family", &family, &family_length)) {
+    if(strncmp(family, "inet", family_length) == 0)
+      family_value = AF_INET;
+    else if(strncmp(family, "inet6", family_length) == 0)
+      family_value = AF_INET6;
+    else {
+      SRVD_LOG_ERROR("srvd_client_tcp_initialize_by_conf: Invalid address family \"%s\" "
+                     "specified", family);
+      return SRVD_FALSE;
+    }
+  }
+
+  return srvd_client_tcp_initialize(cl, family_value, host, port);
+}
+
+srvd_boolean_t srvd_client_tcp_finalize(srvd_client_t *cl) {
+  srvd_client_tcp_t *client = (srvd_client_tcp_t *)cl;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+
+  if(client->connected) {
+    if(!srvd_client_tcp_disconnect(cl)) {
+      SRVD_LOG_ERROR("srvd_client_tcp_finalize: Could not disconnect "
+                     "(connection terminated unexpectedly?)");
+      return SRVD_FALSE;
+    }
+  }
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_tcp_connect(srvd_client_t *cl) {
+  srvd_client_tcp_t *client = (srvd_client_tcp_t *)cl;
+  int on = 1;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_IF(client->connected);
+
+  client->socket = socket(client->endpoint.ss_family, SOCK_STREAM, IPPROTO_TCP);
+  if(client->socket == -1) {
+    SRVD_LOG_ERROR("srvd_client_tcp_connect: Error creating socket");
+    return SRVD_FALSE;
+  }
+
+  /* Requests and responses are small and each one is written all at once, so
+   * Nagle's algorithm would only ever delay them. Keepalives let us notice
+   * when a connection we're keeping around between requests has gone away. */
+  if(setsockopt(client->socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) == -1 ||
+     setsockopt(client->socket, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) == -1) {
+    SRVD_LOG_WARNING("srvd_client_tcp_connect: Unable to set socket options");
+  }
+
+  if(!srvd_client_socket_connect(cl, client->socket, (struct sockaddr *)&client->endpoint,
+                                 client->endpoint_length)) {
+    SRVD_LOG_ERROR("srvd_client_tcp_connect: Error connecting to server%s",
+                   errno == ETIMEDOUT ? " (timed out)" : "");
+    close(client->socket);
+    client->socket = -1;
+    return SRVD_FALSE;
+  }
+
+  client->connected = SRVD_TRUE;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_tcp_disconnect(srvd_client_t *cl) {
+  srvd_client_tcp_t *client = (srvd_client_tcp_t *)cl;
+  int result;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(client->connected);
+
+  client->connected = SRVD_FALSE;
+
+  result = close(client->socket);
+  client->socket = -1;
+  if(result == -1) {
+    SRVD_LOG_ERROR("srvd_client_tcp_disconnect: Error closing socket");
+    return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_tcp_write(srvd_client_t *cl, const srvd_protocol_packet_t *packet) {
+  srvd_client_tcp_t *client = (srvd_client_tcp_t *)cl;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(client->connected);
+
+  return srvd_client_socket_write_packet(cl, client->socket, packet);
+}
+
+srvd_boolean_t srvd_client_tcp_read(srvd_client_t *cl, srvd_protocol_packet_t *packet) {
+  srvd_client_tcp_t *client = (srvd_client_tcp_t *)cl;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(client->connected);
+
+  return srvd_client_socket_read_packet(cl, client->socket, packet);
+}
+
+srvd_boolean_t srvd_client_tcp_read_serial(srvd_client_t *cl, srvd_protocol_serial_packet_t *serial) {
+  srvd_client_tcp_t *client = (srvd_client_tcp_t *)cl;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(client->connected);
+
+  return srvd_client_socket_read_serial(cl, client->socket, serial);
+}
+
+int srvd_client_tcp_descriptor(const srvd_client_t *cl) {
+  const srvd_client_tcp_t *client = (const srvd_client_tcp_t *)cl;
+
+  SRVD_RETURN_VALUE_UNLESS(client, -1);
+  SRVD_RETURN_VALUE_UNLESS(client->connected, -1);
+
+  return client->socket;
+}
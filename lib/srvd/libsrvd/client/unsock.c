@@ -9,7 +9,6 @@
 
 #include <srvd/client.h>
 #include <srvd/client/unsock.h>
-
 #include <srvd/protocol/serial_packet.h>
 
 /* The POSIX standard defines no recommended length for sun_path, so we
@@ -27,6 +26,8 @@ srvd_client_t *srvd_client_unsock_allocate(void) {
   client->disconnect = srvd_client_unsock_disconnect;
   client->write = srvd_client_unsock_write;
   client->read = srvd_client_unsock_read;
+  client->read_serial = srvd_client_unsock_read_serial;
+  client->descriptor = srvd_client_unsock_descriptor;
 
   return client;
 }
@@ -39,21 +40,47 @@ void srvd_client_unsock_free(srvd_client_t *cl) {
   free(client);
 }
 
-srvd_boolean_t srvd_client_unsock_initialize(srvd_client_t *cl, const char *path) {
+/* Creates the socket, falling back to SOCK_STREAM if we can't have the type
+ * we want. */
+static srvd_boolean_t _srvd_client_unsock_socket_create(srvd_client_unsock_t *client) {
+  client->socket = socket(PF_UNIX, client->type, 0);
+  if(client->socket == -1 && client->type != SOCK_STREAM) {
+    client->type = SOCK_STREAM;
+    client->socket = socket(PF_UNIX, client->type, 0);
+  }
+
+  return client->socket == -1 ? SRVD_FALSE : SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_unsock_initialize(srvd_client_t *cl, const char *path, int type) {
   srvd_client_unsock_t *client = (srvd_client_unsock_t *)cl;
 
   SRVD_RETURN_FALSE_UNLESS(client);
   SRVD_RETURN_FALSE_UNLESS(path);
+  SRVD_RETURN_FALSE_UNLESS(type == SOCK_STREAM || type == SOCK_SEQPACKET);
+
+  if(strlen(path) >= _SUN_PATH_LENGTH) {
+    SRVD_LOG_ERROR("srvd_client_unsock_initialize: Path too long: %s", path);
+    return SRVD_FALSE;
+  }
 
   client->connected = SRVD_FALSE;
+  client->persistent = SRVD_FALSE;
+  client->timeout = 0;
+  client->deadline.tv_sec = 0;
+  client->deadline.tv_nsec = 0;
+  client->negotiate = SRVD_FALSE;
+  srvd_protocol_hello_initialize(&client->hello);
 
   /* Set up the address. */
   client->endpoint.sun_family = AF_UNIX;
-  strncpy(client->endpoint.sun_path, path, _SUN_PATH_LENGTH);
+  memcpy(client->endpoint.sun_path, path, strlen(path) + 1);
+
+  client->type = type;
+  client->buffer = NULL;
 
   /* Set up the socket. */
-  client->socket = socket(PF_UNIX, SOCK_STREAM, 0);
-  if(client->socket == -1) {
+  if(!_srvd_client_unsock_socket_create(client)) {
     SRVD_LOG_ERROR("srvd_client_unsock_initialize: Error creating socket");
     return SRVD_FALSE;
   }
@@ -61,6 +88,33 @@ srvd_boolean_t srvd_client_unsock_initialize(srvd_client_t *cl, const char *path
   return SRVD_TRUE;
 }
 
+srvd_boolean_t srvd_client_unsock_initialize_by_conf(srvd_client_t *cl, const srvd_conf_t *conf) {
+  char *path = NULL, *type = NULL;
+  size_t type_length;
+  int type_value = SOCK_STREAM;
+
+  SRVD_RETURN_FALSE_UNLESS(cl);
+  SRVD_RETURN_FALSE_UNLESS(conf);
+
+  if(!srvd_conf_item_get(conf, "client:path", &path, NULL)) {
+    SRVD_LOG_ERROR("srvd_client_unsock_initialize_by_conf: No socket path specified for UNIX "
+                   "domain socket adapter");
+    return SRVD_FALSE;
+  }
+
+  if(srvd_conf_item_get(conf, "client:socket", &type, &type_length)) {
+    if(strncmp(type, "seqpacket", type_length) == 0)
+      type_value = SOCK_SEQPACKET;
+    else if(strncmp(type, "stream", type_length) != 0) {
+      SRVD_LOG_ERROR("srvd_client_unsock_initialize_by_conf: Invalid socket type \"%s\" "
+                     "specified", type);
+      return SRVD_FALSE;
+    }
+  }
+
+  return srvd_client_unsock_initialize(cl, path, type_value);
+}
+
 srvd_boolean_t srvd_client_unsock_finalize(srvd_client_t *cl) {
   srvd_client_unsock_t *client = (srvd_client_unsock_t *)cl;
 
@@ -73,18 +127,51 @@ srvd_boolean_t srvd_client_unsock_finalize(srvd_client_t *cl) {
       return SRVD_FALSE;
     }
   }
+  else if(client->socket != -1) {
+    /* We never managed to connect, but the socket still needs to go. */
+    close(client->socket);
+    client->socket = -1;
+  }
+
+  if(client->buffer) {
+    free(client->buffer);
+    client->buffer = NULL;
+  }
 
   return SRVD_TRUE;
 }
 
 srvd_boolean_t srvd_client_unsock_connect(srvd_client_t *cl) {
   srvd_client_unsock_t *client = (srvd_client_unsock_t *)cl;
+  srvd_boolean_t connected;
 
   SRVD_RETURN_FALSE_UNLESS(client);
   SRVD_RETURN_FALSE_IF(client->connected);
 
-  if(connect(client->socket, (struct sockaddr *)&client->endpoint, sizeof(struct sockaddr_un)) == -1) {
-    SRVD_LOG_ERROR("srvd_client_unsock_connect: Error opening socket");
+  if(client->socket == -1 && !_srvd_client_unsock_socket_create(client)) {
+    SRVD_LOG_ERROR("srvd_client_unsock_connect: Error creating socket");
+    return SRVD_FALSE;
+  }
+
+  connected = srvd_client_socket_connect(cl, client->socket, (struct sockaddr *)&client->endpoint,
+                                         sizeof(struct sockaddr_un));
+  if(!connected && errno == EPROTOTYPE && client->type != SOCK_STREAM) {
+    /* The server is listening on a stream socket; use one too. */
+    close(client->socket);
+    client->type = SOCK_STREAM;
+    if(!_srvd_client_unsock_socket_create(client)) {
+      SRVD_LOG_ERROR("srvd_client_unsock_connect: Error creating socket");
+      return SRVD_FALSE;
+    }
+
+    connected = srvd_client_socket_connect(cl, client->socket,
+                                           (struct sockaddr *)&client->endpoint,
+                                           sizeof(struct sockaddr_un));
+  }
+
+  if(!connected) {
+    SRVD_LOG_ERROR("srvd_client_unsock_connect: Error opening socket%s",
+                   errno == ETIMEDOUT ? " (timed out)" : "");
     return SRVD_FALSE;
   }
 
@@ -99,115 +186,161 @@ srvd_boolean_t srvd_client_unsock_disconnect(srvd_client_t *cl) {
   SRVD_RETURN_FALSE_UNLESS(client);
   SRVD_RETURN_FALSE_UNLESS(client->connected);
 
+  client->connected = SRVD_FALSE;
+
   if(close(client->socket) == -1) {
+    client->socket = -1;
     SRVD_LOG_ERROR("srvd_client_unsock_disconnect: Error closing socket");
     return SRVD_FALSE;
   }
 
+  client->socket = -1;
+
+  return SRVD_TRUE;
+}
+
+static srvd_boolean_t _srvd_client_unsock_buffer_get(srvd_client_unsock_t *client) {
+  if(client->buffer == NULL) {
+    client->buffer = malloc(SRVD_PROTOCOL_SERIAL_PACKET_MESSAGE_SIZE_MAXIMUM);
+    if(client->buffer == NULL) {
+      SRVD_LOG_ERROR("srvd_client_unsock: Could not allocate message buffer (out of memory?)");
+      return SRVD_FALSE;
+    }
+  }
+
   return SRVD_TRUE;
 }
 
 srvd_boolean_t srvd_client_unsock_write(srvd_client_t *cl, const srvd_protocol_packet_t *packet) {
-  srvd_boolean_t status = SRVD_FALSE;
   srvd_client_unsock_t *client = (srvd_client_unsock_t *)cl;
+  size_t size;
   ssize_t result;
 
-  srvd_protocol_serial_packet_t serial;
-
   SRVD_RETURN_FALSE_UNLESS(client);
   SRVD_RETURN_FALSE_UNLESS(client->connected);
+
+  if(client->type == SOCK_STREAM)
+    return srvd_client_socket_write_packet(cl, client->socket, packet);
+
+  /* One message per packet. */
   SRVD_RETURN_FALSE_UNLESS(packet);
+  SRVD_RETURN_FALSE_UNLESS(_srvd_client_unsock_buffer_get(client));
 
-  srvd_protocol_serial_packet_initialize(&serial);
-  if(!srvd_protocol_serial_packet_serialize(&serial, packet)) {
+  size = srvd_protocol_serial_packet_size_version(packet, srvd_client_version(cl));
+  if(size > SRVD_PROTOCOL_SERIAL_PACKET_MESSAGE_SIZE_MAXIMUM) {
+    SRVD_LOG_ERROR("srvd_client_unsock_write: Packet is too big to send (%lu bytes)",
+                   (unsigned long)size);
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_protocol_serial_packet_serialize_into_version(packet, client->buffer, size,
+                                                         srvd_client_version(cl))) {
     SRVD_LOG_ERROR("srvd_client_unsock_write: Unable to serialize packet");
-    goto _srvd_client_unsock_write_error;
+    return SRVD_FALSE;
   }
 
-  /* If we ever decide to use a non-blocking implementation instead of a
-   * blocking one here, we need to account for partial and deferred writes. */
-  result = write(client->socket, serial.data, serial.size);
-  if(result == -1) {
-    SRVD_LOG_ERROR("srvd_client_unsock_write: Error writing data");
-    goto _srvd_client_unsock_write_error;
+  result = srvd_client_socket_write(cl, client->socket, client->buffer, size);
+  if(result == -1 || (size_t)result != size) {
+    SRVD_LOG_ERROR("srvd_client_unsock_write: Error writing data%s",
+                   errno == ETIMEDOUT ? " (timed out)" : "");
+    return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_client_unsock_read(srvd_client_t *cl, srvd_protocol_packet_t *packet) {
+  srvd_client_unsock_t *client = (srvd_client_unsock_t *)cl;
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_protocol_serial_packet_t serial;
+  ssize_t result;
+
+  SRVD_RETURN_FALSE_UNLESS(client);
+  SRVD_RETURN_FALSE_UNLESS(client->connected);
+
+  if(client->type == SOCK_STREAM)
+    return srvd_client_socket_read_packet(cl, client->socket, packet);
+
+  SRVD_RETURN_FALSE_UNLESS(packet);
+  SRVD_RETURN_FALSE_UNLESS(_srvd_client_unsock_buffer_get(client));
+
+  result = srvd_client_socket_receive(cl, client->socket, client->buffer,
+                                      SRVD_PROTOCOL_SERIAL_PACKET_MESSAGE_SIZE_MAXIMUM);
+  if(result <= 0) {
+    SRVD_LOG_ERROR("srvd_client_unsock_read: Error reading data%s",
+                   result == 0 ? " (connection closed)" :
+                   errno == ETIMEDOUT ? " (timed out)" : "");
+    return SRVD_FALSE;
   }
-  else if((size_t)result != serial.size) {
-    SRVD_LOG_ERROR("srvd_client_unsock_write: Interrupted: Wrote %d of %u bytes",
-                   result, serial.size);
-    goto _srvd_client_unsock_write_error;
+
+  /* The kernel kept the message together, so the whole packet is here. */
+  srvd_protocol_serial_packet_initialize(&serial);
+  if((size_t)result < SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE ||
+     !srvd_protocol_serial_packet_unserialize_header(&serial, packet, client->buffer) ||
+     serial.size != (size_t)result ||
+     !srvd_protocol_serial_packet_unserialize_body(&serial, packet,
+                                                   client->buffer +
+                                                   SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE)) {
+    SRVD_LOG_ERROR("srvd_client_unsock_read: Error unserializing packet");
+    goto _srvd_client_unsock_read_error;
   }
 
   status = SRVD_TRUE;
 
- _srvd_client_unsock_write_error:
+ _srvd_client_unsock_read_error:
 
   srvd_protocol_serial_packet_finalize(&serial);
 
   return status;
 }
 
-srvd_boolean_t srvd_client_unsock_read(srvd_client_t *cl, srvd_protocol_packet_t *packet) {
-  srvd_boolean_t status = SRVD_FALSE;
+srvd_boolean_t srvd_client_unsock_read_serial(srvd_client_t *cl, srvd_protocol_serial_packet_t *serial) {
   srvd_client_unsock_t *client = (srvd_client_unsock_t *)cl;
   ssize_t result;
 
-  srvd_protocol_serial_packet_t serial;
-
-  char header[SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE];
-  char *body = NULL;
-  
   SRVD_RETURN_FALSE_UNLESS(client);
   SRVD_RETURN_FALSE_UNLESS(client->connected);
-  SRVD_RETURN_FALSE_UNLESS(packet);
 
-  srvd_protocol_serial_packet_initialize(&serial);
+  if(client->type == SOCK_STREAM)
+    return srvd_client_socket_read_serial(cl, client->socket, serial);
 
-  result = read(client->socket, &header, SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
-  if(result == -1) {
-    SRVD_LOG_ERROR("srvd_client_unsock_read: Error reading packet header");
-    goto _srvd_client_unsock_read_error;
-  }
-  else if((size_t)result != SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE) {
-    SRVD_LOG_ERROR("srvd_client_unsock_read: Interrupted: Read %d of %u bytes",
-                   result, SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
-    goto _srvd_client_unsock_read_error;
-  }
+  SRVD_RETURN_FALSE_UNLESS(serial);
+  SRVD_RETURN_FALSE_UNLESS(_srvd_client_unsock_buffer_get(client));
 
-  if(!srvd_protocol_serial_packet_unserialize_header(&serial, packet, header)) {
-    SRVD_LOG_ERROR("srvd_client_unsock_read: Error unserializing packet header");
-    goto _srvd_client_unsock_read_error;
-  }
-
-  body = malloc(serial.body_size);
-  if(body == NULL) {
-    SRVD_LOG_ERROR("srvd_client_unsock_read: Could not allocate packet body buffer "
-                   "(out of memory?)");
-    goto _srvd_client_unsock_read_error;
+  result = srvd_client_socket_receive(cl, client->socket, client->buffer,
+                                      SRVD_PROTOCOL_SERIAL_PACKET_MESSAGE_SIZE_MAXIMUM);
+  if(result <= 0) {
+    SRVD_LOG_ERROR("srvd_client_unsock_read_serial: Error reading data%s",
+                   result == 0 ? " (connection closed)" :
+                   errno == ETIMEDOUT ? " (timed out)" : "");
+    return SRVD_FALSE;
   }
 
-  result = read(client->socket, body, serial.body_size);
-  if(result == -1) {
-    SRVD_LOG_ERROR("srvd_client_unsock_read: Error reading packet body");
-    goto _srvd_client_unsock_read_error;
-  }
-  else if((size_t)result != serial.body_size) {
-    SRVD_LOG_ERROR("srvd_client_unsock_read: Interrupted: Read %d of %u bytes",
-                   result, serial.body_size);
-    goto _srvd_client_unsock_read_error;
+  if((size_t)result < SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE ||
+     !srvd_protocol_serial_packet_unserialize_header(serial, NULL, client->buffer) ||
+     serial->size != (size_t)result) {
+    SRVD_LOG_ERROR("srvd_client_unsock_read_serial: Error unserializing packet header");
+    return SRVD_FALSE;
   }
 
-  if(!srvd_protocol_serial_packet_unserialize_body(&serial, packet, body)) {
-    SRVD_LOG_ERROR("srvd_client_unsock_read: Error unserializing packet body");
-    goto _srvd_client_unsock_read_error;
+  /* The buffer is reused for the next message, so the packet needs its own
+   * copy. */
+  serial->data = malloc(serial->size);
+  if(serial->data == NULL) {
+    SRVD_LOG_ERROR("srvd_client_unsock_read_serial: Could not allocate packet buffer "
+                   "(out of memory?)");
+    return SRVD_FALSE;
   }
+  memcpy(serial->data, client->buffer, serial->size);
 
-  status = SRVD_TRUE;
+  return SRVD_TRUE;
+}
 
- _srvd_client_unsock_read_error:
+int srvd_client_unsock_descriptor(const srvd_client_t *cl) {
+  const srvd_client_unsock_t *client = (const srvd_client_unsock_t *)cl;
 
-  srvd_protocol_serial_packet_finalize(&serial);
-  if(body)
-    free(body);
+  SRVD_RETURN_VALUE_UNLESS(client, -1);
+  SRVD_RETURN_VALUE_UNLESS(client->connected, -1);
 
-  return status;
+  return client->socket;
 }
@@ -14,6 +14,19 @@
 #include <stdio.h>
 #include <ctype.h>
 
+static SRVD_THREAD_MUTEX_DECLARE(_srvd_conf_generation_lock);
+static unsigned long _srvd_conf_generation = 0;
+
+static unsigned long _srvd_conf_generation_next(void) {
+  unsigned long generation;
+
+  SRVD_THREAD_MUTEX_LOCK(_srvd_conf_generation_lock);
+  generation = ++_srvd_conf_generation;
+  SRVD_THREAD_MUTEX_UNLOCK(_srvd_conf_generation_lock);
+
+  return generation;
+}
+
 srvd_conf_t *srvd_conf_allocate(void) {
   srvd_conf_t *conf = malloc(sizeof(srvd_conf_t));
   SRVD_RETURN_NULL_UNLESS(conf);
@@ -31,6 +44,7 @@ srvd_boolean_t srvd_conf_initialize(srvd_conf_t *conf) {
   SRVD_RETURN_FALSE_UNLESS(conf);
 
   conf->nodes = NULL;
+  conf->generation = _srvd_conf_generation_next();
 
   return SRVD_TRUE;
 }
@@ -55,6 +69,7 @@ srvd_boolean_t srvd_conf_clear(srvd_conf_t *conf) {
     free(i);
   }
   conf->nodes = NULL;
+  conf->generation = _srvd_conf_generation_next();
 
   return SRVD_TRUE;
 }
@@ -97,6 +112,7 @@ srvd_boolean_t srvd_conf_item_add(srvd_conf_t *conf,
     node->next = conf->nodes;
 
     conf->nodes = node;
+    conf->generation = _srvd_conf_generation_next();
 
     return SRVD_TRUE;
   }
@@ -125,6 +141,28 @@ srvd_boolean_t srvd_conf_item_get(const srvd_conf_t *conf,
   return SRVD_FALSE;
 }
 
+srvd_boolean_t srvd_conf_item_get_integer(const srvd_conf_t *conf, const char *name,
+                                          long *value) {
+  char *item = NULL, *end = NULL;
+  long result;
+
+  SRVD_RETURN_FALSE_UNLESS(value);
+
+  if(!srvd_conf_item_get(conf, name, &item, NULL))
+    return SRVD_FALSE;
+
+  errno = 0;
+  result = strtol(item, &end, 10);
+  if(errno != 0 || end == item || *end != '\0') {
+    SRVD_LOG_WARNING("srvd_conf_item_get_integer: Value of \"%s\" is not an integer", name);
+    return SRVD_FALSE;
+  }
+
+  *value = result;
+
+  return SRVD_TRUE;
+}
+
 srvd_boolean_t srvd_conf_item_has(const srvd_conf_t *conf, const char *name) {
   SRVD_RETURN_FALSE_UNLESS(conf);
   SRVD_RETURN_FALSE_UNLESS(name);
@@ -502,3 +540,20 @@ srvd_boolean_t srvd_conf_file_default_get(srvd_conf_file_t **fconfp) {
 
   return status;
 }
+
+srvd_boolean_t srvd_conf_file_default_set(const char *path) {
+  srvd_boolean_t status;
+
+  SRVD_RETURN_FALSE_UNLESS(path);
+
+  SRVD_THREAD_MUTEX_LOCK(_srvd_conf_file_default_lock);
+
+  if(fconf_default.path)
+    srvd_conf_file_finalize(&fconf_default);
+
+  status = srvd_conf_file_initialize(&fconf_default, path, strlen(path) + 1);
+
+  SRVD_THREAD_MUTEX_UNLOCK(_srvd_conf_file_default_lock);
+
+  return status;
+}
@@ -0,0 +1,320 @@
+/* filter.c: Negative lookup filter.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include <srvd/filter.h>
+#include <srvd/conf.h>
+#include <srvd/thread.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+srvd_filter_t *srvd_filter_allocate(void) {
+  srvd_filter_t *filter = malloc(sizeof(srvd_filter_t));
+  SRVD_RETURN_NULL_UNLESS(filter);
+
+  return filter;
+}
+
+void srvd_filter_free(srvd_filter_t *filter) {
+  SRVD_RETURN_UNLESS(filter);
+
+  free(filter);
+}
+
+srvd_boolean_t srvd_filter_initialize(srvd_filter_t *filter, uint32_t key_count) {
+  uint32_t bit_count = SRVD_FILTER_BITS_MINIMUM;
+
+  SRVD_RETURN_FALSE_UNLESS(filter);
+
+  /* Round up to a power of two so we can mask instead of divide. */
+  while(bit_count / SRVD_FILTER_BITS_PER_KEY < key_count && bit_count < ((uint32_t)1 << 31))
+    bit_count <<= 1;
+
+  filter->bit_count = bit_count;
+  filter->hash_count = SRVD_FILTER_HASH_COUNT;
+  filter->key_count = 0;
+  filter->mapped = SRVD_FALSE;
+
+  filter->size = SRVD_FILTER_HEADER_SIZE + bit_count / 8;
+  filter->data = malloc(filter->size);
+  if(filter->data == NULL) {
+    SRVD_LOG_ERROR("srvd_filter_initialize: Unable to allocate memory for filter");
+    return SRVD_FALSE;
+  }
+
+  memset(filter->data, 0, filter->size);
+  filter->bits = (unsigned char *)filter->data + SRVD_FILTER_HEADER_SIZE;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_filter_map(srvd_filter_t *filter, const char *path) {
+  srvd_boolean_t status = SRVD_FALSE;
+  struct stat info;
+  int descriptor;
+  void *data;
+
+  SRVD_RETURN_FALSE_UNLESS(filter);
+  SRVD_RETURN_FALSE_UNLESS(path);
+
+  descriptor = open(path, O_RDONLY);
+  if(descriptor == -1)
+    return SRVD_FALSE;
+
+  if(fstat(descriptor, &info) == -1 || (size_t)info.st_size < SRVD_FILTER_HEADER_SIZE) {
+    SRVD_LOG_ERROR("srvd_filter_map: Filter \"%s\" is too short", path);
+    goto _srvd_filter_map_error;
+  }
+
+  data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+  if(data == MAP_FAILED) {
+    SRVD_LOG_ERROR("srvd_filter_map: Unable to map filter \"%s\"", path);
+    goto _srvd_filter_map_error;
+  }
+
+  filter->data = data;
+  filter->size = (size_t)info.st_size;
+  filter->mapped = SRVD_TRUE;
+
+  if(memcmp(filter->data + SRVD_FILTER_HEADER_OFFSET_MAGIC, SRVD_FILTER_MAGIC, 4) != 0 ||
+     ntohs(*(uint16_t *)(filter->data + SRVD_FILTER_HEADER_OFFSET_VERSION)) != SRVD_FILTER_VERSION) {
+    SRVD_LOG_ERROR("srvd_filter_map: Filter \"%s\" has an invalid header", path);
+    munmap(filter->data, filter->size);
+    goto _srvd_filter_map_error;
+  }
+
+  filter->hash_count = ntohs(*(uint16_t *)(filter->data + SRVD_FILTER_HEADER_OFFSET_HASHES));
+  filter->bit_count = ntohl(*(uint32_t *)(filter->data + SRVD_FILTER_HEADER_OFFSET_BITS));
+  filter->key_count = ntohl(*(uint32_t *)(filter->data + SRVD_FILTER_HEADER_OFFSET_KEYS));
+  filter->bits = (unsigned char *)filter->data + SRVD_FILTER_HEADER_SIZE;
+
+  /* The bit count must be a power of two that fits in the file. */
+  if(filter->bit_count == 0 || (filter->bit_count & (filter->bit_count - 1)) != 0 ||
+     SRVD_FILTER_HEADER_SIZE + filter->bit_count / 8 > filter->size) {
+    SRVD_LOG_ERROR("srvd_filter_map: Filter \"%s\" has an invalid size", path);
+    munmap(filter->data, filter->size);
+    goto _srvd_filter_map_error;
+  }
+
+  status = SRVD_TRUE;
+
+ _srvd_filter_map_error:
+
+  if(!status) {
+    filter->data = NULL;
+    filter->size = 0;
+    filter->mapped = SRVD_FALSE;
+  }
+
+  close(descriptor);
+
+  return status;
+}
+
+srvd_boolean_t srvd_filter_finalize(srvd_filter_t *filter) {
+  SRVD_RETURN_FALSE_UNLESS(filter);
+
+  if(filter->data) {
+    if(filter->mapped)
+      munmap(filter->data, filter->size);
+    else
+      free(filter->data);
+  }
+
+  filter->data = NULL;
+  filter->bits = NULL;
+  filter->size = 0;
+  filter->bit_count = filter->hash_count = filter->key_count = 0;
+  filter->mapped = SRVD_FALSE;
+
+  return SRVD_TRUE;
+}
+
+/* 64-bit FNV-1a over the type (in network byte order) and the key. We split
+ * the result in two and use double hashing to derive the bit positions. */
+static inline uint64_t _srvd_filter_hash(srvd_protocol_type_t type, const void *key,
+                                         size_t length) {
+  const unsigned char *p = key;
+  uint64_t hash = UINT64_C(14695981039346656037);
+  size_t i;
+
+  hash = (hash ^ (uint8_t)(type >> 8)) * UINT64_C(1099511628211);
+  hash = (hash ^ (uint8_t)(type & 0xff)) * UINT64_C(1099511628211);
+  for(i = 0; i < length; i++)
+    hash = (hash ^ p[i]) * UINT64_C(1099511628211);
+
+  return hash;
+}
+
+#define _SRVD_FILTER_ITERATE(filter, hash, i, position)                 \
+  for((i) = 0, (position) = (uint32_t)(hash);                           \
+      (i) < (filter)->hash_count;                                       \
+      (i)++, (position) += (uint32_t)((hash) >> 32) | 1)
+
+srvd_boolean_t srvd_filter_add(srvd_filter_t *filter, srvd_protocol_type_t type,
+                               const void *key, size_t length) {
+  uint64_t hash;
+  uint32_t i, position, mask;
+
+  SRVD_RETURN_FALSE_UNLESS(filter);
+  SRVD_RETURN_FALSE_UNLESS(filter->data);
+  SRVD_RETURN_FALSE_IF(filter->mapped);
+  SRVD_RETURN_FALSE_UNLESS(key || length == 0);
+
+  hash = _srvd_filter_hash(type, key, length);
+  mask = filter->bit_count - 1;
+
+  _SRVD_FILTER_ITERATE(filter, hash, i, position)
+    filter->bits[(position & mask) >> 3] |= (unsigned char)(1 << ((position & mask) & 7));
+
+  filter->key_count++;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_filter_has(const srvd_filter_t *filter, srvd_protocol_type_t type,
+                               const void *key, size_t length) {
+  uint64_t hash;
+  uint32_t i, position, mask;
+
+  /* Without a usable filter, anything might exist. */
+  SRVD_RETURN_TRUE_UNLESS(filter);
+  SRVD_RETURN_TRUE_UNLESS(filter->data);
+  SRVD_RETURN_TRUE_UNLESS(key || length == 0);
+
+  hash = _srvd_filter_hash(type, key, length);
+  mask = filter->bit_count - 1;
+
+  _SRVD_FILTER_ITERATE(filter, hash, i, position) {
+    if(!(filter->bits[(position & mask) >> 3] & (1 << ((position & mask) & 7))))
+      return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_filter_publish(const srvd_filter_t *filter, const char *path) {
+  srvd_boolean_t status = SRVD_FALSE;
+  char *temporary = NULL;
+  size_t temporary_length;
+  int descriptor = -1;
+  ssize_t result;
+
+  SRVD_RETURN_FALSE_UNLESS(filter);
+  SRVD_RETURN_FALSE_UNLESS(filter->data);
+  SRVD_RETURN_FALSE_IF(filter->mapped);
+  SRVD_RETURN_FALSE_UNLESS(path);
+
+  /* Fill in the header. */
+  memcpy(filter->data + SRVD_FILTER_HEADER_OFFSET_MAGIC, SRVD_FILTER_MAGIC, 4);
+  *(uint16_t *)(filter->data + SRVD_FILTER_HEADER_OFFSET_VERSION) =
+    htons((uint16_t)SRVD_FILTER_VERSION);
+  *(uint16_t *)(filter->data + SRVD_FILTER_HEADER_OFFSET_HASHES) =
+    htons((uint16_t)filter->hash_count);
+  *(uint32_t *)(filter->data + SRVD_FILTER_HEADER_OFFSET_BITS) = htonl(filter->bit_count);
+  *(uint32_t *)(filter->data + SRVD_FILTER_HEADER_OFFSET_KEYS) = htonl(filter->key_count);
+
+  /* Write to a temporary file next to the real one and rename it into place so
+   * clients never see a partially-written filter. */
+  temporary_length = strlen(path) + 32;
+  temporary = malloc(temporary_length);
+  if(temporary == NULL) {
+    SRVD_LOG_ERROR("srvd_filter_publish: Unable to allocate memory for path");
+    goto _srvd_filter_publish_error;
+  }
+  snprintf(temporary, temporary_length, "%s.%ld", path, (long)getpid());
+
+  descriptor = open(temporary, O_WRONLY | O_CREAT | O_TRUNC,
+                    S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if(descriptor == -1) {
+    SRVD_LOG_ERROR("srvd_filter_publish: Unable to create \"%s\"", temporary);
+    goto _srvd_filter_publish_error;
+  }
+
+  result = write(descriptor, filter->data, filter->size);
+  if(result == -1 || (size_t)result != filter->size) {
+    SRVD_LOG_ERROR("srvd_filter_publish: Error writing filter to \"%s\"", temporary);
+    goto _srvd_filter_publish_error;
+  }
+
+  if(close(descriptor) == -1) {
+    descriptor = -1;
+    SRVD_LOG_ERROR("srvd_filter_publish: Error closing \"%s\"", temporary);
+    goto _srvd_filter_publish_error;
+  }
+  descriptor = -1;
+
+  if(rename(temporary, path) == -1) {
+    SRVD_LOG_ERROR("srvd_filter_publish: Unable to move filter into place at \"%s\"", path);
+    goto _srvd_filter_publish_error;
+  }
+
+  status = SRVD_TRUE;
+
+ _srvd_filter_publish_error:
+
+  if(descriptor != -1)
+    close(descriptor);
+  if(!status && temporary)
+    unlink(temporary);
+  if(temporary)
+    free(temporary);
+
+  return status;
+}
+
+/* The default filter is mapped once and remapped whenever the file at the
+ * configured path is replaced. */
+static srvd_filter_t _srvd_filter_default = {
+  .data = NULL
+};
+static dev_t _srvd_filter_default_device;
+static ino_t _srvd_filter_default_inode;
+
+static SRVD_THREAD_MUTEX_DECLARE(_srvd_filter_default_lock);
+
+srvd_boolean_t srvd_filter_default_has(srvd_protocol_type_t type, const void *key,
+                                       size_t length) {
+  srvd_boolean_t status = SRVD_TRUE;
+  srvd_conf_file_t *fconf = NULL;
+  char *path = NULL;
+  struct stat info;
+
+  if(!srvd_conf_file_default_get(&fconf) ||
+     !srvd_conf_item_get(&fconf->conf, "client:filter", &path, NULL))
+    return SRVD_TRUE;
+
+  SRVD_THREAD_MUTEX_LOCK(_srvd_filter_default_lock);
+
+  if(stat(path, &info) == -1) {
+    /* No filter published (yet); don't hold on to an old one. */
+    srvd_filter_finalize(&_srvd_filter_default);
+    goto _srvd_filter_default_has_error;
+  }
+
+  if(_srvd_filter_default.data == NULL ||
+     info.st_dev != _srvd_filter_default_device || info.st_ino != _srvd_filter_default_inode) {
+    srvd_filter_finalize(&_srvd_filter_default);
+    if(!srvd_filter_map(&_srvd_filter_default, path))
+      goto _srvd_filter_default_has_error;
+
+    _srvd_filter_default_device = info.st_dev;
+    _srvd_filter_default_inode = info.st_ino;
+  }
+
+  status = srvd_filter_has(&_srvd_filter_default, type, key, length);
+
+ _srvd_filter_default_has_error:
+
+  SRVD_THREAD_MUTEX_UNLOCK(_srvd_filter_default_lock);
+
+  return status;
+}
@@ -0,0 +1,57 @@
+/* probe.h: Static tracepoints.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_PROBE_H
+#define _SRVD_PROBE_H
+
+/* Where the system has <sys/sdt.h>, these become USDT probes in the srvd
+ * provider that tools like perf and bpftrace can attach to (a probe named
+ * server__handler__start shows up as server-handler-start in some tools).
+ * Until something attaches to one, a probe is a single no-op instruction.
+ * Elsewhere, they compile to nothing.
+ *
+ * Server probes (the first argument is always the client's socket, or -1 for
+ * shared memory sessions):
+ *
+ *   server__accept(socket)
+ *   server__header(socket, body size)
+ *   server__body(socket, field count)
+ *   server__handler__start(type)
+ *   server__handler__end(type, status)
+ *   server__expired(type)
+ *   server__serialize(socket, size)
+ *   server__write(socket, size)
+ *
+ * Client probes, from srvd_service_request_query():
+ *
+ *   query__start(type)
+ *   query__connect(reused)
+ *   query__write(type)
+ *   query__read(type)
+ *   query__finish(type, status) */
+
+#include "config.h"
+
+#ifdef HAVE_SYS_SDT_H
+
+# include <sys/sdt.h>
+
+# define SRVD_PROBE1(name, a) DTRACE_PROBE1(srvd, name, a)
+# define SRVD_PROBE2(name, a, b) DTRACE_PROBE2(srvd, name, a, b)
+
+#else
+
+/* The arguments are still "used", so nothing computed only for a probe sets
+ * off unused variable warnings. */
+# define SRVD_PROBE1(name, a) do { SRVD_UNUSED(a); } while(0)
+# define SRVD_PROBE2(name, a, b) do { SRVD_UNUSED(a); SRVD_UNUSED(b); } while(0)
+
+#endif
+
+#endif
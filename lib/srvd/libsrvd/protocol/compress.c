@@ -0,0 +1,206 @@
+/* compress.c: Block compression for packet bodies.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include <srvd/protocol/compress.h>
+
+#define _SRVD_PROTOCOL_COMPRESS_HASH_BITS 12
+
+/* Shortest back-reference. */
+#define _SRVD_PROTOCOL_COMPRESS_MATCH_MINIMUM 4
+
+/* Furthest back a reference can go. */
+#define _SRVD_PROTOCOL_COMPRESS_DISTANCE_MAXIMUM 65535
+
+/* The format requires the last 5 bytes to be literals, and the last
+ * back-reference to start at least 12 bytes from the end. */
+#define _SRVD_PROTOCOL_COMPRESS_LAST_LITERALS 5
+#define _SRVD_PROTOCOL_COMPRESS_LAST_MATCH 12
+
+static inline uint32_t _srvd_protocol_compress_read(const unsigned char *p) {
+  uint32_t value;
+
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint32_t _srvd_protocol_compress_hash(uint32_t value) {
+  return (value * 2654435761U) >> (32 - _SRVD_PROTOCOL_COMPRESS_HASH_BITS);
+}
+
+/* How many bytes it takes to write a length that doesn't fit in its 4 bits of
+ * the token. */
+static inline size_t _srvd_protocol_compress_length_size(size_t length) {
+  return length < 15 ? 0 : (length - 15) / 255 + 1;
+}
+
+static inline unsigned char *_srvd_protocol_compress_length_put(unsigned char *p, size_t length) {
+  if(length < 15)
+    return p;
+
+  for(length -= 15; length >= 255; length -= 255)
+    *p++ = 255;
+  *p++ = (unsigned char)length;
+
+  return p;
+}
+
+/* Writes literals followed by a back-reference, or just literals if the length
+ * of the reference is 0. Returns NULL if they don't fit. */
+static unsigned char *_srvd_protocol_compress_sequence(unsigned char *p, unsigned char *end,
+                                                       const unsigned char *literals,
+                                                       size_t literal_length, size_t offset,
+                                                       size_t match_length) {
+  size_t size = 1 + _srvd_protocol_compress_length_size(literal_length) + literal_length;
+
+  if(match_length)
+    size += 2 + _srvd_protocol_compress_length_size(match_length -
+                                                    _SRVD_PROTOCOL_COMPRESS_MATCH_MINIMUM);
+  if(size > (size_t)(end - p))
+    return NULL;
+
+  *p = (unsigned char)((literal_length < 15 ? literal_length : 15) << 4);
+  if(match_length) {
+    size_t length = match_length - _SRVD_PROTOCOL_COMPRESS_MATCH_MINIMUM;
+    *p = (unsigned char)(*p | (length < 15 ? length : 15));
+  }
+  p = _srvd_protocol_compress_length_put(p + 1, literal_length);
+
+  memcpy(p, literals, literal_length);
+  p += literal_length;
+
+  if(match_length) {
+    *p++ = (unsigned char)(offset & 0xff);
+    *p++ = (unsigned char)(offset >> 8);
+    p = _srvd_protocol_compress_length_put(p, match_length - _SRVD_PROTOCOL_COMPRESS_MATCH_MINIMUM);
+  }
+
+  return p;
+}
+
+size_t srvd_protocol_compress(const char *input, size_t input_size, char *output,
+                              size_t output_size) {
+  uint32_t table[1 << _SRVD_PROTOCOL_COMPRESS_HASH_BITS];
+  const unsigned char *in = (const unsigned char *)input;
+  const unsigned char *ip = in, *anchor = in, *end = in + input_size;
+  unsigned char *op = (unsigned char *)output, *op_end = op + output_size;
+
+  SRVD_RETURN_VALUE_UNLESS(input, 0);
+  SRVD_RETURN_VALUE_UNLESS(output, 0);
+
+  memset(table, 0, sizeof(table));
+
+  if(input_size > _SRVD_PROTOCOL_COMPRESS_LAST_MATCH) {
+    const unsigned char *match_start_limit = end - _SRVD_PROTOCOL_COMPRESS_LAST_MATCH;
+    const unsigned char *match_end_limit = end - _SRVD_PROTOCOL_COMPRESS_LAST_LITERALS;
+
+    while(ip < match_start_limit) {
+      uint32_t value = _srvd_protocol_compress_read(ip);
+      uint32_t hash = _srvd_protocol_compress_hash(value);
+      const unsigned char *candidate = in + table[hash];
+      const unsigned char *m, *c;
+
+      table[hash] = (uint32_t)(ip - in);
+
+      /* The table only gives us a guess; check it. */
+      if(candidate >= ip || (size_t)(ip - candidate) > _SRVD_PROTOCOL_COMPRESS_DISTANCE_MAXIMUM ||
+         _srvd_protocol_compress_read(candidate) != value) {
+        ip++;
+        continue;
+      }
+
+      m = ip + _SRVD_PROTOCOL_COMPRESS_MATCH_MINIMUM;
+      c = candidate + _SRVD_PROTOCOL_COMPRESS_MATCH_MINIMUM;
+      while(m < match_end_limit && *m == *c) {
+        m++;
+        c++;
+      }
+
+      op = _srvd_protocol_compress_sequence(op, op_end, anchor, (size_t)(ip - anchor),
+                                            (size_t)(ip - candidate), (size_t)(m - ip));
+      if(op == NULL)
+        return 0;
+
+      ip = anchor = m;
+    }
+  }
+
+  op = _srvd_protocol_compress_sequence(op, op_end, anchor, (size_t)(end - anchor), 0, 0);
+  if(op == NULL)
+    return 0;
+
+  return (size_t)(op - (unsigned char *)output);
+}
+
+/* Reads the rest of a length that didn't fit in its 4 bits of the token. */
+static inline srvd_boolean_t _srvd_protocol_decompress_length_get(const unsigned char **p,
+                                                                  const unsigned char *end,
+                                                                  size_t *length) {
+  unsigned char byte;
+
+  if(*length < 15)
+    return SRVD_TRUE;
+
+  do {
+    if(*p >= end)
+      return SRVD_FALSE;
+
+    byte = *(*p)++;
+    *length += byte;
+  } while(byte == 255);
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_protocol_decompress(const char *input, size_t input_size, char *output,
+                                        size_t output_size) {
+  const unsigned char *ip = (const unsigned char *)input, *end = ip + input_size;
+  unsigned char *out = (unsigned char *)output, *op = out, *op_end = out + output_size;
+
+  SRVD_RETURN_FALSE_UNLESS(input);
+  SRVD_RETURN_FALSE_UNLESS(output);
+
+  while(ip < end) {
+    unsigned char token = *ip++;
+    size_t length = token >> 4, offset;
+    const unsigned char *match;
+
+    if(!_srvd_protocol_decompress_length_get(&ip, end, &length) ||
+       length > (size_t)(end - ip) || length > (size_t)(op_end - op))
+      return SRVD_FALSE;
+
+    memcpy(op, ip, length);
+    ip += length;
+    op += length;
+
+    /* The last sequence has no back-reference. */
+    if(ip == end)
+      break;
+
+    if(end - ip < 2)
+      return SRVD_FALSE;
+    offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+
+    length = token & 0x0f;
+    if(offset == 0 || offset > (size_t)(op - out) ||
+       !_srvd_protocol_decompress_length_get(&ip, end, &length))
+      return SRVD_FALSE;
+
+    length += _SRVD_PROTOCOL_COMPRESS_MATCH_MINIMUM;
+    if(length > (size_t)(op_end - op))
+      return SRVD_FALSE;
+
+    /* The reference can overlap what it's writing, so copy a byte at a
+     * time. */
+    for(match = op - offset; length > 0; length--)
+      *op++ = *match++;
+  }
+
+  return op == op_end;
+}
@@ -0,0 +1,106 @@
+/* extension.c: Request extensions.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+/* For clock_gettime(). */
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/protocol.h>
+#include <srvd/protocol/extension.h>
+
+#include <time.h>
+
+void srvd_protocol_extension_initialize(srvd_protocol_extension_t *extension) {
+  SRVD_RETURN_UNLESS(extension);
+
+  extension->deadline = 0;
+  extension->priority = SRVD_PROTOCOL_EXTENSION_PRIORITY_NORMAL;
+  extension->flags = 0;
+}
+
+uint64_t srvd_protocol_extension_now(void) {
+  struct timespec now;
+
+  if(clock_gettime(CLOCK_REALTIME, &now) == -1)
+    return 0;
+
+  return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+void srvd_protocol_extension_deadline_set(srvd_protocol_extension_t *extension,
+                                          uint32_t milliseconds) {
+  SRVD_RETURN_UNLESS(extension);
+
+  extension->deadline = srvd_protocol_extension_now() + milliseconds;
+}
+
+srvd_boolean_t srvd_protocol_extension_expired(const srvd_protocol_extension_t *extension) {
+  SRVD_RETURN_FALSE_UNLESS(extension);
+
+  return extension->deadline != 0 && srvd_protocol_extension_now() > extension->deadline;
+}
+
+srvd_boolean_t srvd_protocol_extension_pack(const srvd_protocol_extension_t *extension,
+                                            srvd_protocol_packet_t *packet) {
+  srvd_protocol_packet_field_t *field = NULL;
+  uint32_t deadline[2];
+
+  SRVD_RETURN_FALSE_UNLESS(extension);
+  SRVD_RETURN_FALSE_UNLESS(packet);
+
+  deadline[0] = htonl((uint32_t)(extension->deadline >> 32));
+  deadline[1] = htonl((uint32_t)extension->deadline);
+
+  if(packet->field_head == NULL) {
+    SRVD_LOG_ERROR("srvd_protocol_extension_pack: Extension can't be the first field");
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_protocol_packet_field_get_or_add(packet, SRVD_PROTOCOL_EXTENSION, &field) ||
+     field->entry_count != 0 ||
+     !srvd_protocol_packet_field_entry_add(field, sizeof(deadline), deadline) ||
+     !srvd_protocol_packet_field_entry_add_uint8(field, extension->priority) ||
+     !srvd_protocol_packet_field_entry_add_uint32(field, extension->flags)) {
+    SRVD_LOG_ERROR("srvd_protocol_extension_pack: Unable to add extension field");
+    return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_protocol_extension_unpack(const srvd_protocol_packet_t *packet,
+                                              srvd_protocol_extension_t *extension) {
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry;
+  uint32_t deadline[2];
+
+  SRVD_RETURN_FALSE_UNLESS(packet);
+  SRVD_RETURN_FALSE_UNLESS(extension);
+
+  srvd_protocol_extension_initialize(extension);
+
+  if(!srvd_protocol_packet_field_get_by_type(packet, SRVD_PROTOCOL_EXTENSION, &field))
+    return SRVD_TRUE;
+  else if(field == packet->field_head || field->entry_count < 3)
+    return SRVD_FALSE;
+
+  /* Later versions may add entries; we only look at the ones we know. */
+  entry = field->entry_head;
+  if(entry->size != sizeof(deadline) ||
+     !srvd_protocol_packet_field_entry_get_uint8(entry->next, &extension->priority) ||
+     !srvd_protocol_packet_field_entry_get_uint32(entry->next->next, &extension->flags))
+    return SRVD_FALSE;
+
+  memcpy(deadline, entry->data, sizeof(deadline));
+  extension->deadline = ((uint64_t)ntohl(deadline[0]) << 32) | ntohl(deadline[1]);
+
+  if(extension->priority >= SRVD_PROTOCOL_EXTENSION_PRIORITY_COUNT)
+    extension->priority = SRVD_PROTOCOL_EXTENSION_PRIORITY_NORMAL;
+
+  return SRVD_TRUE;
+}
@@ -0,0 +1,102 @@
+/* hello.c: Protocol feature negotiation.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include <srvd/protocol.h>
+#include <srvd/protocol/hello.h>
+#include <srvd/protocol/serial_packet.h>
+
+void srvd_protocol_hello_initialize(srvd_protocol_hello_t *hello) {
+  SRVD_RETURN_UNLESS(hello);
+
+  hello->version_minimum = SRVD_PROTOCOL_SERIAL_PACKET_VERSION;
+  hello->version_maximum = SRVD_PROTOCOL_SERIAL_PACKET_VERSION;
+  hello->features = 0;
+  hello->size_maximum = 0;
+}
+
+void srvd_protocol_hello_initialize_local(srvd_protocol_hello_t *hello) {
+  SRVD_RETURN_UNLESS(hello);
+
+  hello->version_minimum = SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MINIMUM;
+  hello->version_maximum = SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MAXIMUM;
+  hello->features = SRVD_PROTOCOL_HELLO_FEATURES;
+  hello->size_maximum = 0;
+}
+
+srvd_boolean_t srvd_protocol_hello_pack(const srvd_protocol_hello_t *hello,
+                                        srvd_protocol_packet_t *packet) {
+  srvd_protocol_packet_field_t *field = NULL;
+
+  SRVD_RETURN_FALSE_UNLESS(hello);
+  SRVD_RETURN_FALSE_UNLESS(packet);
+
+  if(!srvd_protocol_packet_field_get_or_add(packet, SRVD_PROTOCOL_HELLO, &field) ||
+     !srvd_protocol_packet_field_entry_add_uint16(field, hello->version_minimum) ||
+     !srvd_protocol_packet_field_entry_add_uint16(field, hello->version_maximum) ||
+     !srvd_protocol_packet_field_entry_add_uint32(field, hello->features) ||
+     !srvd_protocol_packet_field_entry_add_uint32(field, hello->size_maximum)) {
+    SRVD_LOG_ERROR("srvd_protocol_hello_pack: Unable to add handshake field");
+    return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_protocol_hello_unpack(const srvd_protocol_packet_t *packet,
+                                          srvd_protocol_hello_t *hello) {
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry;
+
+  SRVD_RETURN_FALSE_UNLESS(packet);
+  SRVD_RETURN_FALSE_UNLESS(hello);
+
+  if(!srvd_protocol_packet_field_get_by_type(packet, SRVD_PROTOCOL_HELLO, &field) ||
+     field->entry_count < 4)
+    return SRVD_FALSE;
+
+  /* Later versions may add entries; we only look at the ones we know. */
+  entry = field->entry_head;
+  if(!srvd_protocol_packet_field_entry_get_uint16(entry, &hello->version_minimum) ||
+     !srvd_protocol_packet_field_entry_get_uint16(entry->next, &hello->version_maximum) ||
+     !srvd_protocol_packet_field_entry_get_uint32(entry->next->next, &hello->features) ||
+     !srvd_protocol_packet_field_entry_get_uint32(entry->next->next->next,
+                                                  &hello->size_maximum))
+    return SRVD_FALSE;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_protocol_hello_negotiate(const srvd_protocol_hello_t *local,
+                                             const srvd_protocol_hello_t *peer,
+                                             srvd_protocol_hello_t *result) {
+  uint16_t minimum, maximum;
+
+  SRVD_RETURN_FALSE_UNLESS(local);
+  SRVD_RETURN_FALSE_UNLESS(peer);
+  SRVD_RETURN_FALSE_UNLESS(result);
+
+  minimum = local->version_minimum > peer->version_minimum
+    ? local->version_minimum : peer->version_minimum;
+  maximum = local->version_maximum < peer->version_maximum
+    ? local->version_maximum : peer->version_maximum;
+  if(minimum > maximum)
+    return SRVD_FALSE;
+
+  result->version_minimum = result->version_maximum = maximum;
+  result->features = local->features & peer->features;
+
+  /* No limit on one side means the other side's limit applies. */
+  if(local->size_maximum == 0 || peer->size_maximum == 0)
+    result->size_maximum = local->size_maximum + peer->size_maximum;
+  else
+    result->size_maximum = local->size_maximum < peer->size_maximum
+      ? local->size_maximum : peer->size_maximum;
+
+  return SRVD_TRUE;
+}
@@ -226,7 +226,7 @@ srvd_boolean_t srvd_protocol_packet_field_get_or_inject(srvd_protocol_packet_t *
 }
 
 srvd_boolean_t srvd_protocol_packet_field_append(srvd_protocol_packet_t *packet,
-                                                 srvd_protocol_type_t type, uint16_t size,
+                                                 srvd_protocol_type_t type, uint32_t size,
                                                  const void *data) {
   srvd_boolean_t status = SRVD_FALSE;
   srvd_protocol_packet_field_t *field = NULL;
@@ -269,7 +269,7 @@ srvd_boolean_t srvd_protocol_packet_field_append(srvd_protocol_packet_t *packet,
 }
 
 srvd_boolean_t srvd_protocol_packet_field_insert(srvd_protocol_packet_t *packet,
-                                                 srvd_protocol_type_t type, uint16_t size,
+                                                 srvd_protocol_type_t type, uint32_t size,
                                                  const void *data) {
   srvd_boolean_t status = SRVD_FALSE;
   srvd_protocol_packet_field_t *field = NULL;
@@ -359,7 +359,7 @@ srvd_boolean_t srvd_protocol_packet_field_finalize(srvd_protocol_packet_field_t
 }
 
 srvd_boolean_t srvd_protocol_packet_field_entry_add(srvd_protocol_packet_field_t *field,
-                                                    uint16_t size, const void *data) {
+                                                    uint32_t size, const void *data) {
   SRVD_RETURN_FALSE_UNLESS(field);
   SRVD_RETURN_FALSE_IF(size == 0 && data != NULL);
   SRVD_RETURN_FALSE_IF(size != 0 && data == NULL);
@@ -401,7 +401,7 @@ srvd_boolean_t srvd_protocol_packet_field_entry_add(srvd_protocol_packet_field_t
 }
 
 srvd_boolean_t srvd_protocol_packet_field_entry_inject(srvd_protocol_packet_field_t *field,
-                                                       uint16_t size, const void *data) {
+                                                       uint32_t size, const void *data) {
   SRVD_RETURN_FALSE_UNLESS(field);
   SRVD_RETURN_FALSE_IF(size == 0 && data != NULL);
   SRVD_RETURN_FALSE_IF(size != 0 && data == NULL);
@@ -443,10 +443,10 @@ srvd_boolean_t srvd_protocol_packet_field_entry_inject(srvd_protocol_packet_fiel
 }
 
 srvd_boolean_t srvd_protocol_packet_field_entry_get(const srvd_protocol_packet_field_t *field,
-                                                    uint16_t offset,
+                                                    uint32_t offset,
                                                     srvd_protocol_packet_field_entry_t **entry) {
   srvd_protocol_packet_field_entry_t *i;
-  uint16_t c;
+  uint32_t c;
 
   SRVD_RETURN_FALSE_UNLESS(field);
   SRVD_RETURN_FALSE_UNLESS(entry);
@@ -7,6 +7,7 @@
  * this distribution.
  */
 
+#include <srvd/protocol/compress.h>
 #include <srvd/protocol/serial_packet.h>
 
 srvd_protocol_serial_packet_t *srvd_protocol_serial_packet_allocate(void) {
@@ -38,62 +39,195 @@ srvd_boolean_t srvd_protocol_serial_packet_initialize(srvd_protocol_serial_packe
 
   serial->size = 0;
   serial->body_size = 0;
+  serial->version = SRVD_PROTOCOL_SERIAL_PACKET_VERSION;
+  serial->flags = 0;
   serial->data = NULL;
 
   return SRVD_TRUE;
 }
 
-static inline size_t _srvd_protocol_serial_packet_body_size(const srvd_protocol_packet_t *packet) {
-  size_t size = SRVD_PROTOCOL_SERIAL_PACKET_FIELD_HEADER_SIZE * packet->field_count;
+static inline srvd_boolean_t _srvd_protocol_serial_packet_version_supported(uint16_t version) {
+  return version >= SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MINIMUM &&
+    version <= SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MAXIMUM;
+}
+
+/* In version 120, 2- and 4-byte entries are sent as LEB128 integers when
+ * that's shorter. */
+static inline srvd_boolean_t _srvd_protocol_serial_packet_entry_packed(const srvd_protocol_packet_field_entry_t *entry,
+                                                                      uint32_t *value) {
+  if(entry->size == sizeof(uint32_t)) {
+    uint32_t v;
+    memcpy(&v, entry->data, sizeof(uint32_t));
+    *value = ntohl(v);
+  }
+  else if(entry->size == sizeof(uint16_t)) {
+    uint16_t v;
+    memcpy(&v, entry->data, sizeof(uint16_t));
+    *value = ntohs(v);
+  }
+  else
+    return SRVD_FALSE;
+
+  return srvd_protocol_serial_packet_varint_size(*value) < entry->size;
+}
+
+static inline size_t _srvd_protocol_serial_packet_field_header_size(const srvd_protocol_packet_field_t *field,
+                                                                    uint16_t version) {
+  if(version < SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT)
+    return SRVD_PROTOCOL_SERIAL_PACKET_FIELD_HEADER_SIZE;
+
+  return srvd_protocol_serial_packet_varint_size(field->type) +
+    srvd_protocol_serial_packet_varint_size(field->entry_count);
+}
+
+static inline size_t _srvd_protocol_serial_packet_entry_size(const srvd_protocol_packet_field_entry_t *entry,
+                                                             uint16_t version) {
+  uint32_t value;
+
+  if(version < SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT)
+    return SRVD_PROTOCOL_SERIAL_PACKET_FIELD_ENTRY_HEADER_SIZE + entry->size;
+
+  return srvd_protocol_serial_packet_varint_size(entry->size << 1) +
+    (_srvd_protocol_serial_packet_entry_packed(entry, &value)
+     ? srvd_protocol_serial_packet_varint_size(value) : entry->size);
+}
+
+static size_t _srvd_protocol_serial_packet_body_size(const srvd_protocol_packet_t *packet,
+                                                     uint16_t version) {
+  size_t size = 0;
   srvd_protocol_packet_field_t *field;
 
   SRVD_PROTOCOL_PACKET_FIELD_ITERATE(packet, field) {
     srvd_protocol_packet_field_entry_t *entry;
 
-    size += SRVD_PROTOCOL_SERIAL_PACKET_FIELD_ENTRY_HEADER_SIZE * field->entry_count;
+    size += _srvd_protocol_serial_packet_field_header_size(field, version);
     SRVD_PROTOCOL_PACKET_FIELD_ENTRY_ITERATE(field, entry)
-      size += entry->size;
+      size += _srvd_protocol_serial_packet_entry_size(entry, version);
   }
 
   return size;
 }
 
-srvd_boolean_t srvd_protocol_serial_packet_serialize(srvd_protocol_serial_packet_t *serial,
-                                                     const srvd_protocol_packet_t *packet) {
+/* Version 110 only has room for 16-bit sizes and counts, and version 120 uses
+ * the low bit of the entry header for itself. */
+static srvd_boolean_t _srvd_protocol_serial_packet_representable(const srvd_protocol_packet_t *packet,
+                                                                 uint16_t version) {
+  uint32_t maximum = version < SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT
+    ? UINT16_MAX : SRVD_PROTOCOL_SERIAL_PACKET_ENTRY_SIZE_MAXIMUM;
+  srvd_protocol_packet_field_t *field;
+
+  SRVD_PROTOCOL_PACKET_FIELD_ITERATE(packet, field) {
+    srvd_protocol_packet_field_entry_t *entry;
+
+    if(version < SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT && field->entry_count > UINT16_MAX)
+      return SRVD_FALSE;
+
+    SRVD_PROTOCOL_PACKET_FIELD_ENTRY_ITERATE(field, entry) {
+      if(entry->size > maximum)
+        return SRVD_FALSE;
+    }
+  }
+
+  return SRVD_TRUE;
+}
+
+size_t srvd_protocol_serial_packet_size(const srvd_protocol_packet_t *packet) {
+  return srvd_protocol_serial_packet_size_version(packet, SRVD_PROTOCOL_SERIAL_PACKET_VERSION);
+}
+
+size_t srvd_protocol_serial_packet_size_version(const srvd_protocol_packet_t *packet,
+                                                uint16_t version) {
+  SRVD_RETURN_VALUE_UNLESS(packet, 0);
+
+  version &= (uint16_t)~SRVD_PROTOCOL_SERIAL_PACKET_FLAGS;
+
+  return SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE +
+    _srvd_protocol_serial_packet_body_size(packet, version);
+}
+
+static void _srvd_protocol_serial_packet_serialize_body_varint(const srvd_protocol_packet_t *packet,
+                                                               char *p) {
+  srvd_protocol_packet_field_t *field;
+
+  SRVD_PROTOCOL_PACKET_FIELD_ITERATE(packet, field) {
+    srvd_protocol_packet_field_entry_t *entry;
+
+    p += srvd_protocol_serial_packet_varint_put(p, field->type);
+    p += srvd_protocol_serial_packet_varint_put(p, field->entry_count);
+
+    SRVD_PROTOCOL_PACKET_FIELD_ENTRY_ITERATE(field, entry) {
+      uint32_t value;
+
+      if(_srvd_protocol_serial_packet_entry_packed(entry, &value)) {
+        p += srvd_protocol_serial_packet_varint_put(p, (entry->size << 1) | 1);
+        p += srvd_protocol_serial_packet_varint_put(p, value);
+      }
+      else {
+        p += srvd_protocol_serial_packet_varint_put(p, entry->size << 1);
+        memcpy(p, entry->data, entry->size);
+        p += entry->size;
+      }
+    }
+  }
+}
+
+srvd_boolean_t srvd_protocol_serial_packet_serialize_into(const srvd_protocol_packet_t *packet,
+                                                          char *buffer, size_t size) {
+  return srvd_protocol_serial_packet_serialize_into_version(packet, buffer, size,
+                                                            SRVD_PROTOCOL_SERIAL_PACKET_VERSION);
+}
+
+srvd_boolean_t srvd_protocol_serial_packet_serialize_into_version(const srvd_protocol_packet_t *packet,
+                                                                  char *buffer, size_t size,
+                                                                  uint16_t version) {
   srvd_protocol_packet_field_t *field;
   char *p;
   size_t body_size;
+  uint16_t flags = version & SRVD_PROTOCOL_SERIAL_PACKET_FLAGS &
+    (uint16_t)~SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED;
 
-  SRVD_RETURN_FALSE_UNLESS(serial);
   SRVD_RETURN_FALSE_UNLESS(packet);
+  SRVD_RETURN_FALSE_UNLESS(buffer);
 
-  /* How big do we need the packet to be? */
-  body_size = _srvd_protocol_serial_packet_body_size(packet);
-
-  /* Just for reference... */
-  serial->field_count = packet->field_count;
+  version &= (uint16_t)~SRVD_PROTOCOL_SERIAL_PACKET_FLAGS;
+  if(!_srvd_protocol_serial_packet_version_supported(version)) {
+    SRVD_LOG_ERROR("srvd_protocol_serial_packet_serialize_into: Unsupported packet version %u",
+                   version);
+    return SRVD_FALSE;
+  }
 
-  /* Okay, now allocate it. */
-  serial->size = body_size + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE;
-  serial->body_size = body_size;
-  serial->data = malloc(serial->size);
-  if(serial->data == NULL) {
-    SRVD_LOG_ERROR("srvd_protocol_serial_packet_serialize: Unable to allocate memory for "
-                   "packet buffer");
+  if(!_srvd_protocol_serial_packet_representable(packet, version)) {
+    SRVD_LOG_ERROR("srvd_protocol_serial_packet_serialize_into: Packet has entries too large "
+                   "for version %u", version);
     return SRVD_FALSE;
   }
 
-  memset(serial->data, 0, serial->size);
+  /* How big do we need the packet to be? */
+  body_size = _srvd_protocol_serial_packet_body_size(packet, version);
+  if((uint64_t)body_size > UINT32_MAX) {
+    SRVD_LOG_ERROR("srvd_protocol_serial_packet_serialize_into: Packet is too large");
+    return SRVD_FALSE;
+  }
+  else if(size < body_size + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE) {
+    SRVD_LOG_ERROR("srvd_protocol_serial_packet_serialize_into: Buffer is too small for packet");
+    return SRVD_FALSE;
+  }
 
   /* And copy the data into it. */
-  *(uint16_t *)(serial->data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_VERSION) =
-    htons((uint16_t)SRVD_PROTOCOL_SERIAL_PACKET_VERSION);
-  *(uint16_t *)(serial->data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_COUNT) =
+  *(uint16_t *)(buffer + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_VERSION) =
+    htons((uint16_t)(version | flags));
+  *(uint16_t *)(buffer + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_COUNT) =
     htons((uint16_t)packet->field_count);
-  *(uint32_t *)(serial->data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_SIZE) =
-    htonl((uint32_t)serial->body_size);
+  *(uint32_t *)(buffer + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_SIZE) =
+    htonl((uint32_t)body_size);
+
+  if(version >= SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT) {
+    _srvd_protocol_serial_packet_serialize_body_varint(packet,
+                                                       buffer + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
+    return SRVD_TRUE;
+  }
 
-  for(field = packet->field_head, p = serial->data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE;
+  for(field = packet->field_head, p = buffer + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE;
       field != NULL;
       field = field->next) {
     srvd_protocol_packet_field_entry_t *entry;
@@ -106,9 +240,7 @@ srvd_boolean_t srvd_protocol_serial_packet_serialize(srvd_protocol_serial_packet
 
     p += SRVD_PROTOCOL_SERIAL_PACKET_FIELD_HEADER_SIZE;
 
-    for(entry = field->entry_head;
-        entry != NULL;
-        p += entry->size, entry = entry->next) {
+    SRVD_PROTOCOL_PACKET_FIELD_ENTRY_ITERATE(field, entry) {
       /* Headers. */
       *(uint16_t *)(p + SRVD_PROTOCOL_SERIAL_PACKET_FIELD_ENTRY_HEADER_OFFSET_SIZE) =
         htons((uint16_t)entry->size);
@@ -117,23 +249,99 @@ srvd_boolean_t srvd_protocol_serial_packet_serialize(srvd_protocol_serial_packet
 
       /* The real data! */
       memcpy(p, entry->data, entry->size);
+      p += entry->size;
     }
   }
 
   return SRVD_TRUE;
 }
 
+/* Replaces a serialized packet with a compressed copy, if that's smaller. */
+static void _srvd_protocol_serial_packet_compress(srvd_protocol_serial_packet_t *serial) {
+  char *compressed;
+  size_t size;
+
+  /* There's no point keeping it unless it saves something. */
+  size = serial->body_size - SRVD_PROTOCOL_SERIAL_PACKET_COMPRESSED_HEADER_SIZE - 1;
+
+  compressed = malloc(SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE +
+                      SRVD_PROTOCOL_SERIAL_PACKET_COMPRESSED_HEADER_SIZE + size);
+  if(compressed == NULL)
+    return;
+
+  size = srvd_protocol_compress(serial->data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE,
+                                serial->body_size,
+                                compressed + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE +
+                                SRVD_PROTOCOL_SERIAL_PACKET_COMPRESSED_HEADER_SIZE, size);
+  if(size == 0) {
+    free(compressed);
+    return;
+  }
+
+  serial->flags |= SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED;
+  *(uint32_t *)(compressed + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE) =
+    htonl((uint32_t)serial->body_size);
+
+  serial->body_size = SRVD_PROTOCOL_SERIAL_PACKET_COMPRESSED_HEADER_SIZE + size;
+  serial->size = SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE + serial->body_size;
+
+  *(uint16_t *)(compressed + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_VERSION) =
+    htons((uint16_t)(serial->version | serial->flags));
+  *(uint16_t *)(compressed + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_COUNT) =
+    htons(serial->field_count);
+  *(uint32_t *)(compressed + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_SIZE) =
+    htonl((uint32_t)serial->body_size);
+
+  free(serial->data);
+  serial->data = compressed;
+}
+
+srvd_boolean_t srvd_protocol_serial_packet_serialize(srvd_protocol_serial_packet_t *serial,
+                                                     const srvd_protocol_packet_t *packet) {
+  SRVD_RETURN_FALSE_UNLESS(serial);
+  SRVD_RETURN_FALSE_UNLESS(packet);
+
+  /* Just for reference... */
+  serial->field_count = packet->field_count;
+  serial->flags &= (uint16_t)~SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED;
+
+  /* Okay, now allocate it. */
+  serial->size = srvd_protocol_serial_packet_size_version(packet, serial->version);
+  serial->body_size = serial->size - SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE;
+  serial->data = malloc(serial->size);
+  if(serial->data == NULL) {
+    SRVD_LOG_ERROR("srvd_protocol_serial_packet_serialize: Unable to allocate memory for "
+                   "packet buffer");
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_protocol_serial_packet_serialize_into_version(packet, serial->data, serial->size,
+                                                         (uint16_t)(serial->version |
+                                                                    serial->flags)))
+    return SRVD_FALSE;
+
+  if((serial->flags & SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE) &&
+     serial->size >= SRVD_PROTOCOL_SERIAL_PACKET_COMPRESS_THRESHOLD)
+    _srvd_protocol_serial_packet_compress(serial);
+
+  return SRVD_TRUE;
+}
+
 srvd_boolean_t srvd_protocol_serial_packet_unserialize_header(srvd_protocol_serial_packet_t *serial,
                                                               srvd_protocol_packet_t *packet,
                                                               char *header) {
+  SRVD_UNUSED(packet);
+
   SRVD_RETURN_FALSE_UNLESS(serial);
-  SRVD_RETURN_FALSE_UNLESS(packet);
   SRVD_RETURN_FALSE_UNLESS(header);
 
-  /* Make sure the packet version matches. */
-  if(SRVD_PROTOCOL_SERIAL_PACKET_VERSION_GET(header) != (uint16_t)SRVD_PROTOCOL_SERIAL_PACKET_VERSION) {
-    SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_header: Packet header version "
-                   "mismatch (is the data source correct?)");
+  /* Make sure we know how to read this version. */
+  serial->version = SRVD_PROTOCOL_SERIAL_PACKET_VERSION_GET(header);
+  serial->flags = serial->version & SRVD_PROTOCOL_SERIAL_PACKET_FLAGS;
+  serial->version &= (uint16_t)~SRVD_PROTOCOL_SERIAL_PACKET_FLAGS;
+  if(!_srvd_protocol_serial_packet_version_supported(serial->version)) {
+    SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_header: Unsupported packet version "
+                   "%u (is the data source correct?)", serial->version);
     return SRVD_FALSE;
   }
 
@@ -145,12 +353,196 @@ srvd_boolean_t srvd_protocol_serial_packet_unserialize_header(srvd_protocol_seri
   return SRVD_TRUE;
 }
 
+static srvd_boolean_t _srvd_protocol_serial_packet_unserialize_body_varint(srvd_protocol_serial_packet_t *serial,
+                                                                           srvd_protocol_packet_t *packet,
+                                                                           char *body) {
+  char *p = body, *end = body + serial->body_size;
+  uint16_t i;
+
+  for(i = 0; i < serial->field_count; i++) {
+    srvd_protocol_packet_field_t *field = NULL;
+    uint32_t type, entry, entry_count;
+    size_t n, m;
+
+    n = srvd_protocol_serial_packet_varint_get(p, (size_t)(end - p), &type);
+    m = n ? srvd_protocol_serial_packet_varint_get(p + n, (size_t)(end - p) - n, &entry_count) : 0;
+    if(m == 0 || type > UINT16_MAX) {
+      SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_body: Error: Invalid field header");
+      return SRVD_FALSE;
+    }
+    p += n + m;
+
+    if(!srvd_protocol_packet_field_get_or_add(packet, (srvd_protocol_type_t)type, &field)) {
+      SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_body: Unable to get field instance");
+      return SRVD_FALSE;
+    }
+
+    for(entry = 0; entry < entry_count; entry++) {
+      uint32_t header, size, value;
+      char packed[sizeof(uint32_t)];
+      void *data;
+
+      n = srvd_protocol_serial_packet_varint_get(p, (size_t)(end - p), &header);
+      size = header >> 1;
+      if(n == 0) {
+        SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_body: Error: Invalid entry "
+                       "header");
+        return SRVD_FALSE;
+      }
+      p += n;
+
+      if(header & 1) {
+        /* Put the integer back the way it was. */
+        n = srvd_protocol_serial_packet_varint_get(p, (size_t)(end - p), &value);
+        if(n == 0 || (size != sizeof(uint32_t) &&
+                      (size != sizeof(uint16_t) || value > UINT16_MAX))) {
+          SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_body: Error: Invalid integer "
+                         "entry");
+          return SRVD_FALSE;
+        }
+        p += n;
+
+        if(size == sizeof(uint32_t)) {
+          uint32_t v = htonl(value);
+          memcpy(packed, &v, sizeof(uint32_t));
+        }
+        else {
+          uint16_t v = htons((uint16_t)value);
+          memcpy(packed, &v, sizeof(uint16_t));
+        }
+        data = packed;
+      }
+      else {
+        if((size_t)(end - p) < size) {
+          SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_body: Error: Buffer overrun "
+                         "while reading packet field entry");
+          return SRVD_FALSE;
+        }
+
+        data = p;
+        p += size;
+      }
+
+      if(!srvd_protocol_packet_field_entry_add(field, size, size ? data : NULL)) {
+        SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_body: Error: Could not initialize "
+                       "packet field");
+        return SRVD_FALSE;
+      }
+    }
+  }
+
+  return SRVD_TRUE;
+}
+
+/* Decompresses a body into a new buffer, after the given number of bytes left
+ * free at the start, setting the size to what it decompressed to. */
+static char *_srvd_protocol_serial_packet_decompress(const srvd_protocol_serial_packet_t *serial,
+                                                     const char *body, size_t offset,
+                                                     size_t *size) {
+  size_t body_size = serial->body_size;
+  char *buffer;
+
+  if(body_size < SRVD_PROTOCOL_SERIAL_PACKET_COMPRESSED_HEADER_SIZE) {
+    SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_body: Error: Compressed body is too "
+                   "small");
+    return NULL;
+  }
+  body_size -= SRVD_PROTOCOL_SERIAL_PACKET_COMPRESSED_HEADER_SIZE;
+
+  /* Don't let a bogus size make us allocate more than it could possibly
+   * decompress to. */
+  *size = ntohl(*(const uint32_t *)body);
+  if(*size / SRVD_PROTOCOL_COMPRESS_RATIO_MAXIMUM > body_size) {
+    SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_body: Error: Invalid uncompressed "
+                   "body size");
+    return NULL;
+  }
+
+  buffer = malloc(offset + *size > 0 ? offset + *size : 1);
+  if(buffer == NULL) {
+    SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_body: Unable to allocate memory for "
+                   "uncompressed body");
+    return NULL;
+  }
+
+  if(!srvd_protocol_decompress(body + SRVD_PROTOCOL_SERIAL_PACKET_COMPRESSED_HEADER_SIZE,
+                               body_size, buffer + offset, *size)) {
+    SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_body: Error: Could not decompress "
+                   "body");
+    free(buffer);
+    return NULL;
+  }
+
+  return buffer;
+}
+
+static srvd_boolean_t _srvd_protocol_serial_packet_unserialize_body_compressed(srvd_protocol_serial_packet_t *serial,
+                                                                               srvd_protocol_packet_t *packet,
+                                                                               char *body) {
+  srvd_boolean_t status;
+  size_t body_size = serial->body_size, size;
+  char *buffer;
+
+  buffer = _srvd_protocol_serial_packet_decompress(serial, body, 0, &size);
+  if(buffer == NULL)
+    return SRVD_FALSE;
+
+  serial->body_size = size;
+  serial->flags &= (uint16_t)~SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED;
+
+  status = srvd_protocol_serial_packet_unserialize_body(serial, packet, buffer);
+
+  serial->body_size = body_size;
+  serial->flags |= SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED;
+  free(buffer);
+
+  return status;
+}
+
+srvd_boolean_t srvd_protocol_serial_packet_decompress(srvd_protocol_serial_packet_t *serial) {
+  char *data;
+  size_t size;
+
+  SRVD_RETURN_FALSE_UNLESS(serial);
+  SRVD_RETURN_FALSE_UNLESS(serial->data);
+
+  if(!(serial->flags & SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED))
+    return SRVD_TRUE;
+
+  data = _srvd_protocol_serial_packet_decompress(serial, serial->data +
+                                                 SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE,
+                                                 SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE, &size);
+  if(data == NULL)
+    return SRVD_FALSE;
+
+  serial->flags &= (uint16_t)~SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED;
+  serial->body_size = size;
+  serial->size = SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE + size;
+
+  *(uint16_t *)(data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_VERSION) =
+    htons((uint16_t)(serial->version | serial->flags));
+  *(uint16_t *)(data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_COUNT) =
+    htons(serial->field_count);
+  *(uint32_t *)(data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_SIZE) = htonl((uint32_t)size);
+
+  free(serial->data);
+  serial->data = data;
+
+  return SRVD_TRUE;
+}
+
 srvd_boolean_t srvd_protocol_serial_packet_unserialize_body(srvd_protocol_serial_packet_t *serial,
                                                             srvd_protocol_packet_t *packet,
                                                             char *body) {
   char *p;
   uint16_t i;
 
+  if(serial->flags & SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED)
+    return _srvd_protocol_serial_packet_unserialize_body_compressed(serial, packet, body);
+
+  if(serial->version >= SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT)
+    return _srvd_protocol_serial_packet_unserialize_body_varint(serial, packet, body);
+
   /* Make sure we can legitimately read through this. */
   if(serial->body_size < (size_t)(serial->field_count * SRVD_PROTOCOL_SERIAL_PACKET_FIELD_HEADER_SIZE)) {
     SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_body: Error: Field header size is "
@@ -187,6 +579,8 @@ srvd_boolean_t srvd_protocol_serial_packet_unserialize_body(srvd_protocol_serial
 
     p += SRVD_PROTOCOL_SERIAL_PACKET_FIELD_HEADER_SIZE;
 
+    /* The field belongs to the packet now, so it's freed along with it if
+     * anything goes wrong. */
     for(entry = 0; entry < entry_count; entry++) {
       uint16_t size = ntohs(*(uint16_t *)(p + SRVD_PROTOCOL_SERIAL_PACKET_FIELD_ENTRY_HEADER_OFFSET_SIZE));
 
@@ -194,18 +588,15 @@ srvd_boolean_t srvd_protocol_serial_packet_unserialize_body(srvd_protocol_serial
       if((size_t)(p + SRVD_PROTOCOL_SERIAL_PACKET_FIELD_ENTRY_HEADER_SIZE - body) + size > serial->body_size) {
         SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_body: Error: Buffer overrun while "
                        "reading packet field entry");
-        srvd_protocol_packet_field_finalize(field);
-        srvd_protocol_packet_field_free(field);
         return SRVD_FALSE;
       }
 
-      void *data = (void *)(p + SRVD_PROTOCOL_SERIAL_PACKET_FIELD_ENTRY_HEADER_SIZE);
+      /* (Empty entries have no data.) */
+      void *data = size ? (void *)(p + SRVD_PROTOCOL_SERIAL_PACKET_FIELD_ENTRY_HEADER_SIZE) : NULL;
 
       if(!srvd_protocol_packet_field_entry_add(field, size, data)) {
         SRVD_LOG_ERROR("srvd_protocol_serial_packet_unserialize_body: Error: Could not initialize "
                        "packet field");
-        srvd_protocol_packet_field_finalize(field);
-        srvd_protocol_packet_field_free(field);
         return SRVD_FALSE;
       }
 
@@ -215,3 +606,161 @@ srvd_boolean_t srvd_protocol_serial_packet_unserialize_body(srvd_protocol_serial
 
   return SRVD_TRUE;
 }
+
+srvd_boolean_t srvd_protocol_serial_packet_reader_initialize(srvd_protocol_serial_packet_reader_t *reader,
+                                                             const srvd_protocol_serial_packet_t *serial,
+                                                             const char *body) {
+  size_t body_size = serial ? serial->body_size : 0;
+
+  SRVD_RETURN_FALSE_UNLESS(reader);
+  SRVD_RETURN_FALSE_UNLESS(serial);
+  SRVD_RETURN_FALSE_UNLESS(body);
+
+  reader->version = serial->version;
+  reader->field_count = 0;
+  reader->entry_count = 0;
+  reader->error = SRVD_FALSE;
+  reader->buffer = NULL;
+
+  if(serial->flags & SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED) {
+    reader->buffer = _srvd_protocol_serial_packet_decompress(serial, body, 0, &body_size);
+    if(reader->buffer == NULL) {
+      reader->error = SRVD_TRUE;
+      return SRVD_FALSE;
+    }
+
+    body = reader->buffer;
+  }
+
+  reader->field_count = serial->field_count;
+  reader->p = body;
+  reader->end = body + body_size;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_protocol_serial_packet_reader_finalize(srvd_protocol_serial_packet_reader_t *reader) {
+  SRVD_RETURN_FALSE_UNLESS(reader);
+
+  if(reader->buffer)
+    free(reader->buffer);
+  reader->buffer = NULL;
+
+  return SRVD_TRUE;
+}
+
+static srvd_boolean_t _srvd_protocol_serial_packet_reader_fail(srvd_protocol_serial_packet_reader_t *reader,
+                                                               const char *message) {
+  SRVD_LOG_ERROR("srvd_protocol_serial_packet_reader: Error: %s", message);
+
+  reader->field_count = 0;
+  reader->entry_count = 0;
+  reader->error = SRVD_TRUE;
+
+  return SRVD_FALSE;
+}
+
+srvd_boolean_t srvd_protocol_serial_packet_reader_field_next(srvd_protocol_serial_packet_reader_t *reader,
+                                                             srvd_protocol_type_t *type,
+                                                             uint32_t *entry_count) {
+  const char *data;
+  uint32_t value, size;
+  size_t n, m;
+
+  SRVD_RETURN_FALSE_UNLESS(reader);
+  SRVD_RETURN_FALSE_UNLESS(type);
+  SRVD_RETURN_FALSE_UNLESS(entry_count);
+
+  /* Skip whatever's left of the last one. */
+  while(reader->entry_count > 0) {
+    if(!srvd_protocol_serial_packet_reader_entry_next(reader, &data, &size))
+      return SRVD_FALSE;
+  }
+
+  if(reader->field_count == 0)
+    return SRVD_FALSE;
+  reader->field_count--;
+
+  if(reader->version < SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT) {
+    if(reader->end - reader->p < SRVD_PROTOCOL_SERIAL_PACKET_FIELD_HEADER_SIZE)
+      return _srvd_protocol_serial_packet_reader_fail(reader, "Reading after end of valid data");
+
+    *type = (srvd_protocol_type_t)ntohs(*(const uint16_t *)(reader->p + SRVD_PROTOCOL_SERIAL_PACKET_FIELD_HEADER_OFFSET_TYPE));
+    *entry_count = ntohs(*(const uint16_t *)(reader->p + SRVD_PROTOCOL_SERIAL_PACKET_FIELD_HEADER_OFFSET_COUNT));
+    reader->p += SRVD_PROTOCOL_SERIAL_PACKET_FIELD_HEADER_SIZE;
+  }
+  else {
+    n = srvd_protocol_serial_packet_varint_get(reader->p, (size_t)(reader->end - reader->p), &value);
+    m = n ? srvd_protocol_serial_packet_varint_get(reader->p + n,
+                                                   (size_t)(reader->end - reader->p) - n,
+                                                   entry_count) : 0;
+    if(m == 0 || value > UINT16_MAX)
+      return _srvd_protocol_serial_packet_reader_fail(reader, "Invalid field header");
+
+    *type = (srvd_protocol_type_t)value;
+    reader->p += n + m;
+  }
+
+  reader->entry_count = *entry_count;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_protocol_serial_packet_reader_entry_next(srvd_protocol_serial_packet_reader_t *reader,
+                                                             const char **data, uint32_t *size) {
+  uint32_t header, value;
+  size_t n;
+
+  SRVD_RETURN_FALSE_UNLESS(reader);
+  SRVD_RETURN_FALSE_UNLESS(data);
+  SRVD_RETURN_FALSE_UNLESS(size);
+
+  if(reader->entry_count == 0)
+    return SRVD_FALSE;
+  reader->entry_count--;
+
+  if(reader->version < SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT) {
+    if(reader->end - reader->p < SRVD_PROTOCOL_SERIAL_PACKET_FIELD_ENTRY_HEADER_SIZE)
+      return _srvd_protocol_serial_packet_reader_fail(reader, "Invalid entry header");
+
+    *size = ntohs(*(const uint16_t *)(reader->p + SRVD_PROTOCOL_SERIAL_PACKET_FIELD_ENTRY_HEADER_OFFSET_SIZE));
+    reader->p += SRVD_PROTOCOL_SERIAL_PACKET_FIELD_ENTRY_HEADER_SIZE;
+  }
+  else {
+    n = srvd_protocol_serial_packet_varint_get(reader->p, (size_t)(reader->end - reader->p), &header);
+    if(n == 0)
+      return _srvd_protocol_serial_packet_reader_fail(reader, "Invalid entry header");
+    reader->p += n;
+    *size = header >> 1;
+
+    if(header & 1) {
+      n = srvd_protocol_serial_packet_varint_get(reader->p, (size_t)(reader->end - reader->p),
+                                                 &value);
+      if(n == 0 || (*size != sizeof(uint32_t) &&
+                    (*size != sizeof(uint16_t) || value > UINT16_MAX)))
+        return _srvd_protocol_serial_packet_reader_fail(reader, "Invalid integer entry");
+      reader->p += n;
+
+      if(*size == sizeof(uint32_t)) {
+        uint32_t v = htonl(value);
+        memcpy(reader->packed, &v, sizeof(uint32_t));
+      }
+      else {
+        uint16_t v = htons((uint16_t)value);
+        memcpy(reader->packed, &v, sizeof(uint16_t));
+      }
+      *data = reader->packed;
+
+      return SRVD_TRUE;
+    }
+  }
+
+  if((size_t)(reader->end - reader->p) < *size)
+    return _srvd_protocol_serial_packet_reader_fail(reader, "Buffer overrun while reading packet "
+                                                    "field entry");
+
+  *data = reader->p;
+  reader->p += *size;
+
+  return SRVD_TRUE;
+}
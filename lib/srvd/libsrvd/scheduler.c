@@ -0,0 +1,238 @@
+/* scheduler.c: Request scheduling.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+/* For struct ucred. */
+#define _GNU_SOURCE
+
+#include <srvd/scheduler.h>
+
+#include <sys/socket.h>
+
+/* Peers we can't identify are told apart by connection, above the range of
+ * process IDs. */
+#define _SRVD_SCHEDULER_PEER_CONNECTION ((srvd_scheduler_peer_t)1 << 32)
+
+static const uint32_t _srvd_scheduler_weights_default[SRVD_SCHEDULER_CLASS_COUNT] = {
+  SRVD_SCHEDULER_WEIGHT_POINT_DEFAULT,
+  SRVD_SCHEDULER_WEIGHT_BATCH_DEFAULT,
+  SRVD_SCHEDULER_WEIGHT_ENUMERATION_DEFAULT,
+  SRVD_SCHEDULER_WEIGHT_ADMIN_DEFAULT
+};
+
+void srvd_scheduler_weights_default(uint32_t *weights) {
+  SRVD_RETURN_UNLESS(weights);
+
+  memcpy(weights, _srvd_scheduler_weights_default, sizeof(_srvd_scheduler_weights_default));
+}
+
+srvd_boolean_t srvd_scheduler_initialize(srvd_scheduler_t *scheduler, const uint32_t *weights) {
+  uint8_t i;
+
+  SRVD_RETURN_FALSE_UNLESS(scheduler);
+
+  if(weights == NULL)
+    weights = _srvd_scheduler_weights_default;
+
+  for(i = 0; i < SRVD_SCHEDULER_CLASS_COUNT; i++) {
+    SRVD_RETURN_FALSE_UNLESS(weights[i] > 0);
+
+    scheduler->classes[i].weight = weights[i];
+    scheduler->classes[i].credit = 0;
+    scheduler->classes[i].item_count = 0;
+    scheduler->classes[i].cursor = NULL;
+  }
+
+  scheduler->item_count = 0;
+  scheduler->spare = NULL;
+
+  return SRVD_TRUE;
+}
+
+static void _srvd_scheduler_queues_free(srvd_scheduler_queue_t *cursor) {
+  srvd_scheduler_queue_t *i, *ni;
+
+  if(cursor == NULL)
+    return;
+
+  /* Break the ring so we know where to stop. */
+  i = cursor->next;
+  cursor->next = NULL;
+  for(; i != NULL; i = ni) {
+    ni = i->next;
+    free(i);
+  }
+}
+
+srvd_boolean_t srvd_scheduler_finalize(srvd_scheduler_t *scheduler) {
+  srvd_scheduler_queue_t *i, *ni;
+  uint8_t j;
+
+  SRVD_RETURN_FALSE_UNLESS(scheduler);
+
+  for(j = 0; j < SRVD_SCHEDULER_CLASS_COUNT; j++) {
+    _srvd_scheduler_queues_free(scheduler->classes[j].cursor);
+    scheduler->classes[j].cursor = NULL;
+    scheduler->classes[j].item_count = 0;
+  }
+
+  for(i = scheduler->spare; i != NULL; i = ni) {
+    ni = i->next;
+    free(i);
+  }
+  scheduler->spare = NULL;
+  scheduler->item_count = 0;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_scheduler_push(srvd_scheduler_t *scheduler, srvd_scheduler_item_t *item,
+                                   uint8_t request_class, srvd_scheduler_peer_t peer) {
+  srvd_scheduler_class_t *c;
+  srvd_scheduler_queue_t *queue = NULL;
+
+  SRVD_RETURN_FALSE_UNLESS(scheduler);
+  SRVD_RETURN_FALSE_UNLESS(item);
+  SRVD_RETURN_FALSE_UNLESS(request_class < SRVD_SCHEDULER_CLASS_COUNT);
+
+  c = &scheduler->classes[request_class];
+
+  if(c->cursor) {
+    queue = c->cursor;
+    do {
+      if(queue->peer == peer)
+        break;
+      queue = queue->next;
+    } while(queue != c->cursor);
+
+    if(queue->peer != peer)
+      queue = NULL;
+  }
+
+  if(queue == NULL) {
+    if(scheduler->spare) {
+      queue = scheduler->spare;
+      scheduler->spare = queue->next;
+    }
+    else {
+      queue = malloc(sizeof(srvd_scheduler_queue_t));
+      if(queue == NULL) {
+        SRVD_LOG_ERROR("srvd_scheduler_push: Unable to allocate memory for queue");
+        return SRVD_FALSE;
+      }
+    }
+
+    queue->peer = peer;
+    queue->head = queue->tail = NULL;
+
+    /* Newcomers wait for everyone already in line to have a turn. */
+    if(c->cursor) {
+      queue->next = c->cursor->next;
+      c->cursor->next = queue;
+    }
+    else
+      queue->next = queue;
+    c->cursor = queue;
+  }
+
+  item->next = NULL;
+  if(queue->tail)
+    queue->tail->next = item;
+  else
+    queue->head = item;
+  queue->tail = item;
+
+  c->item_count++;
+  scheduler->item_count++;
+
+  return SRVD_TRUE;
+}
+
+/* Takes the next request from a class, moving on to the next peer. */
+static srvd_scheduler_item_t *_srvd_scheduler_class_pop(srvd_scheduler_t *scheduler,
+                                                        srvd_scheduler_class_t *c) {
+  srvd_scheduler_queue_t *queue = c->cursor->next;
+  srvd_scheduler_item_t *item = queue->head;
+
+  queue->head = item->next;
+  item->next = NULL;
+
+  if(queue->head == NULL) {
+    /* Out of the ring, and into the spares. */
+    if(queue == c->cursor)
+      c->cursor = NULL;
+    else
+      c->cursor->next = queue->next;
+
+    queue->tail = NULL;
+    queue->next = scheduler->spare;
+    scheduler->spare = queue;
+  }
+  else
+    c->cursor = queue;
+
+  c->item_count--;
+  scheduler->item_count--;
+
+  return item;
+}
+
+srvd_boolean_t srvd_scheduler_pop(srvd_scheduler_t *scheduler, srvd_scheduler_item_t **item) {
+  srvd_scheduler_class_t *best = NULL;
+  int64_t total = 0;
+  uint8_t i;
+
+  SRVD_RETURN_FALSE_UNLESS(scheduler);
+  SRVD_RETURN_FALSE_UNLESS(item);
+
+  if(scheduler->item_count == 0)
+    return SRVD_FALSE;
+
+  /* Every class with something waiting earns its weight; the richest goes,
+   * and pays for everyone. */
+  for(i = 0; i < SRVD_SCHEDULER_CLASS_COUNT; i++) {
+    srvd_scheduler_class_t *c = &scheduler->classes[i];
+
+    if(c->item_count == 0)
+      continue;
+
+    c->credit += c->weight;
+    total += c->weight;
+    if(best == NULL || c->credit > best->credit)
+      best = c;
+  }
+
+  best->credit -= total;
+  *item = _srvd_scheduler_class_pop(scheduler, best);
+
+  /* Idle classes don't get to save up. */
+  if(best->item_count == 0)
+    best->credit = 0;
+
+  return SRVD_TRUE;
+}
+
+srvd_scheduler_peer_t srvd_scheduler_peer_get(int connection) {
+#ifdef SO_PEERCRED
+  struct sockaddr_storage address;
+  socklen_t address_length = sizeof(address);
+  struct ucred credentials;
+  socklen_t length = sizeof(credentials);
+
+  /* Other kinds of sockets may answer SO_PEERCRED too, just with nothing
+   * useful in it (a pid of 0 for TCP), and then every client would look like
+   * the same peer. */
+  if(getsockname(connection, (struct sockaddr *)&address, &address_length) == 0 &&
+     address.ss_family == AF_UNIX &&
+     getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0 &&
+     length == sizeof(credentials) && credentials.pid > 0)
+    return (srvd_scheduler_peer_t)credentials.pid;
+#endif
+
+  return _SRVD_SCHEDULER_PEER_CONNECTION | (srvd_scheduler_peer_t)(unsigned int)connection;
+}
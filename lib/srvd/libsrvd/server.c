@@ -8,12 +8,48 @@
  */
 
 #include <srvd/server.h>
+#include <srvd/server/shm.h>
+#include <srvd/protocol/extension.h>
+#include <srvd/protocol/serial_packet.h>
+#include <srvd/service/nss/aliases.h>
+#include <srvd/service/nss/group.h>
+#include <srvd/service/nss/passwd.h>
+
+#include "probe.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+/* How many connections we have room for before we have to grow the list. */
+#define _SRVD_SERVER_SOCKET_CONNECTIONS_INITIAL 16
+
+/* The entries in the connection list before the clients: the listening
+ * socket, and the pipe other threads wake us up with when they submit a
+ * request. */
+#define _SRVD_SERVER_SOCKET_CLIENTS_FIRST 2
+
+/* How many requests we answer between checks for new ones. */
+#define _SRVD_SERVER_SOCKET_ANSWERS_PER_PASS 8
 
 srvd_boolean_t srvd_server_initialize(srvd_server_t *server) {
   SRVD_RETURN_FALSE_UNLESS(server);
 
   server->executing = SRVD_FALSE;
   server->services = NULL;
+  server->capture = NULL;
+  srvd_protocol_hello_initialize_local(&server->hello);
+  srvd_scheduler_weights_default(server->scheduling_weights);
+  server->submissions = NULL;
+  server->submissions_wake = -1;
+
+  if(!srvd_stats_initialize(&server->stats, SRVD_STATS_SLOT_COUNT_DEFAULT)) {
+    SRVD_LOG_ERROR("srvd_server_initialize: Unable to initialize statistics");
+    return SRVD_FALSE;
+  }
+
+  SRVD_THREAD_MUTEX_INITIALIZE(server->submissions_lock);
+  SRVD_THREAD_CONDITION_INITIALIZE(server->submissions_done);
 
   return SRVD_TRUE;
 }
@@ -23,6 +59,9 @@ srvd_boolean_t srvd_server_finalize(srvd_server_t *server) {
 
   server->executing = SRVD_FALSE;
 
+  /* Sessions use the services, so they have to be gone first. */
+  srvd_server_shm_detach(server);
+
   srvd_server_service_t *i, *ni;
   for(i = server->services, ni = i ? i->next : NULL;
       i != NULL;
@@ -31,9 +70,65 @@ srvd_boolean_t srvd_server_finalize(srvd_server_t *server) {
   }
   server->services = NULL;
 
+  srvd_stats_finalize(&server->stats);
+  srvd_server_capture(server, NULL);
+
+  SRVD_THREAD_MUTEX_FINALIZE(server->submissions_lock);
+  SRVD_THREAD_CONDITION_FINALIZE(server->submissions_done);
+
   return SRVD_TRUE;
 }
 
+srvd_boolean_t srvd_server_capture(srvd_server_t *server, const char *path) {
+  SRVD_RETURN_FALSE_UNLESS(server);
+
+  if(server->capture) {
+    srvd_capture_finalize(server->capture);
+    srvd_capture_free(server->capture);
+    server->capture = NULL;
+  }
+
+  if(path == NULL)
+    return SRVD_TRUE;
+
+  server->capture = srvd_capture_allocate();
+  if(server->capture == NULL)
+    return SRVD_FALSE;
+
+  if(!srvd_capture_initialize(server->capture, path)) {
+    SRVD_LOG_ERROR("srvd_server_capture: Unable to start capture log");
+    srvd_capture_free(server->capture);
+    server->capture = NULL;
+    return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+/* The request validator for each type we have a schema for. */
+#define _SRVD_SERVER_VALIDATOR(database, name, type, kind, value_type) \
+  { (type), srvd_service_##database##_request_validate },
+
+static const struct {
+  srvd_protocol_type_t type;
+  srvd_server_service_validator_pt validator;
+} _srvd_server_validators[] = {
+  SRVD_SERVICE_NSS_PASSWD_REQUEST_SCHEMA(_SRVD_SERVER_VALIDATOR)
+  SRVD_SERVICE_NSS_GROUP_REQUEST_SCHEMA(_SRVD_SERVER_VALIDATOR)
+  SRVD_SERVICE_NSS_ALIASES_REQUEST_SCHEMA(_SRVD_SERVER_VALIDATOR)
+};
+
+static srvd_server_service_validator_pt _srvd_server_validator_get(srvd_protocol_type_t type) {
+  size_t i;
+
+  for(i = 0; i < sizeof(_srvd_server_validators) / sizeof(_srvd_server_validators[0]); i++) {
+    if(_srvd_server_validators[i].type == type)
+      return _srvd_server_validators[i].validator;
+  }
+
+  return NULL;
+}
+
 srvd_boolean_t srvd_server_service_add(srvd_server_t *server, srvd_protocol_type_t type,
                                        srvd_server_service_handler_pt handler) {
   SRVD_RETURN_FALSE_UNLESS(server);
@@ -47,6 +142,8 @@ srvd_boolean_t srvd_server_service_add(srvd_server_t *server, srvd_protocol_type
 
     node->type = type;
     node->handler = handler;
+    node->validator = _srvd_server_validator_get(type);
+    node->scheduling_class = SRVD_SCHEDULER_CLASS_POINT;
     node->next = server->services;
 
     server->services = node;
@@ -104,3 +201,1418 @@ srvd_boolean_t srvd_server_service_remove(srvd_server_t *server, srvd_protocol_t
 
   return SRVD_FALSE;
 }
+
+srvd_boolean_t srvd_server_service_class_set(srvd_server_t *server, srvd_protocol_type_t type,
+                                             uint8_t scheduling_class) {
+  SRVD_RETURN_FALSE_UNLESS(server);
+  SRVD_RETURN_FALSE_UNLESS(scheduling_class < SRVD_SCHEDULER_CLASS_COUNT);
+
+  srvd_server_service_t *i = server->services;
+  for(; i != NULL; i = i->next) {
+    if(i->type == type) {
+      i->scheduling_class = scheduling_class;
+      return SRVD_TRUE;
+    }
+  }
+
+  return SRVD_FALSE;
+}
+
+srvd_boolean_t srvd_server_service_validator_set(srvd_server_t *server, srvd_protocol_type_t type,
+                                                 srvd_server_service_validator_pt validator) {
+  SRVD_RETURN_FALSE_UNLESS(server);
+
+  srvd_server_service_t *i = server->services;
+  for(; i != NULL; i = i->next) {
+    if(i->type == type) {
+      i->validator = validator;
+      return SRVD_TRUE;
+    }
+  }
+
+  return SRVD_FALSE;
+}
+
+static srvd_server_service_t *_srvd_server_service_find(srvd_server_t *server,
+                                                        srvd_protocol_type_t type) {
+  srvd_server_service_t *i = server->services;
+  for(; i != NULL; i = i->next) {
+    if(i->type == type)
+      return i;
+  }
+
+  return NULL;
+}
+
+static void _srvd_server_dispatch_single(srvd_server_t *server, srvd_protocol_type_t type,
+                                         const srvd_service_request_t *request,
+                                         srvd_service_response_t *response) {
+  srvd_server_service_t *service = NULL;
+
+  /* Okay, let's see if we have a matching handler for the request. */
+  if(type != SRVD_PROTOCOL_BATCH && (service = _srvd_server_service_find(server, type)) != NULL) {
+    if(service->validator && !service->validator(request)) {
+      /* Handlers don't have to cope with requests that don't match the
+       * schema. */
+      SRVD_LOG_WARNING("srvd_server_dispatch: Invalid request of type %u", (unsigned)type);
+      response->status = SRVD_SERVICE_RESPONSE_FAIL;
+    }
+    else {
+      SRVD_PROBE1(server__handler__start, type);
+      service->handler(request, response);
+      SRVD_PROBE2(server__handler__end, type, response->status);
+    }
+
+    /* Get the response status and inject it into the list of fields. */
+    srvd_protocol_packet_field_insert_uint16(&response->packet, SRVD_PROTOCOL_STATUS,
+                                             response->status);
+  }
+  else
+    /* Nope -- unavailable. */
+    srvd_protocol_packet_field_insert_uint16(&response->packet, SRVD_PROTOCOL_STATUS,
+                                             SRVD_SERVICE_RESPONSE_UNAVAIL);
+}
+
+/* A batch request consists of an empty SRVD_PROTOCOL_BATCH field followed by a
+ * field of the type being requested, with one entry per key. We run each key
+ * as if it were a request of its own and pack each serialized response into an
+ * entry of the SRVD_PROTOCOL_BATCH field of the response, in order. A response
+ * too big to be an entry in the version the batch will be sent back in is left
+ * empty, which tells the client to ask for that key on its own. */
+static srvd_boolean_t _srvd_server_dispatch_batch(srvd_server_t *server,
+                                                  const srvd_service_request_t *request,
+                                                  srvd_service_response_t *response,
+                                                  uint16_t version) {
+  srvd_protocol_packet_field_t *keys, *results = NULL;
+  srvd_protocol_packet_field_entry_t *key;
+  uint32_t maximum;
+
+  version &= (uint16_t)~SRVD_PROTOCOL_SERIAL_PACKET_FLAGS;
+  maximum = version < SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT
+    ? UINT16_MAX : SRVD_PROTOCOL_SERIAL_PACKET_ENTRY_SIZE_MAXIMUM;
+
+  keys = request->packet.field_head->next;
+  if(keys == NULL) {
+    SRVD_LOG_WARNING("srvd_server_dispatch: Batch request contains no keys");
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_protocol_packet_field_get_or_add(&response->packet, SRVD_PROTOCOL_BATCH, &results)) {
+    SRVD_LOG_ERROR("srvd_server_dispatch: Unable to get batch field instance");
+    return SRVD_FALSE;
+  }
+
+  SRVD_PROTOCOL_PACKET_FIELD_ENTRY_ITERATE(keys, key) {
+    srvd_service_request_t single_request;
+    srvd_service_response_t single_response;
+    srvd_protocol_serial_packet_t serial;
+
+    srvd_service_request_initialize(&single_request);
+    srvd_service_response_initialize(&single_response);
+    srvd_protocol_serial_packet_initialize(&serial);
+    serial.version = version;
+
+    if(srvd_protocol_packet_field_append(&single_request.packet, keys->type, key->size, key->data))
+      _srvd_server_dispatch_single(server, keys->type, &single_request, &single_response);
+    else {
+      single_response.status = SRVD_SERVICE_RESPONSE_FAIL;
+      srvd_protocol_packet_field_insert_uint16(&single_response.packet, SRVD_PROTOCOL_STATUS,
+                                               single_response.status);
+    }
+
+    if(srvd_protocol_serial_packet_serialize(&serial, &single_response.packet) &&
+       serial.size <= maximum)
+      srvd_protocol_packet_field_entry_add(results, (uint32_t)serial.size, serial.data);
+    else
+      /* Too big to be an entry; the client will have to ask for this key on its
+       * own. */
+      srvd_protocol_packet_field_entry_add(results, 0, NULL);
+
+    srvd_protocol_serial_packet_finalize(&serial);
+    srvd_service_request_finalize(&single_request);
+    srvd_service_response_finalize(&single_response);
+  }
+
+  srvd_protocol_packet_field_insert_uint16(&response->packet, SRVD_PROTOCOL_STATUS,
+                                           SRVD_SERVICE_RESPONSE_SUCCESS);
+
+  return SRVD_TRUE;
+}
+
+static srvd_boolean_t _srvd_server_dispatch_stats(srvd_server_t *server,
+                                                  srvd_service_response_t *response) {
+  srvd_stats_snapshot_t *snapshot;
+  srvd_boolean_t status;
+
+  /* Snapshots are a bit big for the stack. */
+  snapshot = malloc(sizeof(srvd_stats_snapshot_t));
+  if(snapshot == NULL) {
+    SRVD_LOG_ERROR("srvd_server_dispatch: Unable to allocate memory for statistics");
+    status = SRVD_FALSE;
+  }
+  else {
+    status = srvd_stats_snapshot(&server->stats, snapshot) &&
+      srvd_stats_snapshot_pack(snapshot, &response->packet);
+    free(snapshot);
+  }
+
+  response->status = status ? SRVD_SERVICE_RESPONSE_SUCCESS : SRVD_SERVICE_RESPONSE_FAIL;
+  srvd_protocol_packet_field_insert_uint16(&response->packet, SRVD_PROTOCOL_STATUS,
+                                           response->status);
+
+  return SRVD_TRUE;
+}
+
+static srvd_boolean_t _srvd_server_dispatch_hello(srvd_server_t *server,
+                                                  const srvd_service_request_t *request,
+                                                  srvd_service_response_t *response) {
+  srvd_protocol_hello_t hello;
+
+  if(!srvd_protocol_hello_unpack(&request->packet, &hello)) {
+    SRVD_LOG_WARNING("srvd_server_dispatch: Invalid handshake");
+    return SRVD_FALSE;
+  }
+
+  if(srvd_protocol_hello_negotiate(&server->hello, &hello, &hello) &&
+     srvd_protocol_hello_pack(&hello, &response->packet))
+    response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+  else
+    response->status = SRVD_SERVICE_RESPONSE_FAIL;
+
+  srvd_protocol_packet_field_insert_uint16(&response->packet, SRVD_PROTOCOL_STATUS,
+                                           response->status);
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_server_dispatch(srvd_server_t *server, const srvd_service_request_t *request,
+                                    srvd_service_response_t *response) {
+  return srvd_server_dispatch_version(server, request, response,
+                                      SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MAXIMUM);
+}
+
+srvd_boolean_t srvd_server_dispatch_version(srvd_server_t *server,
+                                            const srvd_service_request_t *request,
+                                            srvd_service_response_t *response,
+                                            uint16_t version) {
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_extension_t extension;
+
+  SRVD_RETURN_FALSE_UNLESS(server);
+  SRVD_RETURN_FALSE_UNLESS(request);
+  SRVD_RETURN_FALSE_UNLESS(response);
+
+  if(!srvd_protocol_packet_field_get_first(&request->packet, &field)) {
+    /* Nothing valid? */
+    SRVD_LOG_WARNING("srvd_server_dispatch: Invalid packet");
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_protocol_extension_unpack(&request->packet, &extension)) {
+    SRVD_LOG_WARNING("srvd_server_dispatch: Invalid extension");
+    return SRVD_FALSE;
+  }
+
+  if(server->capture && field->type != SRVD_PROTOCOL_STATS &&
+     field->type != SRVD_PROTOCOL_HELLO)
+    srvd_capture_record(server->capture, &request->packet);
+
+  /* Nobody's waiting for the answer anymore, so don't bother the handler. */
+  if(srvd_protocol_extension_expired(&extension)) {
+    SRVD_PROBE1(server__expired, field->type);
+    response->status = SRVD_SERVICE_RESPONSE_UNAVAIL;
+    srvd_protocol_packet_field_insert_uint16(&response->packet, SRVD_PROTOCOL_STATUS,
+                                             response->status);
+    return SRVD_TRUE;
+  }
+
+  if(field->type == SRVD_PROTOCOL_BATCH)
+    return _srvd_server_dispatch_batch(server, request, response, version);
+  else if(field->type == SRVD_PROTOCOL_STATS)
+    return _srvd_server_dispatch_stats(server, response);
+  else if(field->type == SRVD_PROTOCOL_HELLO)
+    return _srvd_server_dispatch_hello(server, request, response);
+
+  _srvd_server_dispatch_single(server, field->type, request, response);
+
+  return SRVD_TRUE;
+}
+
+void srvd_server_stats_record(srvd_server_t *server, srvd_stats_sample_t *sample,
+                              const srvd_service_request_t *request,
+                              const srvd_service_response_t *response) {
+  SRVD_RETURN_UNLESS(server);
+  SRVD_RETURN_UNLESS(sample);
+
+  srvd_stats_sample_set_packets(sample, request ? &request->packet : NULL,
+                                response ? &response->packet : NULL);
+  srvd_stats_record(&server->stats, sample);
+}
+
+/* Clients may keep a connection open and send several requests before
+ * reading any responses, so requests can arrive in pieces. */
+static ssize_t _srvd_server_socket_read_full(int from, char *buffer, size_t size) {
+  size_t offset = 0;
+
+  while(offset < size) {
+    ssize_t result = read(from, buffer + offset, size - offset);
+    if(result == -1 && errno == EINTR)
+      continue;
+    else if(result <= 0)
+      return result == 0 ? (ssize_t)offset : -1;
+
+    offset += (size_t)result;
+  }
+
+  return (ssize_t)offset;
+}
+
+static ssize_t _srvd_server_socket_write_full(int to, const char *buffer, size_t size) {
+  size_t offset = 0;
+
+  while(offset < size) {
+    ssize_t result = write(to, buffer + offset, size - offset);
+    if(result == -1 && errno == EINTR)
+      continue;
+    else if(result == -1)
+      return -1;
+
+    offset += (size_t)result;
+  }
+
+  return (ssize_t)offset;
+}
+
+/* Picks up a file descriptor the client sent along with a message. We only
+ * ever want one; anything else is closed. */
+static void _srvd_server_socket_descriptor_get(struct msghdr *message, int *descriptor) {
+  struct cmsghdr *control;
+
+  for(control = CMSG_FIRSTHDR(message); control != NULL;
+      control = CMSG_NXTHDR(message, control)) {
+    if(control->cmsg_level == SOL_SOCKET && control->cmsg_type == SCM_RIGHTS &&
+       control->cmsg_len == CMSG_LEN(sizeof(int))) {
+      int received;
+      memcpy(&received, CMSG_DATA(control), sizeof(int));
+
+      if(*descriptor == -1)
+        *descriptor = received;
+      else
+        close(received);
+    }
+  }
+}
+
+/* Reads the packet header, picking up a file descriptor if the client sent one
+ * along with it. */
+static ssize_t _srvd_server_socket_read_header(int from, char *header, int *descriptor) {
+  struct msghdr message;
+  struct iovec vector;
+  union {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(int))];
+  } control_buffer;
+  ssize_t result, rest;
+
+  memset(&message, 0, sizeof(struct msghdr));
+
+  vector.iov_base = header;
+  vector.iov_len = SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE;
+  message.msg_iov = &vector;
+  message.msg_iovlen = 1;
+  message.msg_control = control_buffer.buffer;
+  message.msg_controllen = sizeof(control_buffer.buffer);
+
+  do {
+    result = recvmsg(from, &message, 0);
+  } while(result == -1 && errno == EINTR);
+  if(result <= 0)
+    return result;
+
+  _srvd_server_socket_descriptor_get(&message, descriptor);
+
+  rest = _srvd_server_socket_read_full(from, header + result,
+                                       SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE - (size_t)result);
+  if(rest == -1)
+    return -1;
+
+  return result + rest;
+}
+
+/* Sets *closed if the client hung up cleanly instead of sending another
+ * request, and *version to the version the packet was written in. If given,
+ * *descriptor is set to a file descriptor the client sent with the packet, or
+ * -1 if there wasn't one. */
+static srvd_boolean_t _srvd_server_socket_read(int from, srvd_protocol_packet_t *packet,
+                                               uint16_t *version, srvd_boolean_t *closed,
+                                               int *descriptor) {
+  srvd_boolean_t status = SRVD_FALSE;
+  ssize_t result;
+
+  srvd_protocol_serial_packet_t serial;
+
+  char header[SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE];
+  char *body = NULL;
+
+  srvd_protocol_serial_packet_initialize(&serial);
+
+  if(descriptor) {
+    *descriptor = -1;
+    result = _srvd_server_socket_read_header(from, header, descriptor);
+  }
+  else
+    result = _srvd_server_socket_read_full(from, header, SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
+
+  if(result == 0) {
+    *closed = SRVD_TRUE;
+    goto __srvd_server_socket_read_error;
+  }
+  else if(result == -1) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Error reading packet header");
+    goto __srvd_server_socket_read_error;
+  }
+  else if((size_t)result != SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Interrupted: Read %d of %u bytes",
+                   result, SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
+    goto __srvd_server_socket_read_error;
+  }
+
+  if(!srvd_protocol_serial_packet_unserialize_header(&serial, packet, header)) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Error unserializing packet header");
+    goto __srvd_server_socket_read_error;
+  }
+  else if(serial.size > SRVD_SERVER_SOCKET_REQUEST_SIZE_MAXIMUM) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Packet is too big (%u bytes)",
+                   (unsigned int)serial.size);
+    goto __srvd_server_socket_read_error;
+  }
+  *version = (uint16_t)(serial.version |
+                        (serial.flags & SRVD_PROTOCOL_SERIAL_PACKET_FLAGS_CAPABILITIES));
+  SRVD_PROBE2(server__header, from, serial.body_size);
+
+  body = malloc(serial.body_size);
+  if(body == NULL) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Could not allocate packet body buffer "
+                   "(out of memory?)");
+    goto __srvd_server_socket_read_error;
+  }
+
+  result = _srvd_server_socket_read_full(from, body, serial.body_size);
+  if(result == -1) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Error reading packet body");
+    goto __srvd_server_socket_read_error;
+  }
+  else if((size_t)result != serial.body_size) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Interrupted: Read %d of %u bytes",
+                   result, serial.body_size);
+    goto __srvd_server_socket_read_error;
+  }
+
+  if(!srvd_protocol_serial_packet_unserialize_body(&serial, packet, body)) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Error unserializing packet body");
+    goto __srvd_server_socket_read_error;
+  }
+  SRVD_PROBE2(server__body, from, packet->field_count);
+
+  status = SRVD_TRUE;
+
+ __srvd_server_socket_read_error:
+
+  srvd_protocol_serial_packet_finalize(&serial);
+  if(body)
+    free(body);
+  if(!status && descriptor && *descriptor != -1) {
+    close(*descriptor);
+    *descriptor = -1;
+  }
+
+  return status;
+}
+
+srvd_boolean_t srvd_server_socket_read_packet(int from, srvd_protocol_packet_t *packet,
+                                              uint16_t *version, srvd_boolean_t *closed) {
+  srvd_boolean_t ignored = SRVD_FALSE;
+  uint16_t ignored_version;
+
+  SRVD_RETURN_FALSE_UNLESS(packet);
+
+  return _srvd_server_socket_read(from, packet, version ? version : &ignored_version,
+                                  closed ? closed : &ignored, NULL);
+}
+
+srvd_boolean_t srvd_server_socket_write_packet(int to, const srvd_protocol_packet_t *packet,
+                                               uint16_t version) {
+  srvd_boolean_t status = SRVD_FALSE;
+  ssize_t result;
+
+  srvd_protocol_serial_packet_t serial;
+
+  SRVD_RETURN_FALSE_UNLESS(packet);
+
+  srvd_protocol_serial_packet_initialize(&serial);
+  serial.version = version & (uint16_t)~SRVD_PROTOCOL_SERIAL_PACKET_FLAGS;
+  serial.flags = version & SRVD_PROTOCOL_SERIAL_PACKET_FLAGS;
+  if(!srvd_protocol_serial_packet_serialize(&serial, packet)) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Unable to serialize packet");
+    goto _srvd_server_socket_write_packet_error;
+  }
+  SRVD_PROBE2(server__serialize, to, serial.size);
+
+  result = _srvd_server_socket_write_full(to, serial.data, serial.size);
+  if(result == -1) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Error writing data");
+    goto _srvd_server_socket_write_packet_error;
+  }
+  else if((size_t)result != serial.size) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Interrupted: Wrote %d of %u bytes",
+                   result, serial.size);
+    goto _srvd_server_socket_write_packet_error;
+  }
+  SRVD_PROBE2(server__write, to, serial.size);
+
+  status = SRVD_TRUE;
+
+ _srvd_server_socket_write_packet_error:
+
+  srvd_protocol_serial_packet_finalize(&serial);
+
+  return status;
+}
+
+/* Reads a whole packet that's already been received, header and all. */
+static srvd_boolean_t _srvd_server_socket_unserialize(int from, char *data, size_t size,
+                                                      srvd_protocol_packet_t *packet,
+                                                      uint16_t *version) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_protocol_serial_packet_t serial;
+
+  srvd_protocol_serial_packet_initialize(&serial);
+
+  if(size < SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE ||
+     !srvd_protocol_serial_packet_unserialize_header(&serial, packet, data) ||
+     serial.size != size) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Error unserializing packet");
+    goto _srvd_server_socket_unserialize_error;
+  }
+  SRVD_PROBE2(server__header, from, serial.body_size);
+  *version = (uint16_t)(serial.version |
+                        (serial.flags & SRVD_PROTOCOL_SERIAL_PACKET_FLAGS_CAPABILITIES));
+
+  if(!srvd_protocol_serial_packet_unserialize_body(&serial, packet,
+                                                   data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE)) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Error unserializing packet");
+    goto _srvd_server_socket_unserialize_error;
+  }
+  SRVD_PROBE2(server__body, from, packet->field_count);
+
+  status = SRVD_TRUE;
+
+ _srvd_server_socket_unserialize_error:
+
+  srvd_protocol_serial_packet_finalize(&serial);
+
+  return status;
+}
+
+/* On SOCK_SEQPACKET sockets, every packet is a message of its own, so a single
+ * call reads or writes the whole thing. The buffer is
+ * SRVD_PROTOCOL_SERIAL_PACKET_MESSAGE_SIZE_MAXIMUM bytes. */
+static srvd_boolean_t _srvd_server_socket_receive(int from, char *buffer,
+                                                  srvd_protocol_packet_t *packet,
+                                                  uint16_t *version, srvd_boolean_t *closed,
+                                                  int *descriptor) {
+  srvd_boolean_t status = SRVD_FALSE;
+  ssize_t result;
+
+  struct msghdr message;
+  struct iovec vector;
+  union {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(int))];
+  } control_buffer;
+
+  memset(&message, 0, sizeof(struct msghdr));
+
+  vector.iov_base = buffer;
+  vector.iov_len = SRVD_PROTOCOL_SERIAL_PACKET_MESSAGE_SIZE_MAXIMUM;
+  message.msg_iov = &vector;
+  message.msg_iovlen = 1;
+  message.msg_control = control_buffer.buffer;
+  message.msg_controllen = sizeof(control_buffer.buffer);
+
+  do {
+    result = recvmsg(from, &message, 0);
+  } while(result == -1 && errno == EINTR);
+
+  if(result == 0) {
+    *closed = SRVD_TRUE;
+    return SRVD_FALSE;
+  }
+  else if(result == -1) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Error reading packet");
+    return SRVD_FALSE;
+  }
+
+  _srvd_server_socket_descriptor_get(&message, descriptor);
+
+  if(message.msg_flags & MSG_TRUNC)
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Packet is too big");
+  else
+    status = _srvd_server_socket_unserialize(from, buffer, (size_t)result, packet, version);
+
+  if(!status && *descriptor != -1) {
+    close(*descriptor);
+    *descriptor = -1;
+  }
+
+  return status;
+}
+
+/* A request handed over by another thread (see srvd_server_socket_submit()),
+ * which lives on that thread's stack until it's done. */
+struct srvd_server_submission {
+  const srvd_service_request_t *request;
+  srvd_service_response_t *response;
+  uint16_t version;
+  srvd_stats_sample_t *sample;
+  srvd_scheduler_peer_t peer;
+  srvd_boolean_t status, done;
+  srvd_server_submission_t *next;
+};
+
+/* A request that has been read and is waiting in the scheduler for its turn
+ * to be answered. Submitted requests stay where they are, and are answered on
+ * behalf of the thread that submitted them instead of a connection. */
+typedef struct _srvd_server_socket_pending _srvd_server_socket_pending_t;
+
+struct _srvd_server_socket_pending {
+  /* This comes first, so the scheduler hands back the request itself. */
+  srvd_scheduler_item_t item;
+  srvd_server_submission_t *submission;
+  nfds_t connection;
+  uint16_t version;
+  uint8_t scheduling_class;
+  srvd_service_request_t request;
+  srvd_stats_sample_t sample;
+};
+
+/* What we know about each connection besides its socket: who's on the other
+ * end, and the request we've read from it but not yet answered, if any. We
+ * don't read another one until that one's been answered, so responses go out
+ * in order. */
+typedef struct _srvd_server_socket_connection _srvd_server_socket_connection_t;
+
+/* On SOCK_STREAM connections, a request can arrive a piece at a time. So that
+ * a client that stops partway through can't hold up everyone else, we only
+ * read what's there and keep it (along with any file descriptor sent with it)
+ * until the rest shows up.
+ *
+ * Responses go the same way: client sockets don't block, so whatever the
+ * socket won't take yet is kept in the output until it's writable again. We
+ * don't read anything more from the client until it's all gone. */
+struct _srvd_server_socket_connection {
+  srvd_scheduler_peer_t peer;
+  _srvd_server_socket_pending_t *pending;
+  char *partial;
+  size_t partial_length, partial_capacity;
+  int descriptor;
+  char *output;
+  size_t output_length, output_offset;
+};
+
+/* Reads whatever more of the next request a SOCK_STREAM client has sent,
+ * without waiting for the rest. Returns 1 once the whole packet is in
+ * connection->partial, 0 if there's more to come, and -1 if the connection
+ * should be closed (setting *closed if the client hung up between
+ * requests). */
+static int _srvd_server_socket_gather(int from, _srvd_server_socket_connection_t *connection,
+                                      srvd_boolean_t *closed) {
+  struct msghdr message;
+  struct iovec vector;
+  union {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(int))];
+  } control_buffer;
+  ssize_t result;
+  size_t size;
+
+  for(;;) {
+    /* Read the header, then exactly as much body as it says, so nothing that
+     * belongs to the next request is taken off the socket. */
+    size = SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE;
+    if(connection->partial_length >= SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE) {
+      srvd_protocol_serial_packet_t serial;
+
+      /* Don't set aside room for anything we wouldn't read anyway. */
+      srvd_protocol_serial_packet_initialize(&serial);
+      if(!srvd_protocol_serial_packet_unserialize_header(&serial, NULL, connection->partial)) {
+        SRVD_LOG_ERROR("srvd_server_socket_execute: Error unserializing packet header");
+        return -1;
+      }
+      else if(serial.size > SRVD_SERVER_SOCKET_REQUEST_SIZE_MAXIMUM) {
+        SRVD_LOG_ERROR("srvd_server_socket_execute: Packet is too big (%u bytes)",
+                       (unsigned int)serial.size);
+        return -1;
+      }
+
+      size = serial.size;
+    }
+
+    if(connection->partial_length == size)
+      return 1;
+
+    if(size > connection->partial_capacity) {
+      char *resized = realloc(connection->partial, size);
+      if(resized == NULL) {
+        SRVD_LOG_ERROR("srvd_server_socket_execute: Could not allocate packet buffer "
+                       "(out of memory?)");
+        return -1;
+      }
+
+      connection->partial = resized;
+      connection->partial_capacity = size;
+    }
+
+    memset(&message, 0, sizeof(struct msghdr));
+
+    vector.iov_base = connection->partial + connection->partial_length;
+    vector.iov_len = size - connection->partial_length;
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control_buffer.buffer;
+    message.msg_controllen = sizeof(control_buffer.buffer);
+
+    do {
+      result = recvmsg(from, &message, MSG_DONTWAIT);
+    } while(result == -1 && errno == EINTR);
+
+    if(result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return 0;
+    else if(result == -1) {
+      SRVD_LOG_ERROR("srvd_server_socket_execute: Error reading packet");
+      return -1;
+    }
+    else if(result == 0) {
+      if(connection->partial_length == 0)
+        *closed = SRVD_TRUE;
+      else
+        SRVD_LOG_ERROR("srvd_server_socket_execute: Interrupted: Read %u of %u bytes",
+                       (unsigned int)connection->partial_length, (unsigned int)size);
+      return -1;
+    }
+
+    _srvd_server_socket_descriptor_get(&message, &connection->descriptor);
+    connection->partial_length += (size_t)result;
+  }
+}
+
+/* Serializes a response into the connection's output. A SOCK_SEQPACKET
+ * response has to be a single message; if it's too big even compressed, all
+ * we can do is tell the client it didn't work. */
+static srvd_boolean_t _srvd_server_socket_output_set(int to,
+                                                     _srvd_server_socket_connection_t *connection,
+                                                     const srvd_protocol_packet_t *packet,
+                                                     uint16_t version, srvd_boolean_t message) {
+  srvd_boolean_t status;
+  srvd_protocol_serial_packet_t serial;
+  srvd_protocol_packet_t failure;
+
+  srvd_protocol_serial_packet_initialize(&serial);
+  serial.version = version & (uint16_t)~SRVD_PROTOCOL_SERIAL_PACKET_FLAGS;
+  serial.flags = version & SRVD_PROTOCOL_SERIAL_PACKET_FLAGS;
+  status = srvd_protocol_serial_packet_serialize(&serial, packet);
+
+  if(message && (!status || serial.size > SRVD_PROTOCOL_SERIAL_PACKET_MESSAGE_SIZE_MAXIMUM)) {
+    SRVD_LOG_WARNING("srvd_server_socket_execute: Unable to send response");
+
+    srvd_protocol_serial_packet_finalize(&serial);
+    srvd_protocol_serial_packet_initialize(&serial);
+    serial.version = version & (uint16_t)~SRVD_PROTOCOL_SERIAL_PACKET_FLAGS;
+
+    srvd_protocol_packet_initialize(&failure);
+    srvd_protocol_packet_field_insert_uint16(&failure, SRVD_PROTOCOL_STATUS,
+                                             SRVD_SERVICE_RESPONSE_FAIL);
+    status = srvd_protocol_serial_packet_serialize(&serial, &failure);
+    srvd_protocol_packet_finalize(&failure);
+  }
+
+  if(!status) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Unable to serialize packet");
+    srvd_protocol_serial_packet_finalize(&serial);
+    return SRVD_FALSE;
+  }
+  SRVD_PROBE2(server__serialize, to, serial.size);
+
+  /* The output takes the serialized data over. */
+  connection->output = serial.data;
+  connection->output_length = serial.size;
+  connection->output_offset = 0;
+
+  serial.data = NULL;
+  srvd_protocol_serial_packet_finalize(&serial);
+
+  return SRVD_TRUE;
+}
+
+/* Writes as much of the connection's output as the socket will take without
+ * waiting (a SOCK_SEQPACKET socket takes the whole message or none of it).
+ * Returns 1 once it's all gone, 0 if there's more for when the socket is
+ * writable again, and -1 if the connection should be closed. */
+static int _srvd_server_socket_flush(int to, _srvd_server_socket_connection_t *connection) {
+  ssize_t result;
+
+  while(connection->output_offset < connection->output_length) {
+    do {
+      result = send(to, connection->output + connection->output_offset,
+                    connection->output_length - connection->output_offset, 0);
+    } while(result == -1 && errno == EINTR);
+
+    if(result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return 0;
+    else if(result == -1) {
+      SRVD_LOG_ERROR("srvd_server_socket_execute: Error writing data");
+      return -1;
+    }
+
+    connection->output_offset += (size_t)result;
+  }
+  SRVD_PROBE2(server__write, to, connection->output_length);
+
+  free(connection->output);
+  connection->output = NULL;
+  connection->output_length = 0;
+  connection->output_offset = 0;
+
+  return 1;
+}
+
+/* Works out which of the scheduler's classes a request goes in. */
+static uint8_t _srvd_server_socket_classify(srvd_server_t *server,
+                                            const srvd_service_request_t *request) {
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_extension_t extension;
+  srvd_server_service_t *i;
+
+  if(!srvd_protocol_packet_field_get_first(&request->packet, &field))
+    return SRVD_SCHEDULER_CLASS_POINT;
+
+  if(field->type == SRVD_PROTOCOL_STATS || field->type == SRVD_PROTOCOL_HELLO ||
+     field->type == SRVD_PROTOCOL_SHM)
+    return SRVD_SCHEDULER_CLASS_ADMIN;
+  else if(field->type == SRVD_PROTOCOL_BATCH)
+    return SRVD_SCHEDULER_CLASS_BATCH;
+
+  /* A malformed extension is caught when the request is dispatched. */
+  if(srvd_protocol_extension_unpack(&request->packet, &extension)) {
+    if(extension.priority == SRVD_PROTOCOL_EXTENSION_PRIORITY_INTERACTIVE)
+      return SRVD_SCHEDULER_CLASS_POINT;
+    else if(extension.priority == SRVD_PROTOCOL_EXTENSION_PRIORITY_BULK)
+      return SRVD_SCHEDULER_CLASS_ENUMERATION;
+  }
+
+  for(i = server->services; i != NULL; i = i->next) {
+    if(i->type == field->type)
+      return i->scheduling_class;
+  }
+
+  return SRVD_SCHEDULER_CLASS_POINT;
+}
+
+/* Reads one request from a client. The buffer is only given for
+ * SOCK_SEQPACKET connections; on others, the whole request has already been
+ * gathered into the connection (see _srvd_server_socket_gather()). Ready is
+ * when we found out the client had something for us. Returns SRVD_FALSE when
+ * the connection should be closed, and sets *detached if something else has
+ * taken it over (see <srvd/server/shm.h>); otherwise, the request is ready to
+ * be scheduled. */
+static srvd_boolean_t _srvd_server_socket_receive_request(srvd_server_t *server, int client,
+                                                          char *buffer,
+                                                          _srvd_server_socket_connection_t *connection,
+                                                          uint64_t ready,
+                                                          _srvd_server_socket_pending_t *pending,
+                                                          srvd_boolean_t *detached) {
+  srvd_boolean_t received;
+  srvd_boolean_t closed = SRVD_FALSE;
+  srvd_protocol_packet_field_t *field = NULL;
+  int descriptor = -1;
+
+  pending->submission = NULL;
+  pending->version = SRVD_PROTOCOL_SERIAL_PACKET_VERSION;
+  srvd_service_request_initialize(&pending->request);
+  srvd_stats_sample_initialize(&pending->sample);
+  pending->sample.received = ready;
+
+  /* Responses are written in the same version as the request. */
+  if(buffer)
+    received = _srvd_server_socket_receive(client, buffer, &pending->request.packet,
+                                           &pending->version, &closed, &descriptor);
+  else {
+    received = _srvd_server_socket_unserialize(client, connection->partial,
+                                               connection->partial_length,
+                                               &pending->request.packet, &pending->version);
+    descriptor = connection->descriptor;
+    connection->descriptor = -1;
+    connection->partial_length = 0;
+  }
+
+  if(!received) {
+    if(!closed)
+      SRVD_LOG_WARNING("srvd_server_socket_execute: Could not read data from client");
+    goto _srvd_server_socket_receive_request_error;
+  }
+
+  /* A client that wants to use shared memory sends the region along with its
+   * handshake. If we can't use it, the handshake is dispatched like anything
+   * else, and since nothing handles it, the client hears that it's
+   * unavailable. */
+  if(descriptor != -1 && buffer == NULL &&
+     srvd_protocol_packet_field_get_first(&pending->request.packet, &field) &&
+     field->type == SRVD_PROTOCOL_SHM) {
+    srvd_boolean_t attached;
+
+    /* The session waits on the socket, so it has to block again. */
+    fcntl(client, F_SETFL, fcntl(client, F_GETFL) & ~O_NONBLOCK);
+    attached = srvd_server_shm_attach(server, client, descriptor);
+    descriptor = -1;
+
+    if(attached) {
+      *detached = SRVD_TRUE;
+      srvd_service_request_finalize(&pending->request);
+      return SRVD_TRUE;
+    }
+  }
+
+  if(descriptor != -1)
+    close(descriptor);
+
+  pending->scheduling_class = _srvd_server_socket_classify(server, &pending->request);
+
+  return SRVD_TRUE;
+
+ _srvd_server_socket_receive_request_error:
+
+  if(descriptor != -1)
+    close(descriptor);
+  srvd_service_request_finalize(&pending->request);
+
+  return SRVD_FALSE;
+}
+
+/* Answers a request, which is finalized either way. Message is set for
+ * SOCK_SEQPACKET connections. Whatever the socket doesn't take right away is
+ * left in the connection's output, and the response counts as sent once it's
+ * there. Returns SRVD_FALSE when the connection should be closed. */
+static srvd_boolean_t _srvd_server_socket_respond(srvd_server_t *server, int client,
+                                                  _srvd_server_socket_connection_t *connection,
+                                                  srvd_boolean_t message,
+                                                  _srvd_server_socket_pending_t *pending) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_service_response_t response;
+  srvd_service_response_initialize(&response);
+
+  pending->sample.dispatched = srvd_stats_now();
+  if(!srvd_server_dispatch_version(server, &pending->request, &response, pending->version)) {
+    SRVD_LOG_WARNING("srvd_server_socket_execute: Invalid request");
+    pending->sample.error = SRVD_TRUE;
+    srvd_server_stats_record(server, &pending->sample, &pending->request, NULL);
+    goto _srvd_server_socket_respond_error;
+  }
+  pending->sample.handled = srvd_stats_now();
+
+  if(!_srvd_server_socket_output_set(client, connection, &response.packet, pending->version,
+                                     message) ||
+     _srvd_server_socket_flush(client, connection) == -1) {
+    SRVD_LOG_WARNING("srvd_server_socket_execute: Could not write data to client");
+    pending->sample.error = SRVD_TRUE;
+    srvd_server_stats_record(server, &pending->sample, &pending->request, NULL);
+    goto _srvd_server_socket_respond_error;
+  }
+  pending->sample.sent = srvd_stats_now();
+
+  srvd_server_stats_record(server, &pending->sample, &pending->request, &response);
+
+  status = SRVD_TRUE;
+
+ _srvd_server_socket_respond_error:
+
+  srvd_service_request_finalize(&pending->request);
+  srvd_service_response_finalize(&response);
+
+  return status;
+}
+
+/* Lets the thread that submitted a request know how it went. */
+static void _srvd_server_socket_submission_finish(srvd_server_t *server,
+                                                  srvd_server_submission_t *submission,
+                                                  srvd_boolean_t status) {
+  SRVD_THREAD_MUTEX_LOCK(server->submissions_lock);
+  submission->status = status;
+  submission->done = SRVD_TRUE;
+  SRVD_THREAD_CONDITION_BROADCAST(server->submissions_done);
+  SRVD_THREAD_MUTEX_UNLOCK(server->submissions_lock);
+}
+
+static void _srvd_server_socket_submission_answer(srvd_server_t *server,
+                                                  srvd_server_submission_t *submission) {
+  srvd_boolean_t status;
+
+  submission->sample->dispatched = srvd_stats_now();
+  status = srvd_server_dispatch_version(server, submission->request, submission->response,
+                                        submission->version);
+  submission->sample->handled = srvd_stats_now();
+
+  _srvd_server_socket_submission_finish(server, submission, status);
+}
+
+/* Stops taking submissions, and fails the ones nobody has picked up yet. */
+static void _srvd_server_socket_submissions_close(srvd_server_t *server) {
+  srvd_server_submission_t *submission;
+
+  SRVD_THREAD_MUTEX_LOCK(server->submissions_lock);
+  if(server->submissions_wake != -1) {
+    close(server->submissions_wake);
+    server->submissions_wake = -1;
+  }
+  for(submission = server->submissions; submission; submission = submission->next) {
+    submission->status = SRVD_FALSE;
+    submission->done = SRVD_TRUE;
+  }
+  server->submissions = NULL;
+  SRVD_THREAD_CONDITION_BROADCAST(server->submissions_done);
+  SRVD_THREAD_MUTEX_UNLOCK(server->submissions_lock);
+}
+
+srvd_boolean_t srvd_server_socket_submit(srvd_server_t *server, srvd_scheduler_peer_t peer,
+                                         const srvd_service_request_t *request,
+                                         srvd_service_response_t *response, uint16_t version,
+                                         srvd_stats_sample_t *sample) {
+  srvd_server_submission_t submission;
+  char wake = 0;
+
+  SRVD_RETURN_FALSE_UNLESS(server);
+  SRVD_RETURN_FALSE_UNLESS(request);
+  SRVD_RETURN_FALSE_UNLESS(response);
+  SRVD_RETURN_FALSE_UNLESS(sample);
+
+  submission.request = request;
+  submission.response = response;
+  submission.version = version;
+  submission.sample = sample;
+  submission.peer = peer;
+  submission.status = SRVD_FALSE;
+  submission.done = SRVD_FALSE;
+
+  SRVD_THREAD_MUTEX_LOCK(server->submissions_lock);
+  if(server->submissions_wake == -1) {
+    SRVD_THREAD_MUTEX_UNLOCK(server->submissions_lock);
+    return SRVD_FALSE;
+  }
+
+  submission.next = server->submissions;
+  server->submissions = &submission;
+
+  /* If the pipe is full, the server already has a wakeup coming. */
+  if(write(server->submissions_wake, &wake, 1) == -1 && errno != EAGAIN)
+    SRVD_LOG_WARNING("srvd_server_socket_submit: Could not wake up server");
+
+  while(!submission.done)
+    SRVD_THREAD_CONDITION_WAIT(server->submissions_done, server->submissions_lock);
+  SRVD_THREAD_MUTEX_UNLOCK(server->submissions_lock);
+
+  return submission.status;
+}
+
+/* Forgets about a connection (without closing it, but throwing away anything
+ * we'd gathered from it or not yet written to it), filling its hole in the list with the last one. */
+static void _srvd_server_socket_remove(struct pollfd *connections,
+                                       _srvd_server_socket_connection_t *states,
+                                       nfds_t *connection_count, nfds_t i) {
+  if(states[i].partial)
+    free(states[i].partial);
+  if(states[i].descriptor != -1)
+    close(states[i].descriptor);
+  if(states[i].output)
+    free(states[i].output);
+
+  --*connection_count;
+  connections[i] = connections[*connection_count];
+  states[i] = states[*connection_count];
+
+  if(states[i].pending)
+    states[i].pending->connection = i;
+}
+
+/* Pending requests are kept around for reuse once they've been answered. */
+static _srvd_server_socket_pending_t *
+_srvd_server_socket_pending_get(_srvd_server_socket_pending_t **spare) {
+  _srvd_server_socket_pending_t *pending = *spare;
+
+  if(pending)
+    *spare = (_srvd_server_socket_pending_t *)pending->item.next;
+  else {
+    pending = malloc(sizeof(_srvd_server_socket_pending_t));
+    if(pending == NULL)
+      SRVD_LOG_WARNING("srvd_server_socket_execute: Unable to allocate memory for request");
+  }
+
+  return pending;
+}
+
+static void _srvd_server_socket_pending_release(_srvd_server_socket_pending_t **spare,
+                                                _srvd_server_socket_pending_t *pending) {
+  pending->item.next = *spare ? &(*spare)->item : NULL;
+  *spare = pending;
+}
+
+/* Schedules whatever other threads have submitted since we last looked. */
+static void _srvd_server_socket_submissions_take(srvd_server_t *server, int wake,
+                                                 srvd_scheduler_t *scheduler,
+                                                 _srvd_server_socket_pending_t **spare) {
+  srvd_server_submission_t *submission, *next;
+  _srvd_server_socket_pending_t *pending;
+  char drained[64];
+
+  while(read(wake, drained, sizeof(drained)) > 0);
+
+  SRVD_THREAD_MUTEX_LOCK(server->submissions_lock);
+  submission = server->submissions;
+  server->submissions = NULL;
+  SRVD_THREAD_MUTEX_UNLOCK(server->submissions_lock);
+
+  for(; submission; submission = next) {
+    next = submission->next;
+
+    pending = _srvd_server_socket_pending_get(spare);
+    if(pending == NULL) {
+      _srvd_server_socket_submission_finish(server, submission, SRVD_FALSE);
+      continue;
+    }
+
+    pending->submission = submission;
+    pending->scheduling_class = _srvd_server_socket_classify(server, submission->request);
+
+    if(!srvd_scheduler_push(scheduler, &pending->item, pending->scheduling_class,
+                            submission->peer)) {
+      _srvd_server_socket_submission_answer(server, submission);
+      _srvd_server_socket_pending_release(spare, pending);
+    }
+  }
+}
+
+srvd_boolean_t srvd_server_socket_execute(srvd_server_t *server, int listener,
+                                          srvd_server_socket_prepare_pt prepare) {
+  srvd_boolean_t status = SRVD_TRUE;
+  struct pollfd *connections;
+  _srvd_server_socket_connection_t *states;
+  _srvd_server_socket_pending_t *pending, *spare = NULL;
+  srvd_scheduler_t scheduler;
+  srvd_scheduler_item_t *item;
+  nfds_t i, connection_count, connection_capacity;
+  unsigned int answered;
+  int type;
+  socklen_t type_length = sizeof(type);
+  int wake[2];
+  char *buffer = NULL;
+
+  SRVD_RETURN_FALSE_UNLESS(server);
+
+  if(pipe(wake) == -1) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Unable to create submission pipe");
+    return SRVD_FALSE;
+  }
+  fcntl(wake[0], F_SETFL, fcntl(wake[0], F_GETFL) | O_NONBLOCK);
+  fcntl(wake[1], F_SETFL, fcntl(wake[1], F_GETFL) | O_NONBLOCK);
+
+  SRVD_THREAD_MUTEX_LOCK(server->submissions_lock);
+  if(server->submissions_wake != -1) {
+    SRVD_THREAD_MUTEX_UNLOCK(server->submissions_lock);
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Server is already executing");
+    close(wake[0]);
+    close(wake[1]);
+    return SRVD_FALSE;
+  }
+  server->submissions_wake = wake[1];
+  SRVD_THREAD_MUTEX_UNLOCK(server->submissions_lock);
+
+  /* Connections accepted from a SOCK_SEQPACKET socket need somewhere to put a
+   * whole packet at once. */
+  if(getsockopt(listener, SOL_SOCKET, SO_TYPE, &type, &type_length) == 0 &&
+     type == SOCK_SEQPACKET) {
+    buffer = malloc(SRVD_PROTOCOL_SERIAL_PACKET_MESSAGE_SIZE_MAXIMUM);
+    if(buffer == NULL) {
+      SRVD_LOG_ERROR("srvd_server_socket_execute: Unable to allocate memory for message buffer");
+      _srvd_server_socket_submissions_close(server);
+      close(wake[0]);
+      return SRVD_FALSE;
+    }
+
+    server->hello.size_maximum = SRVD_PROTOCOL_SERIAL_PACKET_MESSAGE_SIZE_MAXIMUM;
+  }
+
+  /* The first entries are always the listening socket and the submission
+   * pipe; the rest are clients that have connected and not yet hung up.
+   * Clients may send any number of requests over a connection, and we answer
+   * them in order. */
+  connection_capacity = _SRVD_SERVER_SOCKET_CONNECTIONS_INITIAL;
+  connections = malloc(sizeof(struct pollfd) * connection_capacity);
+  states = malloc(sizeof(_srvd_server_socket_connection_t) * connection_capacity);
+  if(connections == NULL || states == NULL) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Unable to allocate memory for connection list");
+    if(connections)
+      free(connections);
+    if(states)
+      free(states);
+    if(buffer)
+      free(buffer);
+    _srvd_server_socket_submissions_close(server);
+    close(wake[0]);
+    return SRVD_FALSE;
+  }
+
+  connections[0].fd = listener;
+  connections[0].events = POLLIN;
+  states[0].pending = NULL;
+  states[0].partial = NULL;
+  states[0].descriptor = -1;
+  states[0].output = NULL;
+  connections[1].fd = wake[0];
+  connections[1].events = POLLIN;
+  states[1] = states[0];
+  connection_count = _SRVD_SERVER_SOCKET_CLIENTS_FIRST;
+
+  if(!srvd_scheduler_initialize(&scheduler, server->scheduling_weights)) {
+    SRVD_LOG_ERROR("srvd_server_socket_execute: Invalid scheduling weights");
+    free(connections);
+    free(states);
+    if(buffer)
+      free(buffer);
+    _srvd_server_socket_submissions_close(server);
+    close(wake[0]);
+    return SRVD_FALSE;
+  }
+
+  for(;;) {
+    uint64_t ready;
+
+    /* Don't wait for anything new if there's already something to answer. */
+    if(poll(connections, connection_count, scheduler.item_count > 0 ? 0 : -1) == -1) {
+      if(errno == EINTR)
+        continue;
+
+      SRVD_LOG_ERROR("srvd_server_socket_execute: Error waiting for clients");
+      status = SRVD_FALSE;
+      break;
+    }
+
+    /* Everything we read in this pass has been waiting at least since now. */
+    ready = srvd_stats_now();
+
+    /* Go backward so we can fill the hole left by a closed connection with the
+     * last one in the list. */
+    for(i = connection_count - 1; i >= _SRVD_SERVER_SOCKET_CLIENTS_FIRST; i--) {
+      srvd_boolean_t detached = SRVD_FALSE;
+
+      /* A connection with a request waiting isn't listening for more, and
+       * anything else (like a hangup) can wait until it's been answered. */
+      if(connections[i].revents == 0 || states[i].pending)
+        continue;
+
+      /* Nor is one with a response still to write, which is all we're waiting
+       * for it to be able to take. */
+      if(states[i].output) {
+        int flushed = (connections[i].revents & POLLOUT)
+          ? _srvd_server_socket_flush(connections[i].fd, &states[i]) : -1;
+
+        if(flushed == -1) {
+          close(connections[i].fd);
+          _srvd_server_socket_remove(connections, states, &connection_count, i);
+        }
+        else if(flushed == 1)
+          connections[i].events = POLLIN;
+        continue;
+      }
+
+      if(!(connections[i].revents & POLLIN)) {
+        close(connections[i].fd);
+        _srvd_server_socket_remove(connections, states, &connection_count, i);
+        continue;
+      }
+
+      if(buffer == NULL) {
+        srvd_boolean_t closed = SRVD_FALSE;
+        int gathered = _srvd_server_socket_gather(connections[i].fd, &states[i], &closed);
+
+        if(gathered == -1) {
+          if(!closed)
+            SRVD_LOG_WARNING("srvd_server_socket_execute: Could not read data from client");
+          close(connections[i].fd);
+          _srvd_server_socket_remove(connections, states, &connection_count, i);
+          continue;
+        }
+        else if(gathered == 0)
+          continue;
+      }
+
+      /* Whatever the client sent is already off the socket, so we won't hear
+       * about it again. */
+      pending = _srvd_server_socket_pending_get(&spare);
+      if(pending == NULL) {
+        close(connections[i].fd);
+        _srvd_server_socket_remove(connections, states, &connection_count, i);
+        continue;
+      }
+
+      if(!_srvd_server_socket_receive_request(server, connections[i].fd, buffer, &states[i],
+                                              ready, pending, &detached)) {
+        _srvd_server_socket_pending_release(&spare, pending);
+        close(connections[i].fd);
+        _srvd_server_socket_remove(connections, states, &connection_count, i);
+      }
+      else if(detached) {
+        _srvd_server_socket_pending_release(&spare, pending);
+        _srvd_server_socket_remove(connections, states, &connection_count, i);
+      }
+      else if(!srvd_scheduler_push(&scheduler, &pending->item, pending->scheduling_class,
+                                   states[i].peer)) {
+        /* It'll have to jump the line. */
+        if(_srvd_server_socket_respond(server, connections[i].fd, &states[i], buffer != NULL,
+                                       pending))
+          connections[i].events = states[i].output ? POLLOUT : POLLIN;
+        else {
+          close(connections[i].fd);
+          _srvd_server_socket_remove(connections, states, &connection_count, i);
+        }
+        _srvd_server_socket_pending_release(&spare, pending);
+      }
+      else {
+        pending->connection = i;
+        states[i].pending = pending;
+        connections[i].events = 0;
+      }
+    }
+
+    if(connections[1].revents & POLLIN)
+      _srvd_server_socket_submissions_take(server, wake[0], &scheduler, &spare);
+
+    /* Answer a few before checking for more, so anything more important that
+     * comes in doesn't wait long. */
+    for(answered = 0;
+        answered < _SRVD_SERVER_SOCKET_ANSWERS_PER_PASS &&
+          srvd_scheduler_pop(&scheduler, &item);
+        answered++) {
+      pending = (_srvd_server_socket_pending_t *)item;
+      if(pending->submission) {
+        _srvd_server_socket_submission_answer(server, pending->submission);
+        _srvd_server_socket_pending_release(&spare, pending);
+        continue;
+      }
+
+      i = pending->connection;
+      states[i].pending = NULL;
+
+      if(_srvd_server_socket_respond(server, connections[i].fd, &states[i], buffer != NULL,
+                                     pending))
+        connections[i].events = states[i].output ? POLLOUT : POLLIN;
+      else {
+        close(connections[i].fd);
+        _srvd_server_socket_remove(connections, states, &connection_count, i);
+      }
+
+      _srvd_server_socket_pending_release(&spare, pending);
+    }
+
+    if(connections[0].revents & POLLIN) {
+      int client = accept(listener, NULL, 0);
+      if(client == -1) {
+        SRVD_LOG_WARNING("srvd_server_socket_execute: Error accept()ing client");
+        continue;
+      }
+
+      SRVD_PROBE1(server__accept, client);
+
+      if(prepare && !prepare(client)) {
+        SRVD_LOG_WARNING("srvd_server_socket_execute: Unable to prepare client connection");
+        close(client);
+        continue;
+      }
+
+      if(fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK) == -1) {
+        SRVD_LOG_WARNING("srvd_server_socket_execute: Unable to make client connection "
+                         "non-blocking");
+        close(client);
+        continue;
+      }
+
+      if(connection_count == connection_capacity) {
+        struct pollfd *resized = realloc(connections,
+                                         sizeof(struct pollfd) * connection_capacity * 2);
+        _srvd_server_socket_connection_t *resized_states;
+
+        if(resized != NULL)
+          connections = resized;
+
+        resized_states = realloc(states, sizeof(_srvd_server_socket_connection_t) *
+                                 connection_capacity * 2);
+        if(resized_states != NULL)
+          states = resized_states;
+
+        if(resized == NULL || resized_states == NULL) {
+          SRVD_LOG_WARNING("srvd_server_socket_execute: Unable to allocate memory for "
+                           "connection; dropping client");
+          close(client);
+          continue;
+        }
+
+        connection_capacity *= 2;
+      }
+
+      connections[connection_count].fd = client;
+      connections[connection_count].events = POLLIN;
+      connections[connection_count].revents = 0;
+      states[connection_count].peer = srvd_scheduler_peer_get(client);
+      states[connection_count].pending = NULL;
+      states[connection_count].partial = NULL;
+      states[connection_count].partial_length = 0;
+      states[connection_count].partial_capacity = 0;
+      states[connection_count].descriptor = -1;
+      states[connection_count].output = NULL;
+      states[connection_count].output_length = 0;
+      states[connection_count].output_offset = 0;
+      connection_count++;
+    }
+  }
+
+  /* Whatever was still waiting won't be answered. */
+  _srvd_server_socket_submissions_close(server);
+  close(wake[0]);
+  while(srvd_scheduler_pop(&scheduler, &item)) {
+    pending = (_srvd_server_socket_pending_t *)item;
+    if(pending->submission)
+      _srvd_server_socket_submission_finish(server, pending->submission, SRVD_FALSE);
+    else
+      srvd_service_request_finalize(&pending->request);
+    free(pending);
+  }
+  while(spare) {
+    pending = spare;
+    spare = (_srvd_server_socket_pending_t *)pending->item.next;
+    free(pending);
+  }
+  srvd_scheduler_finalize(&scheduler);
+
+  for(i = _SRVD_SERVER_SOCKET_CLIENTS_FIRST; i < connection_count; i++) {
+    close(connections[i].fd);
+    if(states[i].partial)
+      free(states[i].partial);
+    if(states[i].descriptor != -1)
+      close(states[i].descriptor);
+    if(states[i].output)
+      free(states[i].output);
+  }
+  free(connections);
+  free(states);
+  if(buffer)
+    free(buffer);
+
+  return status;
+}
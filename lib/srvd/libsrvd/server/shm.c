@@ -0,0 +1,345 @@
+/* shm.c: Shared memory server sessions.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include <srvd/server/shm.h>
+#include <srvd/protocol/serial_packet.h>
+#include <srvd/shm.h>
+#include <srvd/thread.h>
+
+#include "../probe.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+
+/* How often (in milliseconds) an idle session checks whether its client is
+ * still there. A client that disconnects properly closes the region, which
+ * wakes the session up right away; this only matters for ones that crash. */
+#define _SRVD_SERVER_SHM_CHECK_INTERVAL 1000
+
+/* Every session has a thread and a mapping of its own, so there can't be an
+ * unlimited number of them. Clients past this keep using their sockets. */
+#define _SRVD_SERVER_SHM_SESSIONS_MAXIMUM 64
+
+typedef struct _srvd_server_shm_session _srvd_server_shm_session_t;
+
+struct _srvd_server_shm_session {
+  srvd_server_t *server;
+  srvd_scheduler_peer_t peer;
+  int socket;
+  srvd_shm_t shm;
+  char *buffer;
+  size_t buffer_size;
+  _srvd_server_shm_session_t *next;
+};
+
+/* Every session that has been attached and hasn't finished yet, so that
+ * srvd_server_shm_detach() can find the ones for its server. A session's
+ * region is only closed and unmapped with the lock held, and it leaves the
+ * list at the same time. */
+static SRVD_THREAD_MUTEX_DECLARE(_srvd_server_shm_sessions_lock);
+static SRVD_THREAD_CONDITION_DECLARE(_srvd_server_shm_sessions_done);
+static _srvd_server_shm_session_t *_srvd_server_shm_sessions = NULL;
+static unsigned int _srvd_server_shm_session_count = 0;
+
+static srvd_boolean_t _srvd_server_shm_session_add(_srvd_server_shm_session_t *session) {
+  srvd_boolean_t status = SRVD_FALSE;
+
+  SRVD_THREAD_MUTEX_LOCK(_srvd_server_shm_sessions_lock);
+  if(_srvd_server_shm_session_count < _SRVD_SERVER_SHM_SESSIONS_MAXIMUM) {
+    session->next = _srvd_server_shm_sessions;
+    _srvd_server_shm_sessions = session;
+    _srvd_server_shm_session_count++;
+    status = SRVD_TRUE;
+  }
+  SRVD_THREAD_MUTEX_UNLOCK(_srvd_server_shm_sessions_lock);
+
+  return status;
+}
+
+/* Closes and unmaps the session's region (waking up the client if it's
+ * waiting on us), and takes it out of the list. */
+static void _srvd_server_shm_session_remove(_srvd_server_shm_session_t *session) {
+  _srvd_server_shm_session_t **i;
+
+  SRVD_THREAD_MUTEX_LOCK(_srvd_server_shm_sessions_lock);
+  srvd_shm_close(&session->shm);
+  srvd_shm_unmap(&session->shm);
+
+  for(i = &_srvd_server_shm_sessions; *i; i = &(*i)->next) {
+    if(*i == session) {
+      *i = session->next;
+      _srvd_server_shm_session_count--;
+      break;
+    }
+  }
+  SRVD_THREAD_CONDITION_BROADCAST(_srvd_server_shm_sessions_done);
+  SRVD_THREAD_MUTEX_UNLOCK(_srvd_server_shm_sessions_lock);
+}
+
+/* Called whenever we've been waiting on the region for a while; returns
+ * SRVD_FALSE if the client has gone away. */
+static srvd_boolean_t _srvd_server_shm_session_check(_srvd_server_shm_session_t *session) {
+  struct pollfd connection;
+  char c;
+
+  if(errno != ETIMEDOUT)
+    return SRVD_FALSE;
+
+  connection.fd = session->socket;
+  connection.events = POLLIN;
+  connection.revents = 0;
+
+  if(poll(&connection, 1, 0) > 0) {
+    if(connection.revents & (POLLERR | POLLHUP | POLLNVAL))
+      return SRVD_FALSE;
+
+    /* Readable might just mean a big packet is on its way. */
+    if((connection.revents & POLLIN) && recv(session->socket, &c, 1, MSG_PEEK) <= 0)
+      return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+/* Sets the sample's received time once there's a request to read, and
+ * *version to the version it was written in. */
+static srvd_boolean_t _srvd_server_shm_session_read(_srvd_server_shm_session_t *session,
+                                                    srvd_protocol_packet_t *packet,
+                                                    uint16_t *version,
+                                                    srvd_stats_sample_t *sample) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_shm_t *shm = &session->shm;
+  srvd_protocol_serial_packet_t serial;
+  char *record = NULL;
+  uint32_t length;
+
+  while(!srvd_shm_ring_peek(shm, &shm->region->requests, shm->requests_data,
+                            _SRVD_SERVER_SHM_CHECK_INTERVAL, &record, &length)) {
+    if(!_srvd_server_shm_session_check(session))
+      return SRVD_FALSE;
+  }
+  sample->received = srvd_stats_now();
+
+  if(length == SRVD_SHM_RECORD_SOCKET) {
+    srvd_shm_ring_release(shm, &shm->region->requests, length);
+    return srvd_server_socket_read_packet(session->socket, packet, version, NULL);
+  }
+
+  /* Copy the record out first, so the client can't change it while we're
+   * parsing it. */
+  if(length > session->buffer_size) {
+    char *resized = realloc(session->buffer, length);
+    if(resized == NULL) {
+      SRVD_LOG_ERROR("srvd_server_shm_attach: Could not allocate request buffer "
+                     "(out of memory?)");
+      return SRVD_FALSE;
+    }
+
+    session->buffer = resized;
+    session->buffer_size = length;
+  }
+
+  memcpy(session->buffer, record, length);
+  srvd_shm_ring_release(shm, &shm->region->requests, length);
+
+  srvd_protocol_serial_packet_initialize(&serial);
+  if(length < SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE ||
+     !srvd_protocol_serial_packet_unserialize_header(&serial, packet, session->buffer) ||
+     serial.size != length) {
+    SRVD_LOG_WARNING("srvd_server_shm_attach: Error unserializing request");
+    goto _srvd_server_shm_session_read_error;
+  }
+  SRVD_PROBE2(server__header, -1, serial.body_size);
+  *version = (uint16_t)(serial.version |
+                        (serial.flags & SRVD_PROTOCOL_SERIAL_PACKET_FLAGS_CAPABILITIES));
+
+  if(!srvd_protocol_serial_packet_unserialize_body(&serial, packet,
+                                                   session->buffer +
+                                                   SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE)) {
+    SRVD_LOG_WARNING("srvd_server_shm_attach: Error unserializing request");
+    goto _srvd_server_shm_session_read_error;
+  }
+  SRVD_PROBE2(server__body, -1, packet->field_count);
+
+  status = SRVD_TRUE;
+
+ _srvd_server_shm_session_read_error:
+
+  srvd_protocol_serial_packet_finalize(&serial);
+
+  return status;
+}
+
+static srvd_boolean_t _srvd_server_shm_session_write(_srvd_server_shm_session_t *session,
+                                                     const srvd_protocol_packet_t *packet,
+                                                     uint16_t version) {
+  srvd_shm_t *shm = &session->shm;
+  char *record = NULL;
+  size_t size;
+  uint32_t length;
+
+  size = srvd_protocol_serial_packet_size_version(packet, version);
+  length = size > srvd_shm_record_maximum(shm) ? SRVD_SHM_RECORD_SOCKET : (uint32_t)size;
+
+  while(!srvd_shm_ring_reserve(shm, &shm->region->responses, shm->responses_data, length,
+                               _SRVD_SERVER_SHM_CHECK_INTERVAL, &record)) {
+    if(!_srvd_server_shm_session_check(session))
+      return SRVD_FALSE;
+  }
+
+  if(length == SRVD_SHM_RECORD_SOCKET) {
+    srvd_shm_ring_publish(shm, &shm->region->responses, shm->responses_data, length);
+    return srvd_server_socket_write_packet(session->socket, packet, version);
+  }
+
+  if(!srvd_protocol_serial_packet_serialize_into_version(packet, record, size, version)) {
+    SRVD_LOG_ERROR("srvd_server_shm_attach: Unable to serialize response");
+    return SRVD_FALSE;
+  }
+  SRVD_PROBE2(server__serialize, -1, size);
+
+  srvd_shm_ring_publish(shm, &shm->region->responses, shm->responses_data, length);
+  SRVD_PROBE2(server__write, -1, size);
+
+  return SRVD_TRUE;
+}
+
+static void *_srvd_server_shm_session_execute(void *argument) {
+  _srvd_server_shm_session_t *session = (_srvd_server_shm_session_t *)argument;
+  srvd_service_response_t accepted;
+
+  /* Tell the client it can start using the region. */
+  srvd_service_response_initialize(&accepted);
+  srvd_protocol_packet_field_insert_uint16(&accepted.packet, SRVD_PROTOCOL_STATUS,
+                                           SRVD_SERVICE_RESPONSE_SUCCESS);
+  if(!srvd_server_socket_write_packet(session->socket, &accepted.packet,
+                                      SRVD_PROTOCOL_SERIAL_PACKET_VERSION))
+    SRVD_LOG_WARNING("srvd_server_shm_attach: Could not accept shared memory handshake");
+  else {
+    for(;;) {
+      srvd_boolean_t status;
+      srvd_service_request_t request;
+      srvd_service_response_t response;
+      srvd_stats_sample_t sample;
+      uint16_t version = SRVD_PROTOCOL_SERIAL_PACKET_VERSION;
+
+      srvd_service_request_initialize(&request);
+      srvd_service_response_initialize(&response);
+      srvd_stats_sample_initialize(&sample);
+
+      status = _srvd_server_shm_session_read(session, &request.packet, &version, &sample);
+      if(status) {
+        status = srvd_server_socket_submit(session->server, session->peer, &request,
+                                           &response, version, &sample);
+        status = status && _srvd_server_shm_session_write(session, &response.packet, version);
+        sample.sent = srvd_stats_now();
+
+        sample.error = !status;
+        srvd_server_stats_record(session->server, &sample, &request,
+                                 status ? &response : NULL);
+      }
+
+      srvd_service_request_finalize(&request);
+      srvd_service_response_finalize(&response);
+
+      if(!status)
+        break;
+    }
+  }
+  srvd_service_response_finalize(&accepted);
+
+  _srvd_server_shm_session_remove(session);
+  close(session->socket);
+  if(session->buffer)
+    free(session->buffer);
+  free(session);
+
+  return NULL;
+}
+
+srvd_boolean_t srvd_server_shm_attach(srvd_server_t *server, int socket, int descriptor) {
+  _srvd_server_shm_session_t *session;
+  pthread_attr_t attributes;
+  pthread_t thread;
+  int result;
+
+  SRVD_RETURN_FALSE_UNLESS(server);
+
+  session = malloc(sizeof(_srvd_server_shm_session_t));
+  if(session == NULL) {
+    SRVD_LOG_ERROR("srvd_server_shm_attach: Unable to allocate memory for session");
+    close(descriptor);
+    return SRVD_FALSE;
+  }
+
+  session->server = server;
+  session->peer = srvd_scheduler_peer_get(socket);
+  session->socket = socket;
+  session->buffer = NULL;
+  session->buffer_size = 0;
+
+  if(!srvd_shm_map(&session->shm, descriptor)) {
+    if(errno != ENOSYS)
+      SRVD_LOG_WARNING("srvd_server_shm_attach: Client sent an unusable shared memory region");
+    close(descriptor);
+    free(session);
+    return SRVD_FALSE;
+  }
+  close(descriptor);
+
+  if(!_srvd_server_shm_session_add(session)) {
+    SRVD_LOG_WARNING("srvd_server_shm_attach: Too many shared memory sessions");
+    srvd_shm_unmap(&session->shm);
+    free(session);
+    return SRVD_FALSE;
+  }
+
+  pthread_attr_init(&attributes);
+  pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+  result = pthread_create(&thread, &attributes, _srvd_server_shm_session_execute, session);
+  pthread_attr_destroy(&attributes);
+
+  if(result != 0) {
+    SRVD_LOG_ERROR("srvd_server_shm_attach: Unable to start session thread");
+    _srvd_server_shm_session_remove(session);
+    free(session);
+    return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+void srvd_server_shm_detach(srvd_server_t *server) {
+  _srvd_server_shm_session_t *i;
+  srvd_boolean_t waiting;
+
+  SRVD_RETURN_UNLESS(server);
+
+  SRVD_THREAD_MUTEX_LOCK(_srvd_server_shm_sessions_lock);
+  for(;;) {
+    waiting = SRVD_FALSE;
+
+    /* Closing the region wakes a session waiting on it, and shutting down
+     * the socket wakes one waiting on that; either way, it finds out it's
+     * done. */
+    for(i = _srvd_server_shm_sessions; i; i = i->next) {
+      if(i->server == server) {
+        srvd_shm_close(&i->shm);
+        shutdown(i->socket, SHUT_RDWR);
+        waiting = SRVD_TRUE;
+      }
+    }
+
+    if(!waiting)
+      break;
+
+    SRVD_THREAD_CONDITION_WAIT(_srvd_server_shm_sessions_done, _srvd_server_shm_sessions_lock);
+  }
+  SRVD_THREAD_MUTEX_UNLOCK(_srvd_server_shm_sessions_lock);
+}
@@ -0,0 +1,138 @@
+/* tcp.c: TCP server.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+/* For getaddrinfo(). */
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/server/tcp.h>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+srvd_server_tcp_t *srvd_server_tcp_allocate(void) {
+  srvd_server_tcp_t *server = malloc(sizeof(srvd_server_tcp_t));
+  SRVD_RETURN_NULL_UNLESS(server);
+
+  return server;
+}
+
+void srvd_server_tcp_free(srvd_server_tcp_t *server) {
+  SRVD_RETURN_UNLESS(server);
+
+  free(server);
+}
+
+srvd_boolean_t srvd_server_tcp_initialize(srvd_server_tcp_t *server,
+                                          const srvd_server_tcp_conf_t *conf) {
+  struct addrinfo hints, *addresses = NULL;
+  int result, on = 1;
+
+  SRVD_RETURN_FALSE_UNLESS(server);
+  SRVD_RETURN_FALSE_UNLESS(conf);
+  SRVD_RETURN_FALSE_UNLESS(conf->port);
+
+  if(!srvd_server_initialize(&server->monitor)) {
+    SRVD_LOG_ERROR("srvd_server_tcp_initialize: Unable to initialize server monitor");
+    return SRVD_FALSE;
+  }
+
+  /* Copy the configuration. */
+  server->conf = *conf;
+
+  /* Set up the address. */
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = server->conf.family;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+  hints.ai_flags = AI_PASSIVE;
+
+  result = getaddrinfo(server->conf.host, server->conf.port, &hints, &addresses);
+  if(result != 0) {
+    SRVD_LOG_ERROR("srvd_server_tcp_initialize: Unable to resolve \"%s\" port \"%s\": %s",
+                   server->conf.host ? server->conf.host : "*", server->conf.port,
+                   gai_strerror(result));
+    return SRVD_FALSE;
+  }
+
+  memcpy(&server->endpoint, addresses->ai_addr, addresses->ai_addrlen);
+  server->endpoint_length = addresses->ai_addrlen;
+
+  freeaddrinfo(addresses);
+
+  /* Set up the socket. */
+  server->socket = socket(server->endpoint.ss_family, SOCK_STREAM, IPPROTO_TCP);
+  if(server->socket == -1) {
+    SRVD_LOG_ERROR("srvd_server_tcp_initialize: Error creating socket");
+    return SRVD_FALSE;
+  }
+
+  /* So we can restart without waiting for old connections to time out. */
+  if(setsockopt(server->socket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1)
+    SRVD_LOG_WARNING("srvd_server_tcp_initialize: Unable to set SO_REUSEADDR");
+
+  if(server->endpoint.ss_family == AF_INET6 &&
+     setsockopt(server->socket, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on)) == -1)
+    SRVD_LOG_WARNING("srvd_server_tcp_initialize: Unable to set IPV6_V6ONLY");
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_server_tcp_finalize(srvd_server_tcp_t *server) {
+  SRVD_RETURN_FALSE_UNLESS(server);
+
+  if(server->monitor.executing) {
+    SRVD_LOG_ERROR("srvd_server_tcp_finalize: Cannot finalize: Server is still executing");
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_server_finalize(&server->monitor)) {
+    SRVD_LOG_ERROR("srvd_server_tcp_finalize: Unable to finalize server monitor");
+    return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+/* See srvd_client_tcp_connect() for why we want these. */
+static srvd_boolean_t _srvd_server_tcp_prepare(int client) {
+  int on = 1;
+
+  if(setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) == -1 ||
+     setsockopt(client, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) == -1) {
+    SRVD_LOG_WARNING("srvd_server_tcp_execute: Unable to set socket options");
+  }
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_server_tcp_execute(srvd_server_tcp_t *server) {
+  srvd_boolean_t status;
+
+  SRVD_RETURN_FALSE_UNLESS(server);
+
+  server->monitor.executing = SRVD_TRUE;
+  if(bind(server->socket, (struct sockaddr *)&server->endpoint, server->endpoint_length) == -1) {
+    SRVD_LOG_ERROR("srvd_server_tcp_execute: Unable to bind to port \"%s\"", server->conf.port);
+    server->monitor.executing = SRVD_FALSE;
+    return SRVD_FALSE;
+  }
+  if(listen(server->socket, server->conf.queue_size) == -1) {
+    SRVD_LOG_ERROR("srvd_server_tcp_execute: Unable to listen on bound socket");
+    server->monitor.executing = SRVD_FALSE;
+    return SRVD_FALSE;
+  }
+
+  status = srvd_server_socket_execute(&server->monitor, server->socket, _srvd_server_tcp_prepare);
+
+  close(server->socket);
+  server->monitor.executing = SRVD_FALSE;
+
+  return status;
+}
@@ -10,6 +10,24 @@
 #include <srvd/service.h>
 #include <srvd/conf.h>
 #include <srvd/client.h>
+#include <srvd/thread.h>
+#include <srvd/protocol/serial_packet.h>
+
+#include "probe.h"
+
+/* Pulls the status out of the first field of a response packet. */
+static void _srvd_service_response_status_update(const srvd_protocol_packet_t *packet,
+                                                 srvd_service_response_code_t *status) {
+  srvd_protocol_packet_field_t *status_field = NULL;
+  srvd_protocol_packet_field_entry_t *status_entry = NULL;
+
+  if(!srvd_protocol_packet_field_get_first(packet, &status_field) ||
+     status_field->type != SRVD_PROTOCOL_STATUS ||
+     !srvd_protocol_packet_field_entry_get_first(status_field, &status_entry) ||
+     !srvd_protocol_packet_field_entry_get_uint16(status_entry, status)) {
+    *status = SRVD_SERVICE_RESPONSE_FAIL;
+  }
+}
 
 srvd_service_request_t *srvd_service_request_allocate(void) {
   srvd_service_request_t *service = malloc(sizeof(srvd_service_request_t));
@@ -47,70 +65,263 @@ srvd_boolean_t srvd_service_request_finalize(srvd_service_request_t *request) {
   return SRVD_TRUE;
 }
 
-srvd_boolean_t srvd_service_request_query(const srvd_service_request_t *request,
-                                          srvd_service_response_t *response) {
-  srvd_boolean_t status = SRVD_FALSE;
+/* Clients that keep their connections open between requests (see the
+ * persistent flag in <srvd/client.h>) are cached here, one per thread, so the
+ * next query from the same thread can skip connecting. A cached client is
+ * thrown away if the configuration changes or if we find ourselves in a
+ * forked child, which shares the socket with its parent. Throwing it away
+ * there only closes the child's copies; clients leave anything they share
+ * with the server, like a shared memory region, as it is for the parent (see
+ * <srvd/client/shm.h>). */
+struct _srvd_service_connection {
+  srvd_client_t *client;
+  pid_t pid;
+  time_t conf_time;
+};
+
+static SRVD_THREAD_KEY_DECLARE(_srvd_service_connection_key);
+static SRVD_THREAD_ONCE_DECLARE(_srvd_service_connection_once);
+
+static void _srvd_service_connection_client_destroy(srvd_client_t *client) {
+  srvd_client_finalize(client);
+  srvd_client_free(client);
+}
+
+static void _srvd_service_connection_destroy(void *data) {
+  struct _srvd_service_connection *connection = data;
+
+  if(connection->client)
+    _srvd_service_connection_client_destroy(connection->client);
+  free(connection);
+}
+
+static void _srvd_service_connection_key_initialize(void) {
+  SRVD_THREAD_KEY_INITIALIZE_DESTRUCTOR(_srvd_service_connection_key,
+                                        _srvd_service_connection_destroy);
+}
+
+/* Returns this thread's cached client, if it's still usable, and removes it
+ * from the cache. */
+static srvd_client_t *_srvd_service_connection_take(const srvd_conf_file_t *fconf) {
+  struct _srvd_service_connection *connection;
+  srvd_client_t *client;
+
+  SRVD_THREAD_ONCE_CALL(_srvd_service_connection_once, _srvd_service_connection_key_initialize);
+
+  connection = SRVD_THREAD_KEY_DATA_GET(_srvd_service_connection_key);
+  SRVD_RETURN_NULL_UNLESS(connection);
+  SRVD_RETURN_NULL_UNLESS(connection->client);
+
+  client = connection->client;
+  connection->client = NULL;
+
+  if(connection->pid != getpid() || connection->conf_time != fconf->updated_time ||
+     !client->connected) {
+    _srvd_service_connection_client_destroy(client);
+    return NULL;
+  }
+
+  return client;
+}
+
+/* Puts a client back into the cache if it's persistent, or gets rid of it. */
+static void _srvd_service_connection_release(srvd_client_t *client,
+                                             const srvd_conf_file_t *fconf) {
+  struct _srvd_service_connection *connection;
+
+  if(!client->persistent || !client->connected)
+    goto _srvd_service_connection_release_error;
+
+  connection = SRVD_THREAD_KEY_DATA_GET(_srvd_service_connection_key);
+  if(connection == NULL) {
+    connection = malloc(sizeof(struct _srvd_service_connection));
+    if(connection == NULL)
+      goto _srvd_service_connection_release_error;
+
+    connection->client = NULL;
+    if(SRVD_THREAD_KEY_DATA_SET(_srvd_service_connection_key, connection) != 0) {
+      free(connection);
+      goto _srvd_service_connection_release_error;
+    }
+  }
+
+  if(connection->client)
+    _srvd_service_connection_client_destroy(connection->client);
+
+  connection->client = client;
+  connection->pid = getpid();
+  connection->conf_time = fconf->updated_time;
+
+  return;
+
+ _srvd_service_connection_release_error:
+
+  if(client->connected && !srvd_client_disconnect(client)) {
+    SRVD_LOG_WARNING("srvd_service_request_query: Unable to cleanly disconnect from server "
+                     "(unexpected connection termination?)");
+  }
+  _srvd_service_connection_client_destroy(client);
+}
+
+/* Pulls the status out of the first field of a serialized response. */
+static srvd_service_response_code_t _srvd_service_serial_response_status_get(const srvd_protocol_serial_packet_t *serial) {
+  srvd_service_response_code_t status = SRVD_SERVICE_RESPONSE_FAIL;
+  srvd_protocol_serial_packet_reader_t reader;
+  srvd_protocol_type_t type;
+  uint32_t entry_count, size;
+  const char *data;
+
+  if(serial->data == NULL)
+    return status;
+
+  if(srvd_protocol_serial_packet_reader_initialize(&reader, serial,
+                                                   serial->data +
+                                                   SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE) &&
+     srvd_protocol_serial_packet_reader_field_next(&reader, &type, &entry_count) &&
+     type == SRVD_PROTOCOL_STATUS &&
+     srvd_protocol_serial_packet_reader_entry_next(&reader, &data, &size) &&
+     size == sizeof(uint16_t)) {
+    uint16_t v;
+
+    memcpy(&v, data, sizeof(uint16_t));
+    status = ntohs(v);
+  }
+  srvd_protocol_serial_packet_reader_finalize(&reader);
+
+  return status;
+}
+
+/* Does the work of srvd_service_request_query() and
+ * srvd_service_request_query_serial(), reading the response into whichever of
+ * the packet and serial packet isn't NULL. */
+static srvd_boolean_t _srvd_service_request_exchange(const srvd_service_request_t *request,
+                                                     srvd_protocol_packet_t *packet,
+                                                     srvd_protocol_serial_packet_t *serial,
+                                                     srvd_service_response_code_t *response_status) {
+  srvd_boolean_t status = SRVD_FALSE, reused, written, read;
   srvd_conf_file_t *fconf = NULL;
   srvd_client_t *client = NULL;
-  srvd_protocol_packet_field_t *status_field = NULL;
-  srvd_protocol_packet_field_entry_t *status_entry = NULL;
+  srvd_client_breaker_t *breaker = NULL;
+  srvd_protocol_type_t type = SRVD_PROTOCOL_NONE;
 
-  SRVD_RETURN_FALSE_UNLESS(request);
-  SRVD_RETURN_FALSE_UNLESS(response);
+  if(request->packet.field_head)
+    type = request->packet.field_head->type;
+  SRVD_PROBE1(query__start, type);
+
+  *response_status = SRVD_SERVICE_RESPONSE_FAIL;
 
   /* Read the default configuration. */
   if(!srvd_conf_file_default_get(&fconf)) {
     SRVD_LOG_ERROR("srvd_service_request_query: Unable to read configuration file "
                    "\"" SRVD_CONF_FILE_DEFAULT_PATH "\"");
-    goto _srvd_service_request_query_error;
+    goto _srvd_service_request_exchange_error;
   }
 
-  if(!srvd_client_get_by_conf(&client, &fconf->conf)) {
-    SRVD_LOG_ERROR("srvd_service_request_query: Unable to create client instance");
-    goto _srvd_service_request_query_error;
+  /* If the server has been failing, don't even try. */
+  srvd_client_breaker_default_get(&breaker, &fconf->conf);
+  if(!srvd_client_breaker_allow(breaker)) {
+    if(packet)
+      srvd_protocol_packet_field_insert_uint16(packet, SRVD_PROTOCOL_STATUS,
+                                               SRVD_SERVICE_RESPONSE_UNAVAIL);
+    *response_status = SRVD_SERVICE_RESPONSE_UNAVAIL;
+    breaker = NULL;
+    goto _srvd_service_request_exchange_error;
   }
 
-  if(!srvd_client_connect(client)) {
-    SRVD_LOG_ERROR("srvd_service_request_query: Unable to connect to remote server");
-    goto _srvd_service_request_query_error;
-  }
+  client = _srvd_service_connection_take(fconf);
+  reused = client != NULL;
 
-  if(!srvd_client_write(client, &request->packet)) {
-    SRVD_LOG_ERROR("srvd_service_request_query: Error writing packet to server");
-    goto _srvd_service_request_query_error;
-  }
+ _srvd_service_request_exchange_retry:
 
-  if(!srvd_client_read(client, &response->packet)) {
-    SRVD_LOG_ERROR("srvd_service_request_query: Error reading response packet from server");
-    goto _srvd_service_request_query_error;
+  if(client == NULL && !srvd_client_get_by_conf(&client, &fconf->conf)) {
+    SRVD_LOG_ERROR("srvd_service_request_query: Unable to create client instance");
+    goto _srvd_service_request_exchange_error;
   }
 
-  if(!srvd_client_disconnect(client)) {
-    SRVD_LOG_WARNING("srvd_service_request_query: Unable to cleanly disconnect from server "
-                     "(unexpected connection termination?)");
+  srvd_client_deadline_start(client);
+
+  if(!client->connected && !srvd_client_connect(client)) {
+    SRVD_LOG_ERROR("srvd_service_request_query: Unable to connect to remote server");
+    goto _srvd_service_request_exchange_error;
   }
+  SRVD_PROBE1(query__connect, reused);
+
+  written = srvd_client_write(client, &request->packet);
+  if(written)
+    SRVD_PROBE1(query__write, type);
+
+  read = written &&
+    (packet ? srvd_client_read(client, packet) :
+     srvd_client_read_serial(client, serial) &&
+     srvd_protocol_serial_packet_decompress(serial));
+  if(!read) {
+    if(reused) {
+      /* The server may have closed the connection while it sat idle; try once
+       * more on a fresh one. */
+      _srvd_service_connection_client_destroy(client);
+      client = NULL;
+      reused = SRVD_FALSE;
+
+      if(packet) {
+        srvd_protocol_packet_finalize(packet);
+        srvd_protocol_packet_initialize(packet);
+      }
+      else {
+        srvd_protocol_serial_packet_finalize(serial);
+        srvd_protocol_serial_packet_initialize(serial);
+      }
+
+      goto _srvd_service_request_exchange_retry;
+    }
+
+    SRVD_LOG_ERROR("srvd_service_request_query: Error exchanging packets with server");
+    goto _srvd_service_request_exchange_error;
+  }
+  SRVD_PROBE1(query__read, type);
 
   status = SRVD_TRUE;
 
- _srvd_service_request_query_error:
+  if(serial)
+    *response_status = _srvd_service_serial_response_status_get(serial);
 
-  /* Assuming response->packet is initialized, the field_count is either updated
-   * by the query or is 0 (its initialization value), so this comparison is
-   * in fact safe even if an error occurred. */
-  if(!srvd_protocol_packet_field_get_first(&response->packet, &status_field) ||
-     !srvd_protocol_packet_field_entry_get_first(status_field, &status_entry)) {
-    response->status = SRVD_SERVICE_RESPONSE_FAIL;
-  }
-  else {
-    srvd_protocol_packet_field_entry_get_uint16(status_entry, &response->status);
-  }
+ _srvd_service_request_exchange_error:
+
+  /* Assuming the packet is initialized, the field_count is either updated by
+   * the query or is 0 (its initialization value), so this comparison is in fact
+   * safe even if an error occurred. */
+  if(packet)
+    _srvd_service_response_status_update(packet, response_status);
+  SRVD_PROBE2(query__finish, type, *response_status);
 
-  if(client)
-    srvd_client_free(client);
+  if(breaker)
+    srvd_client_breaker_report(breaker, status);
+
+  if(client) {
+    if(status)
+      _srvd_service_connection_release(client, fconf);
+    else
+      _srvd_service_connection_client_destroy(client);
+  }
 
   return status;
 }
 
+srvd_boolean_t srvd_service_request_query(const srvd_service_request_t *request,
+                                          srvd_service_response_t *response) {
+  SRVD_RETURN_FALSE_UNLESS(request);
+  SRVD_RETURN_FALSE_UNLESS(response);
+
+  return _srvd_service_request_exchange(request, &response->packet, NULL, &response->status);
+}
+
+srvd_boolean_t srvd_service_request_query_serial(const srvd_service_request_t *request,
+                                                 srvd_service_serial_response_t *response) {
+  SRVD_RETURN_FALSE_UNLESS(request);
+  SRVD_RETURN_FALSE_UNLESS(response);
+
+  return _srvd_service_request_exchange(request, NULL, &response->serial, &response->status);
+}
+
 srvd_service_response_t *srvd_service_response_allocate(void) {
   srvd_service_response_t *response = malloc(sizeof(srvd_service_response_t));
   SRVD_RETURN_NULL_UNLESS(response);
@@ -149,3 +360,220 @@ srvd_boolean_t srvd_service_response_finalize(srvd_service_response_t *response)
 
   return SRVD_TRUE;
 }
+
+srvd_boolean_t srvd_service_serial_response_initialize(srvd_service_serial_response_t *response) {
+  SRVD_RETURN_FALSE_UNLESS(response);
+
+  response->status = SRVD_SERVICE_RESPONSE_UNKNOWN;
+
+  return srvd_protocol_serial_packet_initialize(&response->serial);
+}
+
+srvd_boolean_t srvd_service_serial_response_finalize(srvd_service_serial_response_t *response) {
+  SRVD_RETURN_FALSE_UNLESS(response);
+
+  response->status = SRVD_SERVICE_RESPONSE_UNKNOWN;
+
+  return srvd_protocol_serial_packet_finalize(&response->serial);
+}
+
+srvd_boolean_t srvd_service_serial_response_reader_initialize(const srvd_service_serial_response_t *response,
+                                                              srvd_protocol_serial_packet_reader_t *reader) {
+  SRVD_RETURN_FALSE_UNLESS(response);
+  SRVD_RETURN_FALSE_UNLESS(response->serial.data);
+
+  return srvd_protocol_serial_packet_reader_initialize(reader, &response->serial,
+                                                       response->serial.data +
+                                                       SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
+}
+
+srvd_service_batch_t *srvd_service_batch_allocate(void) {
+  srvd_service_batch_t *batch = malloc(sizeof(srvd_service_batch_t));
+  SRVD_RETURN_NULL_UNLESS(batch);
+
+  return batch;
+}
+
+void srvd_service_batch_free(srvd_service_batch_t *batch) {
+  SRVD_RETURN_UNLESS(batch);
+
+  free(batch);
+}
+
+srvd_boolean_t srvd_service_batch_initialize(srvd_service_batch_t *batch,
+                                             srvd_protocol_type_t type) {
+  SRVD_RETURN_FALSE_UNLESS(batch);
+
+  batch->keys = NULL;
+  batch->status = SRVD_SERVICE_RESPONSE_UNKNOWN;
+  batch->response_count = 0;
+  batch->responses = NULL;
+
+  if(!srvd_service_request_initialize(&batch->request)) {
+    SRVD_LOG_ERROR("srvd_service_batch_initialize: Unable to initialize request");
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_protocol_packet_field_get_or_add(&batch->request.packet, SRVD_PROTOCOL_BATCH,
+                                            &batch->keys)) {
+    SRVD_LOG_ERROR("srvd_service_batch_initialize: Unable to add batch field");
+    srvd_service_request_finalize(&batch->request);
+    return SRVD_FALSE;
+  }
+
+  batch->keys = NULL;
+  if(!srvd_protocol_packet_field_get_or_add(&batch->request.packet, type, &batch->keys)) {
+    SRVD_LOG_ERROR("srvd_service_batch_initialize: Unable to add key field");
+    srvd_service_request_finalize(&batch->request);
+    return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+static void _srvd_service_batch_responses_clear(srvd_service_batch_t *batch) {
+  uint16_t i;
+
+  for(i = 0; i < batch->response_count; i++)
+    srvd_service_response_finalize(&batch->responses[i]);
+
+  if(batch->responses)
+    free(batch->responses);
+
+  batch->responses = NULL;
+  batch->response_count = 0;
+}
+
+srvd_boolean_t srvd_service_batch_finalize(srvd_service_batch_t *batch) {
+  SRVD_RETURN_FALSE_UNLESS(batch);
+
+  _srvd_service_batch_responses_clear(batch);
+
+  batch->keys = NULL;
+  batch->status = SRVD_SERVICE_RESPONSE_UNKNOWN;
+
+  if(!srvd_service_request_finalize(&batch->request)) {
+    SRVD_LOG_ERROR("srvd_service_batch_finalize: Unable to finalize request");
+    return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_service_batch_key_add(srvd_service_batch_t *batch, uint16_t size,
+                                          const void *key) {
+  SRVD_RETURN_FALSE_UNLESS(batch);
+  SRVD_RETURN_FALSE_UNLESS(batch->keys);
+  SRVD_RETURN_FALSE_IF(batch->keys->entry_count == UINT16_MAX);
+
+  return srvd_protocol_packet_field_entry_add(batch->keys, size, key);
+}
+
+static srvd_boolean_t _srvd_service_batch_key_query(const srvd_service_batch_t *batch,
+                                                    const srvd_protocol_packet_field_entry_t *key,
+                                                    srvd_service_response_t *response) {
+  srvd_service_request_t request;
+  srvd_boolean_t status = SRVD_FALSE;
+
+  srvd_service_request_initialize(&request);
+  if(srvd_protocol_packet_field_append(&request.packet, batch->keys->type, key->size, key->data))
+    status = srvd_service_request_query(&request, response);
+  srvd_service_request_finalize(&request);
+
+  if(!status) {
+    response->status = SRVD_SERVICE_RESPONSE_FAIL;
+    return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_service_batch_query(srvd_service_batch_t *batch) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_service_response_t response;
+  srvd_protocol_packet_field_t *results = NULL;
+  srvd_protocol_packet_field_entry_t *entry, *key;
+  uint16_t i;
+
+  SRVD_RETURN_FALSE_UNLESS(batch);
+
+  _srvd_service_batch_responses_clear(batch);
+
+  srvd_service_response_initialize(&response);
+  if(!srvd_service_request_query(&batch->request, &response)) {
+    SRVD_LOG_ERROR("srvd_service_batch_query: Unable to query server");
+    goto _srvd_service_batch_query_error;
+  }
+
+  batch->status = response.status;
+  if(response.status != SRVD_SERVICE_RESPONSE_SUCCESS) {
+    status = SRVD_TRUE;
+    goto _srvd_service_batch_query_error;
+  }
+
+  if(!srvd_protocol_packet_field_get_by_type(&response.packet, SRVD_PROTOCOL_BATCH, &results) ||
+     results->entry_count != batch->keys->entry_count) {
+    SRVD_LOG_ERROR("srvd_service_batch_query: Server sent the wrong number of responses");
+    batch->status = SRVD_SERVICE_RESPONSE_FAIL;
+    goto _srvd_service_batch_query_error;
+  }
+
+  batch->responses = malloc(sizeof(srvd_service_response_t) * results->entry_count);
+  if(batch->responses == NULL) {
+    SRVD_LOG_ERROR("srvd_service_batch_query: Unable to allocate memory for responses");
+    batch->status = SRVD_SERVICE_RESPONSE_FAIL;
+    goto _srvd_service_batch_query_error;
+  }
+
+  /* Each entry is a complete serialized packet. A key whose response we can't
+   * read just gets a failure status. */
+  key = batch->keys->entry_head;
+  SRVD_PROTOCOL_PACKET_FIELD_ENTRY_ITERATE_COUNT(results, entry, i) {
+    srvd_service_response_t *single = &batch->responses[i];
+    srvd_protocol_serial_packet_t serial;
+
+    srvd_service_response_initialize(single);
+    batch->response_count++;
+
+    if(entry->size == 0) {
+      /* The response was too big to fit, so ask for this key alone. */
+      if(!_srvd_service_batch_key_query(batch, key, single))
+        SRVD_LOG_WARNING("srvd_service_batch_query: Unable to query key %u", (unsigned)i);
+      key = key->next;
+      continue;
+    }
+    key = key->next;
+
+    srvd_protocol_serial_packet_initialize(&serial);
+    if(entry->size < SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE ||
+       !srvd_protocol_serial_packet_unserialize_header(&serial, &single->packet, entry->data) ||
+       serial.size != entry->size ||
+       !srvd_protocol_serial_packet_unserialize_body(&serial, &single->packet,
+                                                     (char *)entry->data +
+                                                     SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE)) {
+      SRVD_LOG_WARNING("srvd_service_batch_query: Invalid response for key %u", (unsigned)i);
+    }
+    srvd_protocol_serial_packet_finalize(&serial);
+
+    _srvd_service_response_status_update(&single->packet, &single->status);
+  }
+
+  status = SRVD_TRUE;
+
+ _srvd_service_batch_query_error:
+
+  srvd_service_response_finalize(&response);
+
+  return status;
+}
+
+srvd_boolean_t srvd_service_batch_response_get(const srvd_service_batch_t *batch, uint16_t offset,
+                                               const srvd_service_response_t **response) {
+  SRVD_RETURN_FALSE_UNLESS(batch);
+  SRVD_RETURN_FALSE_UNLESS(response);
+  SRVD_RETURN_FALSE_UNLESS(offset < batch->response_count);
+
+  *response = &batch->responses[offset];
+
+  return SRVD_TRUE;
+}
@@ -0,0 +1,205 @@
+/* group.c: Support for the group database.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include <srvd/service/nss/group.h>
+
+SRVD_SERVICE_NSS_GROUP_REQUEST_SCHEMA(SRVD_SERVICE_SCHEMA_REQUEST_DEFINE)
+
+SRVD_SERVICE_NSS_GROUP_RESPONSE_SCHEMA(SRVD_SERVICE_SCHEMA_RESPONSE_DEFINE)
+
+SRVD_SERVICE_SCHEMA_VALIDATE_DEFINE(nss_group, SRVD_SERVICE_NSS_GROUP_REQUEST_SCHEMA,
+                                    SRVD_SERVICE_NSS_GROUP_RESPONSE_SCHEMA)
+
+srvd_service_nss_group_index_t *srvd_service_nss_group_index_allocate(void) {
+  srvd_service_nss_group_index_t *index = malloc(sizeof(srvd_service_nss_group_index_t));
+  SRVD_RETURN_NULL_UNLESS(index);
+
+  return index;
+}
+
+void srvd_service_nss_group_index_free(srvd_service_nss_group_index_t *index) {
+  SRVD_RETURN_UNLESS(index);
+
+  free(index);
+}
+
+srvd_boolean_t srvd_service_nss_group_index_initialize(srvd_service_nss_group_index_t *index,
+                                                       size_t bucket_count) {
+  SRVD_RETURN_FALSE_UNLESS(index);
+  SRVD_RETURN_FALSE_UNLESS(bucket_count > 0);
+
+  index->buckets = calloc(bucket_count, sizeof(srvd_service_nss_group_index_node_t *));
+  if(index->buckets == NULL) {
+    SRVD_LOG_ERROR("srvd_service_nss_group_index_initialize: Unable to allocate memory for "
+                   "buckets");
+    return SRVD_FALSE;
+  }
+  index->bucket_count = bucket_count;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_service_nss_group_index_finalize(srvd_service_nss_group_index_t *index) {
+  size_t bucket;
+
+  SRVD_RETURN_FALSE_UNLESS(index);
+
+  for(bucket = 0; bucket < index->bucket_count; bucket++) {
+    srvd_service_nss_group_index_node_t *i, *ni;
+    for(i = index->buckets[bucket], ni = i ? i->next : NULL;
+        i != NULL;
+        i = ni, ni = i ? i->next : NULL) {
+      free(i->user);
+      free(i->gids);
+      free(i);
+    }
+  }
+
+  free(index->buckets);
+  index->buckets = NULL;
+  index->bucket_count = 0;
+
+  return SRVD_TRUE;
+}
+
+static inline size_t _srvd_service_nss_group_index_bucket(const srvd_service_nss_group_index_t *index,
+                                                          const char *user) {
+  const unsigned char *p;
+  uint32_t hash = 2166136261U;
+
+  for(p = (const unsigned char *)user; *p; p++)
+    hash = (hash ^ *p) * 16777619U;
+
+  return (size_t)hash % index->bucket_count;
+}
+
+static srvd_service_nss_group_index_node_t *
+_srvd_service_nss_group_index_find(const srvd_service_nss_group_index_t *index,
+                                   const char *user) {
+  srvd_service_nss_group_index_node_t *i;
+
+  for(i = index->buckets[_srvd_service_nss_group_index_bucket(index, user)]; i != NULL; i = i->next) {
+    if(strcmp(i->user, user) == 0)
+      return i;
+  }
+
+  return NULL;
+}
+
+srvd_boolean_t srvd_service_nss_group_index_add(srvd_service_nss_group_index_t *index,
+                                                const char *user, gid_t gid) {
+  srvd_service_nss_group_index_node_t *node;
+  size_t i;
+
+  SRVD_RETURN_FALSE_UNLESS(index);
+  SRVD_RETURN_FALSE_UNLESS(index->buckets);
+  SRVD_RETURN_FALSE_UNLESS(user);
+
+  node = _srvd_service_nss_group_index_find(index, user);
+  if(node == NULL) {
+    size_t bucket = _srvd_service_nss_group_index_bucket(index, user);
+
+    node = malloc(sizeof(srvd_service_nss_group_index_node_t));
+    if(node == NULL) {
+      SRVD_LOG_ERROR("srvd_service_nss_group_index_add: Unable to allocate memory for node");
+      return SRVD_FALSE;
+    }
+
+    node->user = malloc(strlen(user) + 1);
+    if(node->user == NULL) {
+      SRVD_LOG_ERROR("srvd_service_nss_group_index_add: Unable to allocate memory for user");
+      free(node);
+      return SRVD_FALSE;
+    }
+    strcpy(node->user, user);
+
+    node->gid_count = node->gid_capacity = 0;
+    node->gids = NULL;
+    node->next = index->buckets[bucket];
+
+    index->buckets[bucket] = node;
+  }
+
+  /* Groups may list the same member more than once. */
+  for(i = 0; i < node->gid_count; i++) {
+    if(node->gids[i] == gid)
+      return SRVD_TRUE;
+  }
+
+  if(node->gid_count == node->gid_capacity) {
+    size_t capacity = node->gid_capacity ? node->gid_capacity * 2 : 8;
+    gid_t *gids = realloc(node->gids, capacity * sizeof(gid_t));
+    if(gids == NULL) {
+      SRVD_LOG_ERROR("srvd_service_nss_group_index_add: Unable to allocate memory for groups");
+      return SRVD_FALSE;
+    }
+
+    node->gids = gids;
+    node->gid_capacity = capacity;
+  }
+
+  node->gids[node->gid_count++] = gid;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_service_nss_group_index_get(const srvd_service_nss_group_index_t *index,
+                                                const char *user, const gid_t **gids,
+                                                size_t *gid_count) {
+  srvd_service_nss_group_index_node_t *node;
+
+  SRVD_RETURN_FALSE_UNLESS(index);
+  SRVD_RETURN_FALSE_UNLESS(index->buckets);
+  SRVD_RETURN_FALSE_UNLESS(user);
+  SRVD_RETURN_FALSE_UNLESS(gids);
+  SRVD_RETURN_FALSE_UNLESS(gid_count);
+
+  node = _srvd_service_nss_group_index_find(index, user);
+  SRVD_RETURN_FALSE_UNLESS(node);
+
+  *gids = node->gids;
+  *gid_count = node->gid_count;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_service_nss_group_index_respond(const srvd_service_nss_group_index_t *index,
+                                                    const srvd_service_request_t *request,
+                                                    srvd_service_response_t *response) {
+  char *user = NULL;
+  const gid_t *gids;
+  size_t gid_count, i;
+
+  SRVD_RETURN_FALSE_UNLESS(index);
+  SRVD_RETURN_FALSE_UNLESS(request);
+  SRVD_RETURN_FALSE_UNLESS(response);
+
+  if(!srvd_service_nss_group_request_initgroups_get(request, &user)) {
+    response->status = SRVD_SERVICE_RESPONSE_FAIL;
+    return SRVD_FALSE;
+  }
+
+  if(!srvd_service_nss_group_index_get(index, user, &gids, &gid_count)) {
+    response->status = SRVD_SERVICE_RESPONSE_NOTFOUND;
+    srvd_service_nss_group_request_initgroups_free(request, &user);
+    return SRVD_TRUE;
+  }
+
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+  for(i = 0; i < gid_count; i++) {
+    if(!srvd_service_nss_group_response_gids_add(response, gids[i])) {
+      response->status = SRVD_SERVICE_RESPONSE_FAIL;
+      break;
+    }
+  }
+
+  srvd_service_nss_group_request_initgroups_free(request, &user);
+
+  return response->status == SRVD_SERVICE_RESPONSE_SUCCESS;
+}
@@ -0,0 +1,97 @@
+/* schema.c: Declarative descriptions of service databases.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include <srvd/service/schema.h>
+
+/* Finds the only entry of the first field, which has to be of the given
+ * type. */
+static srvd_boolean_t _srvd_service_schema_request_entry_get(const srvd_service_request_t *request,
+                                                             srvd_protocol_type_t type,
+                                                             const char *caller,
+                                                             srvd_protocol_packet_field_entry_t **entry) {
+  srvd_protocol_packet_field_t *field = NULL;
+
+  SRVD_RETURN_FALSE_UNLESS(request);
+  SRVD_RETURN_FALSE_UNLESS(request->packet.field_count > 0);
+
+  srvd_protocol_packet_field_get_first(&request->packet, &field);
+  if(field->type != type) {
+    SRVD_LOG_ERROR("%s: Invalid packet type", caller);
+    return SRVD_FALSE;
+  }
+
+  SRVD_RETURN_FALSE_UNLESS(field->entry_count == 1);
+
+  return srvd_protocol_packet_field_entry_get_first(field, entry);
+}
+
+srvd_boolean_t srvd_service_schema_request_string_get(const srvd_service_request_t *request,
+                                                      srvd_protocol_type_t type,
+                                                      const char *caller, char **value) {
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+
+  SRVD_RETURN_FALSE_UNLESS(value);
+  SRVD_RETURN_FALSE_UNLESS(*value == NULL);
+
+  if(!_srvd_service_schema_request_entry_get(request, type, caller, &entry))
+    return SRVD_FALSE;
+
+  SRVD_RETURN_FALSE_UNLESS(entry->size > 0);
+
+  *value = malloc(entry->size);
+  if(*value == NULL) {
+    SRVD_LOG_ERROR("%s: Unable to allocate memory for value", caller);
+    return SRVD_FALSE;
+  }
+
+  memcpy(*value, entry->data, entry->size);
+  (*value)[entry->size - 1] = '\0';
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_service_schema_request_string_free(const srvd_service_request_t *request,
+                                                       char **value) {
+  SRVD_RETURN_FALSE_UNLESS(request);
+  SRVD_RETURN_FALSE_UNLESS(value);
+  SRVD_RETURN_FALSE_UNLESS(*value);
+
+  free(*value);
+  *value = NULL;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_service_schema_request_uint32_get(const srvd_service_request_t *request,
+                                                      srvd_protocol_type_t type,
+                                                      const char *caller, uint32_t *value) {
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+
+  SRVD_RETURN_FALSE_UNLESS(value);
+
+  if(!_srvd_service_schema_request_entry_get(request, type, caller, &entry))
+    return SRVD_FALSE;
+
+  return srvd_protocol_packet_field_entry_get_uint32(entry, value);
+}
+
+srvd_boolean_t srvd_service_schema_response_entry_add(srvd_service_response_t *response,
+                                                      srvd_protocol_type_t type, const char *caller,
+                                                      uint32_t size, const void *data) {
+  srvd_protocol_packet_field_t *field = NULL;
+
+  SRVD_RETURN_FALSE_UNLESS(response);
+
+  if(!srvd_protocol_packet_field_get_or_add(&response->packet, type, &field)) {
+    SRVD_LOG_ERROR("%s: Unable to get field instance", caller);
+    return SRVD_FALSE;
+  }
+
+  return srvd_protocol_packet_field_entry_add(field, size, data);
+}
@@ -0,0 +1,449 @@
+/* shm.c: Shared memory rings.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+/* For memfd_create() and syscall(). */
+#define _GNU_SOURCE
+
+#include "config.h"
+
+#include <srvd/shm.h>
+
+#if defined(__linux__) && defined(HAVE_LINUX_FUTEX_H) && defined(HAVE_MEMFD_CREATE)
+# define _SRVD_SHM_SUPPORTED 1
+# include <fcntl.h>
+# include <linux/futex.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <sys/syscall.h>
+# include <time.h>
+/* The region can't be trusted unless its size is sealed. */
+# if !defined(MFD_ALLOW_SEALING) || !defined(F_ADD_SEALS)
+#  undef _SRVD_SHM_SUPPORTED
+# endif
+#endif
+
+#define _SRVD_SHM_ALIGN(length)                                         \
+  (((length) + SRVD_SHM_RECORD_ALIGNMENT - 1) & ~(uint32_t)(SRVD_SHM_RECORD_ALIGNMENT - 1))
+
+/* The space a record takes up in the ring, including its header. */
+#define _SRVD_SHM_RECORD_SIZE(length)                                   \
+  ((length) == SRVD_SHM_RECORD_SOCKET                                   \
+   ? SRVD_SHM_RECORD_HEADER_SIZE                                        \
+   : SRVD_SHM_RECORD_HEADER_SIZE + _SRVD_SHM_ALIGN(length))
+
+/* Where in the ring's data a head or tail points. The other side can write
+ * whatever it wants to them, so this always stays in bounds and aligned no
+ * matter what. */
+#define _SRVD_SHM_OFFSET(shm, position)                                 \
+  ((position) & ((shm)->ring_size - 1) & ~(uint32_t)(SRVD_SHM_RECORD_ALIGNMENT - 1))
+
+#define _SRVD_SHM_RECORD_LENGTH(data, offset)   \
+  (*(volatile uint32_t *)((data) + (offset)))
+
+#define _SRVD_SHM_BARRIER() __sync_synchronize()
+
+size_t srvd_shm_region_size(uint32_t ring_size) {
+  return sizeof(srvd_shm_region_t) + 2 * (size_t)ring_size;
+}
+
+#ifdef _SRVD_SHM_SUPPORTED
+
+static srvd_boolean_t _srvd_shm_ring_size_valid(uint32_t ring_size) {
+  return ring_size >= SRVD_SHM_RING_SIZE_MINIMUM && ring_size <= SRVD_SHM_RING_SIZE_MAXIMUM &&
+    (ring_size & (ring_size - 1)) == 0;
+}
+
+static void _srvd_shm_view_set(srvd_shm_t *shm, void *region, size_t size, uint32_t ring_size) {
+  shm->region = (srvd_shm_region_t *)region;
+  shm->size = size;
+  shm->ring_size = ring_size;
+  shm->requests_data = (char *)region + sizeof(srvd_shm_region_t);
+  shm->responses_data = shm->requests_data + ring_size;
+}
+
+srvd_boolean_t srvd_shm_create(srvd_shm_t *shm, uint32_t ring_size, int *descriptor) {
+  void *region;
+  size_t size;
+  int d;
+
+  SRVD_RETURN_FALSE_UNLESS(shm);
+  SRVD_RETURN_FALSE_UNLESS(descriptor);
+
+  if(!_srvd_shm_ring_size_valid(ring_size)) {
+    errno = EINVAL;
+    return SRVD_FALSE;
+  }
+
+  size = srvd_shm_region_size(ring_size);
+
+  d = memfd_create("srvd", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if(d == -1)
+    return SRVD_FALSE;
+
+  /* Once the size is sealed, the server knows the region can't be truncated
+   * out from under it. */
+  if(ftruncate(d, (off_t)size) == -1 ||
+     fcntl(d, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) == -1)
+    goto _srvd_shm_create_error;
+
+  region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, d, 0);
+  if(region == MAP_FAILED)
+    goto _srvd_shm_create_error;
+
+  /* The memory is already zeroed, which takes care of the rings. */
+  _srvd_shm_view_set(shm, region, size, ring_size);
+  shm->region->magic = SRVD_SHM_MAGIC;
+  shm->region->version = SRVD_SHM_VERSION;
+  shm->region->ring_size = ring_size;
+
+  *descriptor = d;
+
+  return SRVD_TRUE;
+
+ _srvd_shm_create_error:
+
+  close(d);
+
+  return SRVD_FALSE;
+}
+
+srvd_boolean_t srvd_shm_map(srvd_shm_t *shm, int descriptor) {
+  struct stat status;
+  void *region;
+  uint32_t ring_size;
+  size_t size;
+  int seals;
+
+  SRVD_RETURN_FALSE_UNLESS(shm);
+
+  /* If the other side could still shrink the file, touching the mapping
+   * afterward would raise SIGBUS. */
+  seals = fcntl(descriptor, F_GET_SEALS);
+  if(seals == -1 || !(seals & F_SEAL_SHRINK)) {
+    errno = EINVAL;
+    return SRVD_FALSE;
+  }
+
+  if(fstat(descriptor, &status) == -1)
+    return SRVD_FALSE;
+
+  size = (size_t)status.st_size;
+  if(status.st_size < 0 || size < sizeof(srvd_shm_region_t)) {
+    errno = EINVAL;
+    return SRVD_FALSE;
+  }
+
+  region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+  if(region == MAP_FAILED)
+    return SRVD_FALSE;
+
+  /* Read the ring size exactly once; after this, we only trust our copy. */
+  ring_size = ((volatile srvd_shm_region_t *)region)->ring_size;
+  if(((srvd_shm_region_t *)region)->magic != SRVD_SHM_MAGIC ||
+     ((srvd_shm_region_t *)region)->version != SRVD_SHM_VERSION ||
+     !_srvd_shm_ring_size_valid(ring_size) || size < srvd_shm_region_size(ring_size)) {
+    munmap(region, size);
+    errno = EINVAL;
+    return SRVD_FALSE;
+  }
+
+  _srvd_shm_view_set(shm, region, size, ring_size);
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_shm_unmap(srvd_shm_t *shm) {
+  SRVD_RETURN_FALSE_UNLESS(shm);
+  SRVD_RETURN_FALSE_UNLESS(shm->region);
+
+  if(munmap(shm->region, shm->size) == -1)
+    return SRVD_FALSE;
+
+  shm->region = NULL;
+  shm->size = 0;
+
+  return SRVD_TRUE;
+}
+
+/* The region is shared between processes, so these can't use the private
+ * futex operations. */
+static void _srvd_shm_futex_wait(volatile uint32_t *word, uint32_t value, int timeout) {
+  struct timespec relative, *relative_p = NULL;
+
+  if(timeout >= 0) {
+    relative.tv_sec = timeout / 1000;
+    relative.tv_nsec = (long)(timeout % 1000) * 1000000;
+    relative_p = &relative;
+  }
+
+  (void)syscall(SYS_futex, word, FUTEX_WAIT, value, relative_p, NULL, 0);
+}
+
+static void _srvd_shm_futex_wake(volatile uint32_t *word) {
+  (void)syscall(SYS_futex, word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+static long _srvd_shm_time_get(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/* Waits until the condition is true, sleeping on the given sequence number
+ * when it isn't. The waiting flag has to be set before the condition is
+ * checked for the last time; otherwise the other side could make it true in
+ * between and decide there was nobody to wake up. */
+#define _SRVD_SHM_WAIT(shm, condition, sequence, waiting, timeout, label) \
+  do {                                                                  \
+    long _start = (timeout) >= 0 ? _srvd_shm_time_get() : 0;            \
+    for(;;) {                                                           \
+      uint32_t _value = (sequence);                                     \
+      int _remaining = -1;                                              \
+                                                                        \
+      _SRVD_SHM_BARRIER();                                              \
+      if(condition)                                                     \
+        break;                                                          \
+      if((shm)->region->closed) {                                       \
+        errno = EPIPE;                                                  \
+        goto label;                                                     \
+      }                                                                 \
+                                                                        \
+      if((timeout) >= 0) {                                              \
+        _remaining = (int)((timeout) - (_srvd_shm_time_get() - _start)); \
+        if(_remaining <= 0) {                                           \
+          errno = ETIMEDOUT;                                            \
+          goto label;                                                   \
+        }                                                               \
+      }                                                                 \
+                                                                        \
+      (waiting) = 1;                                                    \
+      _SRVD_SHM_BARRIER();                                              \
+      if(!(condition) && !(shm)->region->closed)                        \
+        _srvd_shm_futex_wait(&(sequence), _value, _remaining);          \
+      (waiting) = 0;                                                    \
+    }                                                                   \
+  } while(0)
+
+void srvd_shm_close(srvd_shm_t *shm) {
+  srvd_shm_region_t *region;
+
+  SRVD_RETURN_UNLESS(shm);
+  SRVD_RETURN_UNLESS(shm->region);
+
+  region = shm->region;
+  region->closed = 1;
+  _SRVD_SHM_BARRIER();
+
+  region->requests.head_sequence++;
+  region->requests.tail_sequence++;
+  region->responses.head_sequence++;
+  region->responses.tail_sequence++;
+  _SRVD_SHM_BARRIER();
+
+  _srvd_shm_futex_wake(&region->requests.head_sequence);
+  _srvd_shm_futex_wake(&region->requests.tail_sequence);
+  _srvd_shm_futex_wake(&region->responses.head_sequence);
+  _srvd_shm_futex_wake(&region->responses.tail_sequence);
+}
+
+srvd_boolean_t srvd_shm_ring_reserve(const srvd_shm_t *shm, srvd_shm_ring_t *ring, char *data,
+                                     uint32_t length, int timeout, char **record) {
+  uint32_t need, offset, contiguous, total;
+
+  SRVD_RETURN_FALSE_UNLESS(shm);
+  SRVD_RETURN_FALSE_UNLESS(ring);
+  SRVD_RETURN_FALSE_UNLESS(record);
+
+  if(length != SRVD_SHM_RECORD_SOCKET && length > srvd_shm_record_maximum(shm)) {
+    errno = EMSGSIZE;
+    return SRVD_FALSE;
+  }
+
+  need = _SRVD_SHM_RECORD_SIZE(length);
+  offset = _SRVD_SHM_OFFSET(shm, ring->head);
+  contiguous = shm->ring_size - offset;
+  total = need > contiguous ? contiguous + need : need;
+
+  _SRVD_SHM_WAIT(shm, shm->ring_size - (ring->head - ring->tail) >= total,
+                 ring->tail_sequence, ring->producer_waiting, timeout,
+                 _srvd_shm_ring_reserve_error);
+
+  /* Skip to the beginning if we'd run off the end. */
+  if(need > contiguous) {
+    _SRVD_SHM_RECORD_LENGTH(data, offset) = SRVD_SHM_RECORD_WRAP;
+    _SRVD_SHM_BARRIER();
+    ring->head += contiguous;
+    offset = 0;
+  }
+
+  *record = data + offset + SRVD_SHM_RECORD_HEADER_SIZE;
+
+  return SRVD_TRUE;
+
+ _srvd_shm_ring_reserve_error:
+
+  return SRVD_FALSE;
+}
+
+void srvd_shm_ring_publish(const srvd_shm_t *shm, srvd_shm_ring_t *ring, char *data,
+                           uint32_t length) {
+  SRVD_RETURN_UNLESS(shm);
+  SRVD_RETURN_UNLESS(ring);
+
+  _SRVD_SHM_RECORD_LENGTH(data, _SRVD_SHM_OFFSET(shm, ring->head)) = length;
+
+  /* The record has to be complete before the consumer can see it. */
+  _SRVD_SHM_BARRIER();
+  ring->head += _SRVD_SHM_RECORD_SIZE(length);
+  ring->head_sequence++;
+  _SRVD_SHM_BARRIER();
+
+  if(ring->consumer_waiting)
+    _srvd_shm_futex_wake(&ring->head_sequence);
+}
+
+srvd_boolean_t srvd_shm_ring_peek(const srvd_shm_t *shm, srvd_shm_ring_t *ring, char *data,
+                                  int timeout, char **record, uint32_t *length) {
+  uint32_t offset, used, l;
+
+  SRVD_RETURN_FALSE_UNLESS(shm);
+  SRVD_RETURN_FALSE_UNLESS(ring);
+  SRVD_RETURN_FALSE_UNLESS(record);
+  SRVD_RETURN_FALSE_UNLESS(length);
+
+  for(;;) {
+    _SRVD_SHM_WAIT(shm, ring->head != ring->tail,
+                   ring->head_sequence, ring->consumer_waiting, timeout,
+                   _srvd_shm_ring_peek_error);
+
+    /* The producer may not be well-behaved, so check everything before we
+     * trust it. */
+    used = ring->head - ring->tail;
+    offset = _SRVD_SHM_OFFSET(shm, ring->tail);
+    if(used > shm->ring_size || used < SRVD_SHM_RECORD_HEADER_SIZE) {
+      errno = EPROTO;
+      goto _srvd_shm_ring_peek_error;
+    }
+
+    l = _SRVD_SHM_RECORD_LENGTH(data, offset);
+    if(l == SRVD_SHM_RECORD_WRAP) {
+      if(used < shm->ring_size - offset) {
+        errno = EPROTO;
+        goto _srvd_shm_ring_peek_error;
+      }
+
+      ring->tail += shm->ring_size - offset;
+      continue;
+    }
+    else if(l != SRVD_SHM_RECORD_SOCKET &&
+            (l > shm->ring_size - offset - SRVD_SHM_RECORD_HEADER_SIZE ||
+             _SRVD_SHM_RECORD_SIZE(l) > used)) {
+      errno = EPROTO;
+      goto _srvd_shm_ring_peek_error;
+    }
+
+    *record = data + offset + SRVD_SHM_RECORD_HEADER_SIZE;
+    *length = l;
+
+    return SRVD_TRUE;
+  }
+
+ _srvd_shm_ring_peek_error:
+
+  return SRVD_FALSE;
+}
+
+void srvd_shm_ring_release(const srvd_shm_t *shm, srvd_shm_ring_t *ring, uint32_t length) {
+  SRVD_RETURN_UNLESS(shm);
+  SRVD_RETURN_UNLESS(ring);
+
+  /* Everything we needed from the record has to be read before the producer
+   * can overwrite it. */
+  _SRVD_SHM_BARRIER();
+  ring->tail += _SRVD_SHM_RECORD_SIZE(length);
+  ring->tail_sequence++;
+  _SRVD_SHM_BARRIER();
+
+  if(ring->producer_waiting)
+    _srvd_shm_futex_wake(&ring->tail_sequence);
+}
+
+#else
+
+srvd_boolean_t srvd_shm_create(srvd_shm_t *shm, uint32_t ring_size, int *descriptor) {
+  SRVD_UNUSED(shm);
+  SRVD_UNUSED(ring_size);
+  SRVD_UNUSED(descriptor);
+
+  errno = ENOSYS;
+  return SRVD_FALSE;
+}
+
+srvd_boolean_t srvd_shm_map(srvd_shm_t *shm, int descriptor) {
+  SRVD_UNUSED(shm);
+  SRVD_UNUSED(descriptor);
+
+  errno = ENOSYS;
+  return SRVD_FALSE;
+}
+
+srvd_boolean_t srvd_shm_unmap(srvd_shm_t *shm) {
+  SRVD_UNUSED(shm);
+
+  errno = ENOSYS;
+  return SRVD_FALSE;
+}
+
+void srvd_shm_close(srvd_shm_t *shm) {
+  SRVD_UNUSED(shm);
+}
+
+srvd_boolean_t srvd_shm_ring_reserve(const srvd_shm_t *shm, srvd_shm_ring_t *ring, char *data,
+                                     uint32_t length, int timeout, char **record) {
+  SRVD_UNUSED(shm);
+  SRVD_UNUSED(ring);
+  SRVD_UNUSED(data);
+  SRVD_UNUSED(length);
+  SRVD_UNUSED(timeout);
+  SRVD_UNUSED(record);
+
+  errno = ENOSYS;
+  return SRVD_FALSE;
+}
+
+void srvd_shm_ring_publish(const srvd_shm_t *shm, srvd_shm_ring_t *ring, char *data,
+                           uint32_t length) {
+  SRVD_UNUSED(shm);
+  SRVD_UNUSED(ring);
+  SRVD_UNUSED(data);
+  SRVD_UNUSED(length);
+}
+
+srvd_boolean_t srvd_shm_ring_peek(const srvd_shm_t *shm, srvd_shm_ring_t *ring, char *data,
+                                  int timeout, char **record, uint32_t *length) {
+  SRVD_UNUSED(shm);
+  SRVD_UNUSED(ring);
+  SRVD_UNUSED(data);
+  SRVD_UNUSED(timeout);
+  SRVD_UNUSED(record);
+  SRVD_UNUSED(length);
+
+  errno = ENOSYS;
+  return SRVD_FALSE;
+}
+
+void srvd_shm_ring_release(const srvd_shm_t *shm, srvd_shm_ring_t *ring, uint32_t length) {
+  SRVD_UNUSED(shm);
+  SRVD_UNUSED(ring);
+  SRVD_UNUSED(length);
+}
+
+#endif
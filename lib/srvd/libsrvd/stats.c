@@ -0,0 +1,741 @@
+/* stats.c: Server statistics.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+/* For clock_gettime(). */
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/stats.h>
+#include <srvd/protocol/serial_packet.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define _SRVD_STATS_BARRIER() __sync_synchronize()
+
+/* How many times a reader tries to catch a set of counters between updates
+ * before settling for what it has. A writer that died in the middle of an
+ * update would otherwise leave it waiting forever. */
+#define _SRVD_STATS_READ_ATTEMPTS 1000
+
+/* The size of a packed set of counters: the type, then every counter. */
+#define _SRVD_STATS_COUNTERS_VALUE_COUNT                                \
+  (2 + SRVD_STATS_STATUS_COUNT + 2 + 3 * SRVD_STATS_HISTOGRAM_BUCKET_COUNT)
+#define _SRVD_STATS_COUNTERS_PACKED_SIZE                                \
+  (sizeof(srvd_protocol_type_t) + 8 * _SRVD_STATS_COUNTERS_VALUE_COUNT)
+
+/* Gives a slot back when the thread that claimed it exits. Whatever it counted
+ * stays in the slot for the next thread to add to. */
+static void _srvd_stats_claim_release(void *data) {
+  srvd_stats_claim_t *claim = (srvd_stats_claim_t *)data;
+
+  SRVD_THREAD_MUTEX_LOCK(claim->stats->lock);
+  claim->claimed = SRVD_FALSE;
+  SRVD_THREAD_MUTEX_UNLOCK(claim->stats->lock);
+}
+
+srvd_stats_t *srvd_stats_allocate(void) {
+  srvd_stats_t *stats = malloc(sizeof(srvd_stats_t));
+  if(stats == NULL)
+    SRVD_LOG_ERROR("srvd_stats_allocate: Unable to allocate memory");
+
+  return stats;
+}
+
+void srvd_stats_free(srvd_stats_t *stats) {
+  SRVD_RETURN_UNLESS(stats);
+
+  free(stats);
+}
+
+srvd_boolean_t srvd_stats_initialize(srvd_stats_t *stats, uint32_t slot_count) {
+  uint32_t i;
+
+  SRVD_RETURN_FALSE_UNLESS(stats);
+  SRVD_RETURN_FALSE_UNLESS(slot_count > 0);
+
+  stats->size = sizeof(srvd_stats_block_t) + sizeof(srvd_stats_slot_t) * slot_count;
+  stats->block = calloc(1, stats->size);
+  if(stats->block == NULL) {
+    SRVD_LOG_ERROR("srvd_stats_initialize: Unable to allocate memory for slots");
+    return SRVD_FALSE;
+  }
+
+  stats->claims = malloc(sizeof(srvd_stats_claim_t) * slot_count);
+  if(stats->claims == NULL) {
+    SRVD_LOG_ERROR("srvd_stats_initialize: Unable to allocate memory for slot claims");
+    free(stats->block);
+    return SRVD_FALSE;
+  }
+
+  for(i = 0; i < slot_count; i++) {
+    stats->claims[i].stats = stats;
+    stats->claims[i].slot = &stats->block->slots[i];
+    stats->claims[i].claimed = SRVD_FALSE;
+  }
+
+  /* The first slot is for everyone who can't get one of their own. */
+  stats->claims[0].claimed = SRVD_TRUE;
+
+  stats->mapped = SRVD_FALSE;
+  stats->block->magic = SRVD_STATS_MAGIC;
+  stats->block->version = SRVD_STATS_VERSION;
+  stats->block->size = stats->size;
+  stats->block->slot_count = slot_count;
+  stats->block->type_count = 0;
+  stats->block->started = srvd_stats_now();
+
+  SRVD_THREAD_KEY_INITIALIZE_DESTRUCTOR(stats->key, _srvd_stats_claim_release);
+  SRVD_THREAD_MUTEX_INITIALIZE(stats->lock);
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_stats_finalize(srvd_stats_t *stats) {
+  SRVD_RETURN_FALSE_UNLESS(stats);
+
+  if(stats->claims) {
+    (void)pthread_key_delete(stats->key);
+    SRVD_THREAD_MUTEX_FINALIZE(stats->lock);
+    free(stats->claims);
+  }
+
+  if(stats->block) {
+    if(stats->mapped)
+      munmap(stats->block, stats->size);
+    else
+      free(stats->block);
+  }
+
+  stats->claims = NULL;
+  stats->block = NULL;
+  stats->size = 0;
+  stats->mapped = SRVD_FALSE;
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_stats_publish(srvd_stats_t *stats, const char *path) {
+  srvd_boolean_t status = SRVD_FALSE;
+  char *temporary = NULL;
+  size_t temporary_length;
+  int descriptor = -1;
+  void *data = MAP_FAILED;
+  uint32_t i;
+
+  SRVD_RETURN_FALSE_UNLESS(stats);
+  SRVD_RETURN_FALSE_UNLESS(stats->claims);
+  SRVD_RETURN_FALSE_IF(stats->mapped);
+  SRVD_RETURN_FALSE_UNLESS(path);
+
+  /* Nobody may be holding on to a slot in the old block. */
+  SRVD_THREAD_MUTEX_LOCK(stats->lock);
+  for(i = 1; i < stats->block->slot_count; i++) {
+    if(stats->claims[i].claimed) {
+      SRVD_LOG_ERROR("srvd_stats_publish: Cannot publish: Statistics are already being "
+                     "recorded");
+      goto _srvd_stats_publish_error;
+    }
+  }
+
+  /* Build the file next to the real one and rename it into place so readers
+   * never see a partial block. */
+  temporary_length = strlen(path) + 32;
+  temporary = malloc(temporary_length);
+  if(temporary == NULL) {
+    SRVD_LOG_ERROR("srvd_stats_publish: Unable to allocate memory for path");
+    goto _srvd_stats_publish_error;
+  }
+  snprintf(temporary, temporary_length, "%s.%ld", path, (long)getpid());
+
+  descriptor = open(temporary, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if(descriptor == -1) {
+    SRVD_LOG_ERROR("srvd_stats_publish: Unable to create \"%s\"", temporary);
+    goto _srvd_stats_publish_error;
+  }
+
+  if(ftruncate(descriptor, (off_t)stats->size) == -1) {
+    SRVD_LOG_ERROR("srvd_stats_publish: Unable to resize \"%s\"", temporary);
+    goto _srvd_stats_publish_error;
+  }
+
+  data = mmap(NULL, stats->size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+  if(data == MAP_FAILED) {
+    SRVD_LOG_ERROR("srvd_stats_publish: Unable to map \"%s\"", temporary);
+    goto _srvd_stats_publish_error;
+  }
+
+  memcpy(data, stats->block, stats->size);
+
+  if(rename(temporary, path) == -1) {
+    SRVD_LOG_ERROR("srvd_stats_publish: Unable to move statistics into place at \"%s\"", path);
+    goto _srvd_stats_publish_error;
+  }
+
+  free(stats->block);
+  stats->block = (srvd_stats_block_t *)data;
+  stats->mapped = SRVD_TRUE;
+  for(i = 0; i < stats->block->slot_count; i++)
+    stats->claims[i].slot = &stats->block->slots[i];
+
+  status = SRVD_TRUE;
+
+ _srvd_stats_publish_error:
+
+  SRVD_THREAD_MUTEX_UNLOCK(stats->lock);
+
+  if(!status) {
+    if(data != MAP_FAILED)
+      munmap(data, stats->size);
+    if(descriptor != -1)
+      unlink(temporary);
+  }
+  if(descriptor != -1)
+    close(descriptor);
+  if(temporary)
+    free(temporary);
+
+  return status;
+}
+
+srvd_boolean_t srvd_stats_map(srvd_stats_t *stats, const char *path) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_stats_block_t *block;
+  struct stat info;
+  int descriptor;
+  void *data;
+
+  SRVD_RETURN_FALSE_UNLESS(stats);
+  SRVD_RETURN_FALSE_UNLESS(path);
+
+  stats->block = NULL;
+  stats->size = 0;
+  stats->mapped = SRVD_FALSE;
+  stats->claims = NULL;
+
+  descriptor = open(path, O_RDONLY);
+  if(descriptor == -1) {
+    SRVD_LOG_ERROR("srvd_stats_map: Unable to open \"%s\"", path);
+    return SRVD_FALSE;
+  }
+
+  if(fstat(descriptor, &info) == -1 || (size_t)info.st_size < sizeof(srvd_stats_block_t)) {
+    SRVD_LOG_ERROR("srvd_stats_map: Statistics \"%s\" are too short", path);
+    goto _srvd_stats_map_error;
+  }
+
+  data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+  if(data == MAP_FAILED) {
+    SRVD_LOG_ERROR("srvd_stats_map: Unable to map statistics \"%s\"", path);
+    goto _srvd_stats_map_error;
+  }
+
+  /* The size has to match exactly; anything else is from a different
+   * version. */
+  block = (srvd_stats_block_t *)data;
+  if(block->magic != SRVD_STATS_MAGIC || block->version != SRVD_STATS_VERSION ||
+     block->size != (uint64_t)info.st_size || block->slot_count == 0 ||
+     block->size != sizeof(srvd_stats_block_t) +
+     sizeof(srvd_stats_slot_t) * (uint64_t)block->slot_count) {
+    SRVD_LOG_ERROR("srvd_stats_map: Statistics \"%s\" have an invalid header", path);
+    munmap(data, (size_t)info.st_size);
+    goto _srvd_stats_map_error;
+  }
+
+  stats->block = block;
+  stats->size = (size_t)info.st_size;
+  stats->mapped = SRVD_TRUE;
+
+  status = SRVD_TRUE;
+
+ _srvd_stats_map_error:
+
+  close(descriptor);
+
+  return status;
+}
+
+uint64_t srvd_stats_now(void) {
+  struct timespec now;
+
+  if(clock_gettime(CLOCK_MONOTONIC, &now) == -1)
+    return 0;
+
+  return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+void srvd_stats_sample_initialize(srvd_stats_sample_t *sample) {
+  SRVD_RETURN_UNLESS(sample);
+
+  memset(sample, 0, sizeof(srvd_stats_sample_t));
+  sample->type = SRVD_PROTOCOL_NONE;
+  sample->status = SRVD_SERVICE_RESPONSE_UNKNOWN;
+}
+
+void srvd_stats_sample_set_packets(srvd_stats_sample_t *sample,
+                                   const srvd_protocol_packet_t *request,
+                                   const srvd_protocol_packet_t *response) {
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+
+  SRVD_RETURN_UNLESS(sample);
+
+  if(request) {
+    if(srvd_protocol_packet_field_get_first(request, &field))
+      sample->type = field->type;
+    sample->bytes_in = srvd_protocol_serial_packet_size(request);
+  }
+
+  if(response) {
+    field = NULL;
+    if(srvd_protocol_packet_field_get_first(response, &field) &&
+       field->type == SRVD_PROTOCOL_STATUS &&
+       srvd_protocol_packet_field_entry_get_first(field, &entry))
+      srvd_protocol_packet_field_entry_get_uint16(entry, &sample->status);
+    sample->bytes_out = srvd_protocol_serial_packet_size(response);
+  }
+}
+
+/* Histograms.
+ *
+ * Values below 8 get a bucket each. Above that, a value is shifted right until
+ * it's between 4 and 7, and it goes in the bucket for that number and the
+ * shift, so every bucket covers a range a quarter the size of its lower
+ * bound. */
+
+static uint32_t _srvd_stats_histogram_bucket(uint64_t value) {
+  uint32_t shift = 0;
+
+  while((value >> shift) >= (2 << SRVD_STATS_HISTOGRAM_SUB_BUCKET_BITS))
+    shift++;
+
+  value = (uint64_t)shift * (1 << SRVD_STATS_HISTOGRAM_SUB_BUCKET_BITS) + (value >> shift);
+
+  return value < SRVD_STATS_HISTOGRAM_BUCKET_COUNT
+    ? (uint32_t)value
+    : SRVD_STATS_HISTOGRAM_BUCKET_COUNT - 1;
+}
+
+/* The largest value that goes in a bucket. */
+static uint64_t _srvd_stats_histogram_bucket_maximum(uint32_t bucket) {
+  uint32_t shift, base;
+
+  if(bucket < (2 << SRVD_STATS_HISTOGRAM_SUB_BUCKET_BITS))
+    return bucket;
+
+  shift = (bucket >> SRVD_STATS_HISTOGRAM_SUB_BUCKET_BITS) - 1;
+  base = bucket - (shift << SRVD_STATS_HISTOGRAM_SUB_BUCKET_BITS);
+
+  return (((uint64_t)base + 1) << shift) - 1;
+}
+
+void srvd_stats_histogram_record(srvd_stats_histogram_t *histogram, uint64_t value) {
+  SRVD_RETURN_UNLESS(histogram);
+
+  histogram->buckets[_srvd_stats_histogram_bucket(value)]++;
+}
+
+uint64_t srvd_stats_histogram_count(const srvd_stats_histogram_t *histogram) {
+  uint64_t count = 0;
+  uint32_t i;
+
+  SRVD_RETURN_VALUE_UNLESS(histogram, 0);
+
+  for(i = 0; i < SRVD_STATS_HISTOGRAM_BUCKET_COUNT; i++)
+    count += histogram->buckets[i];
+
+  return count;
+}
+
+uint64_t srvd_stats_histogram_percentile(const srvd_stats_histogram_t *histogram,
+                                         double fraction) {
+  uint64_t count, target, seen = 0;
+  uint32_t i;
+
+  SRVD_RETURN_VALUE_UNLESS(histogram, 0);
+
+  count = srvd_stats_histogram_count(histogram);
+  SRVD_RETURN_VALUE_UNLESS(count > 0, 0);
+
+  target = (uint64_t)(fraction * (double)count + 0.999999);
+  if(target < 1)
+    target = 1;
+  else if(target > count)
+    target = count;
+
+  for(i = 0; i < SRVD_STATS_HISTOGRAM_BUCKET_COUNT; i++) {
+    seen += histogram->buckets[i];
+    if(seen >= target)
+      break;
+  }
+
+  return _srvd_stats_histogram_bucket_maximum(i);
+}
+
+/* Recording. */
+
+/* Returns this thread's slot, claiming one if it doesn't have one yet. If
+ * there aren't any left, returns the shared slot and sets *shared. */
+static srvd_stats_slot_t *_srvd_stats_slot_get(srvd_stats_t *stats, srvd_boolean_t *shared) {
+  srvd_stats_claim_t *claim;
+  uint32_t i;
+
+  claim = (srvd_stats_claim_t *)SRVD_THREAD_KEY_DATA_GET(stats->key);
+  if(claim) {
+    *shared = SRVD_FALSE;
+    return claim->slot;
+  }
+
+  SRVD_THREAD_MUTEX_LOCK(stats->lock);
+  for(i = 1; i < stats->block->slot_count; i++) {
+    if(!stats->claims[i].claimed) {
+      claim = &stats->claims[i];
+      claim->claimed = SRVD_TRUE;
+      break;
+    }
+  }
+  SRVD_THREAD_MUTEX_UNLOCK(stats->lock);
+
+  if(claim && SRVD_THREAD_KEY_DATA_SET(stats->key, claim) == 0) {
+    *shared = SRVD_FALSE;
+    return claim->slot;
+  }
+  else if(claim)
+    _srvd_stats_claim_release(claim);
+
+  *shared = SRVD_TRUE;
+  return &stats->block->slots[0];
+}
+
+/* Returns where in a slot a type is counted, adding it to the table if it's
+ * new and there's room. */
+static uint32_t _srvd_stats_type_index(srvd_stats_t *stats, srvd_protocol_type_t type) {
+  srvd_stats_block_t *block = stats->block;
+  uint32_t i, count;
+
+  count = block->type_count;
+  _SRVD_STATS_BARRIER();
+
+  for(i = 0; i < count; i++) {
+    if(block->types[i] == type)
+      return i;
+  }
+
+  SRVD_THREAD_MUTEX_LOCK(stats->lock);
+  for(; i < block->type_count; i++) {
+    if(block->types[i] == type)
+      break;
+  }
+  if(i == block->type_count && i < SRVD_STATS_TYPE_MAXIMUM) {
+    block->types[i] = type;
+    _SRVD_STATS_BARRIER();
+    block->type_count = i + 1;
+  }
+  SRVD_THREAD_MUTEX_UNLOCK(stats->lock);
+
+  return i < SRVD_STATS_TYPE_MAXIMUM ? i : SRVD_STATS_TYPE_MAXIMUM;
+}
+
+static void _srvd_stats_histogram_record_between(srvd_stats_histogram_t *histogram,
+                                                 uint64_t from, uint64_t to) {
+  if(from != 0 && to >= from)
+    srvd_stats_histogram_record(histogram, to - from);
+}
+
+void srvd_stats_record(srvd_stats_t *stats, const srvd_stats_sample_t *sample) {
+  srvd_stats_counters_t *counters;
+  srvd_stats_slot_t *slot;
+  srvd_boolean_t shared;
+  uint32_t index;
+
+  SRVD_RETURN_UNLESS(stats);
+  SRVD_RETURN_UNLESS(stats->claims);
+  SRVD_RETURN_UNLESS(sample);
+
+  slot = _srvd_stats_slot_get(stats, &shared);
+  index = _srvd_stats_type_index(stats, sample->type);
+  counters = &slot->types[index];
+
+  if(shared)
+    SRVD_THREAD_MUTEX_LOCK(stats->lock);
+
+  slot->sequences[index]++;
+  _SRVD_STATS_BARRIER();
+
+  counters->requests++;
+  if(sample->error)
+    counters->errors++;
+  else
+    counters->statuses[sample->status < SRVD_STATS_STATUS_COUNT - 1
+                       ? sample->status
+                       : SRVD_STATS_STATUS_COUNT - 1]++;
+  counters->bytes_in += sample->bytes_in;
+  counters->bytes_out += sample->bytes_out;
+
+  _srvd_stats_histogram_record_between(&counters->queue_wait, sample->received,
+                                       sample->dispatched);
+  _srvd_stats_histogram_record_between(&counters->handler, sample->dispatched, sample->handled);
+  _srvd_stats_histogram_record_between(&counters->serialization, sample->handled, sample->sent);
+
+  _SRVD_STATS_BARRIER();
+  slot->sequences[index]++;
+
+  if(shared)
+    SRVD_THREAD_MUTEX_UNLOCK(stats->lock);
+}
+
+/* Snapshots. */
+
+static void _srvd_stats_histogram_add(srvd_stats_histogram_t *to,
+                                      const srvd_stats_histogram_t *from, srvd_boolean_t negate) {
+  uint32_t i;
+
+  for(i = 0; i < SRVD_STATS_HISTOGRAM_BUCKET_COUNT; i++)
+    to->buckets[i] += negate ? -from->buckets[i] : from->buckets[i];
+}
+
+static void _srvd_stats_counters_add(srvd_stats_counters_t *to, const srvd_stats_counters_t *from,
+                                     srvd_boolean_t negate) {
+  uint32_t i;
+
+#define _SRVD_STATS_COUNTER_ADD(counter)                                \
+  (to->counter += negate ? -from->counter : from->counter)
+
+  _SRVD_STATS_COUNTER_ADD(requests);
+  _SRVD_STATS_COUNTER_ADD(errors);
+  for(i = 0; i < SRVD_STATS_STATUS_COUNT; i++)
+    _SRVD_STATS_COUNTER_ADD(statuses[i]);
+  _SRVD_STATS_COUNTER_ADD(bytes_in);
+  _SRVD_STATS_COUNTER_ADD(bytes_out);
+
+#undef _SRVD_STATS_COUNTER_ADD
+
+  _srvd_stats_histogram_add(&to->queue_wait, &from->queue_wait, negate);
+  _srvd_stats_histogram_add(&to->handler, &from->handler, negate);
+  _srvd_stats_histogram_add(&to->serialization, &from->serialization, negate);
+}
+
+/* Adds one set of counters from a slot to a snapshot, waiting for its writer
+ * to finish with it if necessary. */
+static void _srvd_stats_counters_read(srvd_stats_counters_t *to, const srvd_stats_slot_t *slot,
+                                      uint32_t index) {
+  srvd_stats_counters_t copy;
+  uint32_t sequence, attempt;
+
+  for(attempt = 1; ; attempt++) {
+    sequence = slot->sequences[index];
+    _SRVD_STATS_BARRIER();
+
+    memcpy(&copy, &slot->types[index], sizeof(srvd_stats_counters_t));
+
+    _SRVD_STATS_BARRIER();
+    if((!(sequence & 1) && slot->sequences[index] == sequence) ||
+       attempt == _SRVD_STATS_READ_ATTEMPTS)
+      break;
+  }
+
+  _srvd_stats_counters_add(to, &copy, SRVD_FALSE);
+}
+
+srvd_boolean_t srvd_stats_snapshot(srvd_stats_t *stats, srvd_stats_snapshot_t *snapshot) {
+  srvd_stats_block_t *block;
+  size_t i, slot_count;
+  uint32_t j, count;
+
+  SRVD_RETURN_FALSE_UNLESS(stats);
+  SRVD_RETURN_FALSE_UNLESS(stats->block);
+  SRVD_RETURN_FALSE_UNLESS(snapshot);
+
+  block = stats->block;
+  memset(snapshot, 0, sizeof(srvd_stats_snapshot_t));
+
+  /* Someone else's block might say anything, so go by what we mapped. */
+  slot_count = (stats->size - sizeof(srvd_stats_block_t)) / sizeof(srvd_stats_slot_t);
+  count = block->type_count;
+  if(count > SRVD_STATS_TYPE_MAXIMUM)
+    count = SRVD_STATS_TYPE_MAXIMUM;
+  _SRVD_STATS_BARRIER();
+
+  for(j = 0; j < count; j++)
+    snapshot->types[j] = block->types[j];
+  snapshot->types[count] = SRVD_PROTOCOL_NONE;
+
+  for(i = 0; i < slot_count; i++) {
+    for(j = 0; j < count; j++)
+      _srvd_stats_counters_read(&snapshot->counters[j], &block->slots[i], j);
+    _srvd_stats_counters_read(&snapshot->counters[count], &block->slots[i],
+                              SRVD_STATS_TYPE_MAXIMUM);
+  }
+
+  /* Only report the leftovers if there are any. */
+  snapshot->type_count = snapshot->counters[count].requests > 0 ? count + 1 : count;
+  snapshot->uptime = srvd_stats_now() - block->started;
+
+  return SRVD_TRUE;
+}
+
+void srvd_stats_snapshot_subtract(srvd_stats_snapshot_t *snapshot,
+                                  const srvd_stats_snapshot_t *earlier) {
+  uint32_t i, j;
+
+  SRVD_RETURN_UNLESS(snapshot);
+  SRVD_RETURN_UNLESS(earlier);
+
+  snapshot->uptime -= earlier->uptime;
+
+  for(i = 0; i < snapshot->type_count; i++) {
+    for(j = 0; j < earlier->type_count; j++) {
+      if(earlier->types[j] == snapshot->types[i]) {
+        _srvd_stats_counters_add(&snapshot->counters[i], &earlier->counters[j], SRVD_TRUE);
+        break;
+      }
+    }
+  }
+}
+
+static char *_srvd_stats_pack_uint64(char *to, uint64_t value) {
+  int i;
+
+  for(i = 7; i >= 0; i--) {
+    to[i] = (char)(value & 0xff);
+    value >>= 8;
+  }
+
+  return to + 8;
+}
+
+static const char *_srvd_stats_unpack_uint64(const char *from, uint64_t *value) {
+  int i;
+
+  *value = 0;
+  for(i = 0; i < 8; i++)
+    *value = (*value << 8) | (uint8_t)from[i];
+
+  return from + 8;
+}
+
+static char *_srvd_stats_pack_histogram(char *to, const srvd_stats_histogram_t *histogram) {
+  uint32_t i;
+
+  for(i = 0; i < SRVD_STATS_HISTOGRAM_BUCKET_COUNT; i++)
+    to = _srvd_stats_pack_uint64(to, histogram->buckets[i]);
+
+  return to;
+}
+
+static const char *_srvd_stats_unpack_histogram(const char *from,
+                                                srvd_stats_histogram_t *histogram) {
+  uint32_t i;
+
+  for(i = 0; i < SRVD_STATS_HISTOGRAM_BUCKET_COUNT; i++)
+    from = _srvd_stats_unpack_uint64(from, &histogram->buckets[i]);
+
+  return from;
+}
+
+srvd_boolean_t srvd_stats_snapshot_pack(const srvd_stats_snapshot_t *snapshot,
+                                        srvd_protocol_packet_t *packet) {
+  srvd_protocol_packet_field_t *field = NULL;
+  const srvd_stats_counters_t *counters;
+  char buffer[_SRVD_STATS_COUNTERS_PACKED_SIZE], *position;
+  uint16_t type;
+  uint32_t i, j;
+
+  SRVD_RETURN_FALSE_UNLESS(snapshot);
+  SRVD_RETURN_FALSE_UNLESS(packet);
+
+  if(!srvd_protocol_packet_field_get_or_add(packet, SRVD_PROTOCOL_STATS, &field)) {
+    SRVD_LOG_ERROR("srvd_stats_snapshot_pack: Unable to get statistics field instance");
+    return SRVD_FALSE;
+  }
+
+  _srvd_stats_pack_uint64(buffer, snapshot->uptime);
+  if(!srvd_protocol_packet_field_entry_add(field, 8, buffer))
+    return SRVD_FALSE;
+
+  for(i = 0; i < snapshot->type_count; i++) {
+    counters = &snapshot->counters[i];
+
+    type = htons(snapshot->types[i]);
+    memcpy(buffer, &type, sizeof(uint16_t));
+    position = buffer + sizeof(uint16_t);
+
+    position = _srvd_stats_pack_uint64(position, counters->requests);
+    position = _srvd_stats_pack_uint64(position, counters->errors);
+    for(j = 0; j < SRVD_STATS_STATUS_COUNT; j++)
+      position = _srvd_stats_pack_uint64(position, counters->statuses[j]);
+    position = _srvd_stats_pack_uint64(position, counters->bytes_in);
+    position = _srvd_stats_pack_uint64(position, counters->bytes_out);
+    position = _srvd_stats_pack_histogram(position, &counters->queue_wait);
+    position = _srvd_stats_pack_histogram(position, &counters->handler);
+    _srvd_stats_pack_histogram(position, &counters->serialization);
+
+    if(!srvd_protocol_packet_field_entry_add(field, (uint16_t)sizeof(buffer), buffer))
+      return SRVD_FALSE;
+  }
+
+  return SRVD_TRUE;
+}
+
+srvd_boolean_t srvd_stats_snapshot_unpack(const srvd_protocol_packet_t *packet,
+                                          srvd_stats_snapshot_t *snapshot) {
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry;
+  srvd_stats_counters_t *counters;
+  const char *position;
+  uint16_t type;
+  uint32_t i;
+
+  SRVD_RETURN_FALSE_UNLESS(packet);
+  SRVD_RETURN_FALSE_UNLESS(snapshot);
+
+  memset(snapshot, 0, sizeof(srvd_stats_snapshot_t));
+
+  if(!srvd_protocol_packet_field_get_by_type(packet, SRVD_PROTOCOL_STATS, &field)) {
+    SRVD_LOG_ERROR("srvd_stats_snapshot_unpack: Response contains no statistics");
+    return SRVD_FALSE;
+  }
+
+  entry = field->entry_head;
+  if(entry == NULL || entry->size != 8) {
+    SRVD_LOG_ERROR("srvd_stats_snapshot_unpack: Invalid uptime");
+    return SRVD_FALSE;
+  }
+  _srvd_stats_unpack_uint64(entry->data, &snapshot->uptime);
+
+  for(entry = entry->next; entry != NULL; entry = entry->next) {
+    if(entry->size != _SRVD_STATS_COUNTERS_PACKED_SIZE ||
+       snapshot->type_count > SRVD_STATS_TYPE_MAXIMUM) {
+      SRVD_LOG_ERROR("srvd_stats_snapshot_unpack: Invalid counters");
+      return SRVD_FALSE;
+    }
+
+    counters = &snapshot->counters[snapshot->type_count];
+
+    memcpy(&type, entry->data, sizeof(uint16_t));
+    snapshot->types[snapshot->type_count] = ntohs(type);
+    position = (const char *)entry->data + sizeof(uint16_t);
+
+    position = _srvd_stats_unpack_uint64(position, &counters->requests);
+    position = _srvd_stats_unpack_uint64(position, &counters->errors);
+    for(i = 0; i < SRVD_STATS_STATUS_COUNT; i++)
+      position = _srvd_stats_unpack_uint64(position, &counters->statuses[i]);
+    position = _srvd_stats_unpack_uint64(position, &counters->bytes_in);
+    position = _srvd_stats_unpack_uint64(position, &counters->bytes_out);
+    position = _srvd_stats_unpack_histogram(position, &counters->queue_wait);
+    position = _srvd_stats_unpack_histogram(position, &counters->handler);
+    _srvd_stats_unpack_histogram(position, &counters->serialization);
+
+    snapshot->type_count++;
+  }
+
+  return SRVD_TRUE;
+}
@@ -8,91 +8,35 @@
  */
 
 #include "aliases.h"
+#include "cache.h"
 
 #include <srvd/srvd.h>
-#include <srvd/buffer.h>
+#include <srvd/filter.h>
+#include <srvd/protocol/extension.h>
 #include <srvd/protocol/packet.h>
+#include <srvd/protocol/serial_packet.h>
 #include <srvd/service.h>
 #include <srvd/service/nss/aliases.h>
 #include <srvd/thread.h>
 
 #ifdef HAVE_ALIASES
-static enum nss_status _srvd_nss_aliases_populate(const srvd_service_response_t *response,
-                                                  struct aliasent *ae, char *buffer, size_t bufsize, int *ret_errno) {
-  enum nss_status status = NSS_STATUS_SUCCESS;
-  srvd_protocol_packet_field_t *field;
-  SRVD_BUFFER(bi, buffer);
-
-  /* Servers are not required to send the LOCAL field. */
+#define _SRVD_NSS_ALIASES_SCHEMA(F)                                              \
+  F(SRVD_SERVICE_NSS_ALIASES_RESPONSE_NAME, string, alias_name, )                \
+  F(SRVD_SERVICE_NSS_ALIASES_RESPONSE_MEMBERS, string_vector, alias_members,     \
+    alias_members_len)                                                          \
+  F(SRVD_SERVICE_NSS_ALIASES_RESPONSE_LOCAL, uint8, alias_local, )
+
+SRVD_NSS_DECODER_DEFINE(_srvd_nss_aliases_decode_fields, struct aliasent, _SRVD_NSS_ALIASES_SCHEMA)
+
+static enum nss_status _srvd_nss_aliases_decode(const srvd_service_serial_response_t *response,
+                                                struct aliasent *ae, srvd_nss_buffer_t *bi,
+                                                int *ret_errno) {
+  /* Servers are not required to send the MEMBERS or LOCAL fields. */
+  ae->alias_members_len = 0;
+  ae->alias_members = NULL;
   ae->alias_local = 0;
 
-  SRVD_SERVICE_RESPONSE_FIELD_ITERATE(response, field) {
-    srvd_protocol_packet_field_entry_t *entry = NULL;
-
-    switch(field->type) {
-    case SRVD_SERVICE_NSS_ALIASES_RESPONSE_NAME:
-      if(!srvd_protocol_packet_field_entry_get_first(field, &entry)) {
-        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,
-                      _srvd_nss_aliases_populate_error);
-      }
-
-      if(!SRVD_BUFFER_CHECK_OFFSET(bi, buffer, bufsize, entry->size)) {
-        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE,
-                      _srvd_nss_aliases_populate_error);
-      }
-
-      strncpy(SRVD_BUFFER_REF(bi), entry->data, entry->size);
-      SRVD_BUFFER_REF(bi)[entry->size - 1] = '\0';
-      ae->alias_name = SRVD_BUFFER_REF(bi);
-
-      SRVD_BUFFER_ITERATOR_NEXT(bi, entry->size);
-      break;
-
-    case SRVD_SERVICE_NSS_ALIASES_RESPONSE_MEMBERS:
-      ae->alias_members_len = field->entry_count;
-
-      if(!SRVD_BUFFER_CHECK_OFFSET(bi, buffer, bufsize, ae->alias_members_len * sizeof(char *))) {
-        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE,
-                      _srvd_nss_aliases_populate_error);
-      }
-
-      memset(SRVD_BUFFER_REF(bi), 0, ae->alias_members_len * sizeof(char *));
-      ae->alias_members = (char **)SRVD_BUFFER_REF(bi);
-
-      SRVD_BUFFER_ITERATOR_NEXT(bi, ae->alias_members_len * sizeof(char *));
-
-      uint16_t entry_offset;
-      SRVD_PROTOCOL_PACKET_FIELD_ENTRY_ITERATE_COUNT(field, entry, entry_offset) {
-        if(!SRVD_BUFFER_CHECK_OFFSET(bi, buffer, bufsize, entry->size)) {
-          SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE,
-                        _srvd_nss_aliases_populate_error);
-        }
-
-        strncpy(SRVD_BUFFER_REF(bi), entry->data, entry->size);
-        SRVD_BUFFER_REF(bi)[entry->size - 1] = '\0';
-        ae->alias_members[entry_offset] = SRVD_BUFFER_REF(bi);
-
-        SRVD_BUFFER_ITERATOR_NEXT(bi, entry->size);
-      }
-      break;
-
-    case SRVD_SERVICE_NSS_ALIASES_RESPONSE_LOCAL:
-      if(!srvd_protocol_packet_field_entry_get_first(field, &entry)) {
-        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,
-                      _srvd_nss_aliases_populate_error);
-      }
-
-      srvd_protocol_packet_field_entry_get_uint8(entry, (uint8_t *)&ae->alias_local);
-      break;
-
-    default:
-      break;
-    }
-  }
-
- _srvd_nss_aliases_populate_error:
-
-  return status;
+  return _srvd_nss_aliases_decode_fields(response, ae, bi, ret_errno);
 }
 
 enum nss_status
@@ -100,14 +44,22 @@ _nss_srvd_getaliasbyname_r(const char *name, struct aliasent *ae,
                            char *buffer, size_t bufsize, int *ret_errno) {
   enum nss_status status;
   srvd_service_request_t request;
-  srvd_service_response_t response;
+  srvd_service_serial_response_t response;
+  srvd_nss_buffer_t bi;
+  size_t required;
+
+  /* Don't bother the server about names it has told us it doesn't have. */
+  if(!srvd_filter_default_has(SRVD_SERVICE_NSS_ALIASES_REQUEST_NAME, name, strlen(name)))
+    return NSS_STATUS_NOTFOUND;
 
   srvd_service_request_initialize(&request);
   srvd_protocol_packet_field_append(&request.packet, SRVD_SERVICE_NSS_ALIASES_REQUEST_NAME,
                                     (uint16_t)(sysconf(_SC_LOGIN_NAME_MAX) + 1), name);
+  srvd_nss_request_extension_set(&request, SRVD_PROTOCOL_EXTENSION_PRIORITY_INTERACTIVE);
 
-  srvd_service_response_initialize(&response);
-  srvd_service_request_query(&request, &response);
+  srvd_nss_buffer_initialize(&bi, buffer, bufsize);
+  srvd_service_serial_response_initialize(&response);
+  srvd_nss_cache_query(&request, &response, &required);
 
   if(response.status == SRVD_SERVICE_RESPONSE_NOTFOUND) {
     SRVD_NSS_NORECORD(status, _nss_srvd_getaliasbyname_r_error);
@@ -120,12 +72,21 @@ _nss_srvd_getaliasbyname_r(const char *name, struct aliasent *ae,
                   _nss_srvd_getaliasbyname_r_error);
   }
 
-  status = _srvd_nss_aliases_populate(&response, ae, buffer, bufsize, ret_errno);
+  /* We already know it won't fit. */
+  if(bufsize < required) {
+    bi.used = required;
+    SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE, _nss_srvd_getaliasbyname_r_error);
+  }
+
+  status = _srvd_nss_aliases_decode(&response, ae, &bi, ret_errno);
 
  _nss_srvd_getaliasbyname_r_error:
 
+  if(status == NSS_STATUS_TRYAGAIN && *ret_errno == ERANGE)
+    srvd_nss_cache_keep(&request, &response, bi.used);
+
   srvd_service_request_finalize(&request);
-  srvd_service_response_finalize(&response);
+  srvd_service_serial_response_finalize(&response);
 
   return status;
 }
@@ -189,7 +150,9 @@ _nss_srvd_getaliasent_r(struct aliasent *ae, char *buffer,
   uint32_t *offset;
 
   srvd_service_request_t request;
-  srvd_service_response_t response;
+  srvd_service_serial_response_t response;
+  srvd_nss_buffer_t bi;
+  size_t required;
 
   SRVD_THREAD_ONCE_CALL(_srvd_nss_aliases_aliasent_initialize,
                         _srvd_nss_aliases_aliasent_initialize_callback);
@@ -203,9 +166,11 @@ _nss_srvd_getaliasent_r(struct aliasent *ae, char *buffer,
   srvd_service_request_initialize(&request);
   srvd_protocol_packet_field_append_uint32(&request.packet,
                                            SRVD_SERVICE_NSS_ALIASES_REQUEST_ENTITIES, *offset);
+  srvd_nss_request_extension_set(&request, SRVD_PROTOCOL_EXTENSION_PRIORITY_BULK);
 
-  srvd_service_response_initialize(&response);
-  srvd_service_request_query(&request, &response);
+  srvd_nss_buffer_initialize(&bi, buffer, bufsize);
+  srvd_service_serial_response_initialize(&response);
+  srvd_nss_cache_query(&request, &response, &required);
 
   if(response.status == SRVD_SERVICE_RESPONSE_NOTFOUND) {
     SRVD_NSS_NORECORD(status, _nss_srvd_getaliasent_r_error);
@@ -218,13 +183,26 @@ _nss_srvd_getaliasent_r(struct aliasent *ae, char *buffer,
                   _nss_srvd_getaliasent_r_error);
   }
 
-  status = _srvd_nss_aliases_populate(&response, ae, buffer, bufsize, ret_errno);
-  (*offset)++;
+  /* We already know it won't fit. */
+  if(bufsize < required) {
+    bi.used = required;
+    SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE, _nss_srvd_getaliasent_r_error);
+  }
+
+  status = _srvd_nss_aliases_decode(&response, ae, &bi, ret_errno);
+
+  /* The C library asks again with a bigger buffer when it gets ERANGE, so
+   * only move on once we've handed the entry over. */
+  if(status == NSS_STATUS_SUCCESS)
+    (*offset)++;
 
  _nss_srvd_getaliasent_r_error:
 
+  if(status == NSS_STATUS_TRYAGAIN && *ret_errno == ERANGE)
+    srvd_nss_cache_keep(&request, &response, bi.used);
+
   srvd_service_request_finalize(&request);
-  srvd_service_response_finalize(&response);
+  srvd_service_serial_response_finalize(&response);
 
   return status;
 }
@@ -0,0 +1,194 @@
+/* cache.c: Responses kept for a retry with a bigger buffer.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include "cache.h"
+
+#include <srvd/srvd.h>
+#include <srvd/protocol/packet.h>
+#include <srvd/service.h>
+#include <srvd/thread.h>
+
+#include <time.h>
+
+/* How long, in seconds, a response is kept. Retries follow straight on, so
+ * anything older is somebody else asking. */
+#define _SRVD_NSS_CACHE_LIFETIME 2
+
+typedef struct _srvd_nss_cache _srvd_nss_cache_t;
+
+struct _srvd_nss_cache {
+  /* The request, flattened (see _srvd_nss_cache_key_build()). */
+  char *key;
+  size_t key_size;
+
+  time_t kept;
+  size_t required;
+  srvd_service_serial_response_t response;
+};
+
+static SRVD_THREAD_ONCE_DECLARE(_srvd_nss_cache_initialize);
+static SRVD_THREAD_KEY_DECLARE(_srvd_nss_cache_key);
+
+static void _srvd_nss_cache_clear(_srvd_nss_cache_t *cache) {
+  free(cache->key);
+  cache->key = NULL;
+  cache->key_size = 0;
+
+  srvd_service_serial_response_finalize(&cache->response);
+  srvd_service_serial_response_initialize(&cache->response);
+}
+
+static void _srvd_nss_cache_destroy(void *data) {
+  _srvd_nss_cache_t *cache = (_srvd_nss_cache_t *)data;
+
+  _srvd_nss_cache_clear(cache);
+  free(cache);
+}
+
+static void _srvd_nss_cache_initialize_callback(void) {
+  SRVD_THREAD_KEY_INITIALIZE_DESTRUCTOR(_srvd_nss_cache_key, _srvd_nss_cache_destroy);
+}
+
+static _srvd_nss_cache_t *_srvd_nss_cache_get(void) {
+  _srvd_nss_cache_t *cache;
+
+  SRVD_THREAD_ONCE_CALL(_srvd_nss_cache_initialize, _srvd_nss_cache_initialize_callback);
+  if(SRVD_THREAD_KEY_DATA_HAS(_srvd_nss_cache_key))
+    return (_srvd_nss_cache_t *)SRVD_THREAD_KEY_DATA_GET(_srvd_nss_cache_key);
+
+  cache = malloc(sizeof(_srvd_nss_cache_t));
+  if(cache == NULL) {
+    SRVD_LOG_ERROR("_srvd_nss_cache_get: Unable to allocate memory for cache");
+    return NULL;
+  }
+
+  cache->key = NULL;
+  cache->key_size = 0;
+  cache->kept = 0;
+  cache->required = 0;
+  srvd_service_serial_response_initialize(&cache->response);
+
+  if(SRVD_THREAD_KEY_DATA_SET(_srvd_nss_cache_key, cache) != 0) {
+    free(cache);
+    return NULL;
+  }
+
+  return cache;
+}
+
+/* Lays out every field of the request except its extension (see
+ * <srvd/protocol/extension.h>), which has a deadline that's different on every
+ * retry. Nobody else ever reads the key, so it's just each field's type and
+ * entry count followed by each entry's size and data. */
+static char *_srvd_nss_cache_key_build(const srvd_service_request_t *request, size_t *key_size) {
+  srvd_protocol_packet_field_t *field;
+  srvd_protocol_packet_field_entry_t *entry;
+  char *key, *p;
+  size_t size = 0;
+
+  SRVD_PROTOCOL_PACKET_FIELD_ITERATE(&request->packet, field) {
+    if(field->type == SRVD_PROTOCOL_EXTENSION)
+      continue;
+
+    size += sizeof(srvd_protocol_type_t) + sizeof(uint32_t);
+    SRVD_PROTOCOL_PACKET_FIELD_ENTRY_ITERATE(field, entry)
+      size += sizeof(uint32_t) + entry->size;
+  }
+
+  key = malloc(size > 0 ? size : 1);
+  SRVD_RETURN_NULL_UNLESS(key);
+
+  p = key;
+  SRVD_PROTOCOL_PACKET_FIELD_ITERATE(&request->packet, field) {
+    if(field->type == SRVD_PROTOCOL_EXTENSION)
+      continue;
+
+    memcpy(p, &field->type, sizeof(srvd_protocol_type_t));
+    p += sizeof(srvd_protocol_type_t);
+    memcpy(p, &field->entry_count, sizeof(uint32_t));
+    p += sizeof(uint32_t);
+
+    SRVD_PROTOCOL_PACKET_FIELD_ENTRY_ITERATE(field, entry) {
+      memcpy(p, &entry->size, sizeof(uint32_t));
+      p += sizeof(uint32_t);
+      if(entry->size > 0)
+        memcpy(p, entry->data, entry->size);
+      p += entry->size;
+    }
+  }
+
+  *key_size = size;
+
+  return key;
+}
+
+static srvd_boolean_t _srvd_nss_cache_matches(const _srvd_nss_cache_t *cache,
+                                              const srvd_service_request_t *request) {
+  char *key;
+  size_t key_size;
+  srvd_boolean_t status;
+
+  if(cache->key == NULL || time(NULL) - cache->kept > _SRVD_NSS_CACHE_LIFETIME)
+    return SRVD_FALSE;
+
+  key = _srvd_nss_cache_key_build(request, &key_size);
+  if(key == NULL)
+    return SRVD_FALSE;
+
+  status = key_size == cache->key_size && memcmp(key, cache->key, key_size) == 0;
+  free(key);
+
+  return status;
+}
+
+void srvd_nss_cache_query(const srvd_service_request_t *request,
+                          srvd_service_serial_response_t *response, size_t *required) {
+  _srvd_nss_cache_t *cache;
+
+  *required = 0;
+
+  SRVD_THREAD_ONCE_CALL(_srvd_nss_cache_initialize, _srvd_nss_cache_initialize_callback);
+  cache = (_srvd_nss_cache_t *)SRVD_THREAD_KEY_DATA_GET(_srvd_nss_cache_key);
+  if(cache) {
+    if(_srvd_nss_cache_matches(cache, request)) {
+      srvd_service_serial_response_finalize(response);
+      *response = cache->response;
+      *required = cache->required;
+
+      /* The response is the caller's now. */
+      srvd_service_serial_response_initialize(&cache->response);
+      _srvd_nss_cache_clear(cache);
+
+      return;
+    }
+
+    _srvd_nss_cache_clear(cache);
+  }
+
+  srvd_service_request_query_serial(request, response);
+}
+
+void srvd_nss_cache_keep(const srvd_service_request_t *request,
+                         srvd_service_serial_response_t *response, size_t required) {
+  _srvd_nss_cache_t *cache = _srvd_nss_cache_get();
+  SRVD_RETURN_UNLESS(cache);
+
+  _srvd_nss_cache_clear(cache);
+
+  cache->key = _srvd_nss_cache_key_build(request, &cache->key_size);
+  if(cache->key == NULL)
+    return;
+
+  cache->kept = time(NULL);
+  cache->required = required;
+  cache->response = *response;
+
+  /* The response is ours now. */
+  srvd_service_serial_response_initialize(response);
+}
@@ -0,0 +1,33 @@
+/* cache.h: Responses kept for a retry with a bigger buffer.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef __SRVD_NSS_CACHE_H
+#define __SRVD_NSS_CACHE_H
+
+/* When a response doesn't fit, the C library doubles the buffer and calls us
+ * again with the same request until it does, which would otherwise be a round
+ * trip to the server every time. Instead, each thread keeps the last response
+ * that didn't fit, along with the size it needs, for a couple of seconds. */
+
+#include "nss.h"
+#include <srvd/srvd.h>
+#include <srvd/service.h>
+
+/* Queries the service, unless this thread has a response kept for the same
+ * request, in which case it's handed over instead. Required is set to the size
+ * the kept response needs, or 0 if the service was queried. */
+void srvd_nss_cache_query(const srvd_service_request_t *, srvd_service_serial_response_t *,
+                          size_t *required);
+
+/* Keeps a response that needed the given size, taking it over; the response
+ * is left empty. */
+void srvd_nss_cache_keep(const srvd_service_request_t *, srvd_service_serial_response_t *,
+                         size_t required);
+
+#endif
@@ -0,0 +1,371 @@
+/* group.c: Name switch service for groups.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include "group.h"
+#include "cache.h"
+
+#include <srvd/srvd.h>
+#include <srvd/filter.h>
+#include <srvd/protocol/extension.h>
+#include <srvd/protocol/packet.h>
+#include <srvd/protocol/serial_packet.h>
+#include <srvd/service.h>
+#include <srvd/service/nss/group.h>
+#include <srvd/thread.h>
+
+#define _SRVD_NSS_GROUP_SCHEMA(F)                                        \
+  F(SRVD_SERVICE_NSS_GROUP_RESPONSE_NAME, string, gr_name, )             \
+  F(SRVD_SERVICE_NSS_GROUP_RESPONSE_PASSWD, string, gr_passwd, )         \
+  F(SRVD_SERVICE_NSS_GROUP_RESPONSE_GID, uint32, gr_gid, )               \
+  F(SRVD_SERVICE_NSS_GROUP_RESPONSE_MEMBERS, string_array, gr_mem, )
+
+SRVD_NSS_DECODER_DEFINE(_srvd_nss_group_decode_fields, struct group, _SRVD_NSS_GROUP_SCHEMA)
+
+static enum nss_status _srvd_nss_group_decode(const srvd_service_serial_response_t *response,
+                                              struct group *gr, srvd_nss_buffer_t *bi,
+                                              int *ret_errno) {
+  enum nss_status status;
+
+  /* Servers are not required to send the PASSWD or MEMBERS fields. */
+  gr->gr_passwd = NULL;
+  gr->gr_mem = NULL;
+
+  status = _srvd_nss_group_decode_fields(response, gr, bi, ret_errno);
+  if(status != NSS_STATUS_SUCCESS)
+    return status;
+
+  /* Callers expect gr_passwd and gr_mem to be valid even if they're empty. */
+  if(gr->gr_passwd == NULL)
+    gr->gr_passwd = srvd_nss_buffer_string(bi, NULL, 0);
+
+  if(gr->gr_mem == NULL) {
+    gr->gr_mem = (char **)(void *)srvd_nss_buffer_reserve(bi, sizeof(char *), sizeof(char *));
+    if(gr->gr_mem)
+      gr->gr_mem[0] = NULL;
+  }
+
+  if(srvd_nss_buffer_full(bi)) {
+    SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE,
+                  _srvd_nss_group_decode_error);
+  }
+
+ _srvd_nss_group_decode_error:
+
+  return status;
+}
+
+enum nss_status
+_nss_srvd_getgrnam_r(const char *name, struct group *gr,
+                     char *buffer, size_t bufsize, int *ret_errno) {
+  enum nss_status status;
+  srvd_service_request_t request;
+  srvd_service_serial_response_t response;
+  srvd_nss_buffer_t bi;
+  size_t required;
+
+  /* Don't bother the server about names it has told us it doesn't have. */
+  if(!srvd_filter_default_has(SRVD_SERVICE_NSS_GROUP_REQUEST_NAME, name, strlen(name)))
+    return NSS_STATUS_NOTFOUND;
+
+  srvd_service_request_initialize(&request);
+  srvd_protocol_packet_field_append(&request.packet, SRVD_SERVICE_NSS_GROUP_REQUEST_NAME,
+                                    (uint16_t)(strlen(name) + 1), name);
+  srvd_nss_request_extension_set(&request, SRVD_PROTOCOL_EXTENSION_PRIORITY_INTERACTIVE);
+
+  srvd_nss_buffer_initialize(&bi, buffer, bufsize);
+  srvd_service_serial_response_initialize(&response);
+  srvd_nss_cache_query(&request, &response, &required);
+
+  if(response.status == SRVD_SERVICE_RESPONSE_NOTFOUND) {
+    SRVD_NSS_NORECORD(status, _nss_srvd_getgrnam_r_error);
+  }
+  else if(response.status == SRVD_SERVICE_RESPONSE_UNAVAIL) {
+    SRVD_NSS_UNAVAIL(status, _nss_srvd_getgrnam_r_error);
+  }
+  else if(response.status != SRVD_SERVICE_RESPONSE_SUCCESS) {
+    SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,
+                  _nss_srvd_getgrnam_r_error);
+  }
+
+  /* We already know it won't fit. */
+  if(bufsize < required) {
+    bi.used = required;
+    SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE, _nss_srvd_getgrnam_r_error);
+  }
+
+  status = _srvd_nss_group_decode(&response, gr, &bi, ret_errno);
+
+ _nss_srvd_getgrnam_r_error:
+
+  if(status == NSS_STATUS_TRYAGAIN && *ret_errno == ERANGE)
+    srvd_nss_cache_keep(&request, &response, bi.used);
+
+  srvd_service_request_finalize(&request);
+  srvd_service_serial_response_finalize(&response);
+
+  return status;
+}
+
+enum nss_status
+_nss_srvd_getgrgid_r(gid_t gid, struct group *gr,
+                     char *buffer, size_t bufsize, int *ret_errno) {
+  enum nss_status status;
+  srvd_service_request_t request;
+  srvd_service_serial_response_t response;
+  srvd_nss_buffer_t bi;
+  size_t required;
+
+  if(!srvd_filter_default_has_uint32(SRVD_SERVICE_NSS_GROUP_REQUEST_GID, gid))
+    return NSS_STATUS_NOTFOUND;
+
+  srvd_service_request_initialize(&request);
+  srvd_protocol_packet_field_append_uint32(&request.packet, SRVD_SERVICE_NSS_GROUP_REQUEST_GID,
+                                           gid);
+  srvd_nss_request_extension_set(&request, SRVD_PROTOCOL_EXTENSION_PRIORITY_INTERACTIVE);
+
+  srvd_nss_buffer_initialize(&bi, buffer, bufsize);
+  srvd_service_serial_response_initialize(&response);
+  srvd_nss_cache_query(&request, &response, &required);
+
+  if(response.status == SRVD_SERVICE_RESPONSE_NOTFOUND) {
+    SRVD_NSS_NORECORD(status, _nss_srvd_getgrgid_r_error);
+  }
+  else if(response.status == SRVD_SERVICE_RESPONSE_UNAVAIL) {
+    SRVD_NSS_UNAVAIL(status, _nss_srvd_getgrgid_r_error);
+  }
+  else if(response.status != SRVD_SERVICE_RESPONSE_SUCCESS) {
+    SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,
+                  _nss_srvd_getgrgid_r_error);
+  }
+
+  /* We already know it won't fit. */
+  if(bufsize < required) {
+    bi.used = required;
+    SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE, _nss_srvd_getgrgid_r_error);
+  }
+
+  status = _srvd_nss_group_decode(&response, gr, &bi, ret_errno);
+
+ _nss_srvd_getgrgid_r_error:
+
+  if(status == NSS_STATUS_TRYAGAIN && *ret_errno == ERANGE)
+    srvd_nss_cache_keep(&request, &response, bi.used);
+
+  srvd_service_request_finalize(&request);
+  srvd_service_serial_response_finalize(&response);
+
+  return status;
+}
+
+static SRVD_THREAD_ONCE_DECLARE(_srvd_nss_group_grent_initialize);
+static SRVD_THREAD_KEY_DECLARE(_srvd_nss_group_grent_offset);
+
+static void _srvd_nss_group_grent_initialize_callback(void) {
+  SRVD_THREAD_KEY_INITIALIZE(_srvd_nss_group_grent_offset);
+}
+
+static srvd_boolean_t _srvd_nss_group_grent_initialize_offset(void) {
+  uint32_t *offset = malloc(sizeof(uint32_t));
+  if(offset == NULL) {
+    SRVD_LOG_ERROR("Unable to allocate memory for offset variable");
+    return SRVD_FALSE;
+  }
+
+  (*offset) = 0;
+  SRVD_THREAD_KEY_DATA_SET(_srvd_nss_group_grent_offset, offset);
+
+  return SRVD_TRUE;
+}
+
+enum nss_status
+_nss_srvd_setgrent(int stayopen) {
+  uint32_t *offset;
+
+  SRVD_UNUSED(stayopen);
+
+  SRVD_THREAD_ONCE_CALL(_srvd_nss_group_grent_initialize,
+                        _srvd_nss_group_grent_initialize_callback);
+  if(!SRVD_THREAD_KEY_DATA_HAS(_srvd_nss_group_grent_offset)) {
+    if(!_srvd_nss_group_grent_initialize_offset())
+      return NSS_STATUS_UNAVAIL;
+  }
+
+  offset = (uint32_t *)SRVD_THREAD_KEY_DATA_GET(_srvd_nss_group_grent_offset);
+  *offset = 0;
+
+  return NSS_STATUS_SUCCESS;
+}
+
+enum nss_status
+_nss_srvd_endgrent(void) {
+  SRVD_THREAD_ONCE_CALL(_srvd_nss_group_grent_initialize,
+                        _srvd_nss_group_grent_initialize_callback);
+  if(SRVD_THREAD_KEY_DATA_HAS(_srvd_nss_group_grent_offset)) {
+    uint32_t *offset = (uint32_t *)SRVD_THREAD_KEY_DATA_GET(_srvd_nss_group_grent_offset);
+    SRVD_THREAD_KEY_DATA_SET(_srvd_nss_group_grent_offset, NULL);
+    free(offset);
+  }
+
+  return NSS_STATUS_SUCCESS;
+}
+
+enum nss_status
+_nss_srvd_getgrent_r(struct group *gr, char *buffer,
+                     size_t bufsize, int *ret_errno) {
+  enum nss_status status;
+  uint32_t *offset;
+
+  srvd_service_request_t request;
+  srvd_service_serial_response_t response;
+  srvd_nss_buffer_t bi;
+  size_t required;
+
+  SRVD_THREAD_ONCE_CALL(_srvd_nss_group_grent_initialize,
+                        _srvd_nss_group_grent_initialize_callback);
+  if(!SRVD_THREAD_KEY_DATA_HAS(_srvd_nss_group_grent_offset)) {
+    if(!_srvd_nss_group_grent_initialize_offset())
+      return NSS_STATUS_UNAVAIL;
+  }
+
+  offset = (uint32_t *)SRVD_THREAD_KEY_DATA_GET(_srvd_nss_group_grent_offset);
+
+  srvd_service_request_initialize(&request);
+  srvd_protocol_packet_field_append_uint32(&request.packet,
+                                           SRVD_SERVICE_NSS_GROUP_REQUEST_ENTITIES, *offset);
+  srvd_nss_request_extension_set(&request, SRVD_PROTOCOL_EXTENSION_PRIORITY_BULK);
+
+  srvd_nss_buffer_initialize(&bi, buffer, bufsize);
+  srvd_service_serial_response_initialize(&response);
+  srvd_nss_cache_query(&request, &response, &required);
+
+  if(response.status == SRVD_SERVICE_RESPONSE_NOTFOUND) {
+    SRVD_NSS_NORECORD(status, _nss_srvd_getgrent_r_error);
+  }
+  else if(response.status == SRVD_SERVICE_RESPONSE_UNAVAIL) {
+    SRVD_NSS_UNAVAIL(status, _nss_srvd_getgrent_r_error);
+  }
+  else if(response.status != SRVD_SERVICE_RESPONSE_SUCCESS) {
+    SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,
+                  _nss_srvd_getgrent_r_error);
+  }
+
+  /* We already know it won't fit. */
+  if(bufsize < required) {
+    bi.used = required;
+    SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE, _nss_srvd_getgrent_r_error);
+  }
+
+  status = _srvd_nss_group_decode(&response, gr, &bi, ret_errno);
+
+  /* The C library asks again with a bigger buffer when it gets ERANGE, so
+   * only move on once we've handed the entry over. */
+  if(status == NSS_STATUS_SUCCESS)
+    (*offset)++;
+
+ _nss_srvd_getgrent_r_error:
+
+  if(status == NSS_STATUS_TRYAGAIN && *ret_errno == ERANGE)
+    srvd_nss_cache_keep(&request, &response, bi.used);
+
+  srvd_service_request_finalize(&request);
+  srvd_service_serial_response_finalize(&response);
+
+  return status;
+}
+
+/* The whole point of this function is to avoid having the C library enumerate
+ * every group to find the ones a user belongs to; the server answers with the
+ * complete list in one response. */
+enum nss_status
+_nss_srvd_initgroups_dyn(const char *user, gid_t group, long int *start, long int *size,
+                         gid_t **groupsp, long int limit, int *ret_errno) {
+  enum nss_status status = NSS_STATUS_SUCCESS;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry;
+
+  srvd_service_request_t request;
+  srvd_service_response_t response;
+
+  srvd_service_request_initialize(&request);
+  srvd_protocol_packet_field_append(&request.packet, SRVD_SERVICE_NSS_GROUP_REQUEST_INITGROUPS,
+                                    (uint16_t)(strlen(user) + 1), user);
+  srvd_nss_request_extension_set(&request, SRVD_PROTOCOL_EXTENSION_PRIORITY_INTERACTIVE);
+
+  srvd_service_response_initialize(&response);
+  srvd_service_request_query(&request, &response);
+
+  if(response.status == SRVD_SERVICE_RESPONSE_NOTFOUND) {
+    SRVD_NSS_NORECORD(status, _nss_srvd_initgroups_dyn_error);
+  }
+  else if(response.status == SRVD_SERVICE_RESPONSE_UNAVAIL) {
+    SRVD_NSS_UNAVAIL(status, _nss_srvd_initgroups_dyn_error);
+  }
+  else if(response.status != SRVD_SERVICE_RESPONSE_SUCCESS) {
+    SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,
+                  _nss_srvd_initgroups_dyn_error);
+  }
+
+  /* A user in no supplementary groups is still a successful answer. */
+  if(!srvd_protocol_packet_field_get_by_type(&response.packet, SRVD_SERVICE_NSS_GROUP_RESPONSE_GIDS,
+                                             &field))
+    goto _nss_srvd_initgroups_dyn_error;
+
+  SRVD_PROTOCOL_PACKET_FIELD_ENTRY_ITERATE(field, entry) {
+    uint32_t gid;
+    long int i;
+
+    if(!srvd_protocol_packet_field_entry_get_uint32(entry, &gid)) {
+      SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,
+                    _nss_srvd_initgroups_dyn_error);
+    }
+
+    /* The primary group is already accounted for by the caller. */
+    if((gid_t)gid == group)
+      continue;
+
+    for(i = 0; i < *start; i++) {
+      if((*groupsp)[i] == (gid_t)gid)
+        break;
+    }
+    if(i < *start)
+      continue;
+
+    if(*start == *size) {
+      long int new_size;
+      gid_t *groups;
+
+      if(limit > 0 && *size >= limit)
+        break;
+
+      new_size = *size * 2;
+      if(new_size < 8)
+        new_size = 8;
+      if(limit > 0 && new_size > limit)
+        new_size = limit;
+
+      groups = realloc(*groupsp, (size_t)new_size * sizeof(gid_t));
+      if(groups == NULL) {
+        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ENOMEM,
+                      _nss_srvd_initgroups_dyn_error);
+      }
+
+      *groupsp = groups;
+      *size = new_size;
+    }
+
+    (*groupsp)[(*start)++] = (gid_t)gid;
+  }
+
+ _nss_srvd_initgroups_dyn_error:
+
+  srvd_service_request_finalize(&request);
+  srvd_service_response_finalize(&response);
+
+  return status;
+}
@@ -0,0 +1,26 @@
+/* group.h: Name switch service for groups.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef __SRVD_NSS_GROUP_H
+#define __SRVD_NSS_GROUP_H
+
+#include "nss.h"
+#include <srvd/srvd.h>
+
+#include <grp.h>
+
+enum nss_status _nss_srvd_getgrnam_r(const char *, struct group *, char *, size_t, int *);
+enum nss_status _nss_srvd_getgrgid_r(gid_t, struct group *, char *, size_t, int *);
+enum nss_status _nss_srvd_setgrent(int);
+enum nss_status _nss_srvd_endgrent(void);
+enum nss_status _nss_srvd_getgrent_r(struct group *, char *, size_t, int *);
+enum nss_status _nss_srvd_initgroups_dyn(const char *, gid_t, long int *, long int *, gid_t **,
+                                         long int, int *);
+
+#endif
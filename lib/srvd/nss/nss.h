@@ -13,6 +13,13 @@
 /* In build/include. */
 #include "config.h"
 
+#include <srvd/srvd.h>
+#include <srvd/buffer.h>
+#include <srvd/conf.h>
+#include <srvd/protocol/extension.h>
+#include <srvd/protocol/serial_packet.h>
+#include <srvd/service.h>
+
 #include <nss.h>
 
 #define SRVD_NSS_FAIL(status_variable, errno_variable, status, errnov, jump) \
@@ -34,4 +41,230 @@
     goto jump;                                  \
   } while(0)
 
+/* Lookups by key have someone waiting on them; enumerations can wait their
+ * turn (see <srvd/protocol/extension.h>). Once the client has given up
+ * (client:timeout), nobody is waiting for the answer anymore, so that's the
+ * deadline. The cache ignores the extension, so the deadline moving on every
+ * retry doesn't keep a cached response from being found. */
+static inline
+void srvd_nss_request_extension_set(srvd_service_request_t *request, uint8_t priority) {
+  srvd_protocol_extension_t extension;
+  srvd_conf_file_t *fconf = NULL;
+  long timeout;
+
+  srvd_protocol_extension_initialize(&extension);
+  extension.priority = priority;
+  if(srvd_conf_file_default_get(&fconf) &&
+     srvd_conf_item_get_integer(&fconf->conf, "client:timeout", &timeout) &&
+     timeout > 0 && (unsigned long)timeout <= UINT32_MAX)
+    srvd_protocol_extension_deadline_set(&extension, (uint32_t)timeout);
+
+  srvd_protocol_extension_pack(&extension, &request->packet);
+}
+
+/* Responses are decoded straight from the serialized body into the buffer the
+ * C library gives us. The buffer keeps count of how much room everything takes
+ * even once it runs out, so when it's too small, used says exactly how big it
+ * would have had to be (give or take the padding needed to align pointer
+ * arrays in a differently aligned buffer). */
+typedef struct srvd_nss_buffer srvd_nss_buffer_t;
+
+struct srvd_nss_buffer {
+  char *buffer;
+  size_t size, used;
+};
+
+static inline void srvd_nss_buffer_initialize(srvd_nss_buffer_t *bi, char *buffer, size_t size) {
+  bi->buffer = buffer;
+  bi->size = size;
+  bi->used = 0;
+}
+
+static inline srvd_boolean_t srvd_nss_buffer_full(const srvd_nss_buffer_t *bi) {
+  return bi->used > bi->size;
+}
+
+/* Returns room for the given number of bytes, aligned as given (which must be
+ * a power of two), or NULL if there isn't any left. */
+static inline char *srvd_nss_buffer_reserve(srvd_nss_buffer_t *bi, size_t size, size_t alignment) {
+  char *p = NULL;
+
+  bi->used += SRVD_BUFFER_ALIGNMENT_PADDING((uintptr_t)bi->buffer + bi->used, alignment);
+  if(bi->used <= bi->size && size <= bi->size - bi->used)
+    p = bi->buffer + bi->used;
+  bi->used += size;
+
+  return p;
+}
+
+/* Copies a string entry, which should include its terminator; it gets one
+ * either way. */
+static inline char *srvd_nss_buffer_string(srvd_nss_buffer_t *bi, const char *data, uint32_t size) {
+  char *p = srvd_nss_buffer_reserve(bi, size ? size : 1, 1);
+
+  if(p) {
+    if(size)
+      memcpy(p, data, size - 1);
+    p[size ? size - 1 : 0] = '\0';
+  }
+
+  return p;
+}
+
+/* Copies the next entry of the current field into the buffer as a string.
+ * The string is only set if there was room for it. */
+static inline srvd_boolean_t srvd_nss_reader_get_string(srvd_protocol_serial_packet_reader_t *reader,
+                                                        srvd_nss_buffer_t *bi, char **string) {
+  const char *data;
+  uint32_t size;
+  char *p;
+
+  if(!srvd_protocol_serial_packet_reader_entry_next(reader, &data, &size))
+    return SRVD_FALSE;
+
+  p = srvd_nss_buffer_string(bi, data, size);
+  if(p)
+    *string = p;
+
+  return SRVD_TRUE;
+}
+
+/* Copies every entry of the current field into the buffer as strings, with an
+ * array of pointers to them, NULL-terminated if asked. The array is only set
+ * if there was room for it. */
+static inline srvd_boolean_t srvd_nss_reader_get_strings(srvd_protocol_serial_packet_reader_t *reader,
+                                                         srvd_nss_buffer_t *bi, uint32_t count,
+                                                         srvd_boolean_t terminated, char ***strings) {
+  size_t size = ((size_t)count + (terminated ? 1 : 0)) * sizeof(char *);
+  char **array = (char **)(void *)srvd_nss_buffer_reserve(bi, size, sizeof(char *));
+  uint32_t i;
+
+  if(array) {
+    memset(array, 0, size);
+    *strings = array;
+  }
+
+  for(i = 0; i < count; i++) {
+    char *string = NULL;
+
+    if(!srvd_nss_reader_get_string(reader, bi, &string))
+      return SRVD_FALSE;
+    if(array)
+      array[i] = string;
+  }
+
+  return SRVD_TRUE;
+}
+
+/* Reads the next entry of the current field as an integer. */
+static inline srvd_boolean_t srvd_nss_reader_get_uint32(srvd_protocol_serial_packet_reader_t *reader,
+                                                        uint32_t *value) {
+  const char *data;
+  uint32_t size, v;
+
+  if(!srvd_protocol_serial_packet_reader_entry_next(reader, &data, &size) || size != sizeof(uint32_t))
+    return SRVD_FALSE;
+
+  memcpy(&v, data, sizeof(uint32_t));
+  *value = ntohl(v);
+
+  return SRVD_TRUE;
+}
+
+static inline srvd_boolean_t srvd_nss_reader_get_uint8(srvd_protocol_serial_packet_reader_t *reader,
+                                                       uint8_t *value) {
+  const char *data;
+  uint32_t size;
+
+  if(!srvd_protocol_serial_packet_reader_entry_next(reader, &data, &size) || size != sizeof(uint8_t))
+    return SRVD_FALSE;
+
+  *value = (uint8_t)data[0];
+
+  return SRVD_TRUE;
+}
+
+/* Decoders.
+ *
+ * Each database lists the fields of its responses that end up in the
+ * structure the C library wants, as F(type, kind, member, count), and
+ * SRVD_NSS_DECODER_DEFINE() makes a function out of them that decodes a
+ * response straight into the structure and buffer:
+ *
+ *   static enum nss_status function(const srvd_service_serial_response_t *,
+ *                                   object_type *, srvd_nss_buffer_t *, int *);
+ *
+ * The kinds are string, uint32 and uint8, which copy the first entry of the
+ * field into the member; string_vector, which copies all of them into an
+ * array of strings and their number into the count member; and string_array,
+ * the same but NULL-terminated and without a count. If the buffer is too
+ * small, the function keeps going anyway, so that bi->used ends up as the
+ * size it needed to be. */
+
+#define SRVD_NSS_DECODE_string(reader, bi, object, member, count, entry_count) \
+  srvd_nss_reader_get_string((reader), (bi), &(object)->member)
+
+#define SRVD_NSS_DECODE_uint32(reader, bi, object, member, count, entry_count) \
+  (srvd_nss_reader_get_uint32((reader), &value) ? ((object)->member = value, SRVD_TRUE) : SRVD_FALSE)
+
+#define SRVD_NSS_DECODE_uint8(reader, bi, object, member, count, entry_count) \
+  (srvd_nss_reader_get_uint8((reader), &byte) ? ((object)->member = byte, SRVD_TRUE) : SRVD_FALSE)
+
+#define SRVD_NSS_DECODE_string_vector(reader, bi, object, member, count, entry_count) \
+  ((object)->count = (entry_count),                                     \
+   srvd_nss_reader_get_strings((reader), (bi), (entry_count), SRVD_FALSE, &(object)->member))
+
+#define SRVD_NSS_DECODE_string_array(reader, bi, object, member, count, entry_count) \
+  srvd_nss_reader_get_strings((reader), (bi), (entry_count), SRVD_TRUE, &(object)->member)
+
+#define SRVD_NSS_DECODER_CASE(type, kind, member, count)                \
+  case (type):                                                          \
+    decoded = SRVD_NSS_DECODE_##kind(&reader, bi, object, member, count, entry_count); \
+    break;
+
+#define SRVD_NSS_DECODER_DEFINE(function, object_type, schema)          \
+  static enum nss_status function(const srvd_service_serial_response_t *response, \
+                                  object_type *object, srvd_nss_buffer_t *bi, \
+                                  int *ret_errno) {                     \
+    enum nss_status status = NSS_STATUS_SUCCESS;                        \
+    srvd_protocol_serial_packet_reader_t reader;                        \
+    srvd_protocol_type_t type;                                          \
+    uint32_t entry_count, value = 0;                                    \
+    uint8_t byte = 0;                                                   \
+    srvd_boolean_t decoded = SRVD_TRUE;                                 \
+                                                                        \
+    SRVD_UNUSED(value);                                                 \
+    SRVD_UNUSED(byte);                                                  \
+                                                                        \
+    if(!srvd_service_serial_response_reader_initialize(response, &reader)) { \
+      SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,     \
+                    function##_error);                                  \
+    }                                                                   \
+                                                                        \
+    while(decoded && srvd_protocol_serial_packet_reader_field_next(&reader, &type, &entry_count)) { \
+      switch(type) {                                                    \
+        schema(SRVD_NSS_DECODER_CASE)                                   \
+      default:                                                          \
+        break;                                                          \
+      }                                                                 \
+    }                                                                   \
+                                                                        \
+    if(!decoded || reader.error) {                                      \
+      SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,     \
+                    function##_finalize);                               \
+    }                                                                   \
+    else if(srvd_nss_buffer_full(bi)) {                                 \
+      SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE,     \
+                    function##_finalize);                               \
+    }                                                                   \
+                                                                        \
+  function##_finalize:                                                  \
+                                                                        \
+    srvd_protocol_serial_packet_reader_finalize(&reader);               \
+                                                                        \
+  function##_error:                                                     \
+                                                                        \
+    return status;                                                      \
+  }
+
 #endif
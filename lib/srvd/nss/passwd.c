@@ -8,139 +8,55 @@
  */
 
 #include "passwd.h"
+#include "cache.h"
 
 #include <srvd/srvd.h>
-#include <srvd/buffer.h>
+#include <srvd/filter.h>
+#include <srvd/protocol/extension.h>
 #include <srvd/protocol/packet.h>
+#include <srvd/protocol/serial_packet.h>
 #include <srvd/service.h>
 #include <srvd/service/nss/passwd.h>
 #include <srvd/thread.h>
 
-static enum nss_status _srvd_nss_passwd_populate(const srvd_service_response_t *response,
-                                                 struct passwd *pwd, char *buffer, size_t bufsize, int *ret_errno) {
-  enum nss_status status = NSS_STATUS_SUCCESS;
-  srvd_protocol_packet_field_t *field;
-  SRVD_BUFFER(bi, buffer);
-
-  SRVD_SERVICE_RESPONSE_FIELD_ITERATE(response, field) {
-    srvd_protocol_packet_field_entry_t *entry = NULL;
-
-    switch(field->type) {
-    case SRVD_SERVICE_NSS_PASSWD_RESPONSE_NAME:
-      if(!srvd_protocol_packet_field_entry_get_first(field, &entry)) {
-        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,
-                      _srvd_nss_passwd_populate_error);
-      }
-
-      if(!SRVD_BUFFER_CHECK_OFFSET(bi, buffer, bufsize, entry->size)) {
-        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE,
-                      _srvd_nss_passwd_populate_error);
-      }
-
-      strncpy(SRVD_BUFFER_REF(bi), entry->data, entry->size);
-      SRVD_BUFFER_REF(bi)[entry->size - 1] = '\0';
-      pwd->pw_name = SRVD_BUFFER_REF(bi);
-
-      SRVD_BUFFER_ITERATOR_NEXT(bi, entry->size);
-      break;
-
-    case SRVD_SERVICE_NSS_PASSWD_RESPONSE_UID:
-      if(!srvd_protocol_packet_field_entry_get_first(field, &entry)) {
-        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,
-                      _srvd_nss_passwd_populate_error);
-      }
-
-      srvd_protocol_packet_field_entry_get_uint32(entry, &pwd->pw_uid);
-      break;
-
-    case SRVD_SERVICE_NSS_PASSWD_RESPONSE_GID:
-      if(!srvd_protocol_packet_field_entry_get_first(field, &entry)) {
-        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,
-                      _srvd_nss_passwd_populate_error);
-      }
-
-      srvd_protocol_packet_field_entry_get_uint32(entry, &pwd->pw_gid);
-      break;
-
-    case SRVD_SERVICE_NSS_PASSWD_RESPONSE_DIR:
-      if(!srvd_protocol_packet_field_entry_get_first(field, &entry)) {
-        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,
-                      _srvd_nss_passwd_populate_error);
-      }
-
-      if(!SRVD_BUFFER_CHECK_OFFSET(bi, buffer, bufsize, entry->size)) {
-        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE,
-                      _srvd_nss_passwd_populate_error);
-      }
-
-      strncpy(SRVD_BUFFER_REF(bi), entry->data, entry->size);
-      SRVD_BUFFER_REF(bi)[entry->size - 1] = '\0';
-      pwd->pw_dir = SRVD_BUFFER_REF(bi);
-
-      SRVD_BUFFER_ITERATOR_NEXT(bi, entry->size);
-      break;
-
-    case SRVD_SERVICE_NSS_PASSWD_RESPONSE_SHELL:
-      if(!srvd_protocol_packet_field_entry_get_first(field, &entry)) {
-        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,
-                      _srvd_nss_passwd_populate_error);
-      }
-
-      if(!SRVD_BUFFER_CHECK_OFFSET(bi, buffer, bufsize, entry->size)) {
-        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE,
-                      _srvd_nss_passwd_populate_error);
-      }
-
-      strncpy(SRVD_BUFFER_REF(bi), entry->data, entry->size);
-      SRVD_BUFFER_REF(bi)[entry->size - 1] = '\0';
-      pwd->pw_shell = SRVD_BUFFER_REF(bi);
-
-      SRVD_BUFFER_ITERATOR_NEXT(bi, entry->size);
-      break;
-
 #ifdef HAVE_PASSWD_GECOS
-    case SRVD_SERVICE_NSS_PASSWD_RESPONSE_GECOS:
-      if(!srvd_protocol_packet_field_entry_get_first(field, &entry)) {
-        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, EINVAL,
-                      _srvd_nss_passwd_populate_error);
-      }
-
-      if(!SRVD_BUFFER_CHECK_OFFSET(bi, buffer, bufsize, entry->size)) {
-        SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE,
-                      _srvd_nss_passwd_populate_error);
-      }
-
-      strncpy(SRVD_BUFFER_REF(bi), entry->data, entry->size);
-      SRVD_BUFFER_REF(bi)[entry->size - 1] = '\0';
-      pwd->pw_gecos = SRVD_BUFFER_REF(bi);
-
-      SRVD_BUFFER_ITERATOR_NEXT(bi, entry->size);
-      break;
+# define _SRVD_NSS_PASSWD_SCHEMA_GECOS(F)                        \
+  F(SRVD_SERVICE_NSS_PASSWD_RESPONSE_GECOS, string, pw_gecos, )
+#else
+# define _SRVD_NSS_PASSWD_SCHEMA_GECOS(F)
 #endif
 
-    default:
-      break;
-    }
-  }
-
- _srvd_nss_passwd_populate_error:
+#define _SRVD_NSS_PASSWD_SCHEMA(F)                               \
+  F(SRVD_SERVICE_NSS_PASSWD_RESPONSE_NAME, string, pw_name, )    \
+  F(SRVD_SERVICE_NSS_PASSWD_RESPONSE_UID, uint32, pw_uid, )      \
+  F(SRVD_SERVICE_NSS_PASSWD_RESPONSE_GID, uint32, pw_gid, )      \
+  F(SRVD_SERVICE_NSS_PASSWD_RESPONSE_DIR, string, pw_dir, )      \
+  F(SRVD_SERVICE_NSS_PASSWD_RESPONSE_SHELL, string, pw_shell, )  \
+  _SRVD_NSS_PASSWD_SCHEMA_GECOS(F)
 
-  return status;
-}
+SRVD_NSS_DECODER_DEFINE(_srvd_nss_passwd_decode, struct passwd, _SRVD_NSS_PASSWD_SCHEMA)
 
 enum nss_status
 _nss_srvd_getpwnam_r(const char *name, struct passwd *pwd,
                      char *buffer, size_t bufsize, int *ret_errno) {
   enum nss_status status;
   srvd_service_request_t request;
-  srvd_service_response_t response;
+  srvd_service_serial_response_t response;
+  srvd_nss_buffer_t bi;
+  size_t required;
+
+  /* Don't bother the server about names it has told us it doesn't have. */
+  if(!srvd_filter_default_has(SRVD_SERVICE_NSS_PASSWD_REQUEST_NAME, name, strlen(name)))
+    return NSS_STATUS_NOTFOUND;
 
   srvd_service_request_initialize(&request);
   srvd_protocol_packet_field_append(&request.packet, SRVD_SERVICE_NSS_PASSWD_REQUEST_NAME,
                                     (uint16_t)(sysconf(_SC_LOGIN_NAME_MAX) + 1), name);
+  srvd_nss_request_extension_set(&request, SRVD_PROTOCOL_EXTENSION_PRIORITY_INTERACTIVE);
 
-  srvd_service_response_initialize(&response);
-  srvd_service_request_query(&request, &response);
+  srvd_nss_buffer_initialize(&bi, buffer, bufsize);
+  srvd_service_serial_response_initialize(&response);
+  srvd_nss_cache_query(&request, &response, &required);
 
   if(response.status == SRVD_SERVICE_RESPONSE_NOTFOUND) {
     SRVD_NSS_NORECORD(status, _nss_srvd_getpwnam_r_error);
@@ -153,12 +69,21 @@ _nss_srvd_getpwnam_r(const char *name, struct passwd *pwd,
                   _nss_srvd_getpwnam_r_error);
   }
 
-  status = _srvd_nss_passwd_populate(&response, pwd, buffer, bufsize, ret_errno);
+  /* We already know it won't fit. */
+  if(bufsize < required) {
+    bi.used = required;
+    SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE, _nss_srvd_getpwnam_r_error);
+  }
+
+  status = _srvd_nss_passwd_decode(&response, pwd, &bi, ret_errno);
 
  _nss_srvd_getpwnam_r_error:
 
+  if(status == NSS_STATUS_TRYAGAIN && *ret_errno == ERANGE)
+    srvd_nss_cache_keep(&request, &response, bi.used);
+
   srvd_service_request_finalize(&request);
-  srvd_service_response_finalize(&response);
+  srvd_service_serial_response_finalize(&response);
 
   return status;
 }
@@ -168,14 +93,21 @@ _nss_srvd_getpwuid_r(uid_t uid, struct passwd *pwd,
                        char *buffer, size_t bufsize, int *ret_errno) {
   enum nss_status status;
   srvd_service_request_t request;
-  srvd_service_response_t response;
+  srvd_service_serial_response_t response;
+  srvd_nss_buffer_t bi;
+  size_t required;
+
+  if(!srvd_filter_default_has_uint32(SRVD_SERVICE_NSS_PASSWD_REQUEST_UID, uid))
+    return NSS_STATUS_NOTFOUND;
 
   srvd_service_request_initialize(&request);
   srvd_protocol_packet_field_append_uint32(&request.packet, SRVD_SERVICE_NSS_PASSWD_REQUEST_UID,
                                            uid);
+  srvd_nss_request_extension_set(&request, SRVD_PROTOCOL_EXTENSION_PRIORITY_INTERACTIVE);
 
-  srvd_service_response_initialize(&response);
-  srvd_service_request_query(&request, &response);
+  srvd_nss_buffer_initialize(&bi, buffer, bufsize);
+  srvd_service_serial_response_initialize(&response);
+  srvd_nss_cache_query(&request, &response, &required);
 
   if(response.status == SRVD_SERVICE_RESPONSE_NOTFOUND) {
     SRVD_NSS_NORECORD(status, _nss_srvd_getpwuid_r_error);
@@ -188,12 +120,21 @@ _nss_srvd_getpwuid_r(uid_t uid, struct passwd *pwd,
                   _nss_srvd_getpwuid_r_error);
   }
 
-  status = _srvd_nss_passwd_populate(&response, pwd, buffer, bufsize, ret_errno);
+  /* We already know it won't fit. */
+  if(bufsize < required) {
+    bi.used = required;
+    SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE, _nss_srvd_getpwuid_r_error);
+  }
+
+  status = _srvd_nss_passwd_decode(&response, pwd, &bi, ret_errno);
 
  _nss_srvd_getpwuid_r_error:
 
+  if(status == NSS_STATUS_TRYAGAIN && *ret_errno == ERANGE)
+    srvd_nss_cache_keep(&request, &response, bi.used);
+
   srvd_service_request_finalize(&request);
-  srvd_service_response_finalize(&response);
+  srvd_service_serial_response_finalize(&response);
 
   return status;
 }
@@ -257,7 +198,9 @@ _nss_srvd_getpwent_r(struct passwd *pwd, char *buffer,
   uint32_t *offset;
 
   srvd_service_request_t request;
-  srvd_service_response_t response;
+  srvd_service_serial_response_t response;
+  srvd_nss_buffer_t bi;
+  size_t required;
 
   SRVD_THREAD_ONCE_CALL(_srvd_nss_passwd_pwent_initialize,
                         _srvd_nss_passwd_pwent_initialize_callback);
@@ -271,9 +214,11 @@ _nss_srvd_getpwent_r(struct passwd *pwd, char *buffer,
   srvd_service_request_initialize(&request);
   srvd_protocol_packet_field_append_uint32(&request.packet,
                                            SRVD_SERVICE_NSS_PASSWD_REQUEST_ENTITIES, *offset);
+  srvd_nss_request_extension_set(&request, SRVD_PROTOCOL_EXTENSION_PRIORITY_BULK);
 
-  srvd_service_response_initialize(&response);
-  srvd_service_request_query(&request, &response);
+  srvd_nss_buffer_initialize(&bi, buffer, bufsize);
+  srvd_service_serial_response_initialize(&response);
+  srvd_nss_cache_query(&request, &response, &required);
 
   if(response.status == SRVD_SERVICE_RESPONSE_NOTFOUND) {
     SRVD_NSS_NORECORD(status, _nss_srvd_getpwent_r_error);
@@ -286,13 +231,26 @@ _nss_srvd_getpwent_r(struct passwd *pwd, char *buffer,
                   _nss_srvd_getpwent_r_error);
   }
 
-  status = _srvd_nss_passwd_populate(&response, pwd, buffer, bufsize, ret_errno);
-  (*offset)++;
+  /* We already know it won't fit. */
+  if(bufsize < required) {
+    bi.used = required;
+    SRVD_NSS_FAIL(status, ret_errno, NSS_STATUS_TRYAGAIN, ERANGE, _nss_srvd_getpwent_r_error);
+  }
+
+  status = _srvd_nss_passwd_decode(&response, pwd, &bi, ret_errno);
+
+  /* The C library asks again with a bigger buffer when it gets ERANGE, so
+   * only move on once we've handed the entry over. */
+  if(status == NSS_STATUS_SUCCESS)
+    (*offset)++;
 
  _nss_srvd_getpwent_r_error:
 
+  if(status == NSS_STATUS_TRYAGAIN && *ret_errno == ERANGE)
+    srvd_nss_cache_keep(&request, &response, bi.used);
+
   srvd_service_request_finalize(&request);
-  srvd_service_response_finalize(&response);
+  srvd_service_serial_response_finalize(&response);
 
   return status;
 }
@@ -0,0 +1,97 @@
+/* test-adapter.c: Tests the client adapter registry.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include <srvd/srvd.h>
+#include <srvd/conf.h>
+#include <srvd/client.h>
+#include <srvd/client/unsock.h>
+
+#include <string.h>
+#include <stdio.h>
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+static int test_adapter_initialized = 0;
+
+static srvd_boolean_t test_adapter_initialize(srvd_client_t *client, const srvd_conf_t *conf) {
+  test_adapter_initialized++;
+  return srvd_client_unsock_initialize_by_conf(client, conf);
+}
+
+static srvd_client_adapter_t test_adapter = {
+  "test", srvd_client_unsock_allocate, test_adapter_initialize, 0, NULL
+};
+
+int test_adapter_registry(void) {
+  int errors = 0;
+  const srvd_client_adapter_t *adapter = NULL;
+  unsigned long generation;
+  srvd_client_t *client = NULL;
+  srvd_conf_t conf;
+
+  TEST_HEADER(test_adapter_registry);
+
+  CHECK(errors, srvd_client_adapter_get("unsock", &adapter));
+  CHECK(errors, adapter && (adapter->capabilities & SRVD_CLIENT_ADAPTER_PIPELINING));
+  CHECK(errors, !srvd_client_adapter_get("test", &adapter));
+  CHECK(errors, srvd_client_adapter_register(&test_adapter));
+
+  CHECK(errors, srvd_conf_initialize(&conf));
+  CHECK(errors, srvd_conf_item_add(&conf, "client:adapter", sizeof("client:adapter"), "test",
+                                   sizeof("test")));
+  CHECK(errors, srvd_conf_item_add(&conf, "client:path", sizeof("client:path"),
+                                   "test-adapter.sock", sizeof("test-adapter.sock")));
+
+  CHECK(errors, srvd_client_adapter_get_by_conf(&conf, &adapter));
+  CHECK(errors, adapter == &test_adapter);
+  CHECK(errors, srvd_client_get_by_conf(&client, &conf));
+  CHECK(errors, test_adapter_initialized == 1);
+  srvd_client_finalize(client);
+  srvd_client_free(client);
+
+  /* Changing the configuration changes its generation, so the adapter is
+   * looked up again. */
+  generation = conf.generation;
+  CHECK(errors, srvd_conf_clear(&conf));
+  CHECK(errors, conf.generation != generation);
+  CHECK(errors, srvd_conf_item_add(&conf, "client:adapter", sizeof("client:adapter"), "none",
+                                   sizeof("none")));
+  CHECK(errors, !srvd_client_adapter_get_by_conf(&conf, &adapter));
+
+  srvd_conf_finalize(&conf);
+
+  TEST_FOOTER(test_adapter_registry);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_adapter_registry();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+/* test-async.c: Tests asynchronous clients.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+#include <srvd/server/unsock.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "test-server.h"
+
+#define TEST_PATH "test-async.sock"
+#define TEST_TYPE ((srvd_protocol_type_t)1001)
+#define TEST_COUNT 64
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+static void test_callback(srvd_client_async_request_t *request, void *argument) {
+  SRVD_UNUSED(request);
+  (*(int *)argument)++;
+}
+
+static void test_callback_free(srvd_client_async_request_t *request, void *argument) {
+  (*(int *)argument)++;
+  srvd_client_async_request_free(request);
+}
+
+static uint32_t test_key_get(srvd_client_async_request_t *request) {
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  uint32_t key = UINT32_MAX;
+
+  if(srvd_protocol_packet_field_get_by_type(&request->response, TEST_TYPE, &field) &&
+     srvd_protocol_packet_field_entry_get_first(field, &entry))
+    srvd_protocol_packet_field_entry_get_uint32(entry, &key);
+
+  return key;
+}
+
+int test_async(void) {
+  int errors = 0, completed = 0;
+  uint32_t i;
+
+  TEST_HEADER(test_async);
+
+  srvd_server_unsock_conf_t server_conf = { TEST_PATH, 16, SRVD_FALSE };
+  srvd_server_unsock_t server;
+  pthread_t thread;
+
+  unlink(TEST_PATH);
+  CHECK(errors, srvd_server_unsock_initialize(&server, &server_conf));
+  srvd_server_service_add(&server.monitor, TEST_TYPE, test_server_echo);
+  CHECK(errors, test_server_unsock_start(&server, &thread));
+
+  srvd_conf_t conf;
+  srvd_conf_initialize(&conf);
+  srvd_conf_item_add(&conf, "client:adapter", sizeof("client:adapter"), "unsock", sizeof("unsock"));
+  srvd_conf_item_add(&conf, "client:path", sizeof("client:path"), TEST_PATH, sizeof(TEST_PATH));
+
+  srvd_client_async_t async;
+  CHECK(errors, srvd_client_async_initialize(&async, &conf));
+  CHECK(errors, srvd_client_async_descriptor(&async) >= 0);
+
+  /* Keep all of them outstanding at once. */
+  srvd_client_async_request_t *requests[TEST_COUNT];
+  for(i = 0; i < TEST_COUNT; i++) {
+    srvd_protocol_packet_t packet;
+    srvd_protocol_packet_initialize(&packet);
+    srvd_protocol_packet_field_append_uint32(&packet, TEST_TYPE, i);
+
+    requests[i] = NULL;
+    if(!srvd_client_async_submit(&async, &packet, test_callback, &completed, &requests[i]))
+      errors++;
+
+    srvd_protocol_packet_finalize(&packet);
+  }
+  CHECK(errors, async.pending_count == TEST_COUNT);
+
+  /* Waiting for the last one completes everything before it, in order. */
+  CHECK(errors, srvd_client_async_wait(&async, requests[TEST_COUNT - 1]));
+  CHECK(errors, completed == TEST_COUNT);
+  CHECK(errors, async.pending_count == 0);
+
+  for(i = 0; i < TEST_COUNT; i++) {
+    if(test_key_get(requests[i]) != i)
+      break;
+  }
+  CHECK(errors, i == TEST_COUNT);
+
+  for(i = 0; i < TEST_COUNT; i++)
+    srvd_client_async_request_free(requests[i]);
+
+  /* Nothing outstanding means nothing to process. */
+  CHECK(errors, !srvd_client_async_process(&async));
+
+  /* A callback can free the request we're waiting on. */
+  srvd_client_async_request_t *request = NULL;
+  srvd_protocol_packet_t packet;
+  srvd_protocol_packet_initialize(&packet);
+  srvd_protocol_packet_field_append_uint32(&packet, TEST_TYPE, TEST_COUNT);
+
+  completed = 0;
+  CHECK(errors, srvd_client_async_submit(&async, &packet, test_callback_free, &completed,
+                                         &request));
+  CHECK(errors, srvd_client_async_wait(&async, request));
+  CHECK(errors, completed == 1);
+
+  /* After a failed submit, the next reader fails whatever is outstanding. */
+  request = NULL;
+  completed = 0;
+  CHECK(errors, srvd_client_async_submit(&async, &packet, test_callback, &completed, &request));
+  async.broken = SRVD_TRUE;
+  CHECK(errors, !srvd_client_async_wait(&async, request));
+  CHECK(errors, completed == 1);
+  CHECK(errors, request->complete && !request->succeeded);
+  CHECK(errors, async.pending_count == 0);
+  srvd_client_async_request_free(request);
+
+  request = NULL;
+  CHECK(errors, !srvd_client_async_submit(&async, &packet, test_callback, &completed, &request));
+  CHECK(errors, request == NULL);
+  srvd_protocol_packet_finalize(&packet);
+
+  CHECK(errors, srvd_client_async_finalize(&async));
+  srvd_conf_finalize(&conf);
+  unlink(TEST_PATH);
+
+  TEST_FOOTER(test_async);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_async();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,273 @@
+/* test-batch.c: Tests batch dispatching.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/conf.h>
+#include <srvd/server.h>
+#include <srvd/server/unsock.h>
+#include <srvd/service.h>
+#include <srvd/protocol/serial_packet.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "test-server.h"
+
+#define TEST_TYPE ((srvd_protocol_type_t)1001)
+
+#define TEST_PATH "test-batch.sock"
+#define TEST_CONF_PATH "test-batch.conf"
+
+/* Two entries of this size fit in a version 110 packet, but not in a version
+ * 110 entry. */
+#define TEST_LARGE_SIZE 40000
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+/* Finds even keys and echoes them back. */
+static void test_handler(const srvd_service_request_t *request, srvd_service_response_t *response) {
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  uint32_t key;
+
+  srvd_protocol_packet_field_get_first(&request->packet, &field);
+  srvd_protocol_packet_field_entry_get_first(field, &entry);
+  srvd_protocol_packet_field_entry_get_uint32(entry, &key);
+
+  if(key % 2 == 0) {
+    srvd_protocol_packet_field_append_uint32(&response->packet, TEST_TYPE, key);
+    response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+  }
+  else
+    response->status = SRVD_SERVICE_RESPONSE_NOTFOUND;
+}
+
+/* Like test_handler(), but odd keys get a response too big for a batch. */
+static void test_large_handler(const srvd_service_request_t *request,
+                               srvd_service_response_t *response) {
+  static char large[TEST_LARGE_SIZE];
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  uint32_t key;
+
+  srvd_protocol_packet_field_get_first(&request->packet, &field);
+  srvd_protocol_packet_field_entry_get_first(field, &entry);
+  srvd_protocol_packet_field_entry_get_uint32(entry, &key);
+
+  srvd_protocol_packet_field_append_uint32(&response->packet, TEST_TYPE, key);
+  if(key % 2 == 1) {
+    memset(large, 'l', TEST_LARGE_SIZE);
+    field = NULL;
+    srvd_protocol_packet_field_get_or_add(&response->packet, TEST_TYPE + 1, &field);
+    srvd_protocol_packet_field_entry_add(field, TEST_LARGE_SIZE, large);
+    srvd_protocol_packet_field_entry_add(field, TEST_LARGE_SIZE, large);
+  }
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+}
+
+static uint16_t test_status_get(srvd_protocol_packet_field_entry_t *entry) {
+  srvd_protocol_serial_packet_t serial;
+  srvd_protocol_packet_t packet;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *status = NULL;
+  uint16_t code = SRVD_SERVICE_RESPONSE_UNKNOWN;
+
+  srvd_protocol_serial_packet_initialize(&serial);
+  srvd_protocol_packet_initialize(&packet);
+  if(srvd_protocol_serial_packet_unserialize_header(&serial, &packet, entry->data) &&
+     srvd_protocol_serial_packet_unserialize_body(&serial, &packet, (char *)entry->data +
+                                                  SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE) &&
+     srvd_protocol_packet_field_get_first(&packet, &field) &&
+     srvd_protocol_packet_field_entry_get_first(field, &status))
+    srvd_protocol_packet_field_entry_get_uint16(status, &code);
+  srvd_protocol_packet_finalize(&packet);
+  srvd_protocol_serial_packet_finalize(&serial);
+
+  return code;
+}
+
+int test_batch(void) {
+  int errors = 0;
+  uint32_t i;
+
+  TEST_HEADER(test_batch);
+
+  srvd_server_t server;
+  srvd_server_initialize(&server);
+  srvd_server_service_add(&server, TEST_TYPE, test_handler);
+
+  srvd_service_batch_t batch;
+  CHECK(errors, srvd_service_batch_initialize(&batch, TEST_TYPE));
+  for(i = 0; i < 4; i++)
+    CHECK(errors, srvd_service_batch_key_add_uint32(&batch, i));
+  CHECK(errors, batch.keys->entry_count == 4);
+
+  srvd_service_response_t response;
+  srvd_service_response_initialize(&response);
+  CHECK(errors, srvd_server_dispatch(&server, &batch.request, &response));
+
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  uint16_t status = SRVD_SERVICE_RESPONSE_UNKNOWN;
+  CHECK(errors, srvd_protocol_packet_field_get_first(&response.packet, &field));
+  CHECK(errors, field->type == SRVD_PROTOCOL_STATUS);
+  srvd_protocol_packet_field_entry_get_first(field, &entry);
+  srvd_protocol_packet_field_entry_get_uint16(entry, &status);
+  CHECK(errors, status == SRVD_SERVICE_RESPONSE_SUCCESS);
+
+  /* One response per key, in order. */
+  field = NULL;
+  CHECK(errors, srvd_protocol_packet_field_get_by_type(&response.packet, SRVD_PROTOCOL_BATCH, &field));
+  CHECK(errors, field->entry_count == 4);
+  SRVD_PROTOCOL_PACKET_FIELD_ENTRY_ITERATE_COUNT(field, entry, i) {
+    CHECK(errors, test_status_get(entry) == (i % 2 == 0
+                                             ? SRVD_SERVICE_RESPONSE_SUCCESS
+                                             : SRVD_SERVICE_RESPONSE_NOTFOUND));
+  }
+  srvd_service_response_finalize(&response);
+
+  /* Keys of a type nobody handles are individually unavailable. */
+  srvd_service_batch_finalize(&batch);
+  srvd_service_batch_initialize(&batch, TEST_TYPE + 1);
+  srvd_service_batch_key_add_uint32(&batch, 0);
+
+  srvd_service_response_initialize(&response);
+  CHECK(errors, srvd_server_dispatch(&server, &batch.request, &response));
+  field = NULL;
+  entry = NULL;
+  CHECK(errors, srvd_protocol_packet_field_get_by_type(&response.packet, SRVD_PROTOCOL_BATCH, &field));
+  srvd_protocol_packet_field_entry_get_first(field, &entry);
+  CHECK(errors, test_status_get(entry) == SRVD_SERVICE_RESPONSE_UNAVAIL);
+  srvd_service_response_finalize(&response);
+
+  srvd_service_batch_finalize(&batch);
+  srvd_server_finalize(&server);
+
+  TEST_FOOTER(test_batch);
+
+  return errors;
+}
+
+int test_batch_large(void) {
+  int errors = 0;
+  uint32_t i, key;
+  FILE *conf;
+
+  TEST_HEADER(test_batch_large);
+
+  srvd_server_unsock_conf_t server_conf = { TEST_PATH, 16, SRVD_FALSE };
+  srvd_server_unsock_t server;
+  pthread_t thread;
+
+  unlink(TEST_PATH);
+  CHECK(errors, srvd_server_unsock_initialize(&server, &server_conf));
+  srvd_server_service_add(&server.monitor, TEST_TYPE, test_large_handler);
+
+  srvd_service_batch_t batch;
+  CHECK(errors, srvd_service_batch_initialize(&batch, TEST_TYPE));
+  for(i = 0; i < 4; i++)
+    CHECK(errors, srvd_service_batch_key_add_uint32(&batch, i));
+
+  /* A response that doesn't fit in a version 110 entry is left empty... */
+  srvd_service_response_t response;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  srvd_service_response_initialize(&response);
+  CHECK(errors, srvd_server_dispatch_version(&server.monitor, &batch.request, &response,
+                                             SRVD_PROTOCOL_SERIAL_PACKET_VERSION));
+  CHECK(errors, srvd_protocol_packet_field_get_by_type(&response.packet, SRVD_PROTOCOL_BATCH, &field));
+  CHECK(errors, field->entry_count == 4);
+  SRVD_PROTOCOL_PACKET_FIELD_ENTRY_ITERATE_COUNT(field, entry, i) {
+    if(i % 2 == 1)
+      CHECK(errors, entry->size == 0);
+    else
+      CHECK(errors, test_status_get(entry) == SRVD_SERVICE_RESPONSE_SUCCESS);
+  }
+  srvd_service_response_finalize(&response);
+
+  /* ...but fits in a version 120 one. */
+  srvd_service_response_initialize(&response);
+  CHECK(errors, srvd_server_dispatch_version(&server.monitor, &batch.request, &response,
+                                             SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT));
+  field = NULL;
+  CHECK(errors, srvd_protocol_packet_field_get_by_type(&response.packet, SRVD_PROTOCOL_BATCH, &field));
+  SRVD_PROTOCOL_PACKET_FIELD_ENTRY_ITERATE(field, entry)
+    CHECK(errors, test_status_get(entry) == SRVD_SERVICE_RESPONSE_SUCCESS);
+  srvd_service_response_finalize(&response);
+
+  /* Through a server, the client asks for the empty ones on their own. */
+  CHECK(errors, test_server_unsock_start(&server, &thread));
+
+  conf = fopen(TEST_CONF_PATH, "w");
+  CHECK(errors, conf != NULL);
+  fprintf(conf, "client:adapter = \"unsock\"\nclient:path = \"" TEST_PATH "\"\n");
+  fclose(conf);
+  CHECK(errors, srvd_conf_file_default_set(TEST_CONF_PATH));
+
+  CHECK(errors, srvd_service_batch_query(&batch));
+  CHECK(errors, batch.status == SRVD_SERVICE_RESPONSE_SUCCESS);
+  CHECK(errors, batch.response_count == 4);
+
+  for(i = 0; i < batch.response_count; i++) {
+    const srvd_service_response_t *single = NULL;
+
+    field = NULL;
+    entry = NULL;
+    key = UINT32_MAX;
+    CHECK(errors, srvd_service_batch_response_get(&batch, (uint16_t)i, &single));
+    CHECK(errors, single->status == SRVD_SERVICE_RESPONSE_SUCCESS);
+    CHECK(errors, srvd_protocol_packet_field_get_by_type(&single->packet, TEST_TYPE, &field) &&
+          srvd_protocol_packet_field_entry_get_first(field, &entry) &&
+          srvd_protocol_packet_field_entry_get_uint32(entry, &key) && key == i);
+
+    field = NULL;
+    if(i % 2 == 1)
+      CHECK(errors, srvd_protocol_packet_field_get_by_type(&single->packet, TEST_TYPE + 1, &field) &&
+            field->entry_count == 2 && field->entry_head->size == TEST_LARGE_SIZE);
+  }
+
+  srvd_service_batch_finalize(&batch);
+
+  unlink(TEST_CONF_PATH);
+  unlink(TEST_PATH);
+
+  TEST_FOOTER(test_batch_large);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_batch();
+  errors += test_batch_large();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
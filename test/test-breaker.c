@@ -0,0 +1,91 @@
+/* test-breaker.c: Tests client circuit breakers.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+int test_breaker(void) {
+  int errors = 0;
+  struct timespec delay = { 0, 60000000 };
+
+  TEST_HEADER(test_breaker);
+
+  srvd_client_breaker_t breaker;
+  CHECK(errors, srvd_client_breaker_initialize(&breaker, 3, 50));
+
+  /* Closed: failures below the threshold don't stop anything. */
+  CHECK(errors, srvd_client_breaker_allow(&breaker));
+  srvd_client_breaker_report(&breaker, SRVD_FALSE);
+  srvd_client_breaker_report(&breaker, SRVD_FALSE);
+  CHECK(errors, srvd_client_breaker_allow(&breaker));
+
+  /* A success resets the count. */
+  srvd_client_breaker_report(&breaker, SRVD_TRUE);
+  srvd_client_breaker_report(&breaker, SRVD_FALSE);
+  srvd_client_breaker_report(&breaker, SRVD_FALSE);
+  CHECK(errors, srvd_client_breaker_allow(&breaker));
+
+  /* Open. */
+  srvd_client_breaker_report(&breaker, SRVD_FALSE);
+  CHECK(errors, !srvd_client_breaker_allow(&breaker));
+
+  /* Half-open: exactly one probe gets through; it fails, so we're open
+   * again. */
+  nanosleep(&delay, NULL);
+  CHECK(errors, srvd_client_breaker_allow(&breaker));
+  CHECK(errors, !srvd_client_breaker_allow(&breaker));
+  srvd_client_breaker_report(&breaker, SRVD_FALSE);
+  CHECK(errors, !srvd_client_breaker_allow(&breaker));
+
+  /* This time the probe succeeds, and the breaker closes. */
+  nanosleep(&delay, NULL);
+  CHECK(errors, srvd_client_breaker_allow(&breaker));
+  srvd_client_breaker_report(&breaker, SRVD_TRUE);
+  CHECK(errors, srvd_client_breaker_allow(&breaker));
+  CHECK(errors, srvd_client_breaker_allow(&breaker));
+
+  srvd_client_breaker_finalize(&breaker);
+
+  TEST_FOOTER(test_breaker);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_breaker();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
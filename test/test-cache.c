@@ -0,0 +1,187 @@
+/* test-cache.c: Tests the NSS module's cache of responses that didn't fit.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/conf.h>
+#include <srvd/protocol/extension.h>
+#include <srvd/server/unsock.h>
+#include <srvd/service/nss/passwd.h>
+
+#include <errno.h>
+#include <nss.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "test-server.h"
+
+#define TEST_PATH "test-cache.sock"
+#define TEST_CONF_PATH "test-cache.conf"
+
+/* Big enough that the entry never fits in a small buffer. */
+#define TEST_GECOS_SIZE 3000
+
+#define TEST_BUFFER_SMALL 64
+#define TEST_BUFFER_LARGE 8192
+
+/* Longer than the cache keeps anything. */
+#define TEST_EXPIRY 3
+
+/* Lookups get a deadline this far out. */
+#define TEST_TIMEOUT 2000
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+enum nss_status _nss_srvd_getpwnam_r(const char *, struct passwd *, char *, size_t, int *);
+
+static int test_calls = 0;
+static uint64_t test_deadline = 0;
+
+static void test_handler(const srvd_service_request_t *request, srvd_service_response_t *response) {
+  char *name = NULL;
+  char gecos[TEST_GECOS_SIZE];
+  srvd_protocol_extension_t extension;
+
+  test_calls++;
+  if(srvd_protocol_extension_unpack(&request->packet, &extension))
+    test_deadline = extension.deadline;
+
+  if(!srvd_service_nss_passwd_request_name_get(request, &name)) {
+    response->status = SRVD_SERVICE_RESPONSE_FAIL;
+    return;
+  }
+
+  memset(gecos, 'g', TEST_GECOS_SIZE - 1);
+  gecos[TEST_GECOS_SIZE - 1] = '\0';
+
+  srvd_service_nss_passwd_response_name_set(response, name, strlen(name) + 1);
+  srvd_service_nss_passwd_response_uid_set(response, 1000);
+  srvd_service_nss_passwd_response_gid_set(response, 1000);
+  srvd_service_nss_passwd_response_dir_set(response, "/home", sizeof("/home"));
+  srvd_service_nss_passwd_response_shell_set(response, "/bin/sh", sizeof("/bin/sh"));
+  srvd_service_nss_passwd_response_gecos_set(response, gecos, TEST_GECOS_SIZE);
+  srvd_service_nss_passwd_request_name_free(request, &name);
+
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+}
+
+static enum nss_status test_lookup(const char *name, size_t size, struct passwd *pwd,
+                                   int *error) {
+  static char buffer[TEST_BUFFER_LARGE];
+
+  *error = 0;
+  return _nss_srvd_getpwnam_r(name, pwd, buffer, size, error);
+}
+
+int test_cache(void) {
+  int errors = 0, error;
+  enum nss_status status;
+  struct passwd pwd;
+  FILE *conf;
+
+  TEST_HEADER(test_cache);
+
+  srvd_server_unsock_conf_t server_conf = { TEST_PATH, 16, SRVD_FALSE };
+  srvd_server_unsock_t server;
+  pthread_t thread;
+
+  unlink(TEST_PATH);
+  CHECK(errors, srvd_server_unsock_initialize(&server, &server_conf));
+  srvd_server_service_add(&server.monitor, SRVD_SERVICE_NSS_PASSWD_REQUEST_NAME, test_handler);
+  CHECK(errors, test_server_unsock_start(&server, &thread));
+
+  conf = fopen(TEST_CONF_PATH, "w");
+  CHECK(errors, conf != NULL);
+  fprintf(conf, "client:adapter = \"unsock\"\nclient:path = \"" TEST_PATH "\"\n"
+          "client:timeout = %d\n", TEST_TIMEOUT);
+  fclose(conf);
+  CHECK(errors, srvd_conf_file_default_set(TEST_CONF_PATH));
+
+  CHECK(errors, test_lookup("warmup", TEST_BUFFER_LARGE, &pwd, &error) == NSS_STATUS_SUCCESS);
+
+  /* A response that doesn't fit is kept... */
+  test_calls = 0;
+  status = test_lookup("alice", TEST_BUFFER_SMALL, &pwd, &error);
+  CHECK(errors, status == NSS_STATUS_TRYAGAIN && error == ERANGE);
+  CHECK(errors, test_calls == 1);
+
+  /* (Lookups give up when the client would.) */
+  CHECK(errors, test_deadline > srvd_protocol_extension_now() &&
+        test_deadline <= srvd_protocol_extension_now() + TEST_TIMEOUT);
+
+  /* ...and a retry that still isn't big enough is turned away without even
+   * trying to decode it... */
+  status = test_lookup("alice", TEST_BUFFER_SMALL * 2, &pwd, &error);
+  CHECK(errors, status == NSS_STATUS_TRYAGAIN && error == ERANGE);
+  CHECK(errors, test_calls == 1);
+
+  /* ...until one is. */
+  status = test_lookup("alice", TEST_BUFFER_LARGE, &pwd, &error);
+  CHECK(errors, status == NSS_STATUS_SUCCESS);
+  CHECK(errors, strcmp(pwd.pw_name, "alice") == 0);
+  CHECK(errors, strlen(pwd.pw_gecos) == TEST_GECOS_SIZE - 1);
+  CHECK(errors, test_calls == 1);
+
+  /* The response was handed over, so asking again goes to the server. */
+  status = test_lookup("alice", TEST_BUFFER_LARGE, &pwd, &error);
+  CHECK(errors, status == NSS_STATUS_SUCCESS);
+  CHECK(errors, test_calls == 2);
+
+  /* Somebody else's response is never handed out. */
+  status = test_lookup("alice", TEST_BUFFER_SMALL, &pwd, &error);
+  CHECK(errors, status == NSS_STATUS_TRYAGAIN && error == ERANGE);
+  status = test_lookup("bob", TEST_BUFFER_LARGE, &pwd, &error);
+  CHECK(errors, status == NSS_STATUS_SUCCESS);
+  CHECK(errors, strcmp(pwd.pw_name, "bob") == 0);
+  CHECK(errors, test_calls == 4);
+
+  /* Nothing is kept for long. */
+  status = test_lookup("carol", TEST_BUFFER_SMALL, &pwd, &error);
+  CHECK(errors, status == NSS_STATUS_TRYAGAIN && error == ERANGE);
+  CHECK(errors, test_calls == 5);
+  sleep(TEST_EXPIRY);
+  status = test_lookup("carol", TEST_BUFFER_LARGE, &pwd, &error);
+  CHECK(errors, status == NSS_STATUS_SUCCESS);
+  CHECK(errors, test_calls == 6);
+
+  unlink(TEST_CONF_PATH);
+  unlink(TEST_PATH);
+
+  TEST_FOOTER(test_cache);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_cache();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,130 @@
+/* test-capture.c: Tests request capture logs.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/capture.h>
+#include <srvd/server.h>
+
+#include <string.h>
+#include <stdio.h>
+
+#define TEST_PATH "test-capture.capture"
+#define TEST_TYPE ((srvd_protocol_type_t)1001)
+#define TEST_COUNT 100
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+static void test_handler(const srvd_service_request_t *request, srvd_service_response_t *response) {
+  SRVD_UNUSED(request);
+
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+}
+
+/* Sends requests through the server's dispatcher, as a transport would. */
+static srvd_boolean_t test_dispatch(srvd_server_t *server, uint32_t key) {
+  srvd_boolean_t status;
+  srvd_service_request_t request;
+  srvd_service_response_t response;
+
+  srvd_service_request_initialize(&request);
+  srvd_service_response_initialize(&response);
+  srvd_protocol_packet_field_append_uint32(&request.packet, TEST_TYPE, key);
+
+  status = srvd_server_dispatch(server, &request, &response);
+
+  srvd_service_request_finalize(&request);
+  srvd_service_response_finalize(&response);
+
+  return status;
+}
+
+int test_capture(void) {
+  int errors = 0;
+  srvd_server_t server;
+  srvd_capture_reader_t reader;
+  uint64_t received, previous = 0;
+  uint32_t i, length, key;
+  char *request;
+  FILE *file;
+
+  TEST_HEADER(test_capture);
+
+  CHECK(errors, srvd_server_initialize(&server));
+  srvd_server_service_add(&server, TEST_TYPE, test_handler);
+  CHECK(errors, srvd_server_capture(&server, TEST_PATH));
+
+  for(i = 0; i < TEST_COUNT; i++) {
+    if(!test_dispatch(&server, i))
+      break;
+  }
+  CHECK(errors, i == TEST_COUNT);
+  CHECK(errors, srvd_server_capture(&server, NULL));
+
+  /* A record that was only partly written is left out. */
+  file = fopen(TEST_PATH, "a");
+  fwrite("\0\0\0\0\0\0\0\1\0\0\0\x20\0", 1, 13, file);
+  fclose(file);
+
+  CHECK(errors, srvd_capture_reader_initialize(&reader, TEST_PATH));
+
+  for(i = 0; srvd_capture_reader_next(&reader, &received, &request, &length); i++) {
+    srvd_protocol_packet_t packet;
+    srvd_protocol_packet_field_t *field = NULL;
+    srvd_protocol_packet_field_entry_t *entry = NULL;
+
+    srvd_protocol_packet_initialize(&packet);
+    if(!srvd_capture_request_unpack(request, length, &packet) ||
+       !srvd_protocol_packet_field_get_by_type(&packet, TEST_TYPE, &field) ||
+       !srvd_protocol_packet_field_entry_get_first(field, &entry) ||
+       !srvd_protocol_packet_field_entry_get_uint32(entry, &key) ||
+       key != i || received < previous) {
+      srvd_protocol_packet_finalize(&packet);
+      break;
+    }
+    srvd_protocol_packet_finalize(&packet);
+
+    previous = received;
+  }
+  CHECK(errors, i == TEST_COUNT);
+
+  CHECK(errors, srvd_capture_reader_finalize(&reader));
+  CHECK(errors, srvd_server_finalize(&server));
+  unlink(TEST_PATH);
+
+  TEST_FOOTER(test_capture);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_capture();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
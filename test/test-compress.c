@@ -0,0 +1,260 @@
+/* test-compress.c: Tests packet compression.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+#include <srvd/protocol/compress.h>
+#include <srvd/protocol/serial_packet.h>
+#include <srvd/server/unsock.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "test-server.h"
+
+#define TEST_PATH "test-compress.sock"
+#define TEST_TYPE ((srvd_protocol_type_t)1001)
+
+/* More than fits in a SOCK_SEQPACKET message uncompressed. */
+#define TEST_MEMBERS 8000
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+static void test_build(srvd_protocol_packet_t *packet, uint32_t members) {
+  srvd_protocol_packet_field_t *field = NULL;
+  char member[32];
+  uint32_t i;
+
+  srvd_protocol_packet_field_get_or_add(packet, TEST_TYPE, &field);
+  for(i = 0; i < members; i++) {
+    snprintf(member, sizeof(member), "user%05lu@example.com", (unsigned long)i);
+    srvd_protocol_packet_field_entry_add(field, (uint16_t)(strlen(member) + 1), member);
+  }
+}
+
+static void test_handler(const srvd_service_request_t *request, srvd_service_response_t *response) {
+  SRVD_UNUSED(request);
+
+  test_build(&response->packet, TEST_MEMBERS);
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+}
+
+int test_compress_block(void) {
+  int errors = 0;
+  char input[10000], output[sizeof(input) + sizeof(input) / 255 + 16], result[sizeof(input)];
+  size_t size, i;
+  uint32_t seed = 1;
+
+  TEST_HEADER(test_compress_block);
+
+  /* Text that repeats itself. */
+  for(i = 0; i < sizeof(input); i++)
+    input[i] = "the quick brown fox "[i % 20 + (i / 1000) % 3];
+
+  size = srvd_protocol_compress(input, sizeof(input), output, sizeof(output));
+  CHECK(errors, size > 0 && size < sizeof(input) / 10);
+  CHECK(errors, srvd_protocol_decompress(output, size, result, sizeof(result)));
+  CHECK(errors, memcmp(input, result, sizeof(input)) == 0);
+
+  /* The output size has to be exactly right. */
+  CHECK(errors, !srvd_protocol_decompress(output, size, result, sizeof(result) - 1));
+
+  /* Truncated blocks are caught. */
+  for(i = 1; i < size; i++) {
+    if(srvd_protocol_decompress(output, i, result, sizeof(result)))
+      break;
+  }
+  CHECK(errors, i == size);
+
+  /* Noise doesn't compress, but still round-trips within the bound. */
+  for(i = 0; i < sizeof(input); i++) {
+    seed = seed * 1103515245 + 12345;
+    input[i] = (char)(seed >> 16);
+  }
+
+  size = srvd_protocol_compress(input, sizeof(input), output, sizeof(output));
+  CHECK(errors, size > 0 && size <= srvd_protocol_compress_bound(sizeof(input)));
+  CHECK(errors, srvd_protocol_decompress(output, size, result, sizeof(result)));
+  CHECK(errors, memcmp(input, result, sizeof(input)) == 0);
+  CHECK(errors, srvd_protocol_compress(input, sizeof(input), output, sizeof(input) / 2) == 0);
+
+  /* Tiny inputs are all literals. */
+  size = srvd_protocol_compress("abc", 3, output, sizeof(output));
+  CHECK(errors, size == 4 && srvd_protocol_decompress(output, size, result, 3) &&
+        memcmp(result, "abc", 3) == 0);
+
+  /* A back-reference to before the start of the output. */
+  memcpy(output, "\x14" "a" "\x05\x00", 4);
+  CHECK(errors, !srvd_protocol_decompress(output, 4, result, 9));
+
+  TEST_FOOTER(test_compress_block);
+
+  return errors;
+}
+
+int test_compress_packet(void) {
+  int errors = 0;
+  srvd_protocol_serial_packet_t serial, result;
+  srvd_protocol_packet_t packet, unserialized;
+  size_t size;
+
+  TEST_HEADER(test_compress_packet);
+
+  srvd_protocol_packet_initialize(&packet);
+  test_build(&packet, 1000);
+  size = srvd_protocol_serial_packet_size(&packet);
+
+  /* Not unless we're told we can. */
+  srvd_protocol_serial_packet_initialize(&serial);
+  CHECK(errors, srvd_protocol_serial_packet_serialize(&serial, &packet));
+  CHECK(errors, serial.flags == 0 && serial.size == size);
+  srvd_protocol_serial_packet_finalize(&serial);
+
+  srvd_protocol_serial_packet_initialize(&serial);
+  serial.flags = SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE;
+  CHECK(errors, srvd_protocol_serial_packet_serialize(&serial, &packet));
+  CHECK(errors, serial.flags & SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED);
+  CHECK(errors, serial.size < size / 2);
+
+  srvd_protocol_serial_packet_initialize(&result);
+  srvd_protocol_packet_initialize(&unserialized);
+  CHECK(errors, srvd_protocol_serial_packet_unserialize_header(&result, &unserialized,
+                                                               serial.data));
+  CHECK(errors, result.version == SRVD_PROTOCOL_SERIAL_PACKET_VERSION);
+  CHECK(errors, result.flags == (SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED |
+                                 SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE));
+  CHECK(errors, result.size == serial.size);
+  CHECK(errors, srvd_protocol_serial_packet_unserialize_body(&result, &unserialized,
+                                                             serial.data +
+                                                             SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE));
+  CHECK(errors, unserialized.field_count == 1 && unserialized.field_head->entry_count == 1000);
+  CHECK(errors, srvd_protocol_serial_packet_size(&unserialized) == size);
+  srvd_protocol_packet_finalize(&unserialized);
+  srvd_protocol_serial_packet_finalize(&result);
+
+  /* A claimed size bigger than the body could possibly hold is refused before
+   * anything is allocated for it. */
+  *(uint32_t *)(serial.data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE) = htonl(0xffffffff);
+  srvd_protocol_serial_packet_initialize(&result);
+  srvd_protocol_packet_initialize(&unserialized);
+  CHECK(errors, srvd_protocol_serial_packet_unserialize_header(&result, &unserialized,
+                                                               serial.data));
+  CHECK(errors, !srvd_protocol_serial_packet_unserialize_body(&result, &unserialized,
+                                                              serial.data +
+                                                              SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE));
+  srvd_protocol_packet_finalize(&unserialized);
+  srvd_protocol_serial_packet_finalize(&result);
+  srvd_protocol_serial_packet_finalize(&serial);
+  srvd_protocol_packet_finalize(&packet);
+
+  /* Small packets are left alone. */
+  srvd_protocol_packet_initialize(&packet);
+  test_build(&packet, 10);
+  srvd_protocol_serial_packet_initialize(&serial);
+  serial.flags = SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE;
+  CHECK(errors, srvd_protocol_serial_packet_serialize(&serial, &packet));
+  CHECK(errors, !(serial.flags & SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED));
+  CHECK(errors, serial.size == srvd_protocol_serial_packet_size(&packet));
+  srvd_protocol_serial_packet_finalize(&serial);
+  srvd_protocol_packet_finalize(&packet);
+
+  TEST_FOOTER(test_compress_packet);
+
+  return errors;
+}
+
+static srvd_boolean_t test_query(srvd_client_t *client) {
+  srvd_boolean_t status;
+  srvd_protocol_packet_t request, response;
+  srvd_protocol_packet_field_t *field = NULL;
+
+  srvd_protocol_packet_initialize(&request);
+  srvd_protocol_packet_initialize(&response);
+  srvd_protocol_packet_field_append_uint32(&request, TEST_TYPE, 42);
+
+  status = srvd_client_write(client, &request) && srvd_client_read(client, &response) &&
+    srvd_protocol_packet_field_get_by_type(&response, TEST_TYPE, &field) &&
+    field->entry_count == TEST_MEMBERS;
+
+  srvd_protocol_packet_finalize(&request);
+  srvd_protocol_packet_finalize(&response);
+
+  return status;
+}
+
+int test_compress_seqpacket(void) {
+  int errors = 0;
+  srvd_server_unsock_conf_t server_conf = { TEST_PATH, 16, SRVD_TRUE };
+  srvd_server_unsock_t server;
+  pthread_t thread;
+  srvd_client_t *client = NULL;
+  srvd_conf_t conf;
+
+  TEST_HEADER(test_compress_seqpacket);
+
+  unlink(TEST_PATH);
+  CHECK(errors, srvd_server_unsock_initialize(&server, &server_conf));
+  srvd_server_service_add(&server.monitor, TEST_TYPE, test_handler);
+  CHECK(errors, test_server_unsock_start(&server, &thread));
+
+  srvd_conf_initialize(&conf);
+  srvd_conf_item_add(&conf, "client:adapter", sizeof("client:adapter"), "unsock", sizeof("unsock"));
+  srvd_conf_item_add(&conf, "client:path", sizeof("client:path"), TEST_PATH, sizeof(TEST_PATH));
+  srvd_conf_item_add(&conf, "client:socket", sizeof("client:socket"), "seqpacket",
+                     sizeof("seqpacket"));
+  srvd_conf_item_add(&conf, "client:persistent", sizeof("client:persistent"), "yes",
+                     sizeof("yes"));
+  CHECK(errors, srvd_client_get_by_conf(&client, &conf));
+
+  CHECK(errors, srvd_client_connect(client));
+
+  /* The response is too big for one message, until it's compressed. */
+  CHECK(errors, client->hello.features & SRVD_PROTOCOL_HELLO_COMPRESSION);
+  CHECK(errors, srvd_client_version(client) & SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE);
+  CHECK(errors, test_query(client));
+
+  CHECK(errors, srvd_client_finalize(client));
+  srvd_client_free(client);
+  srvd_conf_finalize(&conf);
+  unlink(TEST_PATH);
+
+  TEST_FOOTER(test_compress_seqpacket);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_compress_block();
+  errors += test_compress_packet();
+  errors += test_compress_seqpacket();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,286 @@
+/* test-extension.c: Tests request deadlines and priorities.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+#include <srvd/protocol/extension.h>
+#include <srvd/server/unsock.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "test-server.h"
+
+#define TEST_PATH "test-extension.sock"
+#define TEST_TYPE ((srvd_protocol_type_t)1001)
+
+/* The key the handler takes its time over. */
+#define TEST_KEY_SLOW 1
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+/* The keys the handler has seen, in order. */
+static uint32_t test_handled[8];
+static unsigned int test_handled_count = 0;
+
+static void test_sleep(long milliseconds) {
+  struct timespec delay;
+
+  delay.tv_sec = milliseconds / 1000;
+  delay.tv_nsec = (milliseconds % 1000) * 1000000;
+  nanosleep(&delay, NULL);
+}
+
+static void test_handler(const srvd_service_request_t *request, srvd_service_response_t *response) {
+  srvd_protocol_packet_field_t *field = NULL;
+  uint32_t key = 0;
+
+  if(srvd_protocol_packet_field_get_by_type(&request->packet, TEST_TYPE, &field))
+    srvd_protocol_packet_field_entry_get_uint32(field->entry_head, &key);
+
+  if(test_handled_count < sizeof(test_handled) / sizeof(test_handled[0]))
+    test_handled[test_handled_count++] = key;
+
+  if(key == TEST_KEY_SLOW)
+    test_sleep(200);
+
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+}
+
+static void test_request(srvd_protocol_packet_t *packet, uint32_t key, uint8_t priority) {
+  srvd_protocol_extension_t extension;
+
+  srvd_protocol_packet_initialize(packet);
+  srvd_protocol_packet_field_append_uint32(packet, TEST_TYPE, key);
+
+  srvd_protocol_extension_initialize(&extension);
+  extension.priority = priority;
+  srvd_protocol_extension_pack(&extension, packet);
+}
+
+int test_extension_pack(void) {
+  int errors = 0;
+  srvd_protocol_packet_t packet;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_extension_t extension, result;
+
+  TEST_HEADER(test_extension_pack);
+
+  /* Requests without one get the defaults. */
+  srvd_protocol_packet_initialize(&packet);
+  srvd_protocol_packet_field_append_uint32(&packet, TEST_TYPE, 42);
+  CHECK(errors, srvd_protocol_extension_unpack(&packet, &result));
+  CHECK(errors, result.deadline == 0 &&
+        result.priority == SRVD_PROTOCOL_EXTENSION_PRIORITY_NORMAL && result.flags == 0);
+  CHECK(errors, !srvd_protocol_extension_expired(&result));
+
+  srvd_protocol_extension_initialize(&extension);
+  extension.deadline = ((uint64_t)0x01234567 << 32) | 0x89abcdef;
+  extension.priority = SRVD_PROTOCOL_EXTENSION_PRIORITY_BULK;
+  extension.flags = SRVD_PROTOCOL_EXTENSION_FLAG_STALE_OK;
+  CHECK(errors, srvd_protocol_extension_pack(&extension, &packet));
+  CHECK(errors, packet.field_head->type == TEST_TYPE && packet.field_count == 2);
+  CHECK(errors, srvd_protocol_extension_unpack(&packet, &result));
+  CHECK(errors, result.deadline == extension.deadline && result.priority == extension.priority &&
+        result.flags == extension.flags);
+
+  /* Only one per request. */
+  CHECK(errors, !srvd_protocol_extension_pack(&extension, &packet));
+  srvd_protocol_packet_finalize(&packet);
+
+  /* Classes we don't know about are treated as normal. */
+  srvd_protocol_packet_initialize(&packet);
+  srvd_protocol_packet_field_append_uint32(&packet, TEST_TYPE, 42);
+  extension.priority = 200;
+  srvd_protocol_extension_pack(&extension, &packet);
+  CHECK(errors, srvd_protocol_extension_unpack(&packet, &result));
+  CHECK(errors, result.priority == SRVD_PROTOCOL_EXTENSION_PRIORITY_NORMAL);
+  srvd_protocol_packet_finalize(&packet);
+
+  /* It can't say what the request is. */
+  srvd_protocol_packet_initialize(&packet);
+  CHECK(errors, !srvd_protocol_extension_pack(&extension, &packet));
+  srvd_protocol_packet_field_get_or_add(&packet, SRVD_PROTOCOL_EXTENSION, &field);
+  srvd_protocol_packet_field_entry_add(field, sizeof(uint64_t), "\0\0\0\0\0\0\0\0");
+  srvd_protocol_packet_field_entry_add_uint8(field, 0);
+  srvd_protocol_packet_field_entry_add_uint32(field, 0);
+  CHECK(errors, !srvd_protocol_extension_unpack(&packet, &result));
+  srvd_protocol_packet_finalize(&packet);
+
+  /* Missing entries. */
+  srvd_protocol_packet_initialize(&packet);
+  srvd_protocol_packet_field_append_uint32(&packet, TEST_TYPE, 42);
+  srvd_protocol_packet_field_append_uint8(&packet, SRVD_PROTOCOL_EXTENSION, 0);
+  CHECK(errors, !srvd_protocol_extension_unpack(&packet, &result));
+  srvd_protocol_packet_finalize(&packet);
+
+  TEST_FOOTER(test_extension_pack);
+
+  return errors;
+}
+
+int test_extension_deadline(void) {
+  int errors = 0;
+  srvd_server_t server;
+  srvd_service_request_t request;
+  srvd_service_response_t response;
+  srvd_protocol_extension_t extension;
+
+  TEST_HEADER(test_extension_deadline);
+
+  srvd_server_initialize(&server);
+  srvd_server_service_add(&server, TEST_TYPE, test_handler);
+  test_handled_count = 0;
+
+  srvd_protocol_extension_initialize(&extension);
+  srvd_protocol_extension_deadline_set(&extension, 10000);
+  CHECK(errors, !srvd_protocol_extension_expired(&extension));
+
+  srvd_service_request_initialize(&request);
+  srvd_service_response_initialize(&response);
+  srvd_protocol_packet_field_append_uint32(&request.packet, TEST_TYPE, 2);
+  srvd_protocol_extension_pack(&extension, &request.packet);
+  CHECK(errors, srvd_server_dispatch(&server, &request, &response));
+  CHECK(errors, response.status == SRVD_SERVICE_RESPONSE_SUCCESS && test_handled_count == 1);
+  srvd_service_request_finalize(&request);
+  srvd_service_response_finalize(&response);
+
+  /* The client has given up on this one already. */
+  extension.deadline = srvd_protocol_extension_now() - 1;
+  CHECK(errors, srvd_protocol_extension_expired(&extension));
+
+  srvd_service_request_initialize(&request);
+  srvd_service_response_initialize(&response);
+  srvd_protocol_packet_field_append_uint32(&request.packet, TEST_TYPE, 3);
+  srvd_protocol_extension_pack(&extension, &request.packet);
+  CHECK(errors, srvd_server_dispatch(&server, &request, &response));
+  CHECK(errors, response.status == SRVD_SERVICE_RESPONSE_UNAVAIL && test_handled_count == 1);
+  CHECK(errors, response.packet.field_head->type == SRVD_PROTOCOL_STATUS);
+  srvd_service_request_finalize(&request);
+  srvd_service_response_finalize(&response);
+
+  srvd_server_finalize(&server);
+
+  TEST_FOOTER(test_extension_deadline);
+
+  return errors;
+}
+
+static srvd_boolean_t test_connect(srvd_client_t **client, srvd_conf_t *conf) {
+  *client = NULL;
+
+  return srvd_client_get_by_conf(client, conf) && srvd_client_connect(*client);
+}
+
+int test_extension_priority(void) {
+  int errors = 0;
+  srvd_server_unsock_conf_t server_conf = { TEST_PATH, 16, SRVD_TRUE };
+  srvd_server_unsock_t server;
+  pthread_t thread;
+  srvd_client_t *interactive = NULL, *bulk = NULL, *slow = NULL;
+  srvd_protocol_packet_t request, response;
+  srvd_conf_t conf;
+
+  TEST_HEADER(test_extension_priority);
+
+  unlink(TEST_PATH);
+  CHECK(errors, srvd_server_unsock_initialize(&server, &server_conf));
+  srvd_server_service_add(&server.monitor, TEST_TYPE, test_handler);
+  CHECK(errors, test_server_unsock_start(&server, &thread));
+  test_handled_count = 0;
+
+  srvd_conf_initialize(&conf);
+  srvd_conf_item_add(&conf, "client:adapter", sizeof("client:adapter"), "unsock", sizeof("unsock"));
+  srvd_conf_item_add(&conf, "client:path", sizeof("client:path"), TEST_PATH, sizeof(TEST_PATH));
+  srvd_conf_item_add(&conf, "client:socket", sizeof("client:socket"), "seqpacket",
+                     sizeof("seqpacket"));
+  srvd_conf_item_add(&conf, "client:persistent", sizeof("client:persistent"), "yes",
+                     sizeof("yes"));
+
+  /* The server goes through connections newest first, so the interactive one
+   * has to be older for the order to say anything. */
+  CHECK(errors, test_connect(&interactive, &conf));
+  test_sleep(50);
+  CHECK(errors, test_connect(&bulk, &conf));
+  test_sleep(50);
+  CHECK(errors, test_connect(&slow, &conf));
+  test_sleep(50);
+
+  /* Keep the server busy while both of the others get their requests in. */
+  test_request(&request, TEST_KEY_SLOW, SRVD_PROTOCOL_EXTENSION_PRIORITY_NORMAL);
+  CHECK(errors, srvd_client_write(slow, &request));
+  srvd_protocol_packet_finalize(&request);
+  test_sleep(50);
+
+  test_request(&request, 2, SRVD_PROTOCOL_EXTENSION_PRIORITY_BULK);
+  CHECK(errors, srvd_client_write(bulk, &request));
+  srvd_protocol_packet_finalize(&request);
+
+  test_request(&request, 3, SRVD_PROTOCOL_EXTENSION_PRIORITY_INTERACTIVE);
+  CHECK(errors, srvd_client_write(interactive, &request));
+  srvd_protocol_packet_finalize(&request);
+
+  srvd_protocol_packet_initialize(&response);
+  CHECK(errors, srvd_client_read(slow, &response));
+  srvd_protocol_packet_finalize(&response);
+  srvd_protocol_packet_initialize(&response);
+  CHECK(errors, srvd_client_read(bulk, &response));
+  srvd_protocol_packet_finalize(&response);
+  srvd_protocol_packet_initialize(&response);
+  CHECK(errors, srvd_client_read(interactive, &response));
+  srvd_protocol_packet_finalize(&response);
+
+  CHECK(errors, test_handled_count == 3);
+  CHECK(errors, test_handled[0] == TEST_KEY_SLOW && test_handled[1] == 3 &&
+        test_handled[2] == 2);
+
+  srvd_client_finalize(interactive);
+  srvd_client_free(interactive);
+  srvd_client_finalize(bulk);
+  srvd_client_free(bulk);
+  srvd_client_finalize(slow);
+  srvd_client_free(slow);
+  srvd_conf_finalize(&conf);
+  unlink(TEST_PATH);
+
+  TEST_FOOTER(test_extension_priority);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_extension_pack();
+  errors += test_extension_deadline();
+  errors += test_extension_priority();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
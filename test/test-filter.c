@@ -0,0 +1,88 @@
+/* test-filter.c: Tests the negative lookup filter.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include <srvd/srvd.h>
+#include <srvd/filter.h>
+
+#include <string.h>
+#include <stdio.h>
+
+#define TEST_PATH "test-filter.filter"
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+int test_filter(void) {
+  int errors = 0;
+  uint32_t i, false_positives = 0;
+
+  TEST_HEADER(test_filter);
+
+  srvd_filter_t builder;
+  CHECK(errors, srvd_filter_initialize(&builder, 1000));
+
+  for(i = 0; i < 1000; i++)
+    srvd_filter_add_uint32(&builder, 702, i);
+  CHECK(errors, srvd_filter_add(&builder, 701, "root", 4));
+
+  CHECK(errors, srvd_filter_has(&builder, 701, "root", 4));
+  CHECK(errors, srvd_filter_has_uint32(&builder, 702, 999));
+  CHECK(errors, srvd_filter_publish(&builder, TEST_PATH));
+
+  srvd_filter_t filter;
+  CHECK(errors, srvd_filter_map(&filter, TEST_PATH));
+  CHECK(errors, filter.key_count == 1001);
+  CHECK(errors, srvd_filter_has(&filter, 701, "root", 4));
+
+  /* Every key we added must be present... */
+  for(i = 0; i < 1000; i++) {
+    if(!srvd_filter_has_uint32(&filter, 702, i))
+      break;
+  }
+  CHECK(errors, i == 1000);
+
+  /* ...and keys from other namespaces should almost never be. */
+  for(i = 0; i < 1000; i++) {
+    if(srvd_filter_has_uint32(&filter, 703, i))
+      false_positives++;
+  }
+  CHECK(errors, false_positives < 50);
+
+  srvd_filter_finalize(&filter);
+  srvd_filter_finalize(&builder);
+  unlink(TEST_PATH);
+
+  TEST_FOOTER(test_filter);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_filter();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,304 @@
+/* test-group.c: Tests the NSS module's group lookups.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/conf.h>
+#include <srvd/server/unsock.h>
+#include <srvd/service/nss/group.h>
+
+#include <errno.h>
+#include <grp.h>
+#include <nss.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "test-server.h"
+
+#define TEST_PATH "test-group.sock"
+#define TEST_CONF_PATH "test-group.conf"
+
+#define TEST_GID 50
+#define TEST_GID_EMPTY 60
+
+#define TEST_BUFFER_SMALL 16
+#define TEST_BUFFER_LARGE 1024
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+enum nss_status _nss_srvd_getgrnam_r(const char *, struct group *, char *, size_t, int *);
+enum nss_status _nss_srvd_getgrgid_r(gid_t, struct group *, char *, size_t, int *);
+enum nss_status _nss_srvd_initgroups_dyn(const char *, gid_t, long int *, long int *, gid_t **,
+                                         long int, int *);
+
+static const char *test_members[] = { "alice", "bob", "carol" };
+
+static srvd_service_nss_group_index_t test_index;
+
+/* Knows about two groups: one with members, and one with nothing but a
+ * name. */
+static void test_group_respond(gid_t gid, srvd_service_response_t *response) {
+  size_t i;
+
+  if(gid == TEST_GID) {
+    srvd_service_nss_group_response_name_set(response, "staff", sizeof("staff"));
+    srvd_service_nss_group_response_passwd_set(response, "x", sizeof("x"));
+    srvd_service_nss_group_response_gid_set(response, gid);
+    for(i = 0; i < sizeof(test_members) / sizeof(test_members[0]); i++)
+      srvd_service_nss_group_response_member_add(response, test_members[i],
+                                                 strlen(test_members[i]) + 1);
+    response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+  }
+  else if(gid == TEST_GID_EMPTY) {
+    srvd_service_nss_group_response_name_set(response, "empty", sizeof("empty"));
+    srvd_service_nss_group_response_gid_set(response, gid);
+    response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+  }
+  else
+    response->status = SRVD_SERVICE_RESPONSE_NOTFOUND;
+}
+
+static void test_name_handler(const srvd_service_request_t *request,
+                              srvd_service_response_t *response) {
+  char *name = NULL;
+
+  if(!srvd_service_nss_group_request_name_get(request, &name)) {
+    response->status = SRVD_SERVICE_RESPONSE_FAIL;
+    return;
+  }
+
+  if(strcmp(name, "staff") == 0)
+    test_group_respond(TEST_GID, response);
+  else if(strcmp(name, "empty") == 0)
+    test_group_respond(TEST_GID_EMPTY, response);
+  else
+    response->status = SRVD_SERVICE_RESPONSE_NOTFOUND;
+
+  srvd_service_nss_group_request_name_free(request, &name);
+}
+
+static void test_gid_handler(const srvd_service_request_t *request,
+                             srvd_service_response_t *response) {
+  gid_t gid;
+
+  if(!srvd_service_nss_group_request_gid_get(request, &gid)) {
+    response->status = SRVD_SERVICE_RESPONSE_FAIL;
+    return;
+  }
+
+  test_group_respond(gid, response);
+}
+
+static void test_initgroups_handler(const srvd_service_request_t *request,
+                                    srvd_service_response_t *response) {
+  srvd_service_nss_group_index_respond(&test_index, request, response);
+}
+
+static srvd_boolean_t test_aligned(const void *pointer) {
+  return (uintptr_t)pointer % sizeof(char *) == 0;
+}
+
+static int test_group_lookup(void) {
+  int errors = 0, error;
+  enum nss_status status;
+  struct group gr;
+  /* Start the buffer somewhere the member list can't just be put. */
+  static char storage[TEST_BUFFER_LARGE + 1];
+  char *buffer = storage + 1;
+  size_t i;
+
+  TEST_HEADER(test_group_lookup);
+
+  /* By name... */
+  error = 0;
+  status = _nss_srvd_getgrnam_r("staff", &gr, buffer, TEST_BUFFER_LARGE, &error);
+  CHECK(errors, status == NSS_STATUS_SUCCESS);
+  CHECK(errors, strcmp(gr.gr_name, "staff") == 0);
+  CHECK(errors, strcmp(gr.gr_passwd, "x") == 0);
+  CHECK(errors, gr.gr_gid == TEST_GID);
+  CHECK(errors, test_aligned(gr.gr_mem));
+  for(i = 0; i < sizeof(test_members) / sizeof(test_members[0]); i++)
+    CHECK(errors, gr.gr_mem[i] != NULL && strcmp(gr.gr_mem[i], test_members[i]) == 0);
+  CHECK(errors, gr.gr_mem[i] == NULL);
+
+  /* ...and by ID. */
+  memset(&gr, 0, sizeof(struct group));
+  status = _nss_srvd_getgrgid_r(TEST_GID, &gr, buffer, TEST_BUFFER_LARGE, &error);
+  CHECK(errors, status == NSS_STATUS_SUCCESS);
+  CHECK(errors, strcmp(gr.gr_name, "staff") == 0);
+  CHECK(errors, test_aligned(gr.gr_mem));
+  CHECK(errors, gr.gr_mem[0] != NULL && strcmp(gr.gr_mem[0], "alice") == 0);
+
+  /* A group without a password or members still gets valid (empty) ones. */
+  status = _nss_srvd_getgrgid_r(TEST_GID_EMPTY, &gr, buffer, TEST_BUFFER_LARGE, &error);
+  CHECK(errors, status == NSS_STATUS_SUCCESS);
+  CHECK(errors, strcmp(gr.gr_name, "empty") == 0);
+  CHECK(errors, gr.gr_passwd != NULL && gr.gr_passwd[0] == '\0');
+  CHECK(errors, gr.gr_mem != NULL && test_aligned(gr.gr_mem) && gr.gr_mem[0] == NULL);
+
+  /* A buffer that's too small asks for a bigger one. */
+  error = 0;
+  status = _nss_srvd_getgrnam_r("staff", &gr, buffer, TEST_BUFFER_SMALL, &error);
+  CHECK(errors, status == NSS_STATUS_TRYAGAIN && error == ERANGE);
+  error = 0;
+  status = _nss_srvd_getgrgid_r(TEST_GID, &gr, buffer, TEST_BUFFER_SMALL, &error);
+  CHECK(errors, status == NSS_STATUS_TRYAGAIN && error == ERANGE);
+
+  status = _nss_srvd_getgrnam_r("staff", &gr, buffer, TEST_BUFFER_LARGE, &error);
+  CHECK(errors, status == NSS_STATUS_SUCCESS);
+  CHECK(errors, gr.gr_gid == TEST_GID);
+
+  /* Groups the server doesn't know about aren't found. */
+  status = _nss_srvd_getgrnam_r("nobody", &gr, buffer, TEST_BUFFER_LARGE, &error);
+  CHECK(errors, status == NSS_STATUS_NOTFOUND);
+  status = _nss_srvd_getgrgid_r(TEST_GID + 1, &gr, buffer, TEST_BUFFER_LARGE, &error);
+  CHECK(errors, status == NSS_STATUS_NOTFOUND);
+
+  TEST_FOOTER(test_group_lookup);
+
+  return errors;
+}
+
+static int test_group_initgroups(void) {
+  int errors = 0, error = 0;
+  enum nss_status status;
+  long int start, size;
+  gid_t *groups;
+
+  TEST_HEADER(test_group_initgroups);
+
+  /* The caller's primary group is skipped, and the list grows as needed. */
+  start = size = 1;
+  groups = malloc(sizeof(gid_t));
+  groups[0] = 100;
+  status = _nss_srvd_initgroups_dyn("alice", 100, &start, &size, &groups, 0, &error);
+  CHECK(errors, status == NSS_STATUS_SUCCESS);
+  CHECK(errors, start == 4);
+  CHECK(errors, size >= start);
+  CHECK(errors, groups[0] == 100 && groups[1] == TEST_GID && groups[2] == TEST_GID_EMPTY &&
+        groups[3] == 70);
+  free(groups);
+
+  /* Groups already in the list (from other modules) aren't repeated, and new
+   * ones go after *start. */
+  start = 2;
+  size = 2;
+  groups = malloc(sizeof(gid_t) * 2);
+  groups[0] = 100;
+  groups[1] = TEST_GID_EMPTY;
+  status = _nss_srvd_initgroups_dyn("alice", 100, &start, &size, &groups, 0, &error);
+  CHECK(errors, status == NSS_STATUS_SUCCESS);
+  CHECK(errors, start == 4);
+  CHECK(errors, groups[1] == TEST_GID_EMPTY && groups[2] == TEST_GID && groups[3] == 70);
+  free(groups);
+
+  /* The list never grows past the limit. */
+  start = size = 1;
+  groups = malloc(sizeof(gid_t));
+  groups[0] = 100;
+  status = _nss_srvd_initgroups_dyn("alice", 100, &start, &size, &groups, 2, &error);
+  CHECK(errors, status == NSS_STATUS_SUCCESS);
+  CHECK(errors, start == 2 && size == 2);
+  CHECK(errors, groups[1] == TEST_GID);
+  free(groups);
+
+  /* Users the server doesn't know about leave the list alone. */
+  start = size = 1;
+  groups = malloc(sizeof(gid_t));
+  groups[0] = 100;
+  status = _nss_srvd_initgroups_dyn("nobody", 100, &start, &size, &groups, 0, &error);
+  CHECK(errors, status == NSS_STATUS_NOTFOUND);
+  CHECK(errors, start == 1 && size == 1);
+  free(groups);
+
+  TEST_FOOTER(test_group_initgroups);
+
+  return errors;
+}
+
+int test_group(void) {
+  int errors = 0, error;
+  struct group gr;
+  char buffer[TEST_BUFFER_LARGE];
+  FILE *conf;
+
+  TEST_HEADER(test_group);
+
+  srvd_server_unsock_conf_t server_conf = { TEST_PATH, 16, SRVD_FALSE };
+  srvd_server_unsock_t server;
+  pthread_t thread;
+
+  CHECK(errors, srvd_service_nss_group_index_initialize(&test_index, 16));
+  CHECK(errors, srvd_service_nss_group_index_add(&test_index, "alice", TEST_GID));
+  CHECK(errors, srvd_service_nss_group_index_add(&test_index, "alice", 100));
+  CHECK(errors, srvd_service_nss_group_index_add(&test_index, "alice", TEST_GID_EMPTY));
+  CHECK(errors, srvd_service_nss_group_index_add(&test_index, "alice", 70));
+
+  unlink(TEST_PATH);
+  CHECK(errors, srvd_server_unsock_initialize(&server, &server_conf));
+  srvd_server_service_add(&server.monitor, SRVD_SERVICE_NSS_GROUP_REQUEST_NAME,
+                          test_name_handler);
+  srvd_server_service_add(&server.monitor, SRVD_SERVICE_NSS_GROUP_REQUEST_GID,
+                          test_gid_handler);
+  srvd_server_service_add(&server.monitor, SRVD_SERVICE_NSS_GROUP_REQUEST_INITGROUPS,
+                          test_initgroups_handler);
+  CHECK(errors, test_server_unsock_start(&server, &thread));
+
+  conf = fopen(TEST_CONF_PATH, "w");
+  CHECK(errors, conf != NULL);
+  fprintf(conf, "client:adapter = \"unsock\"\nclient:path = \"" TEST_PATH "\"\n");
+  fclose(conf);
+  CHECK(errors, srvd_conf_file_default_set(TEST_CONF_PATH));
+
+  error = 0;
+  CHECK(errors, _nss_srvd_getgrgid_r(TEST_GID, &gr, buffer, TEST_BUFFER_LARGE, &error) ==
+        NSS_STATUS_SUCCESS);
+
+  TEST_FOOTER(test_group);
+
+  errors += test_group_lookup();
+  errors += test_group_initgroups();
+
+  unlink(TEST_CONF_PATH);
+  unlink(TEST_PATH);
+
+  srvd_service_nss_group_index_finalize(&test_index);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_group();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+/* test-hello.c: Tests protocol feature negotiation.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+#include <srvd/protocol/hello.h>
+#include <srvd/protocol/serial_packet.h>
+#include <srvd/server/unsock.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "test-server.h"
+
+#define TEST_PATH "test-hello.sock"
+#define TEST_TYPE ((srvd_protocol_type_t)1001)
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+static void test_handler(const srvd_service_request_t *request, srvd_service_response_t *response) {
+  SRVD_UNUSED(request);
+
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+}
+
+static srvd_boolean_t test_query(srvd_client_t *client) {
+  srvd_boolean_t status;
+  srvd_protocol_packet_t request, response;
+
+  srvd_protocol_packet_initialize(&request);
+  srvd_protocol_packet_initialize(&response);
+  srvd_protocol_packet_field_append_uint32(&request, TEST_TYPE, 42);
+
+  status = srvd_client_write(client, &request) && srvd_client_read(client, &response);
+
+  srvd_protocol_packet_finalize(&request);
+  srvd_protocol_packet_finalize(&response);
+
+  return status;
+}
+
+int test_hello_negotiate(void) {
+  int errors = 0;
+  srvd_protocol_hello_t local, peer, result;
+  srvd_protocol_packet_t packet;
+
+  TEST_HEADER(test_hello_negotiate);
+
+  srvd_protocol_hello_initialize_local(&local);
+  srvd_protocol_hello_initialize_local(&peer);
+  peer.version_minimum = 100;
+  peer.features = SRVD_PROTOCOL_HELLO_BATCH | (uint32_t)(1 << 31);
+  peer.size_maximum = 4096;
+
+  CHECK(errors, srvd_protocol_hello_negotiate(&local, &peer, &result));
+  CHECK(errors, result.version_minimum == SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MAXIMUM);
+  CHECK(errors, result.version_maximum == SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MAXIMUM);
+  CHECK(errors, result.features == SRVD_PROTOCOL_HELLO_BATCH);
+  CHECK(errors, result.size_maximum == 4096);
+
+  /* Packing and unpacking round-trips. */
+  srvd_protocol_packet_initialize(&packet);
+  CHECK(errors, srvd_protocol_hello_pack(&peer, &packet));
+  memset(&result, 0, sizeof(result));
+  CHECK(errors, srvd_protocol_hello_unpack(&packet, &result));
+  CHECK(errors, memcmp(&result, &peer, sizeof(result)) == 0);
+  srvd_protocol_packet_finalize(&packet);
+
+  /* Nothing in common. */
+  peer.version_minimum = peer.version_maximum = 100;
+  CHECK(errors, !srvd_protocol_hello_negotiate(&local, &peer, &result));
+
+  TEST_FOOTER(test_hello_negotiate);
+
+  return errors;
+}
+
+int test_hello_handshake(void) {
+  int errors = 0;
+  srvd_server_unsock_conf_t server_conf = { TEST_PATH, 16, SRVD_TRUE };
+  srvd_server_unsock_t server;
+  pthread_t thread;
+  srvd_client_t *client = NULL;
+  srvd_conf_t conf;
+
+  TEST_HEADER(test_hello_handshake);
+
+  unlink(TEST_PATH);
+  CHECK(errors, srvd_server_unsock_initialize(&server, &server_conf));
+  srvd_server_service_add(&server.monitor, TEST_TYPE, test_handler);
+  CHECK(errors, test_server_unsock_start(&server, &thread));
+
+  srvd_conf_initialize(&conf);
+  srvd_conf_item_add(&conf, "client:adapter", sizeof("client:adapter"), "unsock", sizeof("unsock"));
+  srvd_conf_item_add(&conf, "client:path", sizeof("client:path"), TEST_PATH, sizeof(TEST_PATH));
+  srvd_conf_item_add(&conf, "client:socket", sizeof("client:socket"), "seqpacket",
+                     sizeof("seqpacket"));
+  srvd_conf_item_add(&conf, "client:persistent", sizeof("client:persistent"), "yes",
+                     sizeof("yes"));
+
+  /* Persistent clients negotiate by default. */
+  CHECK(errors, srvd_client_get_by_conf(&client, &conf));
+  CHECK(errors, client->negotiate);
+  CHECK(errors, client->hello.features == 0);
+  CHECK(errors, srvd_client_connect(client));
+  CHECK(errors, client->hello.version_maximum == SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MAXIMUM);
+  CHECK(errors, client->hello.features == SRVD_PROTOCOL_HELLO_FEATURES);
+  CHECK(errors, client->hello.size_maximum == SRVD_PROTOCOL_SERIAL_PACKET_MESSAGE_SIZE_MAXIMUM);
+  CHECK(errors, test_query(client));
+  CHECK(errors, srvd_client_finalize(client));
+  srvd_client_free(client);
+  client = NULL;
+
+  /* Others don't, unless they're told to. */
+  srvd_conf_item_add(&conf, "client:negotiate", sizeof("client:negotiate"), "no", sizeof("no"));
+  CHECK(errors, srvd_client_get_by_conf(&client, &conf));
+  CHECK(errors, !client->negotiate);
+  CHECK(errors, srvd_client_connect(client));
+  CHECK(errors, client->hello.features == 0);
+  CHECK(errors, test_query(client));
+  CHECK(errors, srvd_client_finalize(client));
+  srvd_client_free(client);
+
+  srvd_conf_finalize(&conf);
+  unlink(TEST_PATH);
+
+  TEST_FOOTER(test_hello_handshake);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_hello_negotiate();
+  errors += test_hello_handshake();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,177 @@
+/* test-inproc.c: Tests the in-process client.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+#include <srvd/client/inproc.h>
+#include <srvd/server.h>
+#include <srvd/stats.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define TEST_TYPE ((srvd_protocol_type_t)1001)
+#define TEST_COUNT 100
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+/* Answers with the key it was given, plus one. */
+static void test_handler(const srvd_service_request_t *request, srvd_service_response_t *response) {
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  uint32_t key;
+
+  if(!srvd_protocol_packet_field_get_by_type(&request->packet, TEST_TYPE, &field) ||
+     !srvd_protocol_packet_field_entry_get_first(field, &entry) ||
+     !srvd_protocol_packet_field_entry_get_uint32(entry, &key)) {
+    response->status = SRVD_SERVICE_RESPONSE_FAIL;
+    return;
+  }
+
+  srvd_protocol_packet_field_append_uint32(&response->packet, TEST_TYPE, key + 1);
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+}
+
+static srvd_boolean_t test_query(srvd_client_t *client, uint32_t key) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_protocol_packet_t packet, response;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  uint32_t value;
+
+  srvd_protocol_packet_initialize(&packet);
+  srvd_protocol_packet_initialize(&response);
+  srvd_protocol_packet_field_append_uint32(&packet, TEST_TYPE, key);
+
+  if(srvd_client_write(client, &packet) && srvd_client_read(client, &response) &&
+     srvd_protocol_packet_field_get_by_type(&response, TEST_TYPE, &field) &&
+     srvd_protocol_packet_field_entry_get_first(field, &entry) &&
+     srvd_protocol_packet_field_entry_get_uint32(entry, &value))
+    status = value == key + 1;
+
+  /* The request still belongs to us. */
+  status = status && packet.field_count == 1;
+
+  srvd_protocol_packet_finalize(&packet);
+  srvd_protocol_packet_finalize(&response);
+
+  return status;
+}
+
+int test_inproc(void) {
+  int errors = 0;
+  srvd_server_t server;
+  srvd_client_t *client = NULL;
+  srvd_protocol_packet_t packet;
+  srvd_protocol_serial_packet_t serial;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_stats_snapshot_t *snapshot = malloc(sizeof(srvd_stats_snapshot_t));
+  srvd_conf_t conf;
+  uint32_t i;
+
+  TEST_HEADER(test_inproc);
+
+  CHECK(errors, srvd_server_initialize(&server));
+  srvd_server_service_add(&server, TEST_TYPE, test_handler);
+
+  client = srvd_client_inproc_allocate();
+  CHECK(errors, client != NULL);
+  CHECK(errors, srvd_client_inproc_initialize(client, &server));
+  CHECK(errors, srvd_client_descriptor(client) == -1);
+  CHECK(errors, srvd_client_connect(client));
+
+  for(i = 0; i < TEST_COUNT; i++) {
+    if(!test_query(client, i))
+      break;
+  }
+  CHECK(errors, i == TEST_COUNT);
+
+  /* Requests are counted as if they'd come in over a socket. */
+  CHECK(errors, snapshot && srvd_stats_snapshot(&server.stats, snapshot));
+  CHECK(errors, snapshot && snapshot->type_count == 1 && snapshot->types[0] == TEST_TYPE &&
+        snapshot->counters[0].requests == TEST_COUNT);
+  free(snapshot);
+
+  /* Only one request may be outstanding. */
+  srvd_protocol_packet_initialize(&packet);
+  srvd_protocol_packet_field_append_uint32(&packet, TEST_TYPE, 0);
+  CHECK(errors, srvd_client_write(client, &packet));
+  CHECK(errors, !srvd_client_write(client, &packet));
+  srvd_protocol_packet_finalize(&packet);
+
+  /* The response can be read serialized, too. */
+  srvd_protocol_serial_packet_initialize(&serial);
+  CHECK(errors, srvd_client_read_serial(client, &serial));
+  srvd_protocol_packet_initialize(&packet);
+  CHECK(errors, srvd_protocol_serial_packet_unserialize_body(&serial, &packet,
+                                                             serial.data +
+                                                             SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE));
+  CHECK(errors, srvd_protocol_packet_field_get_by_type(&packet, TEST_TYPE, &field));
+  srvd_protocol_packet_finalize(&packet);
+  srvd_protocol_serial_packet_finalize(&serial);
+  CHECK(errors, test_query(client, 1));
+
+  CHECK(errors, srvd_client_disconnect(client));
+  srvd_client_finalize(client);
+  srvd_client_free(client);
+  client = NULL;
+
+  /* Through the configuration, by name. */
+  CHECK(errors, srvd_conf_initialize(&conf));
+  CHECK(errors, srvd_conf_item_add(&conf, "client:adapter", sizeof("client:adapter"), "inproc",
+                                   sizeof("inproc")));
+  CHECK(errors, srvd_conf_item_add(&conf, "client:server", sizeof("client:server"), "test",
+                                   sizeof("test")));
+  CHECK(errors, srvd_client_get_by_conf(&client, &conf));
+
+  CHECK(errors, !srvd_client_connect(client));
+  CHECK(errors, srvd_client_inproc_server_register("test", &server));
+  CHECK(errors, srvd_client_connect(client));
+  CHECK(errors, test_query(client, 42));
+  CHECK(errors, srvd_client_disconnect(client));
+
+  CHECK(errors, srvd_client_inproc_server_register("test", NULL));
+  CHECK(errors, !srvd_client_connect(client));
+
+  srvd_client_finalize(client);
+  srvd_client_free(client);
+  srvd_conf_finalize(&conf);
+
+  CHECK(errors, srvd_server_finalize(&server));
+
+  TEST_FOOTER(test_inproc);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_inproc();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,338 @@
+/* test-reader.c: Tests reading serialized packets in place.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+#include <srvd/protocol/packet.h>
+#include <srvd/protocol/serial_packet.h>
+#include <srvd/server/unsock.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "test-server.h"
+
+#define TEST_PATH "test-reader.sock"
+#define TEST_TYPE ((srvd_protocol_type_t)1001)
+#define TEST_TYPE_OTHER ((srvd_protocol_type_t)1002)
+
+/* Enough to be worth compressing, and too much for a seqpacket message unless
+ * it is. */
+#define TEST_MEMBERS 20000
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+static void test_build(srvd_protocol_packet_t *packet, uint32_t members) {
+  srvd_protocol_packet_field_t *field = NULL;
+  char member[32];
+  uint32_t i;
+
+  srvd_protocol_packet_field_append_uint32(packet, TEST_TYPE_OTHER, 10042);
+
+  srvd_protocol_packet_field_get_or_add(packet, TEST_TYPE, &field);
+  for(i = 0; i < members; i++) {
+    snprintf(member, sizeof(member), "user%05lu@example.com", (unsigned long)i);
+    srvd_protocol_packet_field_entry_add(field, (uint16_t)(strlen(member) + 1), member);
+  }
+}
+
+/* Checks that the reader sees exactly the fields and entries of the packet. */
+static srvd_boolean_t test_walk(const srvd_protocol_packet_t *packet,
+                                srvd_protocol_serial_packet_reader_t *reader) {
+  srvd_protocol_packet_field_t *field;
+  srvd_protocol_type_t type;
+  uint32_t entry_count, size;
+  const char *data;
+
+  for(field = packet->field_head; field; field = field->next) {
+    srvd_protocol_packet_field_entry_t *entry;
+
+    if(!srvd_protocol_serial_packet_reader_field_next(reader, &type, &entry_count) ||
+       type != field->type || entry_count != field->entry_count)
+      return SRVD_FALSE;
+
+    for(entry = field->entry_head; entry; entry = entry->next) {
+      if(!srvd_protocol_serial_packet_reader_entry_next(reader, &data, &size) ||
+         size != entry->size || memcmp(data, entry->data, size) != 0)
+        return SRVD_FALSE;
+    }
+
+    if(srvd_protocol_serial_packet_reader_entry_next(reader, &data, &size))
+      return SRVD_FALSE;
+  }
+
+  return !srvd_protocol_serial_packet_reader_field_next(reader, &type, &entry_count) &&
+    !reader->error;
+}
+
+static srvd_boolean_t test_read(const srvd_protocol_packet_t *packet,
+                                const srvd_protocol_serial_packet_t *serial) {
+  srvd_protocol_serial_packet_reader_t reader;
+  srvd_boolean_t status;
+
+  if(!srvd_protocol_serial_packet_reader_initialize(&reader, serial,
+                                                    serial->data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE))
+    return SRVD_FALSE;
+
+  status = test_walk(packet, &reader);
+  srvd_protocol_serial_packet_reader_finalize(&reader);
+
+  return status;
+}
+
+static int test_reader_version(uint16_t version) {
+  int errors = 0;
+  srvd_protocol_packet_t packet;
+  srvd_protocol_serial_packet_t serial;
+  srvd_protocol_serial_packet_reader_t reader;
+  srvd_protocol_type_t type;
+  uint32_t entry_count, size;
+  const char *data;
+  srvd_boolean_t status;
+  size_t i;
+
+  srvd_protocol_packet_initialize(&packet);
+  test_build(&packet, 3);
+
+  srvd_protocol_serial_packet_initialize(&serial);
+  serial.version = version;
+  CHECK(errors, srvd_protocol_serial_packet_serialize(&serial, &packet));
+  CHECK(errors, test_read(&packet, &serial));
+
+  /* Skipping entries and fields we don't care about. */
+  CHECK(errors, srvd_protocol_serial_packet_reader_initialize(&reader, &serial,
+                                                              serial.data +
+                                                              SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE));
+  CHECK(errors, srvd_protocol_serial_packet_reader_field_next(&reader, &type, &entry_count) &&
+        type == TEST_TYPE_OTHER && entry_count == 1);
+  CHECK(errors, srvd_protocol_serial_packet_reader_field_next(&reader, &type, &entry_count) &&
+        type == TEST_TYPE && entry_count == 3);
+  CHECK(errors, srvd_protocol_serial_packet_reader_entry_next(&reader, &data, &size) &&
+        size == sizeof("user00000@example.com") && strcmp(data, "user00000@example.com") == 0);
+  CHECK(errors, !srvd_protocol_serial_packet_reader_field_next(&reader, &type, &entry_count) &&
+        !reader.error);
+  srvd_protocol_serial_packet_reader_finalize(&reader);
+
+  /* Every truncation of the body is caught. */
+  for(i = 0; i < serial.body_size; i++) {
+    srvd_protocol_serial_packet_t truncated = serial;
+
+    truncated.body_size = i;
+    if(!srvd_protocol_serial_packet_reader_initialize(&reader, &truncated,
+                                                      serial.data +
+                                                      SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE))
+      continue;
+
+    status = test_walk(&packet, &reader) || !reader.error;
+    srvd_protocol_serial_packet_reader_finalize(&reader);
+
+    if(status)
+      break;
+  }
+  CHECK(errors, i == serial.body_size);
+
+  srvd_protocol_serial_packet_finalize(&serial);
+  srvd_protocol_packet_finalize(&packet);
+
+  return errors;
+}
+
+int test_reader_packet(void) {
+  int errors = 0;
+
+  TEST_HEADER(test_reader_packet);
+
+  errors += test_reader_version(SRVD_PROTOCOL_SERIAL_PACKET_VERSION);
+  errors += test_reader_version(SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT);
+
+  TEST_FOOTER(test_reader_packet);
+
+  return errors;
+}
+
+int test_reader_compressed(void) {
+  int errors = 0;
+  srvd_protocol_packet_t packet;
+  srvd_protocol_serial_packet_t serial;
+  size_t size;
+
+  TEST_HEADER(test_reader_compressed);
+
+  srvd_protocol_packet_initialize(&packet);
+  test_build(&packet, 1000);
+
+  srvd_protocol_serial_packet_initialize(&serial);
+  serial.version = SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT;
+  serial.flags = SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE;
+  CHECK(errors, srvd_protocol_serial_packet_serialize(&serial, &packet));
+  CHECK(errors, serial.flags & SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED);
+
+  /* The reader takes care of it... */
+  CHECK(errors, test_read(&packet, &serial));
+
+  /* ...or it can be done once up front. */
+  size = srvd_protocol_serial_packet_size_version(&packet, SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT);
+  CHECK(errors, srvd_protocol_serial_packet_decompress(&serial));
+  CHECK(errors, !(serial.flags & SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSED));
+  CHECK(errors, serial.size == size);
+  CHECK(errors, test_read(&packet, &serial));
+
+  srvd_protocol_serial_packet_finalize(&serial);
+  srvd_protocol_packet_finalize(&packet);
+
+  TEST_FOOTER(test_reader_compressed);
+
+  return errors;
+}
+
+static void test_handler(const srvd_service_request_t *request, srvd_service_response_t *response) {
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  uint32_t members = 0;
+
+  if(srvd_protocol_packet_field_get_by_type(&request->packet, TEST_TYPE, &field) &&
+     srvd_protocol_packet_field_entry_get_first(field, &entry))
+    srvd_protocol_packet_field_entry_get_uint32(entry, &members);
+
+  test_build(&response->packet, members);
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+}
+
+/* Counts the members in a response, checking each of them on the way. */
+static uint32_t test_count(const srvd_protocol_serial_packet_t *serial) {
+  srvd_protocol_serial_packet_reader_t reader;
+  srvd_protocol_type_t type;
+  uint32_t entry_count, size, members = 0;
+  const char *data;
+  char member[32];
+
+  if(!srvd_protocol_serial_packet_reader_initialize(&reader, serial,
+                                                    serial->data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE))
+    return 0;
+
+  while(srvd_protocol_serial_packet_reader_field_next(&reader, &type, &entry_count)) {
+    if(type != TEST_TYPE)
+      continue;
+
+    while(srvd_protocol_serial_packet_reader_entry_next(&reader, &data, &size)) {
+      snprintf(member, sizeof(member), "user%05lu@example.com", (unsigned long)members);
+      if(size != strlen(member) + 1 || memcmp(data, member, size) != 0)
+        break;
+
+      members++;
+    }
+  }
+
+  if(reader.error)
+    members = 0;
+  srvd_protocol_serial_packet_reader_finalize(&reader);
+
+  return members;
+}
+
+static srvd_boolean_t test_query(srvd_client_t *client, uint32_t members) {
+  srvd_boolean_t status;
+  srvd_protocol_packet_t request;
+  srvd_protocol_serial_packet_t serial;
+
+  srvd_protocol_packet_initialize(&request);
+  srvd_protocol_serial_packet_initialize(&serial);
+  srvd_protocol_packet_field_append_uint32(&request, TEST_TYPE, members);
+
+  status = srvd_client_write(client, &request) && srvd_client_read_serial(client, &serial) &&
+    test_count(&serial) == members;
+
+  srvd_protocol_serial_packet_finalize(&serial);
+  srvd_protocol_packet_finalize(&request);
+
+  return status;
+}
+
+static int test_reader_socket(const char *type) {
+  int errors = 0;
+  srvd_server_unsock_conf_t server_conf = { TEST_PATH, 16, SRVD_TRUE };
+  srvd_server_unsock_t server;
+  pthread_t thread;
+  srvd_client_t *client = NULL;
+  srvd_conf_t conf;
+
+  server_conf.seqpacket = strcmp(type, "seqpacket") == 0;
+
+  unlink(TEST_PATH);
+  CHECK(errors, srvd_server_unsock_initialize(&server, &server_conf));
+  srvd_server_service_add(&server.monitor, TEST_TYPE, test_handler);
+  CHECK(errors, test_server_unsock_start(&server, &thread));
+
+  srvd_conf_initialize(&conf);
+  srvd_conf_item_add(&conf, "client:adapter", sizeof("client:adapter"), "unsock", sizeof("unsock"));
+  srvd_conf_item_add(&conf, "client:path", sizeof("client:path"), TEST_PATH, sizeof(TEST_PATH));
+  srvd_conf_item_add(&conf, "client:socket", sizeof("client:socket"), type, strlen(type) + 1);
+  srvd_conf_item_add(&conf, "client:persistent", sizeof("client:persistent"), "yes",
+                     sizeof("yes"));
+  CHECK(errors, srvd_client_get_by_conf(&client, &conf));
+  CHECK(errors, client->read_serial != NULL);
+
+  CHECK(errors, srvd_client_connect(client));
+
+  CHECK(errors, test_query(client, 3));
+
+  /* Compressed. */
+  CHECK(errors, test_query(client, TEST_MEMBERS));
+  CHECK(errors, test_query(client, 0));
+
+  CHECK(errors, srvd_client_finalize(client));
+  srvd_client_free(client);
+  srvd_conf_finalize(&conf);
+  unlink(TEST_PATH);
+
+  return errors;
+}
+
+int test_reader_end_to_end(void) {
+  int errors = 0;
+
+  TEST_HEADER(test_reader_end_to_end);
+
+  errors += test_reader_socket("stream");
+  errors += test_reader_socket("seqpacket");
+
+  TEST_FOOTER(test_reader_end_to_end);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_reader_packet();
+  errors += test_reader_compressed();
+  errors += test_reader_end_to_end();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
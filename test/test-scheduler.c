@@ -0,0 +1,230 @@
+/* test-scheduler.c: Tests request scheduling.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/scheduler.h>
+
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#define TEST_ITEMS 64
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+typedef struct test_item test_item_t;
+
+struct test_item {
+  srvd_scheduler_item_t item;
+  uint8_t scheduling_class;
+  srvd_scheduler_peer_t peer;
+  unsigned int sequence;
+};
+
+static test_item_t test_items[TEST_ITEMS];
+
+static test_item_t *test_pop(srvd_scheduler_t *scheduler) {
+  srvd_scheduler_item_t *item = NULL;
+
+  if(!srvd_scheduler_pop(scheduler, &item))
+    return NULL;
+
+  return (test_item_t *)item;
+}
+
+static void test_push(srvd_scheduler_t *scheduler, unsigned int i, uint8_t scheduling_class,
+                      srvd_scheduler_peer_t peer) {
+  test_items[i].scheduling_class = scheduling_class;
+  test_items[i].peer = peer;
+  test_items[i].sequence = i;
+  srvd_scheduler_push(scheduler, &test_items[i].item, scheduling_class, peer);
+}
+
+int test_scheduler_classes(void) {
+  int errors = 0;
+  srvd_scheduler_t scheduler;
+  test_item_t *item;
+  unsigned int i, points = 0, enumerations = 0, run = 0, run_maximum = 0;
+  uint32_t weights[SRVD_SCHEDULER_CLASS_COUNT];
+
+  TEST_HEADER(test_scheduler_classes);
+
+  CHECK(errors, srvd_scheduler_initialize(&scheduler, NULL));
+  CHECK(errors, test_pop(&scheduler) == NULL);
+
+  /* An enumeration in line first doesn't keep lookups waiting for long, and
+   * doesn't starve either. */
+  for(i = 0; i < TEST_ITEMS / 2; i++)
+    test_push(&scheduler, i, SRVD_SCHEDULER_CLASS_ENUMERATION, 1);
+  for(; i < TEST_ITEMS; i++)
+    test_push(&scheduler, i, SRVD_SCHEDULER_CLASS_POINT, 1);
+  CHECK(errors, scheduler.item_count == TEST_ITEMS);
+
+  for(i = 0; i < 18; i++) {
+    item = test_pop(&scheduler);
+    if(item->scheduling_class == SRVD_SCHEDULER_CLASS_POINT) {
+      points++;
+      run++;
+      run_maximum = run > run_maximum ? run : run_maximum;
+    }
+    else {
+      enumerations++;
+      run = 0;
+    }
+  }
+  CHECK(errors, points == 16 && enumerations == 2);
+  CHECK(errors, run_maximum <= SRVD_SCHEDULER_WEIGHT_POINT_DEFAULT);
+
+  /* Each class is still first come, first served. */
+  item = test_pop(&scheduler);
+  CHECK(errors, item->scheduling_class == SRVD_SCHEDULER_CLASS_POINT &&
+        item->sequence == TEST_ITEMS / 2 + 16);
+
+  /* Once lookups run out, everything else goes. */
+  for(i = 0; test_pop(&scheduler) != NULL; i++);
+  CHECK(errors, i == TEST_ITEMS - 19);
+  CHECK(errors, scheduler.item_count == 0);
+
+  /* A class that was idle doesn't get to catch up. */
+  test_push(&scheduler, 0, SRVD_SCHEDULER_CLASS_POINT, 1);
+  test_push(&scheduler, 1, SRVD_SCHEDULER_CLASS_POINT, 1);
+  test_push(&scheduler, 2, SRVD_SCHEDULER_CLASS_ADMIN, 1);
+  item = test_pop(&scheduler);
+  CHECK(errors, item->sequence == 0);
+  while(test_pop(&scheduler) != NULL);
+  srvd_scheduler_finalize(&scheduler);
+
+  /* Weights can be changed. */
+  srvd_scheduler_weights_default(weights);
+  CHECK(errors, weights[SRVD_SCHEDULER_CLASS_POINT] == SRVD_SCHEDULER_WEIGHT_POINT_DEFAULT);
+  weights[SRVD_SCHEDULER_CLASS_POINT] = 1;
+  weights[SRVD_SCHEDULER_CLASS_ENUMERATION] = 3;
+  CHECK(errors, srvd_scheduler_initialize(&scheduler, weights));
+  for(i = 0; i < 8; i++)
+    test_push(&scheduler, i, i < 4 ? SRVD_SCHEDULER_CLASS_POINT : SRVD_SCHEDULER_CLASS_ENUMERATION,
+              1);
+  for(i = 0, enumerations = 0; i < 4; i++) {
+    if(test_pop(&scheduler)->scheduling_class == SRVD_SCHEDULER_CLASS_ENUMERATION)
+      enumerations++;
+  }
+  CHECK(errors, enumerations == 3);
+  srvd_scheduler_finalize(&scheduler);
+
+  weights[SRVD_SCHEDULER_CLASS_POINT] = 0;
+  CHECK(errors, !srvd_scheduler_initialize(&scheduler, weights));
+
+  TEST_FOOTER(test_scheduler_classes);
+
+  return errors;
+}
+
+int test_scheduler_peers(void) {
+  int errors = 0;
+  srvd_scheduler_t scheduler;
+  test_item_t *item;
+  unsigned int i, greedy = 0;
+  int pair[2];
+
+  TEST_HEADER(test_scheduler_peers);
+
+  srvd_scheduler_initialize(&scheduler, NULL);
+
+  /* One peer gets a lot in before two others show up. */
+  for(i = 0; i < 20; i++)
+    test_push(&scheduler, i, SRVD_SCHEDULER_CLASS_POINT, 100);
+  test_push(&scheduler, 20, SRVD_SCHEDULER_CLASS_POINT, 200);
+  test_push(&scheduler, 21, SRVD_SCHEDULER_CLASS_POINT, 300);
+  test_push(&scheduler, 22, SRVD_SCHEDULER_CLASS_POINT, 200);
+
+  /* Everyone takes turns, in the order they showed up. */
+  CHECK(errors, test_pop(&scheduler)->peer == 100);
+  CHECK(errors, test_pop(&scheduler)->peer == 200);
+  CHECK(errors, test_pop(&scheduler)->peer == 300);
+  CHECK(errors, test_pop(&scheduler)->peer == 100);
+  item = test_pop(&scheduler);
+  CHECK(errors, item->peer == 200 && item->sequence == 22);
+
+  /* Then the only one left goes as fast as it likes. */
+  while((item = test_pop(&scheduler)) != NULL) {
+    if(item->peer == 100 && item->sequence == greedy + 2)
+      greedy++;
+  }
+  CHECK(errors, greedy == 18);
+
+  /* Peers come and go. */
+  test_push(&scheduler, 0, SRVD_SCHEDULER_CLASS_POINT, 200);
+  CHECK(errors, test_pop(&scheduler)->peer == 200);
+  CHECK(errors, test_pop(&scheduler) == NULL);
+  srvd_scheduler_finalize(&scheduler);
+
+  /* Local connections are told apart by process. */
+  CHECK(errors, socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+  CHECK(errors, srvd_scheduler_peer_get(pair[0]) == (srvd_scheduler_peer_t)getpid());
+  CHECK(errors, srvd_scheduler_peer_get(pair[0]) == srvd_scheduler_peer_get(pair[1]));
+  close(pair[0]);
+  close(pair[1]);
+
+  /* TCP connections say they're from nobody, so each one is its own peer. */
+  struct sockaddr_in address;
+  socklen_t length = sizeof(address);
+  int listener, connections[2];
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = 0;
+
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  CHECK(errors, listener != -1);
+  CHECK(errors, bind(listener, (struct sockaddr *)&address, sizeof(address)) == 0);
+  CHECK(errors, getsockname(listener, (struct sockaddr *)&address, &length) == 0);
+  CHECK(errors, listen(listener, 2) == 0);
+  for(i = 0; i < 2; i++) {
+    connections[i] = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(errors, connect(connections[i], (struct sockaddr *)&address, sizeof(address)) == 0);
+  }
+  CHECK(errors, srvd_scheduler_peer_get(connections[0]) != srvd_scheduler_peer_get(connections[1]));
+  CHECK(errors, srvd_scheduler_peer_get(connections[0]) != (srvd_scheduler_peer_t)getpid());
+  close(connections[0]);
+  close(connections[1]);
+  close(listener);
+
+  TEST_FOOTER(test_scheduler_peers);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_scheduler_classes();
+  errors += test_scheduler_peers();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,197 @@
+/* test-schema.c: Tests the accessors generated from service schemas.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include <srvd/srvd.h>
+#include <srvd/server.h>
+#include <srvd/service.h>
+#include <srvd/service/nss/aliases.h>
+#include <srvd/service/nss/group.h>
+#include <srvd/service/nss/passwd.h>
+
+#include <string.h>
+#include <stdio.h>
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+int test_schema_request(void) {
+  int errors = 0;
+  srvd_service_request_t request;
+  char *name = NULL;
+  uid_t uid = 0;
+
+  TEST_HEADER(test_schema_request);
+
+  srvd_service_request_initialize(&request);
+  srvd_protocol_packet_field_append(&request.packet, SRVD_SERVICE_NSS_PASSWD_REQUEST_NAME,
+                                    sizeof("jdoe"), "jdoe");
+  CHECK(errors, srvd_service_nss_passwd_request_validate(&request));
+  CHECK(errors, srvd_service_nss_passwd_request_name_get(&request, &name));
+  CHECK(errors, name && strcmp(name, "jdoe") == 0);
+  CHECK(errors, srvd_service_nss_passwd_request_name_free(&request, &name) && name == NULL);
+
+  /* The first field decides what the request is. */
+  CHECK(errors, !srvd_service_nss_passwd_request_uid_get(&request, &uid));
+  CHECK(errors, !srvd_service_nss_group_request_validate(&request));
+  srvd_service_request_finalize(&request);
+
+  srvd_service_request_initialize(&request);
+  srvd_protocol_packet_field_append_uint32(&request.packet, SRVD_SERVICE_NSS_PASSWD_REQUEST_UID,
+                                           10042);
+  CHECK(errors, srvd_service_nss_passwd_request_validate(&request));
+  CHECK(errors, srvd_service_nss_passwd_request_uid_get(&request, &uid) && uid == 10042);
+  srvd_service_request_finalize(&request);
+
+  /* Malformed values are caught. */
+  srvd_service_request_initialize(&request);
+  srvd_protocol_packet_field_append(&request.packet, SRVD_SERVICE_NSS_PASSWD_REQUEST_UID, 2, "ab");
+  CHECK(errors, !srvd_service_nss_passwd_request_validate(&request));
+  srvd_service_request_finalize(&request);
+
+  srvd_service_request_initialize(&request);
+  srvd_protocol_packet_field_append(&request.packet, SRVD_SERVICE_NSS_PASSWD_REQUEST_NAME, 4, "jdoe");
+  CHECK(errors, !srvd_service_nss_passwd_request_validate(&request));
+  srvd_service_request_finalize(&request);
+
+  TEST_FOOTER(test_schema_request);
+
+  return errors;
+}
+
+int test_schema_response(void) {
+  int errors = 0;
+  srvd_service_response_t response;
+  srvd_protocol_packet_field_t *field = NULL;
+
+  TEST_HEADER(test_schema_response);
+
+  srvd_service_response_initialize(&response);
+  CHECK(errors, srvd_service_nss_aliases_response_name_set(&response, "staff", sizeof("staff")));
+  CHECK(errors, srvd_service_nss_aliases_response_member_add(&response, "jdoe", sizeof("jdoe")));
+  CHECK(errors, srvd_service_nss_aliases_response_member_add(&response, "root", sizeof("root")));
+  CHECK(errors, srvd_service_nss_aliases_response_local_set(&response, SRVD_TRUE));
+  CHECK(errors, srvd_service_nss_aliases_response_validate(&response));
+  CHECK(errors, srvd_protocol_packet_field_get_by_type(&response.packet,
+                                                       SRVD_SERVICE_NSS_ALIASES_RESPONSE_MEMBERS,
+                                                       &field) && field->entry_count == 2);
+
+  /* A single-valued field with two entries isn't well-formed. */
+  field = NULL;
+  srvd_protocol_packet_field_get_by_type(&response.packet, SRVD_SERVICE_NSS_ALIASES_RESPONSE_NAME,
+                                         &field);
+  srvd_protocol_packet_field_entry_add(field, sizeof("wheel"), "wheel");
+  CHECK(errors, !srvd_service_nss_aliases_response_validate(&response));
+  srvd_service_response_finalize(&response);
+
+  srvd_service_response_initialize(&response);
+  CHECK(errors, srvd_service_nss_group_response_gids_add(&response, 100));
+  CHECK(errors, srvd_service_nss_group_response_gids_add(&response, 101));
+  CHECK(errors, srvd_service_nss_group_response_validate(&response));
+  srvd_service_response_finalize(&response);
+
+  TEST_FOOTER(test_schema_response);
+
+  return errors;
+}
+
+static int test_calls = 0;
+
+static void test_handler(const srvd_service_request_t *request, srvd_service_response_t *response) {
+  SRVD_UNUSED(request);
+
+  test_calls++;
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+}
+
+static uint16_t test_dispatch(srvd_server_t *server, srvd_protocol_type_t type, uint16_t size,
+                              const void *data) {
+  srvd_service_request_t request;
+  srvd_service_response_t response;
+  uint16_t status;
+
+  srvd_service_request_initialize(&request);
+  srvd_service_response_initialize(&response);
+  srvd_protocol_packet_field_append(&request.packet, type, size, data);
+  srvd_server_dispatch(server, &request, &response);
+  status = response.status;
+  srvd_service_request_finalize(&request);
+  srvd_service_response_finalize(&response);
+
+  return status;
+}
+
+int test_schema_server(void) {
+  int errors = 0;
+  srvd_server_t server;
+  uint32_t uid = htonl(10042);
+
+  TEST_HEADER(test_schema_server);
+
+  srvd_server_initialize(&server);
+  CHECK(errors, srvd_server_service_add(&server, SRVD_SERVICE_NSS_PASSWD_REQUEST_UID, test_handler));
+
+  /* Requests that don't match the schema never reach the handler... */
+  test_calls = 0;
+  CHECK(errors, test_dispatch(&server, SRVD_SERVICE_NSS_PASSWD_REQUEST_UID, sizeof(uid), &uid) ==
+        SRVD_SERVICE_RESPONSE_SUCCESS);
+  CHECK(errors, test_dispatch(&server, SRVD_SERVICE_NSS_PASSWD_REQUEST_UID, 2, "ab") ==
+        SRVD_SERVICE_RESPONSE_FAIL);
+  CHECK(errors, test_calls == 1);
+
+  /* ...unless checking is turned off. */
+  CHECK(errors, srvd_server_service_validator_set(&server, SRVD_SERVICE_NSS_PASSWD_REQUEST_UID,
+                                                  NULL));
+  CHECK(errors, test_dispatch(&server, SRVD_SERVICE_NSS_PASSWD_REQUEST_UID, 2, "ab") ==
+        SRVD_SERVICE_RESPONSE_SUCCESS);
+  CHECK(errors, test_calls == 2);
+
+  /* Other types can be given a validator. */
+  CHECK(errors, srvd_server_service_add(&server, (srvd_protocol_type_t)1001, test_handler));
+  CHECK(errors, test_dispatch(&server, (srvd_protocol_type_t)1001, 2, "ab") ==
+        SRVD_SERVICE_RESPONSE_SUCCESS);
+  CHECK(errors, srvd_server_service_validator_set(&server, (srvd_protocol_type_t)1001,
+                                                  srvd_service_nss_passwd_request_validate));
+  CHECK(errors, test_dispatch(&server, (srvd_protocol_type_t)1001, 2, "ab") ==
+        SRVD_SERVICE_RESPONSE_FAIL);
+  CHECK(errors, test_calls == 3);
+
+  CHECK(errors, !srvd_server_service_validator_set(&server, (srvd_protocol_type_t)1002, NULL));
+
+  srvd_server_finalize(&server);
+
+  TEST_FOOTER(test_schema_server);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_schema_request();
+  errors += test_schema_response();
+  errors += test_schema_server();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+/* test-seqpacket.c: Tests SOCK_SEQPACKET UNIX domain sockets.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+#include <srvd/client/unsock.h>
+#include <srvd/server/unsock.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "test-server.h"
+
+#define TEST_PATH "test-seqpacket.sock"
+#define TEST_STREAM_PATH "test-seqpacket-stream.sock"
+#define TEST_TYPE ((srvd_protocol_type_t)1001)
+#define TEST_COUNT 100
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+static srvd_boolean_t test_echo(srvd_client_t *client, uint32_t key) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_protocol_packet_t request, response;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  uint32_t echoed;
+
+  srvd_protocol_packet_initialize(&request);
+  srvd_protocol_packet_initialize(&response);
+  srvd_protocol_packet_field_append_uint32(&request, TEST_TYPE, key);
+
+  if(srvd_client_write(client, &request) && srvd_client_read(client, &response) &&
+     srvd_protocol_packet_field_get_by_type(&response, TEST_TYPE, &field) &&
+     srvd_protocol_packet_field_entry_get_first(field, &entry) &&
+     srvd_protocol_packet_field_entry_get_uint32(entry, &echoed))
+    status = echoed == key;
+
+  srvd_protocol_packet_finalize(&request);
+  srvd_protocol_packet_finalize(&response);
+
+  return status;
+}
+
+int test_seqpacket(void) {
+  int errors = 0;
+  uint32_t i;
+
+  TEST_HEADER(test_seqpacket);
+
+  srvd_server_unsock_conf_t server_conf = { TEST_PATH, 16, SRVD_TRUE };
+  srvd_server_unsock_t server;
+  pthread_t thread;
+
+  unlink(TEST_PATH);
+  CHECK(errors, srvd_server_unsock_initialize(&server, &server_conf));
+  srvd_server_service_add(&server.monitor, TEST_TYPE, test_server_echo);
+  CHECK(errors, test_server_unsock_start(&server, &thread));
+
+  srvd_conf_t conf;
+  srvd_conf_initialize(&conf);
+  srvd_conf_item_add(&conf, "client:adapter", sizeof("client:adapter"), "unsock", sizeof("unsock"));
+  srvd_conf_item_add(&conf, "client:path", sizeof("client:path"), TEST_PATH, sizeof(TEST_PATH));
+  srvd_conf_item_add(&conf, "client:socket", sizeof("client:socket"), "seqpacket",
+                     sizeof("seqpacket"));
+
+  srvd_client_t *client = NULL;
+  CHECK(errors, srvd_client_get_by_conf(&client, &conf));
+  CHECK(errors, srvd_client_connect(client));
+  CHECK(errors, ((srvd_client_unsock_t *)client)->type == SOCK_SEQPACKET);
+
+  for(i = 0; i < TEST_COUNT; i++) {
+    if(!test_echo(client, i))
+      break;
+  }
+  CHECK(errors, i == TEST_COUNT);
+
+  CHECK(errors, srvd_client_finalize(client));
+  srvd_client_free(client);
+  srvd_conf_finalize(&conf);
+  unlink(TEST_PATH);
+
+  TEST_FOOTER(test_seqpacket);
+
+  return errors;
+}
+
+int test_seqpacket_fallback(void) {
+  int errors = 0;
+
+  TEST_HEADER(test_seqpacket_fallback);
+
+  /* A client that asks for SOCK_SEQPACKET still works with a server that
+   * doesn't. */
+  srvd_server_unsock_conf_t server_conf = { TEST_STREAM_PATH, 16, SRVD_FALSE };
+  srvd_server_unsock_t server;
+  pthread_t thread;
+
+  unlink(TEST_STREAM_PATH);
+  CHECK(errors, srvd_server_unsock_initialize(&server, &server_conf));
+  srvd_server_service_add(&server.monitor, TEST_TYPE, test_server_echo);
+  CHECK(errors, test_server_unsock_start(&server, &thread));
+
+  srvd_client_t *client = srvd_client_unsock_allocate();
+  CHECK(errors, srvd_client_unsock_initialize(client, TEST_STREAM_PATH, SOCK_SEQPACKET));
+  CHECK(errors, srvd_client_connect(client));
+  CHECK(errors, ((srvd_client_unsock_t *)client)->type == SOCK_STREAM);
+  CHECK(errors, test_echo(client, 42));
+
+  CHECK(errors, srvd_client_finalize(client));
+  srvd_client_free(client);
+  unlink(TEST_STREAM_PATH);
+
+  TEST_FOOTER(test_seqpacket_fallback);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_seqpacket();
+  errors += test_seqpacket_fallback();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
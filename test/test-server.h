@@ -0,0 +1,82 @@
+/* test-server.h: Helpers for tests that run a server of their own.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#ifndef _SRVD_TEST_SERVER_H
+#define _SRVD_TEST_SERVER_H
+
+/* Tests start the server on a thread of their own, and talk to it from the
+ * main one. Servers don't listen until they're executing, so starting one
+ * waits until it is; the test can connect right away after that. */
+
+#include <srvd/srvd.h>
+#include <srvd/server/tcp.h>
+#include <srvd/server/unsock.h>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <time.h>
+
+static inline void *_test_server_unsock_execute(void *argument) {
+  srvd_server_unsock_execute((srvd_server_unsock_t *)argument);
+  return NULL;
+}
+
+static inline void *_test_server_tcp_execute(void *argument) {
+  srvd_server_tcp_execute((srvd_server_tcp_t *)argument);
+  return NULL;
+}
+
+/* Gives the server up to a second to start listening on its socket. */
+static inline srvd_boolean_t _test_server_wait(int listener) {
+  int attempts, listening;
+  socklen_t length;
+
+  for(attempts = 0; attempts < 100; attempts++) {
+    struct timespec delay = { 0, 10000000 };
+
+    listening = 0;
+    length = sizeof(listening);
+    if(getsockopt(listener, SOL_SOCKET, SO_ACCEPTCONN, &listening, &length) == 0 && listening)
+      return SRVD_TRUE;
+    nanosleep(&delay, NULL);
+  }
+
+  return SRVD_FALSE;
+}
+
+static inline srvd_boolean_t test_server_unsock_start(srvd_server_unsock_t *server,
+                                                      pthread_t *thread) {
+  return pthread_create(thread, NULL, _test_server_unsock_execute, server) == 0 &&
+    _test_server_wait(server->socket);
+}
+
+static inline srvd_boolean_t test_server_tcp_start(srvd_server_tcp_t *server,
+                                                   pthread_t *thread) {
+  return pthread_create(thread, NULL, _test_server_tcp_execute, server) == 0 &&
+    _test_server_wait(server->socket);
+}
+
+/* A handler that answers with the request's first entry, in a field of the
+ * same type. */
+static inline void test_server_echo(const srvd_service_request_t *request,
+                                    srvd_service_response_t *response) {
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+
+  if(!srvd_protocol_packet_field_get_first(&request->packet, &field) ||
+     !srvd_protocol_packet_field_entry_get_first(field, &entry)) {
+    response->status = SRVD_SERVICE_RESPONSE_FAIL;
+    return;
+  }
+
+  srvd_protocol_packet_field_append(&response->packet, field->type, entry->size, entry->data);
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,228 @@
+/* test-shm.c: Tests the shared memory transport.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+#include <srvd/client/shm.h>
+#include <srvd/server/shm.h>
+#include <srvd/server/unsock.h>
+#include <srvd/shm.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/wait.h>
+
+#include "test-server.h"
+
+#define TEST_PATH "test-shm.sock"
+#define TEST_REGION_PATH "test-shm.region"
+#define TEST_TYPE ((srvd_protocol_type_t)1001)
+#define TEST_COUNT 1000
+#define TEST_LARGE_SIZE 3000
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+/* The thread the last request was handled on. */
+static pthread_t test_handler_thread;
+
+static void test_handler(const srvd_service_request_t *request, srvd_service_response_t *response) {
+  test_handler_thread = pthread_self();
+  test_server_echo(request, response);
+}
+
+/* Sends a request with one entry and checks that the same thing comes back. */
+static srvd_boolean_t test_echo(srvd_client_t *client, const char *data, uint16_t size) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_protocol_packet_t request, response;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+
+  srvd_protocol_packet_initialize(&request);
+  srvd_protocol_packet_initialize(&response);
+  srvd_protocol_packet_field_append(&request, TEST_TYPE, size, data);
+
+  if(srvd_client_write(client, &request) && srvd_client_read(client, &response) &&
+     srvd_protocol_packet_field_get_by_type(&response, TEST_TYPE, &field) &&
+     srvd_protocol_packet_field_entry_get_first(field, &entry))
+    status = entry->size == size && memcmp(entry->data, data, size) == 0;
+
+  srvd_protocol_packet_finalize(&request);
+  srvd_protocol_packet_finalize(&response);
+
+  return status;
+}
+
+/* The same, but reads the response without unserializing it. */
+static srvd_boolean_t test_echo_serial(srvd_client_t *client, const char *data, uint16_t size) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_protocol_packet_t request, response;
+  srvd_protocol_serial_packet_t serial;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+
+  srvd_protocol_packet_initialize(&request);
+  srvd_protocol_packet_initialize(&response);
+  srvd_protocol_serial_packet_initialize(&serial);
+  srvd_protocol_packet_field_append(&request, TEST_TYPE, size, data);
+
+  if(srvd_client_write(client, &request) && srvd_client_read_serial(client, &serial) &&
+     srvd_protocol_serial_packet_decompress(&serial) &&
+     srvd_protocol_serial_packet_unserialize_body(&serial, &response,
+                                                  serial.data +
+                                                  SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE) &&
+     srvd_protocol_packet_field_get_by_type(&response, TEST_TYPE, &field) &&
+     srvd_protocol_packet_field_entry_get_first(field, &entry))
+    status = entry->size == size && memcmp(entry->data, data, size) == 0;
+
+  srvd_protocol_serial_packet_finalize(&serial);
+  srvd_protocol_packet_finalize(&request);
+  srvd_protocol_packet_finalize(&response);
+
+  return status;
+}
+
+int test_shm(void) {
+  int errors = 0;
+  uint32_t i;
+
+  TEST_HEADER(test_shm);
+
+  srvd_server_unsock_conf_t server_conf = { TEST_PATH, 16, SRVD_FALSE };
+  srvd_server_unsock_t server;
+  pthread_t thread;
+
+  unlink(TEST_PATH);
+  CHECK(errors, srvd_server_unsock_initialize(&server, &server_conf));
+  srvd_server_service_add(&server.monitor, TEST_TYPE, test_handler);
+  CHECK(errors, test_server_unsock_start(&server, &thread));
+
+  srvd_conf_t conf;
+  srvd_conf_initialize(&conf);
+  srvd_conf_item_add(&conf, "client:adapter", sizeof("client:adapter"), "shm", sizeof("shm"));
+  srvd_conf_item_add(&conf, "client:path", sizeof("client:path"), TEST_PATH, sizeof(TEST_PATH));
+  srvd_conf_item_add(&conf, "client:shm:size", sizeof("client:shm:size"), "4096", sizeof("4096"));
+
+  srvd_client_t *client = NULL;
+  CHECK(errors, srvd_client_get_by_conf(&client, &conf));
+  CHECK(errors, client->persistent);
+
+  CHECK(errors, srvd_client_connect(client));
+  CHECK(errors, ((srvd_client_shm_t *)client)->shm.region != NULL);
+  CHECK(errors, srvd_client_descriptor(client) == -1);
+
+  /* Enough small requests to go around the rings many times. */
+  for(i = 0; i < TEST_COUNT; i++) {
+    if(!test_echo(client, (const char *)&i, sizeof(uint32_t)))
+      break;
+  }
+  CHECK(errors, i == TEST_COUNT);
+  CHECK(errors, pthread_equal(test_handler_thread, thread));
+  CHECK(errors, client->read_serial != NULL);
+  CHECK(errors, test_echo_serial(client, (const char *)&i, sizeof(uint32_t)));
+
+  /* Too big for a 4096-byte ring, so it goes over the socket both ways. */
+  char large[TEST_LARGE_SIZE];
+  memset(large, 'x', TEST_LARGE_SIZE);
+  CHECK(errors, test_echo(client, large, TEST_LARGE_SIZE));
+  CHECK(errors, test_echo_serial(client, large, TEST_LARGE_SIZE));
+  CHECK(errors, test_echo(client, (const char *)&i, sizeof(uint32_t)));
+
+  /* A forked child that gets rid of the client it inherited leaves our
+   * session alone. */
+  pid_t child = fork();
+  if(child == 0) {
+    srvd_client_finalize(client);
+    srvd_client_free(client);
+    _exit(0);
+  }
+  CHECK(errors, child != -1 && waitpid(child, NULL, 0) == child);
+  CHECK(errors, test_echo(client, (const char *)&i, sizeof(uint32_t)));
+
+  /* Ending the session wakes the client up instead of leaving it waiting. */
+  srvd_server_shm_detach(&server.monitor);
+  CHECK(errors, !test_echo(client, (const char *)&i, sizeof(uint32_t)));
+
+  CHECK(errors, srvd_client_disconnect(client));
+  srvd_client_finalize(client);
+  srvd_client_free(client);
+
+  srvd_conf_finalize(&conf);
+  unlink(TEST_PATH);
+
+  TEST_FOOTER(test_shm);
+
+  return errors;
+}
+
+int test_shm_sealed(void) {
+  int errors = 0, descriptor;
+  srvd_shm_t shm, mapped;
+  srvd_shm_region_t region;
+
+  TEST_HEADER(test_shm_sealed);
+
+  /* Our own regions can't be resized. */
+  CHECK(errors, srvd_shm_create(&shm, SRVD_SHM_RING_SIZE_MINIMUM, &descriptor));
+  CHECK(errors, ftruncate(descriptor, 0) == -1);
+  CHECK(errors, srvd_shm_map(&mapped, descriptor));
+  CHECK(errors, mapped.ring_size == SRVD_SHM_RING_SIZE_MINIMUM);
+  CHECK(errors, srvd_shm_unmap(&mapped));
+  CHECK(errors, srvd_shm_unmap(&shm));
+  close(descriptor);
+
+  /* A region that looks fine but could be truncated is refused. */
+  memset(&region, 0, sizeof(srvd_shm_region_t));
+  region.magic = SRVD_SHM_MAGIC;
+  region.version = SRVD_SHM_VERSION;
+  region.ring_size = SRVD_SHM_RING_SIZE_MINIMUM;
+
+  unlink(TEST_REGION_PATH);
+  descriptor = open(TEST_REGION_PATH, O_RDWR | O_CREAT | O_EXCL, 0600);
+  CHECK(errors, descriptor != -1);
+  CHECK(errors, ftruncate(descriptor, (off_t)srvd_shm_region_size(SRVD_SHM_RING_SIZE_MINIMUM)) == 0);
+  CHECK(errors, write(descriptor, &region, sizeof(srvd_shm_region_t)) ==
+        (ssize_t)sizeof(srvd_shm_region_t));
+  CHECK(errors, !srvd_shm_map(&mapped, descriptor));
+  close(descriptor);
+  unlink(TEST_REGION_PATH);
+
+  TEST_FOOTER(test_shm_sealed);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_shm();
+  errors += test_shm_sealed();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,214 @@
+/* test-stats.c: Tests server statistics.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+#include <srvd/client/unsock.h>
+#include <srvd/server/unsock.h>
+#include <srvd/stats.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "test-server.h"
+
+#define TEST_PATH "test-stats.sock"
+#define TEST_SEGMENT_PATH "test-stats.segment"
+#define TEST_TYPE ((srvd_protocol_type_t)1001)
+#define TEST_COUNT 100
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+static srvd_boolean_t test_echo(srvd_client_t *client, uint32_t key) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_protocol_packet_t request, response;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  uint32_t echoed;
+
+  srvd_protocol_packet_initialize(&request);
+  srvd_protocol_packet_initialize(&response);
+  srvd_protocol_packet_field_append_uint32(&request, TEST_TYPE, key);
+
+  if(srvd_client_write(client, &request) && srvd_client_read(client, &response) &&
+     srvd_protocol_packet_field_get_by_type(&response, TEST_TYPE, &field) &&
+     srvd_protocol_packet_field_entry_get_first(field, &entry) &&
+     srvd_protocol_packet_field_entry_get_uint32(entry, &echoed))
+    status = echoed == key;
+
+  srvd_protocol_packet_finalize(&request);
+  srvd_protocol_packet_finalize(&response);
+
+  return status;
+}
+
+static srvd_boolean_t test_stats_get(srvd_client_t *client, srvd_stats_snapshot_t *snapshot) {
+  srvd_boolean_t status;
+  srvd_protocol_packet_t request, response;
+  srvd_protocol_packet_field_t *field = NULL;
+
+  srvd_protocol_packet_initialize(&request);
+  srvd_protocol_packet_initialize(&response);
+  srvd_protocol_packet_field_get_or_add(&request, SRVD_PROTOCOL_STATS, &field);
+
+  status = srvd_client_write(client, &request) && srvd_client_read(client, &response) &&
+    srvd_stats_snapshot_unpack(&response, snapshot);
+
+  srvd_protocol_packet_finalize(&request);
+  srvd_protocol_packet_finalize(&response);
+
+  return status;
+}
+
+int test_stats_histogram(void) {
+  int errors = 0;
+  srvd_stats_histogram_t histogram;
+  uint64_t i, median;
+
+  TEST_HEADER(test_stats_histogram);
+
+  memset(&histogram, 0, sizeof(srvd_stats_histogram_t));
+  CHECK(errors, srvd_stats_histogram_percentile(&histogram, 0.5) == 0);
+
+  for(i = 1; i <= 1000; i++)
+    srvd_stats_histogram_record(&histogram, i);
+
+  median = srvd_stats_histogram_percentile(&histogram, 0.5);
+  CHECK(errors, srvd_stats_histogram_count(&histogram) == 1000);
+  CHECK(errors, median >= 500 && median <= 625);
+  CHECK(errors, srvd_stats_histogram_percentile(&histogram, 1.0) >= 1000);
+
+  TEST_FOOTER(test_stats_histogram);
+
+  return errors;
+}
+
+int test_stats_segment(void) {
+  int errors = 0;
+  srvd_stats_t stats, reader;
+  srvd_stats_sample_t sample;
+
+  TEST_HEADER(test_stats_segment);
+
+  CHECK(errors, srvd_stats_initialize(&stats, 4));
+  CHECK(errors, srvd_stats_publish(&stats, TEST_SEGMENT_PATH));
+  CHECK(errors, srvd_stats_map(&reader, TEST_SEGMENT_PATH));
+
+  srvd_stats_sample_initialize(&sample);
+  sample.type = TEST_TYPE;
+  sample.status = SRVD_SERVICE_RESPONSE_NOTFOUND;
+  sample.dispatched = 1;
+  sample.handled = 11;
+  srvd_stats_record(&stats, &sample);
+  srvd_stats_record(&stats, &sample);
+
+  /* The reader sees what was recorded without asking anyone. */
+  srvd_stats_snapshot_t *snapshot = malloc(sizeof(srvd_stats_snapshot_t));
+  CHECK(errors, srvd_stats_snapshot(&reader, snapshot));
+  CHECK(errors, snapshot->type_count == 1 && snapshot->types[0] == TEST_TYPE);
+  CHECK(errors, snapshot->counters[0].requests == 2);
+  CHECK(errors, snapshot->counters[0].statuses[SRVD_SERVICE_RESPONSE_NOTFOUND] == 2);
+  CHECK(errors, srvd_stats_histogram_percentile(&snapshot->counters[0].handler, 0.5) == 11);
+  free(snapshot);
+
+  srvd_stats_record(&reader, &sample);
+  CHECK(errors, srvd_stats_finalize(&reader));
+  CHECK(errors, srvd_stats_finalize(&stats));
+  unlink(TEST_SEGMENT_PATH);
+
+  TEST_FOOTER(test_stats_segment);
+
+  return errors;
+}
+
+int test_stats_server(void) {
+  int errors = 0;
+  uint32_t i;
+
+  TEST_HEADER(test_stats_server);
+
+  srvd_server_unsock_conf_t server_conf = { TEST_PATH, 16, SRVD_FALSE };
+  srvd_server_unsock_t server;
+  pthread_t thread;
+
+  unlink(TEST_PATH);
+  CHECK(errors, srvd_server_unsock_initialize(&server, &server_conf));
+  srvd_server_service_add(&server.monitor, TEST_TYPE, test_server_echo);
+  CHECK(errors, test_server_unsock_start(&server, &thread));
+
+  srvd_conf_t conf;
+  srvd_conf_initialize(&conf);
+  srvd_conf_item_add(&conf, "client:adapter", sizeof("client:adapter"), "unsock", sizeof("unsock"));
+  srvd_conf_item_add(&conf, "client:path", sizeof("client:path"), TEST_PATH, sizeof(TEST_PATH));
+
+  srvd_client_t *client = NULL;
+  CHECK(errors, srvd_client_get_by_conf(&client, &conf));
+  CHECK(errors, srvd_client_connect(client));
+
+  for(i = 0; i < TEST_COUNT; i++) {
+    if(!test_echo(client, i))
+      break;
+  }
+  CHECK(errors, i == TEST_COUNT);
+
+  srvd_stats_snapshot_t *snapshot = malloc(sizeof(srvd_stats_snapshot_t));
+  CHECK(errors, test_stats_get(client, snapshot));
+  CHECK(errors, snapshot->type_count == 1);
+  CHECK(errors, snapshot->types[0] == TEST_TYPE);
+  CHECK(errors, snapshot->counters[0].requests == TEST_COUNT);
+  CHECK(errors, snapshot->counters[0].errors == 0);
+  CHECK(errors, snapshot->counters[0].statuses[SRVD_SERVICE_RESPONSE_SUCCESS] == TEST_COUNT);
+  CHECK(errors, snapshot->counters[0].bytes_in > 0 && snapshot->counters[0].bytes_out > 0);
+  CHECK(errors, srvd_stats_histogram_count(&snapshot->counters[0].handler) == TEST_COUNT);
+
+  /* Asking for statistics counts as a request of its own. */
+  CHECK(errors, test_stats_get(client, snapshot));
+  CHECK(errors, snapshot->type_count == 2);
+  CHECK(errors, snapshot->types[1] == SRVD_PROTOCOL_STATS);
+  free(snapshot);
+
+  CHECK(errors, srvd_client_finalize(client));
+  srvd_client_free(client);
+  srvd_conf_finalize(&conf);
+  unlink(TEST_PATH);
+
+  TEST_FOOTER(test_stats_server);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_stats_histogram();
+  errors += test_stats_segment();
+  errors += test_stats_server();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,305 @@
+/* test-stream.c: Tests big entries and fields with lots of them.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+#include <srvd/protocol/serial_packet.h>
+#include <srvd/server/unsock.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "test-server.h"
+
+#define TEST_PATH "test-stream.sock"
+#define TEST_TYPE ((srvd_protocol_type_t)1001)
+#define TEST_TYPE_OTHER ((srvd_protocol_type_t)1002)
+
+/* More than a version 110 field can have. */
+#define TEST_MEMBERS 70000
+
+/* More than a version 110 entry can hold. */
+#define TEST_ENTRY_SIZE 70000
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+static void test_build(srvd_protocol_packet_t *packet, uint32_t members) {
+  srvd_protocol_packet_field_t *field = NULL;
+  char member[32];
+  uint32_t i;
+
+  srvd_protocol_packet_field_append_uint32(packet, TEST_TYPE_OTHER, 42);
+
+  srvd_protocol_packet_field_get_or_add(packet, TEST_TYPE, &field);
+  for(i = 0; i < members; i++) {
+    snprintf(member, sizeof(member), "user%05lu", (unsigned long)i);
+    srvd_protocol_packet_field_entry_add(field, (uint32_t)(strlen(member) + 1), member);
+  }
+}
+
+/* Checks that two packets have the same fields and entries, in order. */
+static srvd_boolean_t test_equal(const srvd_protocol_packet_t *a, const srvd_protocol_packet_t *b) {
+  srvd_protocol_packet_field_t *fa, *fb;
+
+  if(a->field_count != b->field_count)
+    return SRVD_FALSE;
+
+  for(fa = a->field_head, fb = b->field_head; fa && fb; fa = fa->next, fb = fb->next) {
+    srvd_protocol_packet_field_entry_t *ea, *eb;
+
+    if(fa->type != fb->type || fa->entry_count != fb->entry_count)
+      return SRVD_FALSE;
+
+    for(ea = fa->entry_head, eb = fb->entry_head; ea && eb; ea = ea->next, eb = eb->next) {
+      if(ea->size != eb->size || memcmp(ea->data, eb->data, ea->size) != 0)
+        return SRVD_FALSE;
+    }
+  }
+
+  return SRVD_TRUE;
+}
+
+/* Serializes the packet in the given version and reads it back, returning
+ * whether that worked. */
+static srvd_boolean_t test_round_trip(const srvd_protocol_packet_t *packet, uint16_t version,
+                                      srvd_protocol_packet_t *result) {
+  srvd_protocol_serial_packet_t serial, header;
+  srvd_boolean_t status;
+
+  srvd_protocol_serial_packet_initialize(&serial);
+  srvd_protocol_serial_packet_initialize(&header);
+  serial.version = version;
+  status = srvd_protocol_serial_packet_serialize(&serial, packet) &&
+    srvd_protocol_serial_packet_unserialize_header(&header, result, serial.data) &&
+    header.size == serial.size &&
+    srvd_protocol_serial_packet_unserialize_body(&header, result,
+                                                 serial.data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
+  srvd_protocol_serial_packet_finalize(&header);
+  srvd_protocol_serial_packet_finalize(&serial);
+
+  return status;
+}
+
+int test_stream_entry(void) {
+  int errors = 0;
+  srvd_protocol_packet_t packet, result;
+  char *data;
+
+  TEST_HEADER(test_stream_entry);
+
+  data = malloc(TEST_ENTRY_SIZE);
+  CHECK(errors, data != NULL);
+  memset(data, 'x', TEST_ENTRY_SIZE);
+
+  srvd_protocol_packet_initialize(&packet);
+  CHECK(errors, srvd_protocol_packet_field_append(&packet, TEST_TYPE, TEST_ENTRY_SIZE, data));
+  CHECK(errors, packet.field_head->entry_head->size == TEST_ENTRY_SIZE);
+  srvd_protocol_packet_field_entry_add(packet.field_head, TEST_ENTRY_SIZE, data);
+
+  /* Too big for version 110... */
+  srvd_protocol_packet_initialize(&result);
+  CHECK(errors, !test_round_trip(&packet, SRVD_PROTOCOL_SERIAL_PACKET_VERSION, &result));
+  srvd_protocol_packet_finalize(&result);
+
+  /* ...but not for version 120. */
+  srvd_protocol_packet_initialize(&result);
+  CHECK(errors, test_round_trip(&packet, SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT, &result));
+  CHECK(errors, test_equal(&packet, &result));
+  srvd_protocol_packet_finalize(&result);
+
+  srvd_protocol_packet_finalize(&packet);
+  free(data);
+
+  TEST_FOOTER(test_stream_entry);
+
+  return errors;
+}
+
+int test_stream_field(void) {
+  int errors = 0;
+  srvd_protocol_packet_t packet, result;
+
+  TEST_HEADER(test_stream_field);
+
+  srvd_protocol_packet_initialize(&packet);
+  test_build(&packet, TEST_MEMBERS);
+
+  /* Too many entries for a version 110 field... */
+  srvd_protocol_packet_initialize(&result);
+  CHECK(errors, !test_round_trip(&packet, SRVD_PROTOCOL_SERIAL_PACKET_VERSION, &result));
+  srvd_protocol_packet_finalize(&result);
+
+  /* ...but not for version 120. */
+  srvd_protocol_packet_initialize(&result);
+  CHECK(errors, test_round_trip(&packet, SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT, &result));
+  CHECK(errors, test_equal(&packet, &result));
+  srvd_protocol_packet_finalize(&result);
+
+  srvd_protocol_packet_finalize(&packet);
+
+  /* Small packets are the same in both. */
+  srvd_protocol_packet_initialize(&packet);
+  test_build(&packet, 10);
+  srvd_protocol_packet_initialize(&result);
+  CHECK(errors, test_round_trip(&packet, SRVD_PROTOCOL_SERIAL_PACKET_VERSION, &result));
+  CHECK(errors, test_equal(&packet, &result));
+  srvd_protocol_packet_finalize(&result);
+  srvd_protocol_packet_finalize(&packet);
+
+  TEST_FOOTER(test_stream_field);
+
+  return errors;
+}
+
+static void test_handler(const srvd_service_request_t *request, srvd_service_response_t *response) {
+  SRVD_UNUSED(request);
+
+  test_build(&response->packet, TEST_MEMBERS);
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+}
+
+/* Seqpacket responses have to fit in a message, so this one only comes back
+ * whole on a stream socket; otherwise the server says it failed. */
+static srvd_boolean_t test_read(srvd_client_t *client, srvd_boolean_t whole) {
+  srvd_boolean_t status;
+  srvd_protocol_packet_t response;
+  srvd_protocol_packet_field_t *field = NULL, *other = NULL;
+  uint16_t result = 0;
+
+  srvd_protocol_packet_initialize(&response);
+
+  status = srvd_client_read(client, &response);
+  if(status && whole)
+    status = srvd_protocol_packet_field_get_by_type(&response, TEST_TYPE, &field) &&
+      field->entry_count == TEST_MEMBERS &&
+      srvd_protocol_packet_field_get_by_type(&response, TEST_TYPE_OTHER, &other) &&
+      other->entry_count == 1;
+  else if(status)
+    status = !srvd_protocol_packet_field_get_by_type(&response, TEST_TYPE, &field) &&
+      srvd_protocol_packet_field_get_by_type(&response, SRVD_PROTOCOL_STATUS, &field) &&
+      srvd_protocol_packet_field_entry_get_uint16(field->entry_head, &result) &&
+      result == SRVD_SERVICE_RESPONSE_FAIL;
+
+  srvd_protocol_packet_finalize(&response);
+
+  return status;
+}
+
+static srvd_boolean_t test_write(srvd_client_t *client) {
+  srvd_boolean_t status;
+  srvd_protocol_packet_t request;
+
+  srvd_protocol_packet_initialize(&request);
+  srvd_protocol_packet_field_append_uint32(&request, TEST_TYPE, 42);
+  status = srvd_client_write(client, &request);
+  srvd_protocol_packet_finalize(&request);
+
+  return status;
+}
+
+static srvd_boolean_t test_query(srvd_client_t *client, srvd_boolean_t whole) {
+  return test_write(client) && test_read(client, whole);
+}
+
+static int test_stream_socket(const char *type) {
+  int errors = 0;
+  srvd_server_unsock_conf_t server_conf = { TEST_PATH, 16, SRVD_TRUE };
+  srvd_server_unsock_t server;
+  pthread_t thread;
+  srvd_client_t *client = NULL, *idle = NULL;
+  srvd_conf_t conf;
+
+  server_conf.seqpacket = strcmp(type, "seqpacket") == 0;
+
+  unlink(TEST_PATH);
+  CHECK(errors, srvd_server_unsock_initialize(&server, &server_conf));
+  srvd_server_service_add(&server.monitor, TEST_TYPE, test_handler);
+  CHECK(errors, test_server_unsock_start(&server, &thread));
+
+  srvd_conf_initialize(&conf);
+  srvd_conf_item_add(&conf, "client:adapter", sizeof("client:adapter"), "unsock", sizeof("unsock"));
+  srvd_conf_item_add(&conf, "client:path", sizeof("client:path"), TEST_PATH, sizeof(TEST_PATH));
+  srvd_conf_item_add(&conf, "client:socket", sizeof("client:socket"), type, strlen(type) + 1);
+  srvd_conf_item_add(&conf, "client:persistent", sizeof("client:persistent"), "yes",
+                     sizeof("yes"));
+  srvd_conf_item_add(&conf, "client:timeout", sizeof("client:timeout"), "10000",
+                     sizeof("10000"));
+  CHECK(errors, srvd_client_get_by_conf(&client, &conf));
+
+  CHECK(errors, srvd_client_connect(client));
+
+  CHECK(errors, test_query(client, !server_conf.seqpacket));
+
+  /* The connection is still good for the next one. */
+  CHECK(errors, test_query(client, !server_conf.seqpacket));
+
+  /* A client that doesn't read its response right away doesn't hold up
+   * anyone else, and still gets all of it once it does. */
+  CHECK(errors, srvd_client_get_by_conf(&idle, &conf));
+  srvd_client_deadline_start(idle);
+  CHECK(errors, srvd_client_connect(idle));
+  CHECK(errors, test_write(idle));
+  srvd_client_deadline_start(client);
+  CHECK(errors, test_query(client, !server_conf.seqpacket));
+  srvd_client_deadline_start(idle);
+  CHECK(errors, test_read(idle, !server_conf.seqpacket));
+  CHECK(errors, srvd_client_finalize(idle));
+  srvd_client_free(idle);
+
+  CHECK(errors, srvd_client_finalize(client));
+  srvd_client_free(client);
+  srvd_conf_finalize(&conf);
+  unlink(TEST_PATH);
+
+  return errors;
+}
+
+int test_stream_end_to_end(void) {
+  int errors = 0;
+
+  TEST_HEADER(test_stream_end_to_end);
+
+  errors += test_stream_socket("stream");
+  errors += test_stream_socket("seqpacket");
+
+  TEST_FOOTER(test_stream_end_to_end);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_stream_entry();
+  errors += test_stream_field();
+  errors += test_stream_end_to_end();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
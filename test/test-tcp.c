@@ -0,0 +1,186 @@
+/* test-tcp.c: Tests the TCP client and server over the loopback interface.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+#include <srvd/protocol/serial_packet.h>
+#include <srvd/server/tcp.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "test-server.h"
+
+#define TEST_TYPE ((srvd_protocol_type_t)1001)
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+/* Echoes the key back, plus one. */
+static void test_handler(const srvd_service_request_t *request, srvd_service_response_t *response) {
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  uint32_t key;
+
+  srvd_protocol_packet_field_get_first(&request->packet, &field);
+  srvd_protocol_packet_field_entry_get_first(field, &entry);
+  srvd_protocol_packet_field_entry_get_uint32(entry, &key);
+
+  srvd_protocol_packet_field_append_uint32(&response->packet, TEST_TYPE, key + 1);
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+}
+
+static uint32_t test_query(srvd_client_t *client, uint32_t key) {
+  srvd_protocol_packet_t request, response;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  uint32_t value = UINT32_MAX;
+
+  srvd_protocol_packet_initialize(&request);
+  srvd_protocol_packet_initialize(&response);
+  srvd_protocol_packet_field_append_uint32(&request, TEST_TYPE, key);
+
+  if(srvd_client_write(client, &request) && srvd_client_read(client, &response) &&
+     srvd_protocol_packet_field_get_by_type(&response, TEST_TYPE, &field) &&
+     srvd_protocol_packet_field_entry_get_first(field, &entry))
+    srvd_protocol_packet_field_entry_get_uint32(entry, &value);
+
+  srvd_protocol_packet_finalize(&request);
+  srvd_protocol_packet_finalize(&response);
+
+  return value;
+}
+
+int test_tcp(void) {
+  int errors = 0;
+  char port[16];
+
+  TEST_HEADER(test_tcp);
+
+  snprintf(port, sizeof(port), "%d", 20000 + (int)(getpid() % 20000));
+
+  srvd_server_tcp_conf_t server_conf = { AF_INET, "127.0.0.1", port, 16 };
+  srvd_server_tcp_t server;
+  pthread_t thread;
+
+  CHECK(errors, srvd_server_tcp_initialize(&server, &server_conf));
+  srvd_server_service_add(&server.monitor, TEST_TYPE, test_handler);
+  CHECK(errors, test_server_tcp_start(&server, &thread));
+
+  srvd_conf_t conf;
+  srvd_conf_initialize(&conf);
+  srvd_conf_item_add(&conf, "client:adapter", sizeof("client:adapter"), "tcp", sizeof("tcp"));
+  srvd_conf_item_add(&conf, "client:family", sizeof("client:family"), "inet", sizeof("inet"));
+  srvd_conf_item_add(&conf, "client:host", sizeof("client:host"),
+                     "127.0.0.1", sizeof("127.0.0.1"));
+  srvd_conf_item_add(&conf, "client:port", sizeof("client:port"), port, strlen(port) + 1);
+  srvd_conf_item_add(&conf, "client:timeout", sizeof("client:timeout"), "2000", sizeof("2000"));
+
+  srvd_client_t *client = NULL;
+  CHECK(errors, srvd_client_get_by_conf(&client, &conf));
+  CHECK(errors, client->persistent);
+  CHECK(errors, client->timeout == 2000);
+
+  srvd_client_deadline_start(client);
+  CHECK(errors, srvd_client_connect(client));
+
+  /* Several requests over the same connection. */
+  CHECK(errors, test_query(client, 1) == 2);
+  CHECK(errors, test_query(client, 41) == 42);
+  CHECK(errors, test_query(client, 99) == 100);
+
+  CHECK(errors, srvd_client_disconnect(client));
+
+  /* And a new connection on the same client. */
+  srvd_client_deadline_start(client);
+  CHECK(errors, srvd_client_connect(client));
+  CHECK(errors, test_query(client, 7) == 8);
+
+  /* A client that stops partway through a request doesn't hold anyone else
+   * up, and can finish it later. */
+  srvd_client_t *stalled = NULL;
+  srvd_protocol_serial_packet_t serial;
+  srvd_protocol_packet_t request, response;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  uint32_t value = 0;
+
+  CHECK(errors, srvd_client_get_by_conf(&stalled, &conf));
+  srvd_client_deadline_start(stalled);
+  CHECK(errors, srvd_client_connect(stalled));
+
+  srvd_protocol_packet_initialize(&request);
+  srvd_protocol_packet_initialize(&response);
+  srvd_protocol_packet_field_append_uint32(&request, TEST_TYPE, 11);
+  srvd_protocol_serial_packet_initialize(&serial);
+  CHECK(errors, srvd_protocol_serial_packet_serialize(&serial, &request));
+
+  CHECK(errors, write(srvd_client_descriptor(stalled), serial.data, 3) == 3);
+  CHECK(errors, test_query(client, 8) == 9);
+  CHECK(errors, write(srvd_client_descriptor(stalled), serial.data + 3, serial.size - 3) ==
+        (ssize_t)(serial.size - 3));
+
+  srvd_client_deadline_start(stalled);
+  CHECK(errors, srvd_client_read(stalled, &response));
+  CHECK(errors, srvd_protocol_packet_field_get_by_type(&response, TEST_TYPE, &field) &&
+        srvd_protocol_packet_field_entry_get_first(field, &entry) &&
+        srvd_protocol_packet_field_entry_get_uint32(entry, &value) && value == 12);
+
+  /* A request that says it's bigger than we'll take is refused as soon as its
+   * header is in, without waiting for the rest. */
+  uint32_t size = htonl((uint32_t)SRVD_SERVER_SOCKET_REQUEST_SIZE_MAXIMUM);
+  memcpy(serial.data + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_OFFSET_SIZE, &size, sizeof(uint32_t));
+  CHECK(errors, write(srvd_client_descriptor(stalled), serial.data,
+                      SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE) ==
+        SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
+  srvd_client_deadline_start(stalled);
+  CHECK(errors, !srvd_client_read(stalled, &response));
+  CHECK(errors, test_query(client, 9) == 10);
+
+  srvd_protocol_serial_packet_finalize(&serial);
+  srvd_protocol_packet_finalize(&request);
+  srvd_protocol_packet_finalize(&response);
+  srvd_client_finalize(stalled);
+  srvd_client_free(stalled);
+
+  srvd_client_finalize(client);
+  srvd_client_free(client);
+  srvd_conf_finalize(&conf);
+
+  TEST_FOOTER(test_tcp);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_tcp();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
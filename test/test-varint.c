@@ -0,0 +1,182 @@
+/* test-varint.c: Tests the variable-length packet format.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+#include <srvd/srvd.h>
+#include <srvd/protocol/packet.h>
+#include <srvd/protocol/serial_packet.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define TEST_TYPE_SMALL ((srvd_protocol_type_t)1)
+#define TEST_TYPE_LARGE ((srvd_protocol_type_t)1001)
+#define TEST_TYPE_STRING ((srvd_protocol_type_t)40000)
+
+#define CHECK(errors, condition)                                        \
+  do {                                                                  \
+    printf("  CHECK(%s): ", #condition);                                \
+    if(!(condition)) {                                                  \
+      (errors)++;                                                       \
+      printf("Assertion failed!\n");                                    \
+    }                                                                   \
+    else                                                                \
+      printf("Passed.\n");                                              \
+  } while(0)
+
+#define TEST_HEADER(function)                   \
+  printf("%s:\n", #function)
+
+#define TEST_FOOTER(function)                   \
+  printf("\n")
+
+static void test_build(srvd_protocol_packet_t *packet) {
+  srvd_protocol_packet_initialize(packet);
+  srvd_protocol_packet_field_append_uint32(packet, TEST_TYPE_SMALL, 10042);
+  srvd_protocol_packet_field_append_uint32(packet, TEST_TYPE_SMALL, 0xffffffff);
+  srvd_protocol_packet_field_append_uint16(packet, TEST_TYPE_LARGE, 7);
+  srvd_protocol_packet_field_append_uint16(packet, TEST_TYPE_LARGE, 0xffff);
+  srvd_protocol_packet_field_append_uint8(packet, TEST_TYPE_LARGE, 200);
+  srvd_protocol_packet_field_append(packet, TEST_TYPE_STRING, sizeof("/home/jdoe"), "/home/jdoe");
+}
+
+/* Checks that two packets have the same fields and entries, in order. */
+static srvd_boolean_t test_equal(const srvd_protocol_packet_t *a, const srvd_protocol_packet_t *b) {
+  srvd_protocol_packet_field_t *fa, *fb;
+
+  if(a->field_count != b->field_count)
+    return SRVD_FALSE;
+
+  for(fa = a->field_head, fb = b->field_head; fa && fb; fa = fa->next, fb = fb->next) {
+    srvd_protocol_packet_field_entry_t *ea, *eb;
+
+    if(fa->type != fb->type || fa->entry_count != fb->entry_count)
+      return SRVD_FALSE;
+
+    for(ea = fa->entry_head, eb = fb->entry_head; ea && eb; ea = ea->next, eb = eb->next) {
+      if(ea->size != eb->size || memcmp(ea->data, eb->data, ea->size) != 0)
+        return SRVD_FALSE;
+    }
+  }
+
+  return SRVD_TRUE;
+}
+
+static srvd_boolean_t test_unserialize(char *buffer, size_t size, srvd_protocol_packet_t *packet) {
+  srvd_protocol_serial_packet_t serial;
+  srvd_boolean_t status;
+
+  srvd_protocol_serial_packet_initialize(&serial);
+  status = size >= SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE &&
+    srvd_protocol_serial_packet_unserialize_header(&serial, packet, buffer) &&
+    serial.size == size &&
+    srvd_protocol_serial_packet_unserialize_body(&serial, packet,
+                                                 buffer + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
+  srvd_protocol_serial_packet_finalize(&serial);
+
+  return status;
+}
+
+int test_varint_integer(void) {
+  int errors = 0;
+  char buffer[SRVD_PROTOCOL_SERIAL_PACKET_VARINT_SIZE_MAXIMUM];
+  uint32_t value = 0;
+
+  TEST_HEADER(test_varint_integer);
+
+  CHECK(errors, srvd_protocol_serial_packet_varint_size(0) == 1);
+  CHECK(errors, srvd_protocol_serial_packet_varint_size(127) == 1);
+  CHECK(errors, srvd_protocol_serial_packet_varint_size(128) == 2);
+  CHECK(errors, srvd_protocol_serial_packet_varint_size(0xffffffff) == 5);
+
+  CHECK(errors, srvd_protocol_serial_packet_varint_put(buffer, 300) == 2);
+  CHECK(errors, (unsigned char)buffer[0] == 0xac && buffer[1] == 0x02);
+  CHECK(errors, srvd_protocol_serial_packet_varint_get(buffer, 2, &value) == 2 && value == 300);
+
+  /* Truncated. */
+  CHECK(errors, srvd_protocol_serial_packet_varint_get(buffer, 1, &value) == 0);
+
+  /* Too big for 32 bits. */
+  memset(buffer, 0xff, sizeof(buffer));
+  buffer[4] = 0x1f;
+  CHECK(errors, srvd_protocol_serial_packet_varint_get(buffer, sizeof(buffer), &value) == 0);
+  buffer[4] = 0x0f;
+  CHECK(errors, srvd_protocol_serial_packet_varint_get(buffer, sizeof(buffer), &value) == 5 &&
+        value == 0xffffffff);
+
+  TEST_FOOTER(test_varint_integer);
+
+  return errors;
+}
+
+int test_varint_packet(void) {
+  int errors = 0;
+  srvd_protocol_packet_t packet, result;
+  char *buffer;
+  size_t size, i;
+
+  TEST_HEADER(test_varint_packet);
+
+  test_build(&packet);
+
+  size = srvd_protocol_serial_packet_size_version(&packet, SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT);
+  CHECK(errors, size < srvd_protocol_serial_packet_size(&packet));
+
+  buffer = malloc(size);
+  CHECK(errors, buffer != NULL);
+  CHECK(errors, srvd_protocol_serial_packet_serialize_into_version(&packet, buffer, size,
+                                                                   SRVD_PROTOCOL_SERIAL_PACKET_VERSION_VARINT));
+
+  srvd_protocol_packet_initialize(&result);
+  CHECK(errors, test_unserialize(buffer, size, &result));
+  CHECK(errors, test_equal(&packet, &result));
+  srvd_protocol_packet_finalize(&result);
+
+  /* Every truncation of the body is caught. */
+  for(i = SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE; i < size; i++) {
+    srvd_protocol_serial_packet_t serial;
+    srvd_boolean_t status;
+
+    srvd_protocol_packet_initialize(&result);
+    srvd_protocol_serial_packet_initialize(&serial);
+    status = srvd_protocol_serial_packet_unserialize_header(&serial, &result, buffer);
+    serial.body_size = i - SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE;
+    status = status &&
+      srvd_protocol_serial_packet_unserialize_body(&serial, &result,
+                                                   buffer + SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
+    srvd_protocol_serial_packet_finalize(&serial);
+    srvd_protocol_packet_finalize(&result);
+
+    if(status)
+      break;
+  }
+  CHECK(errors, i == size);
+
+  /* Versions we don't know are refused. */
+  CHECK(errors, !srvd_protocol_serial_packet_serialize_into_version(&packet, buffer, size,
+                                                                    SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MAXIMUM + 1));
+
+  free(buffer);
+  srvd_protocol_packet_finalize(&packet);
+
+  TEST_FOOTER(test_varint_packet);
+
+  return errors;
+}
+
+int main(void) {
+  int errors = 0;
+
+  errors += test_varint_integer();
+  errors += test_varint_packet();
+
+  printf("%d error(s) occurred while testing.\n", errors);
+
+  return errors ? 1 : 0;
+}
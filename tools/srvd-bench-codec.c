@@ -0,0 +1,322 @@
+/* srvd-bench-codec.c: Measures what it costs to build and (un)serialize packets.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+/* For clock_gettime(). */
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/protocol/packet.h>
+#include <srvd/protocol/serial_packet.h>
+#include <srvd/service.h>
+#include <srvd/service/nss/aliases.h>
+#include <srvd/service/nss/passwd.h>
+
+#include <stdio.h>
+#include <time.h>
+
+/* Usage: srvd-bench-codec [-c] [-d milliseconds] [-m members] [-v version]
+ *
+ * For a typical passwd response and an aliases response with a lot of members
+ * (1000 by default), measures building the packet, serializing it (into a new
+ * buffer and into one set aside ahead of time), and unserializing it again.
+ * Each case runs for the given number of milliseconds (500 by default) and
+ * reports the nanoseconds, memory allocations and bytes allocated per
+ * operation, along with the size of the serialized packet. Packets are written
+ * in the given packet version (SRVD_PROTOCOL_SERIAL_PACKET_VERSION by default).
+ * With -c, they're compressed when it's worth it; packets can't be compressed
+ * into memory that's been set aside, so serialize_into isn't measured then.
+ *
+ * Allocations are counted by replacing malloc() and friends for the whole
+ * process, which only works with the GNU C library; elsewhere, they're
+ * reported as "-". */
+
+#define SRVD_BENCH_CODEC_BATCH 64
+
+/* Allocation accounting. */
+
+static srvd_boolean_t srvd_bench_codec_counting = SRVD_FALSE;
+static uint64_t srvd_bench_codec_allocations = 0;
+static uint64_t srvd_bench_codec_allocated = 0;
+
+#ifdef __GLIBC__
+#define SRVD_BENCH_CODEC_ACCOUNTING 1
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void __libc_free(void *);
+
+void *malloc(size_t size) {
+  if(srvd_bench_codec_counting) {
+    srvd_bench_codec_allocations++;
+    srvd_bench_codec_allocated += size;
+  }
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  if(srvd_bench_codec_counting) {
+    srvd_bench_codec_allocations++;
+    srvd_bench_codec_allocated += count * size;
+  }
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+  if(srvd_bench_codec_counting) {
+    srvd_bench_codec_allocations++;
+    srvd_bench_codec_allocated += size;
+  }
+  return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer) {
+  __libc_free(pointer);
+}
+#else
+#define SRVD_BENCH_CODEC_ACCOUNTING 0
+#endif
+
+/* Cases. */
+
+typedef struct srvd_bench_codec_case srvd_bench_codec_case_t;
+
+typedef srvd_boolean_t (*srvd_bench_codec_build_pt)(srvd_service_response_t *);
+typedef srvd_boolean_t (*srvd_bench_codec_run_pt)(srvd_bench_codec_case_t *);
+
+struct srvd_bench_codec_case {
+  const char *name;
+  srvd_service_response_t response;
+  char *serialized;
+  size_t size;
+};
+
+static uint32_t srvd_bench_codec_members = 1000;
+static uint16_t srvd_bench_codec_version = SRVD_PROTOCOL_SERIAL_PACKET_VERSION;
+static uint16_t srvd_bench_codec_flags = 0;
+
+static srvd_boolean_t srvd_bench_codec_build_passwd(srvd_service_response_t *response) {
+  srvd_service_response_initialize(response);
+
+  return
+    srvd_protocol_packet_field_insert_uint16(&response->packet, SRVD_PROTOCOL_STATUS,
+                                             SRVD_SERVICE_RESPONSE_SUCCESS) &&
+    srvd_service_nss_passwd_response_name_set(response, "jdoe", sizeof("jdoe")) &&
+    srvd_service_nss_passwd_response_uid_set(response, 10042) &&
+    srvd_service_nss_passwd_response_gid_set(response, 100) &&
+    srvd_service_nss_passwd_response_dir_set(response, "/home/jdoe", sizeof("/home/jdoe")) &&
+    srvd_service_nss_passwd_response_shell_set(response, "/bin/bash", sizeof("/bin/bash")) &&
+    srvd_service_nss_passwd_response_gecos_set(response, "John Doe,,,", sizeof("John Doe,,,"));
+}
+
+static srvd_boolean_t srvd_bench_codec_build_aliases(srvd_service_response_t *response) {
+  char member[32];
+  uint32_t i;
+
+  srvd_service_response_initialize(response);
+
+  if(!srvd_protocol_packet_field_insert_uint16(&response->packet, SRVD_PROTOCOL_STATUS,
+                                               SRVD_SERVICE_RESPONSE_SUCCESS) ||
+     !srvd_service_nss_aliases_response_name_set(response, "everyone", sizeof("everyone")))
+    return SRVD_FALSE;
+
+  for(i = 0; i < srvd_bench_codec_members; i++) {
+    snprintf(member, sizeof(member), "user%05lu@example.com", (unsigned long)i);
+    if(!srvd_service_nss_aliases_response_member_add(response, member, strlen(member) + 1))
+      return SRVD_FALSE;
+  }
+
+  return srvd_service_nss_aliases_response_local_set(response, SRVD_FALSE);
+}
+
+static srvd_bench_codec_build_pt srvd_bench_codec_builder;
+
+static srvd_boolean_t srvd_bench_codec_run_build(srvd_bench_codec_case_t *c) {
+  srvd_service_response_t response;
+  srvd_boolean_t status;
+
+  SRVD_UNUSED(c);
+
+  status = srvd_bench_codec_builder(&response);
+  srvd_service_response_finalize(&response);
+
+  return status;
+}
+
+static srvd_boolean_t srvd_bench_codec_run_serialize(srvd_bench_codec_case_t *c) {
+  srvd_protocol_serial_packet_t serial;
+  srvd_boolean_t status;
+
+  srvd_protocol_serial_packet_initialize(&serial);
+  serial.version = srvd_bench_codec_version;
+  serial.flags = srvd_bench_codec_flags;
+  status = srvd_protocol_serial_packet_serialize(&serial, &c->response.packet);
+  srvd_protocol_serial_packet_finalize(&serial);
+
+  return status;
+}
+
+static srvd_boolean_t srvd_bench_codec_run_serialize_into(srvd_bench_codec_case_t *c) {
+  return srvd_protocol_serial_packet_serialize_into_version(&c->response.packet, c->serialized,
+                                                            c->size, srvd_bench_codec_version);
+}
+
+static srvd_boolean_t srvd_bench_codec_run_unserialize(srvd_bench_codec_case_t *c) {
+  srvd_protocol_serial_packet_t serial;
+  srvd_protocol_packet_t packet;
+  srvd_boolean_t status;
+
+  srvd_protocol_serial_packet_initialize(&serial);
+  srvd_protocol_packet_initialize(&packet);
+
+  status =
+    srvd_protocol_serial_packet_unserialize_header(&serial, &packet, c->serialized) &&
+    srvd_protocol_serial_packet_unserialize_body(&serial, &packet,
+                                                 c->serialized +
+                                                 SRVD_PROTOCOL_SERIAL_PACKET_HEADER_SIZE);
+
+  srvd_protocol_packet_finalize(&packet);
+  srvd_protocol_serial_packet_finalize(&serial);
+
+  return status;
+}
+
+static uint64_t srvd_bench_codec_now(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static srvd_boolean_t srvd_bench_codec_measure(srvd_bench_codec_case_t *c, const char *operation,
+                                               srvd_bench_codec_run_pt run, uint64_t duration) {
+  uint64_t start, elapsed, operations = 0;
+  uint32_t i;
+
+  /* Warm up (and make sure it works) first. */
+  for(i = 0; i < SRVD_BENCH_CODEC_BATCH; i++) {
+    if(!run(c)) {
+      fprintf(stderr, "srvd-bench-codec: %s %s failed\n", c->name, operation);
+      return SRVD_FALSE;
+    }
+  }
+
+  srvd_bench_codec_allocations = 0;
+  srvd_bench_codec_allocated = 0;
+  srvd_bench_codec_counting = SRVD_TRUE;
+
+  start = srvd_bench_codec_now();
+  do {
+    for(i = 0; i < SRVD_BENCH_CODEC_BATCH; i++)
+      run(c);
+    operations += SRVD_BENCH_CODEC_BATCH;
+    elapsed = srvd_bench_codec_now() - start;
+  } while(elapsed < duration);
+
+  srvd_bench_codec_counting = SRVD_FALSE;
+
+  if(SRVD_BENCH_CODEC_ACCOUNTING)
+    printf("%-8s %-15s %8lu %12.1f %10.1f %12.1f\n", c->name, operation, (unsigned long)c->size,
+           (double)elapsed / (double)operations,
+           (double)srvd_bench_codec_allocations / (double)operations,
+           (double)srvd_bench_codec_allocated / (double)operations);
+  else
+    printf("%-8s %-15s %8lu %12.1f %10s %12s\n", c->name, operation, (unsigned long)c->size,
+           (double)elapsed / (double)operations, "-", "-");
+  fflush(stdout);
+
+  return SRVD_TRUE;
+}
+
+static srvd_boolean_t srvd_bench_codec_case(const char *name, srvd_bench_codec_build_pt build,
+                                            uint64_t duration) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_bench_codec_case_t c;
+  srvd_protocol_serial_packet_t serial;
+
+  c.name = name;
+  c.serialized = NULL;
+  srvd_protocol_serial_packet_initialize(&serial);
+
+  if(!build(&c.response)) {
+    fprintf(stderr, "srvd-bench-codec: Unable to build %s packet\n", name);
+    goto _srvd_bench_codec_case_error;
+  }
+
+  /* Keep a serialized copy around to unserialize. */
+  serial.version = srvd_bench_codec_version;
+  serial.flags = srvd_bench_codec_flags;
+  if(!srvd_protocol_serial_packet_serialize(&serial, &c.response.packet)) {
+    fprintf(stderr, "srvd-bench-codec: Unable to serialize %s packet\n", name);
+    goto _srvd_bench_codec_case_error;
+  }
+  c.serialized = serial.data;
+  c.size = serial.size;
+  serial.data = NULL;
+
+  srvd_bench_codec_builder = build;
+
+  status =
+    srvd_bench_codec_measure(&c, "build", srvd_bench_codec_run_build, duration) &&
+    srvd_bench_codec_measure(&c, "serialize", srvd_bench_codec_run_serialize, duration) &&
+    (srvd_bench_codec_flags ||
+     srvd_bench_codec_measure(&c, "serialize_into", srvd_bench_codec_run_serialize_into,
+                              duration)) &&
+    srvd_bench_codec_measure(&c, "unserialize", srvd_bench_codec_run_unserialize, duration);
+
+ _srvd_bench_codec_case_error:
+
+  free(c.serialized);
+  srvd_protocol_serial_packet_finalize(&serial);
+  srvd_service_response_finalize(&c.response);
+
+  return status;
+}
+
+int main(int argc, char *argv[]) {
+  long milliseconds = 500, members = 1000, version = SRVD_PROTOCOL_SERIAL_PACKET_VERSION;
+  uint64_t duration;
+  int option;
+
+  while((option = getopt(argc, argv, "cd:m:v:")) != -1) {
+    if(option == 'c')
+      srvd_bench_codec_flags = SRVD_PROTOCOL_SERIAL_PACKET_FLAG_COMPRESSIBLE;
+    else if(option == 'd')
+      milliseconds = strtol(optarg, NULL, 10);
+    else if(option == 'm')
+      members = strtol(optarg, NULL, 10);
+    else if(option == 'v')
+      version = strtol(optarg, NULL, 10);
+    else {
+      fprintf(stderr, "usage: srvd-bench-codec [-c] [-d milliseconds] [-m members] "
+              "[-v version]\n");
+      return 2;
+    }
+  }
+  if(optind != argc || milliseconds <= 0 || members <= 0 || members > 65535 ||
+     version < SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MINIMUM ||
+     version > SRVD_PROTOCOL_SERIAL_PACKET_VERSION_MAXIMUM) {
+    fprintf(stderr, "usage: srvd-bench-codec [-c] [-d milliseconds] [-m members] "
+            "[-v version]\n");
+    return 2;
+  }
+
+  srvd_bench_codec_members = (uint32_t)members;
+  srvd_bench_codec_version = (uint16_t)version;
+  duration = (uint64_t)milliseconds * 1000000;
+
+  printf("%-8s %-15s %8s %12s %10s %12s\n",
+         "PACKET", "OPERATION", "SIZE", "NS/OP", "ALLOCS/OP", "BYTES/OP");
+
+  if(!srvd_bench_codec_case("passwd", srvd_bench_codec_build_passwd, duration) ||
+     !srvd_bench_codec_case("aliases", srvd_bench_codec_build_aliases, duration))
+    return 1;
+
+  return 0;
+}
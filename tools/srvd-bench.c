@@ -0,0 +1,630 @@
+/* srvd-bench.c: Measures how quickly a server answers NSS lookups.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+/* For mkdtemp() and kill(). */
+#define _POSIX_C_SOURCE 200809L
+
+/* In build/include. */
+#include "config.h"
+
+#include <srvd/srvd.h>
+#include <srvd/client.h>
+#include <srvd/conf.h>
+#include <srvd/server.h>
+#include <srvd/server/unsock.h>
+#include <srvd/client/inproc.h>
+#include <srvd/service.h>
+#include <srvd/service/nss/aliases.h>
+#include <srvd/service/nss/passwd.h>
+#include <srvd/stats.h>
+
+/* The module's own entry points, exactly as the C library calls them. */
+#include "../lib/srvd/nss/aliases.h"
+#include "../lib/srvd/nss/passwd.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/* Usage: srvd-bench [-f] [-p] [-s] [-a adapter] [-u users] [-t threads]
+ *                   [-d seconds]
+ *
+ * Starts a server on a UNIX domain socket in a temporary directory, in a
+ * thread of its own (or, with -f, in a child process), with a made-up backend
+ * of the given number of users and aliases (1000 by default). Then, for each of
+ * getpwnam, getpwuid, getaliasbyname and a full enumeration of the users, it
+ * runs the given number of client threads (4 by default) for the given number
+ * of seconds (2 by default), first through the client API on a connection of
+ * their own and then through the _nss_srvd_* functions the C library would
+ * call, and reports how many lookups were done per second and the 50th, 99th
+ * and 99.9th percentile latencies in microseconds. An enumeration counts as a
+ * single lookup.
+ *
+ * The NSS functions are pointed at a configuration file in the same directory
+ * naming the adapter (`unsock' or `shm'), whether to use SOCK_SEQPACKET
+ * sockets (-s, `unsock' only) and whether to keep connections open (-p, which
+ * `shm' always does). Nothing outside of the temporary directory is used.
+ *
+ * With `inproc', the clients call the server's handlers directly (see
+ * <srvd/client/inproc.h>), so the results show what the lookups cost without
+ * any transport at all. */
+
+#define SRVD_BENCH_MEMBER_COUNT 3
+#define SRVD_BENCH_BUFFER_SIZE 4096
+
+typedef enum {
+  SRVD_BENCH_GETPWNAM,
+  SRVD_BENCH_GETPWUID,
+  SRVD_BENCH_GETALIASBYNAME,
+  SRVD_BENCH_GETPWENT
+} srvd_bench_test_t;
+
+static const char *srvd_bench_test_names[] = {
+  "getpwnam", "getpwuid", "getaliasbyname", "getpwent"
+};
+
+typedef struct srvd_bench_worker srvd_bench_worker_t;
+
+struct srvd_bench_worker {
+  pthread_t thread;
+  srvd_bench_test_t test;
+  srvd_boolean_t nss;
+  const srvd_conf_t *conf;
+  uint64_t deadline;
+  uint32_t seed;
+  uint64_t count, failures;
+  srvd_stats_histogram_t latency;
+};
+
+/* The backend. Entry i is the user "user<i>" with the UID (and GID) 10000 + i,
+ * and the alias "alias<i>", whose members are the next few users. */
+
+#define SRVD_BENCH_UID_BASE 10000
+
+static uint32_t srvd_bench_size = 1000;
+
+static srvd_boolean_t srvd_bench_index(const char *name, const char *prefix, uint32_t *index) {
+  size_t length = strlen(prefix);
+  char *end;
+  unsigned long value;
+
+  if(strncmp(name, prefix, length) != 0 || name[length] == '\0')
+    return SRVD_FALSE;
+
+  value = strtoul(name + length, &end, 10);
+  if(*end != '\0' || value >= srvd_bench_size)
+    return SRVD_FALSE;
+
+  *index = (uint32_t)value;
+  return SRVD_TRUE;
+}
+
+static void srvd_bench_passwd_respond(srvd_service_response_t *response, uint32_t index) {
+  char name[32], dir[48], gecos[48];
+
+  snprintf(name, sizeof(name), "user%lu", (unsigned long)index);
+  snprintf(dir, sizeof(dir), "/home/user%lu", (unsigned long)index);
+  snprintf(gecos, sizeof(gecos), "Benchmark User %lu", (unsigned long)index);
+
+  srvd_service_nss_passwd_response_name_set(response, name, strlen(name) + 1);
+  srvd_service_nss_passwd_response_uid_set(response, (uid_t)(SRVD_BENCH_UID_BASE + index));
+  srvd_service_nss_passwd_response_gid_set(response, (gid_t)(SRVD_BENCH_UID_BASE + index));
+  srvd_service_nss_passwd_response_dir_set(response, dir, strlen(dir) + 1);
+  srvd_service_nss_passwd_response_shell_set(response, "/bin/sh", sizeof("/bin/sh"));
+  srvd_service_nss_passwd_response_gecos_set(response, gecos, strlen(gecos) + 1);
+
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+}
+
+static void srvd_bench_passwd_name(const srvd_service_request_t *request,
+                                   srvd_service_response_t *response) {
+  char *name = NULL;
+  uint32_t index;
+
+  response->status = SRVD_SERVICE_RESPONSE_NOTFOUND;
+
+  if(!srvd_service_nss_passwd_request_name_get(request, &name))
+    return;
+  if(srvd_bench_index(name, "user", &index))
+    srvd_bench_passwd_respond(response, index);
+  srvd_service_nss_passwd_request_name_free(request, &name);
+}
+
+static void srvd_bench_passwd_uid(const srvd_service_request_t *request,
+                                  srvd_service_response_t *response) {
+  uid_t uid;
+
+  response->status = SRVD_SERVICE_RESPONSE_NOTFOUND;
+
+  if(srvd_service_nss_passwd_request_uid_get(request, &uid) &&
+     uid >= SRVD_BENCH_UID_BASE && uid - SRVD_BENCH_UID_BASE < srvd_bench_size)
+    srvd_bench_passwd_respond(response, (uint32_t)(uid - SRVD_BENCH_UID_BASE));
+}
+
+static void srvd_bench_passwd_entities(const srvd_service_request_t *request,
+                                       srvd_service_response_t *response) {
+  int32_t offset;
+
+  response->status = SRVD_SERVICE_RESPONSE_NOTFOUND;
+
+  if(srvd_service_nss_passwd_request_entities_get(request, &offset) &&
+     offset >= 0 && (uint32_t)offset < srvd_bench_size)
+    srvd_bench_passwd_respond(response, (uint32_t)offset);
+}
+
+static void srvd_bench_aliases_respond(srvd_service_response_t *response, uint32_t index) {
+  char name[32], member[32];
+  uint32_t i;
+
+  snprintf(name, sizeof(name), "alias%lu", (unsigned long)index);
+  srvd_service_nss_aliases_response_name_set(response, name, strlen(name) + 1);
+
+  for(i = 1; i <= SRVD_BENCH_MEMBER_COUNT; i++) {
+    snprintf(member, sizeof(member), "user%lu", (unsigned long)((index + i) % srvd_bench_size));
+    srvd_service_nss_aliases_response_member_add(response, member, strlen(member) + 1);
+  }
+  srvd_service_nss_aliases_response_local_set(response, SRVD_TRUE);
+
+  response->status = SRVD_SERVICE_RESPONSE_SUCCESS;
+}
+
+static void srvd_bench_aliases_name(const srvd_service_request_t *request,
+                                    srvd_service_response_t *response) {
+  char *name = NULL;
+  uint32_t index;
+
+  response->status = SRVD_SERVICE_RESPONSE_NOTFOUND;
+
+  if(!srvd_service_nss_aliases_request_name_get(request, &name))
+    return;
+  if(srvd_bench_index(name, "alias", &index))
+    srvd_bench_aliases_respond(response, index);
+  srvd_service_nss_aliases_request_name_free(request, &name);
+}
+
+static void srvd_bench_aliases_entities(const srvd_service_request_t *request,
+                                        srvd_service_response_t *response) {
+  int32_t offset;
+
+  response->status = SRVD_SERVICE_RESPONSE_NOTFOUND;
+
+  if(srvd_service_nss_aliases_request_entities_get(request, &offset) &&
+     offset >= 0 && (uint32_t)offset < srvd_bench_size)
+    srvd_bench_aliases_respond(response, (uint32_t)offset);
+}
+
+static srvd_boolean_t srvd_bench_server_initialize(srvd_server_unsock_t *server, char *path,
+                                                   srvd_boolean_t seqpacket) {
+  srvd_server_unsock_conf_t conf;
+
+  conf.path = path;
+  conf.queue_size = 128;
+  conf.seqpacket = seqpacket;
+
+  if(!srvd_server_unsock_initialize(server, &conf))
+    return SRVD_FALSE;
+
+  srvd_server_service_add(&server->monitor, SRVD_SERVICE_NSS_PASSWD_REQUEST_NAME,
+                          srvd_bench_passwd_name);
+  srvd_server_service_add(&server->monitor, SRVD_SERVICE_NSS_PASSWD_REQUEST_UID,
+                          srvd_bench_passwd_uid);
+  srvd_server_service_add(&server->monitor, SRVD_SERVICE_NSS_PASSWD_REQUEST_ENTITIES,
+                          srvd_bench_passwd_entities);
+  srvd_server_service_add(&server->monitor, SRVD_SERVICE_NSS_ALIASES_REQUEST_NAME,
+                          srvd_bench_aliases_name);
+  srvd_server_service_add(&server->monitor, SRVD_SERVICE_NSS_ALIASES_REQUEST_ENTITIES,
+                          srvd_bench_aliases_entities);
+
+  return SRVD_TRUE;
+}
+
+static void *srvd_bench_server_execute(void *argument) {
+  srvd_server_unsock_execute((srvd_server_unsock_t *)argument);
+  return NULL;
+}
+
+/* Clients. */
+
+static uint32_t srvd_bench_random(uint32_t *seed) {
+  /* xorshift32; good enough to spread keys around. */
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return *seed;
+}
+
+static srvd_boolean_t srvd_bench_raw_query(srvd_client_t *client,
+                                           const srvd_service_request_t *request,
+                                           srvd_service_response_code_t *code) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_service_response_t response;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_protocol_packet_field_entry_t *entry = NULL;
+  uint16_t value;
+
+  srvd_service_response_initialize(&response);
+
+  if(!client->connected && !srvd_client_connect(client))
+    goto _srvd_bench_raw_query_error;
+  if(!srvd_client_write(client, &request->packet) ||
+     !srvd_client_read(client, &response.packet)) {
+    srvd_client_disconnect(client);
+    goto _srvd_bench_raw_query_error;
+  }
+
+  if(!srvd_protocol_packet_field_get_first(&response.packet, &field) ||
+     field->type != SRVD_PROTOCOL_STATUS ||
+     !srvd_protocol_packet_field_entry_get_first(field, &entry) ||
+     !srvd_protocol_packet_field_entry_get_uint16(entry, &value))
+    goto _srvd_bench_raw_query_error;
+
+  *code = (srvd_service_response_code_t)value;
+  status = SRVD_TRUE;
+
+ _srvd_bench_raw_query_error:
+
+  srvd_service_response_finalize(&response);
+
+  return status;
+}
+
+static srvd_boolean_t srvd_bench_raw(srvd_bench_worker_t *worker, srvd_client_t *client,
+                                     uint32_t index) {
+  srvd_boolean_t status = SRVD_TRUE;
+  srvd_service_request_t request;
+  srvd_service_response_code_t code = SRVD_SERVICE_RESPONSE_UNKNOWN;
+  char name[32];
+  uint32_t offset;
+
+  srvd_service_request_initialize(&request);
+
+  switch(worker->test) {
+  case SRVD_BENCH_GETPWNAM:
+    snprintf(name, sizeof(name), "user%lu", (unsigned long)index);
+    srvd_protocol_packet_field_append(&request.packet, SRVD_SERVICE_NSS_PASSWD_REQUEST_NAME,
+                                      (uint16_t)(strlen(name) + 1), name);
+    status = srvd_bench_raw_query(client, &request, &code) &&
+      code == SRVD_SERVICE_RESPONSE_SUCCESS;
+    break;
+
+  case SRVD_BENCH_GETPWUID:
+    srvd_protocol_packet_field_append_uint32(&request.packet, SRVD_SERVICE_NSS_PASSWD_REQUEST_UID,
+                                             SRVD_BENCH_UID_BASE + index);
+    status = srvd_bench_raw_query(client, &request, &code) &&
+      code == SRVD_SERVICE_RESPONSE_SUCCESS;
+    break;
+
+  case SRVD_BENCH_GETALIASBYNAME:
+    snprintf(name, sizeof(name), "alias%lu", (unsigned long)index);
+    srvd_protocol_packet_field_append(&request.packet, SRVD_SERVICE_NSS_ALIASES_REQUEST_NAME,
+                                      (uint16_t)(strlen(name) + 1), name);
+    status = srvd_bench_raw_query(client, &request, &code) &&
+      code == SRVD_SERVICE_RESPONSE_SUCCESS;
+    break;
+
+  case SRVD_BENCH_GETPWENT:
+    for(offset = 0; status; offset++) {
+      srvd_service_request_finalize(&request);
+      srvd_service_request_initialize(&request);
+      srvd_protocol_packet_field_append_uint32(&request.packet,
+                                               SRVD_SERVICE_NSS_PASSWD_REQUEST_ENTITIES, offset);
+
+      if(!srvd_bench_raw_query(client, &request, &code))
+        status = SRVD_FALSE;
+      else if(code == SRVD_SERVICE_RESPONSE_NOTFOUND)
+        break;
+      else if(code != SRVD_SERVICE_RESPONSE_SUCCESS)
+        status = SRVD_FALSE;
+    }
+    status = status && offset == srvd_bench_size;
+    break;
+  }
+
+  srvd_service_request_finalize(&request);
+
+  return status;
+}
+
+static srvd_boolean_t srvd_bench_nss(srvd_bench_worker_t *worker, uint32_t index) {
+  char buffer[SRVD_BENCH_BUFFER_SIZE];
+  char name[32];
+  struct passwd pwd;
+  enum nss_status status;
+  uint32_t count;
+  int error = 0;
+
+  switch(worker->test) {
+  case SRVD_BENCH_GETPWNAM:
+    snprintf(name, sizeof(name), "user%lu", (unsigned long)index);
+    return _nss_srvd_getpwnam_r(name, &pwd, buffer, sizeof(buffer), &error) ==
+      NSS_STATUS_SUCCESS && pwd.pw_uid == SRVD_BENCH_UID_BASE + index;
+
+  case SRVD_BENCH_GETPWUID:
+    return _nss_srvd_getpwuid_r(SRVD_BENCH_UID_BASE + index, &pwd, buffer, sizeof(buffer),
+                                &error) == NSS_STATUS_SUCCESS;
+
+  case SRVD_BENCH_GETALIASBYNAME:
+#ifdef HAVE_ALIASES
+    {
+      struct aliasent alias;
+
+      snprintf(name, sizeof(name), "alias%lu", (unsigned long)index);
+      return _nss_srvd_getaliasbyname_r(name, &alias, buffer, sizeof(buffer), &error) ==
+        NSS_STATUS_SUCCESS && alias.alias_members_len == SRVD_BENCH_MEMBER_COUNT;
+    }
+#else
+    return SRVD_FALSE;
+#endif
+
+  case SRVD_BENCH_GETPWENT:
+    _nss_srvd_setpwent(0);
+    for(count = 0;
+        (status = _nss_srvd_getpwent_r(&pwd, buffer, sizeof(buffer), &error)) ==
+          NSS_STATUS_SUCCESS;
+        count++);
+    _nss_srvd_endpwent();
+    return status == NSS_STATUS_NOTFOUND && count == srvd_bench_size;
+  }
+
+  return SRVD_FALSE;
+}
+
+static void *srvd_bench_worker_execute(void *argument) {
+  srvd_bench_worker_t *worker = (srvd_bench_worker_t *)argument;
+  srvd_client_t *client = NULL;
+  uint64_t start, end;
+  srvd_boolean_t succeeded;
+
+  if(!worker->nss && !srvd_client_get_by_conf(&client, worker->conf)) {
+    worker->failures++;
+    return NULL;
+  }
+
+  do {
+    uint32_t index = srvd_bench_random(&worker->seed) % srvd_bench_size;
+
+    start = srvd_stats_now();
+    if(worker->nss)
+      succeeded = srvd_bench_nss(worker, index);
+    else
+      succeeded = srvd_bench_raw(worker, client, index);
+    end = srvd_stats_now();
+
+    if(succeeded) {
+      worker->count++;
+      srvd_stats_histogram_record(&worker->latency, end - start);
+    }
+    else
+      worker->failures++;
+  } while(end < worker->deadline);
+
+  if(client) {
+    srvd_client_finalize(client);
+    srvd_client_free(client);
+  }
+
+  return NULL;
+}
+
+static srvd_boolean_t srvd_bench_run(srvd_bench_test_t test, srvd_boolean_t nss,
+                                     const srvd_conf_t *conf, uint32_t thread_count,
+                                     uint64_t duration) {
+  srvd_bench_worker_t *workers;
+  srvd_stats_histogram_t latency;
+  uint64_t start, elapsed, count = 0, failures = 0;
+  uint32_t i, j, started;
+
+  workers = calloc(thread_count, sizeof(srvd_bench_worker_t));
+  if(workers == NULL) {
+    fprintf(stderr, "srvd-bench: Out of memory\n");
+    return SRVD_FALSE;
+  }
+
+  start = srvd_stats_now();
+  for(started = 0; started < thread_count; started++) {
+    srvd_bench_worker_t *worker = &workers[started];
+
+    worker->test = test;
+    worker->nss = nss;
+    worker->conf = conf;
+    worker->deadline = start + duration;
+    worker->seed = 2463534242UL + started * 7919;
+
+    if(pthread_create(&worker->thread, NULL, srvd_bench_worker_execute, worker) != 0) {
+      fprintf(stderr, "srvd-bench: Unable to start client thread\n");
+      break;
+    }
+  }
+
+  memset(&latency, 0, sizeof(latency));
+  for(i = 0; i < started; i++) {
+    pthread_join(workers[i].thread, NULL);
+
+    count += workers[i].count;
+    failures += workers[i].failures;
+    for(j = 0; j < SRVD_STATS_HISTOGRAM_BUCKET_COUNT; j++)
+      latency.buckets[j] += workers[i].latency.buckets[j];
+  }
+  elapsed = srvd_stats_now() - start;
+
+  printf("%-16s %-4s %12.1f %8lu %8lu %8lu %8lu\n",
+         srvd_bench_test_names[test], nss ? "nss" : "raw",
+         elapsed > 0 ? (double)count * 1000000.0 / (double)elapsed : 0,
+         (unsigned long)srvd_stats_histogram_percentile(&latency, 0.5),
+         (unsigned long)srvd_stats_histogram_percentile(&latency, 0.99),
+         (unsigned long)srvd_stats_histogram_percentile(&latency, 0.999),
+         (unsigned long)failures);
+  fflush(stdout);
+
+  free(workers);
+
+  return started == thread_count;
+}
+
+static srvd_boolean_t srvd_bench_wait(const srvd_conf_t *conf) {
+  srvd_client_t *client = NULL;
+  srvd_boolean_t connected = SRVD_FALSE;
+  int attempts;
+
+  if(!srvd_client_get_by_conf(&client, conf))
+    return SRVD_FALSE;
+
+  /* Give the server a moment to start listening. */
+  for(attempts = 0; attempts < 500 && !connected; attempts++) {
+    struct timespec delay = { 0, 10000000 };
+
+    connected = srvd_client_connect(client);
+    if(!connected)
+      nanosleep(&delay, NULL);
+  }
+
+  srvd_client_finalize(client);
+  srvd_client_free(client);
+
+  return connected;
+}
+
+static void srvd_bench_usage(void) {
+  fprintf(stderr, "usage: srvd-bench [-f] [-p] [-s] [-a adapter] [-u users] [-t threads] "
+          "[-d seconds]\n");
+}
+
+int main(int argc, char *argv[]) {
+  char directory[] = "/tmp/srvd-bench.XXXXXX";
+  char socket_path[sizeof(directory) + sizeof("/srvd.sock")];
+  char conf_path[sizeof(directory) + sizeof("/srvd.conf")];
+  const char *adapter = "unsock";
+  srvd_boolean_t forked = SRVD_FALSE, persistent = SRVD_FALSE, seqpacket = SRVD_FALSE;
+  long users = 1000, threads = 4, seconds = 2;
+  srvd_server_unsock_t server;
+  srvd_conf_file_t fconf;
+  pthread_t server_thread;
+  pid_t child = -1;
+  FILE *file;
+  int option, test, status = 1;
+
+  while((option = getopt(argc, argv, "fpsa:u:t:d:")) != -1) {
+    switch(option) {
+    case 'f': forked = SRVD_TRUE; break;
+    case 'p': persistent = SRVD_TRUE; break;
+    case 's': seqpacket = SRVD_TRUE; break;
+    case 'a': adapter = optarg; break;
+    case 'u': users = strtol(optarg, NULL, 10); break;
+    case 't': threads = strtol(optarg, NULL, 10); break;
+    case 'd': seconds = strtol(optarg, NULL, 10); break;
+    default:
+      srvd_bench_usage();
+      return 2;
+    }
+  }
+  if(optind != argc) {
+    srvd_bench_usage();
+    return 2;
+  }
+  if(users <= 0 || users > 1000000 || threads <= 0 || threads > 1024 || seconds <= 0 ||
+     (strcmp(adapter, "unsock") != 0 && strcmp(adapter, "shm") != 0 &&
+      strcmp(adapter, "inproc") != 0) ||
+     (seqpacket && strcmp(adapter, "unsock") != 0) ||
+     (forked && strcmp(adapter, "inproc") == 0)) {
+    fprintf(stderr, "srvd-bench: Invalid option value\n");
+    return 2;
+  }
+  srvd_bench_size = (uint32_t)users;
+
+  if(mkdtemp(directory) == NULL) {
+    fprintf(stderr, "srvd-bench: Unable to create temporary directory\n");
+    return 1;
+  }
+  snprintf(socket_path, sizeof(socket_path), "%s/srvd.sock", directory);
+  snprintf(conf_path, sizeof(conf_path), "%s/srvd.conf", directory);
+
+  file = fopen(conf_path, "w");
+  if(file == NULL) {
+    fprintf(stderr, "srvd-bench: Unable to write \"%s\"\n", conf_path);
+    goto _main_error;
+  }
+  fprintf(file,
+          "client:adapter = %s\n"
+          "client:path = \"%s\"\n"
+          "client:socket = %s\n"
+          "client:server = bench\n"
+          "client:breaker:threshold = 0\n",
+          adapter, socket_path, seqpacket ? "seqpacket" : "stream");
+  if(persistent)
+    fprintf(file, "client:persistent = yes\n");
+  fclose(file);
+
+  srvd_conf_file_initialize(&fconf, conf_path, sizeof(conf_path));
+  if(!srvd_conf_file_parse(&fconf) || !srvd_conf_file_default_set(conf_path)) {
+    fprintf(stderr, "srvd-bench: Unable to read \"%s\"\n", conf_path);
+    goto _main_error;
+  }
+
+  /* Fork before any threads are started. */
+  if(forked) {
+    child = fork();
+    if(child == -1) {
+      fprintf(stderr, "srvd-bench: Unable to start server process\n");
+      goto _main_error;
+    }
+    else if(child == 0) {
+      if(!srvd_bench_server_initialize(&server, socket_path, seqpacket))
+        _exit(1);
+      srvd_server_unsock_execute(&server);
+      _exit(0);
+    }
+  }
+  else if(strcmp(adapter, "inproc") == 0) {
+    if(!srvd_bench_server_initialize(&server, socket_path, seqpacket) ||
+       !srvd_client_inproc_server_register("bench", &server.monitor)) {
+      fprintf(stderr, "srvd-bench: Unable to start server\n");
+      goto _main_error;
+    }
+  }
+  else if(!srvd_bench_server_initialize(&server, socket_path, seqpacket) ||
+          pthread_create(&server_thread, NULL, srvd_bench_server_execute, &server) != 0) {
+    fprintf(stderr, "srvd-bench: Unable to start server\n");
+    goto _main_error;
+  }
+
+  if(!srvd_bench_wait(&fconf.conf)) {
+    fprintf(stderr, "srvd-bench: The server didn't start\n");
+    goto _main_error;
+  }
+
+  printf("%ld users, %ld threads, %ld seconds per test, %s adapter, %s server\n\n",
+         users, threads, seconds, adapter, forked ? "forked" : "in-process");
+  printf("%-16s %-4s %12s %8s %8s %8s %8s\n",
+         "TEST", "API", "OPS/S", "P50", "P99", "P999", "FAILED");
+
+  for(test = SRVD_BENCH_GETPWNAM; test <= SRVD_BENCH_GETPWENT; test++) {
+    if(!srvd_bench_run((srvd_bench_test_t)test, SRVD_FALSE, &fconf.conf, (uint32_t)threads,
+                       (uint64_t)seconds * 1000000) ||
+       !srvd_bench_run((srvd_bench_test_t)test, SRVD_TRUE, &fconf.conf, (uint32_t)threads,
+                       (uint64_t)seconds * 1000000))
+      goto _main_error;
+  }
+
+  status = 0;
+
+ _main_error:
+
+  if(child > 0) {
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+  }
+
+  unlink(socket_path);
+  unlink(conf_path);
+  rmdir(directory);
+
+  return status;
+}
@@ -0,0 +1,244 @@
+/* srvd-replay.c: Plays a capture log back against a server.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+/* For nanosleep(). */
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/capture.h>
+#include <srvd/client.h>
+#include <srvd/conf.h>
+#include <srvd/protocol/extension.h>
+#include <srvd/stats.h>
+#include <srvd/thread.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Usage: srvd-replay [-c concurrency] [-s speed] [-f conf] capture
+ *
+ * Sends every request in a capture log (see srvd_server_capture()) to the
+ * server named by the default configuration file (or the given one) from the
+ * given number of threads (4 by default), each with a connection of its own.
+ *
+ * Requests are sent when they were received in the capture, relative to when
+ * the replay started, or that many times faster with -s (e.g., 2 for twice as
+ * fast). With -s 0, they're sent as fast as the server will take them. Either
+ * way, a request is only sent once one of the threads is free, so if there
+ * aren't enough of them, the replay falls behind.
+ *
+ * At the end, reports how many requests were answered and how many failed,
+ * the request rate, the 50th, 99th and 99.9th percentile latencies, and the
+ * 99th percentile of how far behind schedule requests were sent (all in
+ * microseconds). */
+
+typedef struct srvd_replay_worker srvd_replay_worker_t;
+
+struct srvd_replay_worker {
+  pthread_t thread;
+  uint64_t count, failures;
+  srvd_stats_histogram_t latency, lateness;
+};
+
+static srvd_capture_reader_t srvd_replay_reader;
+static SRVD_THREAD_MUTEX_DECLARE(srvd_replay_reader_lock);
+
+static srvd_conf_file_t *srvd_replay_conf = NULL;
+static double srvd_replay_speed = 1.0;
+static uint64_t srvd_replay_started;
+
+static void srvd_replay_wait(uint64_t until) {
+  uint64_t now;
+
+  while((now = srvd_stats_now()) < until) {
+    struct timespec delay;
+
+    delay.tv_sec = (time_t)((until - now) / 1000000);
+    delay.tv_nsec = (long)((until - now) % 1000000) * 1000;
+    nanosleep(&delay, NULL);
+  }
+}
+
+static srvd_boolean_t srvd_replay_send(srvd_client_t *client, char *request, uint32_t length) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_protocol_packet_t packet, response;
+  srvd_protocol_packet_field_t *field = NULL;
+
+  srvd_protocol_packet_initialize(&packet);
+  srvd_protocol_packet_initialize(&response);
+
+  if(!srvd_capture_request_unpack(request, length, &packet))
+    goto _srvd_replay_send_error;
+
+  /* Any deadline the request had passed long ago; the server shouldn't throw it
+   * away for that. */
+  if(srvd_protocol_packet_field_get_by_type(&packet, SRVD_PROTOCOL_EXTENSION, &field) &&
+     field->entry_head && field->entry_head->size == sizeof(uint64_t))
+    memset(field->entry_head->data, 0, sizeof(uint64_t));
+
+  if(!client->connected && !srvd_client_connect(client))
+    goto _srvd_replay_send_error;
+
+  if(!srvd_client_write(client, &packet) || !srvd_client_read(client, &response)) {
+    srvd_client_disconnect(client);
+    goto _srvd_replay_send_error;
+  }
+
+  status = SRVD_TRUE;
+
+ _srvd_replay_send_error:
+
+  srvd_protocol_packet_finalize(&packet);
+  srvd_protocol_packet_finalize(&response);
+
+  return status;
+}
+
+static void *srvd_replay_worker_execute(void *argument) {
+  srvd_replay_worker_t *worker = (srvd_replay_worker_t *)argument;
+  srvd_client_t *client = NULL;
+  srvd_boolean_t more;
+  uint64_t received, scheduled, start;
+  uint32_t length;
+  char *request;
+
+  if(!srvd_client_get_by_conf(&client, &srvd_replay_conf->conf)) {
+    fprintf(stderr, "srvd-replay: Unable to create client\n");
+    return NULL;
+  }
+
+  for(;;) {
+    SRVD_THREAD_MUTEX_LOCK(srvd_replay_reader_lock);
+    more = srvd_capture_reader_next(&srvd_replay_reader, &received, &request, &length);
+    SRVD_THREAD_MUTEX_UNLOCK(srvd_replay_reader_lock);
+    if(!more)
+      break;
+
+    scheduled = srvd_replay_started;
+    if(srvd_replay_speed > 0) {
+      scheduled += (uint64_t)((double)received / srvd_replay_speed);
+      srvd_replay_wait(scheduled);
+    }
+
+    start = srvd_stats_now();
+    if(srvd_replay_send(client, request, length)) {
+      worker->count++;
+      srvd_stats_histogram_record(&worker->latency, srvd_stats_now() - start);
+      if(srvd_replay_speed > 0)
+        srvd_stats_histogram_record(&worker->lateness, start - scheduled);
+    }
+    else
+      worker->failures++;
+  }
+
+  srvd_client_finalize(client);
+  srvd_client_free(client);
+
+  return NULL;
+}
+
+static void srvd_replay_histogram_add(srvd_stats_histogram_t *to,
+                                      const srvd_stats_histogram_t *from) {
+  uint32_t i;
+
+  for(i = 0; i < SRVD_STATS_HISTOGRAM_BUCKET_COUNT; i++)
+    to->buckets[i] += from->buckets[i];
+}
+
+static void srvd_replay_usage(void) {
+  fprintf(stderr, "usage: srvd-replay [-c concurrency] [-s speed] [-f conf] capture\n");
+}
+
+int main(int argc, char *argv[]) {
+  srvd_replay_worker_t *workers = NULL;
+  srvd_stats_histogram_t latency, lateness;
+  uint64_t count = 0, failures = 0, elapsed;
+  long concurrency = 4;
+  uint32_t i, started;
+  int option, status = 1;
+
+  while((option = getopt(argc, argv, "c:s:f:")) != -1) {
+    switch(option) {
+    case 'c': concurrency = strtol(optarg, NULL, 10); break;
+    case 's': srvd_replay_speed = strtod(optarg, NULL); break;
+    case 'f':
+      if(!srvd_conf_file_default_set(optarg))
+        return 1;
+      break;
+    default:
+      srvd_replay_usage();
+      return 2;
+    }
+  }
+  if(optind != argc - 1) {
+    srvd_replay_usage();
+    return 2;
+  }
+  if(concurrency <= 0 || concurrency > 1024 || srvd_replay_speed < 0) {
+    fprintf(stderr, "srvd-replay: Invalid concurrency or speed\n");
+    return 2;
+  }
+
+  if(!srvd_conf_file_default_get(&srvd_replay_conf)) {
+    fprintf(stderr, "srvd-replay: Unable to read configuration file\n");
+    return 1;
+  }
+
+  if(!srvd_capture_reader_initialize(&srvd_replay_reader, argv[optind])) {
+    fprintf(stderr, "srvd-replay: Unable to read capture \"%s\"\n", argv[optind]);
+    return 1;
+  }
+
+  workers = calloc((size_t)concurrency, sizeof(srvd_replay_worker_t));
+  if(workers == NULL) {
+    fprintf(stderr, "srvd-replay: Out of memory\n");
+    goto _main_error;
+  }
+
+  srvd_replay_started = srvd_stats_now();
+  for(started = 0; started < (uint32_t)concurrency; started++) {
+    if(pthread_create(&workers[started].thread, NULL, srvd_replay_worker_execute,
+                      &workers[started]) != 0) {
+      fprintf(stderr, "srvd-replay: Unable to start thread\n");
+      break;
+    }
+  }
+
+  memset(&latency, 0, sizeof(latency));
+  memset(&lateness, 0, sizeof(lateness));
+  for(i = 0; i < started; i++) {
+    pthread_join(workers[i].thread, NULL);
+
+    count += workers[i].count;
+    failures += workers[i].failures;
+    srvd_replay_histogram_add(&latency, &workers[i].latency);
+    srvd_replay_histogram_add(&lateness, &workers[i].lateness);
+  }
+  elapsed = srvd_stats_now() - srvd_replay_started;
+
+  printf("%10s %10s %10s %8s %8s %8s %8s\n",
+         "REQUESTS", "FAILED", "REQ/S", "P50", "P99", "P999", "LATE99");
+  printf("%10lu %10lu %10.1f %8lu %8lu %8lu %8lu\n",
+         (unsigned long)count, (unsigned long)failures,
+         elapsed > 0 ? (double)count * 1000000.0 / (double)elapsed : 0,
+         (unsigned long)srvd_stats_histogram_percentile(&latency, 0.5),
+         (unsigned long)srvd_stats_histogram_percentile(&latency, 0.99),
+         (unsigned long)srvd_stats_histogram_percentile(&latency, 0.999),
+         (unsigned long)srvd_stats_histogram_percentile(&lateness, 0.99));
+
+  status = failures == 0 && started == (uint32_t)concurrency ? 0 : 1;
+
+ _main_error:
+
+  free(workers);
+  srvd_capture_reader_finalize(&srvd_replay_reader);
+
+  return status;
+}
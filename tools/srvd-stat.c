@@ -0,0 +1,190 @@
+/* srvd-stat.c: Reports server statistics.
+ *
+ * This file is part of srvd, a service daemon for POSIX-compliant systems.
+ * Copyright (c) 2008-2009 Transtruct. All rights reserved.
+ *
+ * This file is released under the terms of the LICENSE document included with
+ * this distribution.
+ */
+
+/* For sleep(). */
+#define _POSIX_C_SOURCE 200112L
+
+#include <srvd/srvd.h>
+#include <srvd/service.h>
+#include <srvd/stats.h>
+
+#include <stdio.h>
+
+/* Usage: srvd-stat [-m path] [interval [count]]
+ *
+ * Asks the server named by the default configuration file for its statistics
+ * (or, with -m, reads them from the file the server published them to) and
+ * prints, for each protocol type, the request and error rates, the
+ * fraction of requests that succeeded or found nothing, the data rates, and
+ * the 99th percentile queue wait and serialization times along with the 50th,
+ * 99th and 99.9th percentile handler times (all in microseconds).
+ *
+ * The first report covers everything since the server started. Given an
+ * interval (in seconds), it keeps reporting on each interval since the last
+ * one, count times or forever. */
+
+static srvd_boolean_t srvd_stat_get(srvd_stats_t *mapped, srvd_stats_snapshot_t *snapshot) {
+  srvd_boolean_t status = SRVD_FALSE;
+  srvd_protocol_packet_field_t *field = NULL;
+  srvd_service_request_t request;
+  srvd_service_response_t response;
+
+  if(mapped)
+    return srvd_stats_snapshot(mapped, snapshot);
+
+  srvd_service_request_initialize(&request);
+  srvd_service_response_initialize(&response);
+
+  if(!srvd_protocol_packet_field_get_or_add(&request.packet, SRVD_PROTOCOL_STATS, &field)) {
+    fprintf(stderr, "srvd-stat: Unable to build request\n");
+    goto _srvd_stat_get_error;
+  }
+
+  if(!srvd_service_request_query(&request, &response) ||
+     response.status != SRVD_SERVICE_RESPONSE_SUCCESS) {
+    fprintf(stderr, "srvd-stat: Unable to get statistics from the server\n");
+    goto _srvd_stat_get_error;
+  }
+
+  if(!srvd_stats_snapshot_unpack(&response.packet, snapshot)) {
+    fprintf(stderr, "srvd-stat: The server sent invalid statistics\n");
+    goto _srvd_stat_get_error;
+  }
+
+  status = SRVD_TRUE;
+
+ _srvd_stat_get_error:
+
+  srvd_service_request_finalize(&request);
+  srvd_service_response_finalize(&response);
+
+  return status;
+}
+
+static double srvd_stat_rate(uint64_t count, double seconds) {
+  return seconds > 0 ? (double)count / seconds : 0;
+}
+
+static double srvd_stat_percent(uint64_t count, uint64_t total) {
+  return total > 0 ? 100.0 * (double)count / (double)total : 0;
+}
+
+static void srvd_stat_print(const srvd_stats_snapshot_t *snapshot) {
+  const srvd_stats_counters_t *counters;
+  double seconds = (double)snapshot->uptime / 1000000.0;
+  uint32_t i;
+
+  printf("%6s %10s %8s %6s %6s %10s %10s %8s %8s %8s %8s %8s\n",
+         "TYPE", "REQ/S", "ERR/S", "OK%", "NF%", "IN/S", "OUT/S",
+         "QUEUE99", "P50", "P99", "P999", "SER99");
+
+  for(i = 0; i < snapshot->type_count; i++) {
+    counters = &snapshot->counters[i];
+    if(counters->requests == 0)
+      continue;
+
+    printf("%6u %10.1f %8.1f %6.1f %6.1f %10.0f %10.0f %8lu %8lu %8lu %8lu %8lu\n",
+           (unsigned)snapshot->types[i],
+           srvd_stat_rate(counters->requests, seconds),
+           srvd_stat_rate(counters->errors, seconds),
+           srvd_stat_percent(counters->statuses[SRVD_SERVICE_RESPONSE_SUCCESS],
+                             counters->requests),
+           srvd_stat_percent(counters->statuses[SRVD_SERVICE_RESPONSE_NOTFOUND],
+                             counters->requests),
+           srvd_stat_rate(counters->bytes_in, seconds),
+           srvd_stat_rate(counters->bytes_out, seconds),
+           (unsigned long)srvd_stats_histogram_percentile(&counters->queue_wait, 0.99),
+           (unsigned long)srvd_stats_histogram_percentile(&counters->handler, 0.5),
+           (unsigned long)srvd_stats_histogram_percentile(&counters->handler, 0.99),
+           (unsigned long)srvd_stats_histogram_percentile(&counters->handler, 0.999),
+           (unsigned long)srvd_stats_histogram_percentile(&counters->serialization, 0.99));
+  }
+
+  printf("\n");
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+  srvd_stats_snapshot_t *previous, *current, *delta, *swap;
+  srvd_stats_t segment, *mapped = NULL;
+  const char *path = NULL;
+  long interval = 0, count = -1;
+  int option, status = 1;
+
+  while((option = getopt(argc, argv, "m:")) != -1) {
+    if(option == 'm')
+      path = optarg;
+    else {
+      fprintf(stderr, "usage: srvd-stat [-m path] [interval [count]]\n");
+      return 2;
+    }
+  }
+  argc -= optind;
+  argv += optind;
+
+  if(argc > 2) {
+    fprintf(stderr, "usage: srvd-stat [-m path] [interval [count]]\n");
+    return 2;
+  }
+  if(argc > 0)
+    interval = strtol(argv[0], NULL, 10);
+  if(argc > 1)
+    count = strtol(argv[1], NULL, 10);
+  if(interval < 0 || (argc > 0 && interval == 0) || (argc > 1 && count <= 0)) {
+    fprintf(stderr, "srvd-stat: Invalid interval or count\n");
+    return 2;
+  }
+
+  if(path) {
+    if(!srvd_stats_map(&segment, path)) {
+      fprintf(stderr, "srvd-stat: Unable to read statistics from \"%s\"\n", path);
+      return 1;
+    }
+    mapped = &segment;
+  }
+
+  previous = malloc(sizeof(srvd_stats_snapshot_t));
+  current = malloc(sizeof(srvd_stats_snapshot_t));
+  delta = malloc(sizeof(srvd_stats_snapshot_t));
+  if(previous == NULL || current == NULL || delta == NULL) {
+    fprintf(stderr, "srvd-stat: Out of memory\n");
+    goto _main_error;
+  }
+
+  if(!srvd_stat_get(mapped, previous))
+    goto _main_error;
+  srvd_stat_print(previous);
+
+  while(interval > 0 && (count < 0 || --count > 0)) {
+    sleep((unsigned int)interval);
+
+    if(!srvd_stat_get(mapped, current))
+      goto _main_error;
+
+    memcpy(delta, current, sizeof(srvd_stats_snapshot_t));
+    srvd_stats_snapshot_subtract(delta, previous);
+    srvd_stat_print(delta);
+
+    swap = previous;
+    previous = current;
+    current = swap;
+  }
+
+  status = 0;
+
+ _main_error:
+
+  free(previous);
+  free(current);
+  free(delta);
+  if(mapped)
+    srvd_stats_finalize(mapped);
+
+  return status;
+}